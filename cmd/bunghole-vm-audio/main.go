@@ -19,6 +19,7 @@ import (
 var (
 	flagTransport       = flag.String("transport", "auto", "Transport: auto, vsock, or udp")
 	flagUDP             = flag.String("udp", "", "host:port to send raw Opus packet datagrams (UDP mode)")
+	flagUDPSeq          = flag.Bool("udp-seq", false, "Prefix UDP datagrams with a sequence header so the host can reorder them and detect loss")
 	flagVsockPort       = flag.Uint("vsock-port", 5000, "Vsock port to connect to (vsock mode)")
 	flagStats           = flag.Bool("stats", true, "Log packet stats")
 	flagStatsInterval   = flag.Duration("stats-interval", 5*time.Second, "Stats logging interval")
@@ -128,10 +129,21 @@ type packetSender interface {
 
 type udpSender struct {
 	conn *net.UDPConn
+
+	// With --udp-seq, each datagram is built in buf behind its header.
+	seq  bool
+	next uint32
+	buf  []byte
 }
 
 func (s *udpSender) send(data []byte) error {
-	_, err := s.conn.Write(data)
+	if !s.seq {
+		_, err := s.conn.Write(data)
+		return err
+	}
+	s.buf = append(audio.AppendUDPSeqHeader(s.buf[:0], s.next), data...)
+	s.next++
+	_, err := s.conn.Write(s.buf)
 	return err
 }
 
@@ -181,8 +193,8 @@ func connectUDP() packetSender {
 	if err != nil {
 		log.Fatalf("dial --udp %q: %v", *flagUDP, err)
 	}
-	log.Printf("sending Opus datagrams to %s", addr.String())
-	return &udpSender{conn: conn}
+	log.Printf("sending Opus datagrams to %s (sequence header: %v)", addr.String(), *flagUDPSeq)
+	return &udpSender{conn: conn, seq: *flagUDPSeq}
 }
 
 func connectAuto(vsockPort uint32) packetSender {
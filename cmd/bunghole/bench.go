@@ -0,0 +1,104 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"os"
+	"strings"
+
+	"bunghole/internal/bench"
+	"bunghole/internal/platform"
+)
+
+// runBench implements "bunghole bench [encode|capture|all]". The JSON
+// report goes to stdout (or --bench-out); everything else, including the
+// encoders' own start-up lines, goes to stderr.
+func runBench(cfg *platform.Config, args []string) {
+	out := os.Stdout
+	os.Stdout = os.Stderr
+
+	mode := "encode"
+	if len(args) > 0 {
+		mode = args[0]
+	}
+	bc := bench.Config{
+		Encode:  mode == "encode" || mode == "all",
+		Capture: mode == "capture" || mode == "all",
+
+		Input:  *flagBenchInput,
+		Pacing: *flagPacing,
+
+		Frames:  *flagBenchFrames,
+		FPS:     *flagFPS,
+		Bitrate: *flagBitrate,
+		GPU:     *flagGPU,
+		Codec:   *flagCodec,
+		GOP:     *flagGOP,
+
+		NewCapturer: newCapturer,
+		NewEncoder:  newEncoder,
+	}
+	if !bc.Encode && !bc.Capture {
+		log.Fatalf("bench: unknown mode %q (want encode, capture or all)", mode)
+	}
+	if *flagBenchFrames <= 0 {
+		log.Fatal("--bench-frames must be > 0")
+	}
+	if *flagFPS <= 0 {
+		log.Fatal("--fps must be > 0")
+	}
+	if *flagCodec != "h264" && *flagCodec != "h265" {
+		log.Fatalf("--codec must be h264 or h265, got %q", *flagCodec)
+	}
+	if *flagPacing != "tick" && *flagPacing != "source" {
+		log.Fatalf("--pacing must be tick or source, got %q", *flagPacing)
+	}
+	if _, err := fmt.Sscanf(cfg.Resolution, "%dx%d", &bc.Width, &bc.Height); err != nil || bc.Width <= 0 || bc.Height <= 0 {
+		log.Fatalf("--resolution must be WxH, got %q", cfg.Resolution)
+	}
+	for _, m := range strings.Split(*flagBenchMotion, ",") {
+		if m = strings.TrimSpace(m); m != "" {
+			bc.Motions = append(bc.Motions, m)
+		}
+	}
+
+	cleanup := func() {}
+	if bc.Capture {
+		if cfg.VM {
+			log.Fatal("bench: capture does not support --vm")
+		}
+		platform.SaveTermState()
+		var err error
+		cleanup, err = platform.Init(cfg)
+		if err != nil {
+			log.Fatal(err)
+		}
+		platform.RestoreTermState()
+		if cfg.Display == "" {
+			cleanup()
+			log.Fatal("bench: no display to capture — use --display, set DISPLAY env, or use --start-x")
+		}
+		bc.Display = cfg.Display
+	}
+
+	rep := bench.Run(bc)
+	cleanup()
+	platform.RestoreTermState()
+
+	if *flagBenchOut != "" {
+		f, err := os.Create(*flagBenchOut)
+		if err != nil {
+			log.Fatalf("bench: %v", err)
+		}
+		out = f
+	}
+	if err := rep.WriteJSON(out); err != nil {
+		log.Fatalf("bench: write report: %v", err)
+	}
+	if err := out.Close(); err != nil {
+		log.Fatalf("bench: write report: %v", err)
+	}
+	if rep.Failed() {
+		os.Exit(1)
+	}
+}
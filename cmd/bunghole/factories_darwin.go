@@ -5,6 +5,7 @@ package main
 import (
 	"flag"
 	"fmt"
+	"log"
 	"unsafe"
 
 	"bunghole/internal/capture"
@@ -21,8 +22,13 @@ var (
 	flagVMShare         = flag.String("vm-share", "", "Directory to share with VM via VirtioFS")
 	flagVMAudioPassthru = flag.Bool("vm-audio-passthru", false, "Pass VM guest audio through to host speakers")
 	flagDisk            = flag.Int("disk", 64, "VM disk size in GB (used with setup)")
+	flagVMStreamSize    = flag.String("vm-stream-size", "", "Stream the VM display at WxH, scaled on the GPU (default: the guest resolution)")
 )
 
+// vmStreamW and vmStreamH are the VM stream size; --vm-stream-size or the
+// guest resolution.
+var vmStreamW, vmStreamH int
+
 func registerPlatformFlags() {
 	// flags are registered above via flag.Bool/flag.String
 }
@@ -40,13 +46,25 @@ func fillPlatformConfig(cfg *platform.Config) {
 		}
 		cfg.VMWidth = w
 		cfg.VMHeight = h
+
+		vmStreamW, vmStreamH = w, h
+		if *flagVMStreamSize != "" {
+			if _, err := fmt.Sscanf(*flagVMStreamSize, "%dx%d", &vmStreamW, &vmStreamH); err != nil || vmStreamW <= 0 || vmStreamH <= 0 {
+				log.Fatalf("--vm-stream-size must be WxH, got %q", *flagVMStreamSize)
+			}
+			// ScreenCaptureKit letterboxes a mismatched aspect ratio, which
+			// would throw pointer mapping off.
+			if d := float64(vmStreamW*h) / float64(vmStreamH*w); d < 0.99 || d > 1.01 {
+				log.Fatalf("--vm-stream-size %s must keep the guest's %dx%d aspect ratio", *flagVMStreamSize, w, h)
+			}
+		}
 	}
 }
 
 func newCapturer(display string, fps, gpu int) (types.MediaCapturer, error) {
 	if display == "vm" {
 		if g := vm.GetGlobal(); g != nil {
-			return vm.NewVMCapturer(g.WindowID, fps, g.Width, g.Height)
+			return vm.NewVMCapturer(g.WindowID, fps, vmStreamW, vmStreamH)
 		}
 	}
 	return capture.NewCapturer(display, fps, gpu)
@@ -59,12 +77,23 @@ func newEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int,
 func newInputHandler(displayName string) (types.EventInjector, error) {
 	if displayName == "vm" {
 		if g := vm.GetGlobal(); g != nil {
-			return vm.NewVMInputHandler(g.View()), nil
+			return vm.NewVMInputHandler(g.View(), vmStreamW, vmStreamH, g.Width, g.Height), nil
 		}
 	}
 	return input.NewInputHandler(displayName)
 }
 
+// hostCapturerFactory returns nil: macOS capture never hands out CUDA
+// frames.
+func hostCapturerFactory() func(display string, fps, gpu int) (types.MediaCapturer, error) {
+	return nil
+}
+
+// cursorSourceFactory returns nil: macOS always composites the cursor.
+func cursorSourceFactory() func(displayName string) (types.CursorSource, error) {
+	return nil
+}
+
 func newClipboardHandler(displayName string, sendFn func(string)) (types.ClipboardSync, error) {
 	if displayName == "vm" {
 		if g := vm.GetGlobal(); g != nil {
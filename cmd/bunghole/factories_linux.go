@@ -4,6 +4,9 @@ package main
 
 import (
 	"flag"
+	"log"
+	"strconv"
+	"strings"
 	"unsafe"
 
 	"bunghole/internal/capture"
@@ -18,6 +21,14 @@ var (
 	flagStartX            = flag.Bool("start-x", false, "Start a new Xorg server with nvidia driver")
 	flagUser              = flag.String("user", "", "Run desktop session as this user (with --start-x)")
 	flagExperimentalNvFBC = flag.Bool("experimental-nvfbc", false, "Enable experimental NvFBC capture path (Linux/NVIDIA only)")
+	flagXDamage           = flag.Bool("xdamage", false, "Only refetch XDamage-reported regions and skip encoding unchanged frames (XShm only)")
+	flagDamageQP          = flag.Int("damage-qp", 0, "Lower the QP of regions reported changed by this much, so text edits stay sharp (needs --xdamage or --pacing source; 0 = off)")
+	flagNvFBCZeroCopy     = flag.Bool("nvfbc-zerocopy", false, "Feed NvFBC's CUDA buffer to NVENC directly instead of copying it (with --experimental-nvfbc)")
+	flagCursorChannel     = flag.Bool("cursor-channel", false, "Send the cursor over a data channel for the client to draw instead of compositing it into frames")
+	flagDesktops          = flag.String("desktops", "", "Serve several desktops from this process, comma-separated name[=display][@gpu]; desktops without a display get their own Xorg (served at /d/{name}/)")
+	flagDesktopPool       = flag.Int("desktop-pool", 0, "Keep this many desktops (Xorg + session) started ahead of time and hand them out on POST /desktops (served at /d/{name}/; 0 = off)")
+	flagDesktopLimit      = flag.Int("desktop-limit", 0, "Most desktops started with POST /desktops running at once (0 = --desktop-pool)")
+	flagNVENCSessions     = flag.Int("nvenc-sessions", 0, "NVENC sessions to open per GPU before encoding further pipelines on the CPU (0 = no limit)")
 )
 
 func registerPlatformFlags() {
@@ -28,12 +39,79 @@ func fillPlatformConfig(cfg *platform.Config) {
 	cfg.StartX = *flagStartX
 	cfg.User = *flagUser
 	capture.SetExperimentalNvFBC(*flagExperimentalNvFBC)
+	capture.SetDamageTracking(*flagXDamage)
+	encode.SetCUDAZeroCopy(*flagNvFBCZeroCopy)
+	if *flagDamageQP < 0 || *flagDamageQP > 51 {
+		log.Fatalf("--damage-qp must be between 0 and 51, got %d", *flagDamageQP)
+	}
+	encode.SetDamageQP(*flagDamageQP)
+	capture.SetCursorChannel(*flagCursorChannel)
+	if *flagNVENCSessions < 0 {
+		log.Fatal("--nvenc-sessions must be >= 0")
+	}
+	encode.SetNVENCSessionLimit(*flagNVENCSessions)
+	if *flagDesktops != "" {
+		cfg.Desktops = parseDesktops(*flagDesktops, *flagGPU)
+	}
+	if *flagDesktopPool < 0 {
+		log.Fatal("--desktop-pool must be >= 0")
+	}
+	cfg.DesktopPool = *flagDesktopPool
+	if *flagDesktopLimit < 0 {
+		log.Fatal("--desktop-limit must be >= 0")
+	}
+	cfg.DesktopLimit = *flagDesktopLimit
+	if cfg.DesktopLimit == 0 {
+		cfg.DesktopLimit = cfg.DesktopPool
+	}
+}
+
+// parseDesktops parses --desktops. Desktops without @gpu use gpu.
+func parseDesktops(spec string, gpu int) []platform.Desktop {
+	var desktops []platform.Desktop
+	seen := make(map[string]bool)
+	for _, item := range strings.Split(spec, ",") {
+		item = strings.TrimSpace(item)
+		if item == "" {
+			continue
+		}
+		d := platform.Desktop{GPU: gpu}
+		if i := strings.LastIndexByte(item, '@'); i >= 0 {
+			n, err := strconv.Atoi(item[i+1:])
+			if err != nil || n < 0 {
+				log.Fatalf("--desktops %q: bad GPU index", item)
+			}
+			d.GPU = n
+			item = item[:i]
+		}
+		d.Name, d.Display, _ = strings.Cut(item, "=")
+		if d.Name == "" || strings.ContainsAny(d.Name, "/?#%") {
+			log.Fatalf("--desktops %q: bad name", item)
+		}
+		if seen[d.Name] {
+			log.Fatalf("--desktops: %q named twice", d.Name)
+		}
+		seen[d.Name] = true
+		desktops = append(desktops, d)
+	}
+	if len(desktops) == 0 {
+		log.Fatal("--desktops: no desktops given")
+	}
+	return desktops
 }
 
 func newCapturer(display string, fps, gpu int) (types.MediaCapturer, error) {
 	return capture.NewCapturer(display, fps, gpu)
 }
 
+// hostCapturerFactory returns XShm, which the pipeline falls back to when
+// NvFBC's CUDA frames find no NVENC session.
+func hostCapturerFactory() func(display string, fps, gpu int) (types.MediaCapturer, error) {
+	return func(display string, fps, gpu int) (types.MediaCapturer, error) {
+		return capture.NewXShmCapturer(display, fps)
+	}
+}
+
 func newEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int, cudaCtx, cuMemcpy2D unsafe.Pointer) (types.VideoEncoder, error) {
 	return encode.NewEncoder(width, height, fps, bitrateKbps, gpu, codec, gop, cudaCtx, cuMemcpy2D)
 }
@@ -42,6 +120,14 @@ func newInputHandler(displayName string) (types.EventInjector, error) {
 	return input.NewInputHandler(displayName)
 }
 
+// cursorSourceFactory returns nil unless --cursor-channel is set.
+func cursorSourceFactory() func(displayName string) (types.CursorSource, error) {
+	if !*flagCursorChannel {
+		return nil
+	}
+	return capture.NewCursorSource
+}
+
 func newClipboardHandler(displayName string, sendFn func(string)) (types.ClipboardSync, error) {
 	return clipboard.NewClipboardHandler(displayName, sendFn)
 }
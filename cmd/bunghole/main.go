@@ -11,6 +11,8 @@ import (
 	"syscall"
 	"time"
 
+	"bunghole/internal/audio"
+	"bunghole/internal/encode"
 	"bunghole/internal/platform"
 	"bunghole/internal/server"
 	tlsutil "bunghole/internal/tls"
@@ -22,11 +24,23 @@ var (
 	flagToken          = flag.String("token", "", "Bearer token for authentication (required)")
 	flagFPS            = flag.Int("fps", 30, "Capture frame rate")
 	flagBitrate        = flag.Int("bitrate", 4000, "Video bitrate in kbps")
+	flagMinBitrate     = flag.Int("min-bitrate", 500, "Lowest video bitrate in kbps adaptive bitrate may drop to")
+	flagABR            = flag.String("abr", "controller", "Adaptive bitrate policy: controller (follow the controller's link), slowest (follow the slowest session) or off")
+	flagLadder         = flag.Int("ladder", 1, "Renditions to encode for viewers: 1 = full resolution only, 2 adds half, 3 adds quarter; each viewer gets the one its bandwidth fits")
+	flagPacing         = flag.String("pacing", "tick", "Capture pacing: tick (grab on a fixed --fps ticker) or source (grab as soon as the capturer has a new frame, capped at --fps)")
+	flagAdaptiveFPS    = flag.Bool("adaptive-fps", false, "Grab a static screen less often, down to once a second, and sharpen it with one refresh frame; input restores the full rate")
 	flagGPU            = flag.Int("gpu", 0, "GPU index for Xorg (0=first, 1=second)")
 	flagCodec          = flag.String("codec", "h264", "Video codec (h264 or h265)")
 	flagGOP            = flag.Int("gop", 0, "Keyframe interval in frames (0 = 2x FPS)")
+	flagIntraRefresh   = flag.Bool("intra-refresh", false, "Use intra refresh over each --gop instead of periodic keyframes (NVENC, x264, x265)")
 	flagStats          = flag.Bool("stats", false, "Log pipeline stats every 5 seconds")
+	flagCaptureTimes   = flag.Bool("capture-timestamps", false, "Send each frame's capture time in an SEI message so the web client can measure glass-to-glass latency (exported on /metrics)")
+	flagLinger         = flag.Duration("linger", 0, "Keep the pipeline warm but paused this long after the last session leaves (0 = stop immediately)")
+	flagPrewarm        = flag.Bool("prewarm", false, "Start the pipeline at launch and keep it warm while idle, so the first session only waits for the next frame")
 	flagAudioUDPListen = flag.String("audio-udp-listen", "", "Listen address for external Opus packets (e.g. guest agent), example :18080")
+	flagAudioFrame     = flag.Duration("audio-frame", 20*time.Millisecond, "Opus frame duration for locally captured audio: 2.5ms, 5ms, 10ms or 20ms")
+	flagAudioFEC       = flag.Bool("audio-fec", true, "Opus in-band FEC, sized to the loss receivers report (needs --audio-frame 10ms or more)")
+	flagAudioDTX       = flag.Bool("audio-dtx", false, "Opus DTX: send almost nothing while the desktop is silent")
 	flagOfferTimeout   = flag.Duration("offer-timeout", 10*time.Second, "Timeout for WHEP offer processing and ICE gathering")
 	flagAllowOrigins   = flag.String("allow-origins", "", "Comma-separated CORS allowlist (in addition to same-origin). Empty = same-origin only")
 	flagResolution     = flag.String("resolution", "1920x1080", "Display resolution (WxH)")
@@ -35,6 +49,10 @@ var (
 	flagTLS            = flag.Bool("tls", false, "Enable TLS with auto-generated self-signed certificate")
 	flagTLSCert        = flag.String("tls-cert", "", "Path to TLS certificate file (PEM)")
 	flagTLSKey         = flag.String("tls-key", "", "Path to TLS private key file (PEM)")
+	flagBenchFrames    = flag.Int("bench-frames", 300, "Frames to measure per run (used with bench)")
+	flagBenchMotion    = flag.String("bench-motion", "static,scroll,noise", "Comma-separated synthetic frame sources for bench encode: static, scroll, noise")
+	flagBenchInput     = flag.String("bench-input", "", "Raw BGRA recording at --resolution to encode instead of synthetic frames (used with bench)")
+	flagBenchOut       = flag.String("bench-out", "", "Write the bench JSON report here instead of stdout")
 )
 
 func main() {
@@ -59,6 +77,12 @@ func main() {
 		return
 	}
 
+	// Subcommand: bunghole bench [encode|capture|all]
+	if flag.NArg() > 0 && flag.Arg(0) == "bench" {
+		runBench(cfg, flag.Args()[1:])
+		return
+	}
+
 	// VM mode needs NSApplication RunLoop on the main OS thread.
 	// We must branch on requested config (cfg.VM), not runtime VM state,
 	// because global VM state is only set during platform.Init() in runServer.
@@ -90,15 +114,47 @@ func runServer(cfg *platform.Config) {
 	// Restore them now so our log output renders correctly.
 	platform.RestoreTermState()
 
-	if cfg.Display == "" {
+	if cfg.Display == "" && len(cfg.Desktops) == 0 && cfg.NewDesktop == nil {
 		log.Fatal("no display available — use --display, set DISPLAY env, or use --start-x")
 	}
+	if len(cfg.Desktops) > 0 && *flagAudioUDPListen != "" {
+		log.Fatal("--audio-udp-listen can't be used with --desktops")
+	}
+	if cfg.NewDesktop != nil && *flagAudioUDPListen != "" {
+		log.Fatal("--audio-udp-listen can't be used with --desktop-pool")
+	}
 
 	codec := *flagCodec
 	if codec != "h264" && codec != "h265" {
 		log.Fatalf("--codec must be h264 or h265, got %q", codec)
 	}
 
+	encode.SetIntraRefresh(*flagIntraRefresh)
+
+	if err := audio.SetOpusFrame(*flagAudioFrame); err != nil {
+		log.Fatalf("--audio-frame: %v", err)
+	}
+	audio.SetOpusFEC(*flagAudioFEC)
+	audio.SetOpusDTX(*flagAudioDTX)
+
+	switch *flagABR {
+	case "controller", "slowest", "off":
+	default:
+		log.Fatalf("--abr must be controller, slowest or off, got %q", *flagABR)
+	}
+	if *flagMinBitrate <= 0 {
+		log.Fatal("--min-bitrate must be > 0")
+	}
+	if *flagLadder < 1 || *flagLadder > 3 {
+		log.Fatalf("--ladder must be 1, 2 or 3, got %d", *flagLadder)
+	}
+	if *flagPacing != "tick" && *flagPacing != "source" {
+		log.Fatalf("--pacing must be tick or source, got %q", *flagPacing)
+	}
+	if *flagLinger < 0 {
+		log.Fatal("--linger must be >= 0")
+	}
+
 	// TLS validation
 	if (*flagTLSCert != "") != (*flagTLSKey != "") {
 		log.Fatal("--tls-cert and --tls-key must both be set")
@@ -126,7 +182,7 @@ func runServer(cfg *platform.Config) {
 		}
 	}
 
-	srv := server.New(server.Config{
+	base := server.Config{
 		Display:        cfg.Display,
 		Token:          *flagToken,
 		FPS:            *flagFPS,
@@ -136,9 +192,18 @@ func runServer(cfg *platform.Config) {
 		GOP:            *flagGOP,
 		Addr:           *flagAddr,
 		Stats:          *flagStats,
+		ABR:            *flagABR,
+		MinBitrate:     min(*flagMinBitrate, *flagBitrate),
+		Ladder:         *flagLadder,
+		Pacing:         *flagPacing,
+		AdaptiveFPS:    *flagAdaptiveFPS,
+		CaptureTimes:   *flagCaptureTimes,
 		AudioUDPListen: *flagAudioUDPListen,
 		VsockAudioCh:   cfg.VsockAudioCh,
 
+		Linger:  *flagLinger,
+		Prewarm: *flagPrewarm,
+
 		OfferTimeout:   *flagOfferTimeout,
 		AllowedOrigins: allowedOrigins,
 		AuthFailLimit:  *flagAuthFailLimit,
@@ -152,7 +217,38 @@ func runServer(cfg *platform.Config) {
 		NewEncoder:   newEncoder,
 		InputFactory: newInputHandler,
 		ClipFactory:  newClipboardHandler,
-	})
+
+		NewHostCapturer: hostCapturerFactory(),
+		NewCursorSource: cursorSourceFactory(),
+	}
+
+	desktopConfig := func(d platform.Desktop) server.Config {
+		sc := base
+		sc.Name = d.Name
+		sc.Display = d.Display
+		sc.GPU = d.GPU
+		sc.AudioServer = d.AudioServer
+		return sc
+	}
+
+	var servers []*server.Server
+	if len(cfg.Desktops) == 0 && cfg.NewDesktop == nil {
+		servers = append(servers, server.New(base))
+	}
+	for _, d := range cfg.Desktops {
+		servers = append(servers, server.New(desktopConfig(d)))
+	}
+
+	var spawner *server.Spawner
+	if cfg.NewDesktop != nil {
+		spawner = server.NewSpawner(base, cfg.DesktopLimit, func(name string) (*server.Server, func(), error) {
+			d, stop, err := cfg.NewDesktop(name)
+			if err != nil {
+				return nil, nil, err
+			}
+			return server.New(desktopConfig(d)), stop, nil
+		})
+	}
 
 	// Handle graceful shutdown
 	sigCh := make(chan os.Signal, 1)
@@ -160,7 +256,12 @@ func runServer(cfg *platform.Config) {
 	go func() {
 		sig := <-sigCh
 		log.Printf("received %s, shutting down...", sig)
-		srv.Teardown()
+		for _, srv := range servers {
+			srv.Teardown()
+		}
+		if spawner != nil {
+			spawner.Teardown()
+		}
 		cleanup()
 		platform.RestoreTermState()
 		if platform.IsVMMode() {
@@ -169,7 +270,7 @@ func runServer(cfg *platform.Config) {
 		os.Exit(0)
 	}()
 
-	if err := srv.ListenAndServe(); err != nil {
+	if err := server.ServeDesktops(servers, spawner); err != nil {
 		log.Fatal(err)
 	}
 }
@@ -17,6 +17,7 @@ typedef int CUresult;
 typedef int CUdevice;
 typedef void *CUcontext;
 typedef unsigned long long CUdeviceptr;
+typedef struct CUstream_st *CUstream;
 
 #define CUDA_SUCCESS 0
 #endif
@@ -31,5 +32,10 @@ typedef CUresult (*PFN_cuCtxDestroy)(CUcontext);
 typedef CUresult (*PFN_cuCtxSetCurrent)(CUcontext);
 typedef CUresult (*PFN_cuCtxGetCurrent)(CUcontext *);
 typedef CUresult (*PFN_cuMemcpyDtoH)(void *, CUdeviceptr, size_t);
+typedef CUresult (*PFN_cuCtxPushCurrent)(CUcontext);
+typedef CUresult (*PFN_cuCtxPopCurrent)(CUcontext *);
+typedef CUresult (*PFN_cuStreamCreate)(CUstream *, unsigned int);
+typedef CUresult (*PFN_cuStreamDestroy)(CUstream);
+typedef CUresult (*PFN_cuStreamSynchronize)(CUstream);
 
 #endif /* CUDA_DEFS_H */
@@ -36,6 +36,7 @@ typedef enum {
     NVFBC_ERR_X              = 10,
     NVFBC_ERR_GL             = 11,
     NVFBC_ERR_CUDA           = 12,
+    NVFBC_ERR_MUST_RECREATE  = 13, // mode set: capture session must be recreated
 } NVFBCSTATUS;
 
 typedef enum {
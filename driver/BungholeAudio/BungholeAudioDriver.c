@@ -13,6 +13,7 @@
  * Build: compiled as a MODULE library → BungholeAudio.driver bundle.
  */
 
+#include <Accelerate/Accelerate.h>
 #include <CoreAudio/AudioServerPlugIn.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <mach/mach_time.h>
@@ -58,11 +59,24 @@ struct sockaddr_vm {
 
 #define RING_CAPACITY       8192    /* frames (~170ms at 48kHz) */
 
-/* Opus: 20ms frames = 960 samples at 48kHz */
-#define OPUS_FRAME_SIZE     960
+/* Opus: 20ms frames = 960 samples at 48kHz by default; the bundle's
+ * Info.plist can pick 5, 10, 20, 40 or 60ms (BungholeOpusFrameMs). */
+#define OPUS_DEFAULT_FRAME_MS 20
+#define OPUS_MAX_FRAME_SIZE 2880    /* 60ms: largest frame the driver encodes */
+#define OPUS_MAX_DECODE     5760    /* 120ms: largest frame a packet can carry */
 #define OPUS_MAX_PACKET     1500
 #define OPUS_BITRATE        128000
 
+/* Packets per vsock write (BungholePacketsPerWrite, 1 = no coalescing) */
+#define MAX_PACKETS_PER_WRITE 8
+
+/* Frames with this bit set in the length prefix carry a stats record
+ * instead of an Opus packet; Opus packets never come near 0x8000 bytes. */
+#define FRAME_STATS_FLAG    0x8000
+#define STATS_VERSION       1
+#define STATS_SIZE          35
+#define STATS_INTERVAL_MS   1000
+
 /* IO nominal buffer = 512 frames */
 #define IO_BUFFER_FRAMES    512
 
@@ -184,6 +198,14 @@ typedef struct {
     OpusEncoder    *opusEncoder;
     OpusDecoder    *opusDecoder;
 
+    /* Transport settings, from the bundle's Info.plist */
+    int             frameSize;          /* samples per Opus packet */
+    int             packetsPerWrite;
+
+    /* Counters reported to the host in stats frames */
+    _Atomic uint64_t outputOverruns;    /* frames dropped: output ring full */
+    _Atomic uint64_t inputUnderruns;    /* frames padded with silence: input ring empty */
+
     /* Mach timebase for clock calculations */
     mach_timebase_info_data_t timebase;
 
@@ -218,28 +240,25 @@ static int vsock_connect(unsigned int port) {
 /*  Utility: framed write/read (2-byte BE length prefix)              */
 /* ------------------------------------------------------------------ */
 
-static int framed_write(int fd, const unsigned char *data, uint16_t len) {
-    unsigned char hdr[2];
-    hdr[0] = (unsigned char)(len >> 8);
-    hdr[1] = (unsigned char)(len & 0xFF);
-
-    /* Write header */
-    ssize_t n = 0;
-    while (n < 2) {
-        ssize_t w = write(fd, hdr + n, 2 - n);
-        if (w <= 0) return -1;
-        n += w;
-    }
-    /* Write payload */
-    n = 0;
+static int write_all(int fd, const unsigned char *data, size_t len) {
+    size_t n = 0;
     while (n < len) {
         ssize_t w = write(fd, data + n, len - n);
         if (w <= 0) return -1;
-        n += w;
+        n += (size_t)w;
     }
     return 0;
 }
 
+/* Writes the 2-byte length prefix for a frame of len bytes (optionally
+ * flagged) at dst. Returns the header size. */
+static size_t frame_header(unsigned char *dst, uint16_t len, uint16_t flags) {
+    uint16_t v = len | flags;
+    dst[0] = (unsigned char)(v >> 8);
+    dst[1] = (unsigned char)(v & 0xFF);
+    return 2;
+}
+
 static int framed_read(int fd, unsigned char *buf, int bufsize, uint16_t *out_len) {
     unsigned char hdr[2];
     ssize_t n = 0;
@@ -277,18 +296,76 @@ static float db_to_scalar(float db) {
     return powf(10.0f, db / 20.0f);
 }
 
+/* ------------------------------------------------------------------ */
+/*  Utility: gain                                                     */
+/* ------------------------------------------------------------------ */
+
+/* Scales n samples in place by the control's volume, or silences them
+ * when muted. */
+static void apply_gain(float *pcm, int n, _Atomic float *volume, _Atomic int *mute) {
+    if (atomic_load_explicit(mute, memory_order_relaxed)) {
+        vDSP_vclr(pcm, 1, (vDSP_Length)n);
+        return;
+    }
+    float gain = atomic_load_explicit(volume, memory_order_relaxed);
+    if (gain != 1.0f) {
+        vDSP_vsmul(pcm, 1, &gain, pcm, 1, (vDSP_Length)n);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Utility: stats record                                             */
+/* ------------------------------------------------------------------ */
+
+static void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+}
+
+static void put_be64(unsigned char *p, uint64_t v) {
+    put_be32(p, (uint32_t)(v >> 32));
+    put_be32(p + 4, (uint32_t)v);
+}
+
+/* Record layout (big-endian): version u8, frame size u16, output ring
+ * fill u32, ring peak since the last record u32, output overruns u64,
+ * input underruns u64, packets sent u64. */
+static size_t stats_record(DriverState *drv, unsigned char *dst, uint32_t fill, uint32_t peak, uint64_t packets) {
+    dst[0] = STATS_VERSION;
+    dst[1] = (unsigned char)(drv->frameSize >> 8);
+    dst[2] = (unsigned char)(drv->frameSize & 0xFF);
+    put_be32(dst + 3, fill);
+    put_be32(dst + 7, peak);
+    put_be64(dst + 11, atomic_load_explicit(&drv->outputOverruns, memory_order_relaxed));
+    put_be64(dst + 19, atomic_load_explicit(&drv->inputUnderruns, memory_order_relaxed));
+    put_be64(dst + 27, packets);
+    return STATS_SIZE;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Transport: output thread (ring → Opus → vsock)                    */
 /* ------------------------------------------------------------------ */
 
+/* Encodes drv->frameSize frames at a time. Up to packetsPerWrite framed
+ * packets are coalesced into one write; a partial batch is flushed
+ * whenever the ring runs dry, so coalescing never holds a packet longer
+ * than it takes the next ones to arrive. A stats frame rides along with
+ * the first batch after each STATS_INTERVAL_MS. */
 static void *output_transport_thread(void *arg) {
     DriverState *drv = (DriverState *)arg;
-    float pcm[OPUS_FRAME_SIZE * NUM_CHANNELS];
-    int16_t pcm16[OPUS_FRAME_SIZE * NUM_CHANNELS];
-    unsigned char opus_buf[OPUS_MAX_PACKET];
+    float pcm[OPUS_MAX_FRAME_SIZE * NUM_CHANNELS];
+    unsigned char batch[MAX_PACKETS_PER_WRITE * (2 + OPUS_MAX_PACKET) + 2 + STATS_SIZE];
     uint64_t acc = 0; /* accumulated frames in pcm buffer */
+    uint64_t frame = (uint64_t)drv->frameSize;
+    int stats_every = STATS_INTERVAL_MS * SAMPLE_RATE / 1000 / drv->frameSize;
 
-    os_log(drv->logger, "output transport thread started");
+    /* Poll a few times per frame, but no more often than every 1ms */
+    useconds_t poll_us = (useconds_t)(frame * 1000000 / SAMPLE_RATE / 4);
+    if (poll_us < 1000) poll_us = 1000;
+    if (poll_us > 2000) poll_us = 2000;
+
+    os_log(drv->logger, "output transport thread started (%d-frame packets, %d per write)",
+           drv->frameSize, drv->packetsPerWrite);
 
     while (atomic_load(&drv->running)) {
         int fd = vsock_connect(VSOCK_PORT_OUT);
@@ -298,46 +375,61 @@ static void *output_transport_thread(void *arg) {
         }
         os_log(drv->logger, "output vsock connected to host port %d", VSOCK_PORT_OUT);
 
-        while (atomic_load(&drv->running)) {
+        size_t batch_len = 0;
+        int batched = 0;
+        uint64_t packets = 0;
+        uint32_t peak = 0;
+        int ok = 1;
+
+        while (ok && atomic_load(&drv->running)) {
             /* Drain ring buffer into accumulation buffer */
-            uint64_t need = OPUS_FRAME_SIZE - acc;
-            uint64_t got = ring_read(&drv->outputRing, pcm + acc * NUM_CHANNELS, need);
+            uint64_t fill = ring_available(&drv->outputRing);
+            if (fill > peak) peak = (uint32_t)fill;
+            uint64_t got = ring_read(&drv->outputRing, pcm + acc * NUM_CHANNELS, frame - acc);
             acc += got;
 
-            if (acc < OPUS_FRAME_SIZE) {
-                /* Not enough data yet — sleep briefly */
-                usleep(2000); /* 2ms */
+            if (acc < frame) {
+                /* Not enough data yet: send what is batched, then sleep */
+                if (batched > 0) {
+                    ok = write_all(fd, batch, batch_len) == 0;
+                    batch_len = 0;
+                    batched = 0;
+                    continue;
+                }
+                usleep(poll_us);
                 continue;
             }
 
-            /* Apply volume */
-            float vol = atomic_load_explicit(&drv->outputVolume, memory_order_relaxed);
-            int mute = atomic_load_explicit(&drv->outputMute, memory_order_relaxed);
-            float gain = mute ? 0.0f : vol;
-
-            /* Convert Float32 → Int16 with volume */
-            for (int i = 0; i < OPUS_FRAME_SIZE * NUM_CHANNELS; i++) {
-                float s = pcm[i] * gain * 32767.0f;
-                if (s > 32767.0f) s = 32767.0f;
-                if (s < -32768.0f) s = -32768.0f;
-                pcm16[i] = (int16_t)s;
-            }
+            apply_gain(pcm, (int)(frame * NUM_CHANNELS), &drv->outputVolume, &drv->outputMute);
 
-            /* Encode */
-            int nbytes = opus_encode(drv->opusEncoder, pcm16, OPUS_FRAME_SIZE, opus_buf, OPUS_MAX_PACKET);
+            /* Encode straight from float, no int16 round trip */
+            unsigned char *pkt = batch + batch_len + 2;
+            int nbytes = opus_encode_float(drv->opusEncoder, pcm, (int)frame, pkt, OPUS_MAX_PACKET);
+            acc = 0;
             if (nbytes < 0) {
-                os_log_error(drv->logger, "opus_encode error: %d", nbytes);
-                acc = 0;
+                os_log_error(drv->logger, "opus_encode_float error: %d", nbytes);
                 continue;
             }
-
-            /* Send framed packet */
-            if (framed_write(fd, opus_buf, (uint16_t)nbytes) < 0) {
-                os_log(drv->logger, "output vsock write failed, reconnecting");
-                break;
+            batch_len += frame_header(batch + batch_len, (uint16_t)nbytes, 0) + (size_t)nbytes;
+            batched++;
+            packets++;
+
+            if (packets % (uint64_t)stats_every == 0) {
+                batch_len += frame_header(batch + batch_len, STATS_SIZE, FRAME_STATS_FLAG);
+                batch_len += stats_record(drv, batch + batch_len,
+                                          (uint32_t)ring_available(&drv->outputRing), peak, packets);
+                peak = 0;
+                batched = drv->packetsPerWrite; /* flush with this batch */
             }
 
-            acc = 0;
+            if (batched >= drv->packetsPerWrite) {
+                ok = write_all(fd, batch, batch_len) == 0;
+                batch_len = 0;
+                batched = 0;
+            }
+        }
+        if (!ok) {
+            os_log(drv->logger, "output vsock write failed, reconnecting");
         }
 
         close(fd);
@@ -357,8 +449,7 @@ static void *output_transport_thread(void *arg) {
 static void *input_transport_thread(void *arg) {
     DriverState *drv = (DriverState *)arg;
     unsigned char opus_buf[OPUS_MAX_PACKET];
-    int16_t pcm16[OPUS_FRAME_SIZE * NUM_CHANNELS];
-    float pcm[OPUS_FRAME_SIZE * NUM_CHANNELS];
+    float pcm[OPUS_MAX_DECODE * NUM_CHANNELS];
 
     os_log(drv->logger, "input transport thread started");
 
@@ -377,22 +468,14 @@ static void *input_transport_thread(void *arg) {
                 break;
             }
 
-            /* Decode */
-            int nsamples = opus_decode(drv->opusDecoder, opus_buf, pkt_len, pcm16, OPUS_FRAME_SIZE, 0);
+            /* Decode straight to float; the host may use any frame size */
+            int nsamples = opus_decode_float(drv->opusDecoder, opus_buf, pkt_len, pcm, OPUS_MAX_DECODE, 0);
             if (nsamples < 0) {
-                os_log_error(drv->logger, "opus_decode error: %d", nsamples);
+                os_log_error(drv->logger, "opus_decode_float error: %d", nsamples);
                 continue;
             }
 
-            /* Apply volume, convert Int16 → Float32 */
-            float vol = atomic_load_explicit(&drv->inputVolume, memory_order_relaxed);
-            int mute = atomic_load_explicit(&drv->inputMute, memory_order_relaxed);
-            float gain = mute ? 0.0f : vol;
-
-            for (int i = 0; i < nsamples * NUM_CHANNELS; i++) {
-                pcm[i] = ((float)pcm16[i] / 32768.0f) * gain;
-            }
-
+            apply_gain(pcm, nsamples * NUM_CHANNELS, &drv->inputVolume, &drv->inputMute);
             ring_write(&drv->inputRing, pcm, (uint64_t)nsamples);
         }
 
@@ -532,6 +615,37 @@ static ULONG driver_Release(void *inDriver) {
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Configuration (bundle Info.plist)                                 */
+/* ------------------------------------------------------------------ */
+
+static int bundle_int(const char *key, int def) {
+    CFBundleRef bundle = CFBundleGetBundleWithIdentifier(CFSTR("com.bunghole.audio"));
+    if (!bundle) return def;
+    CFStringRef k = make_cfstr(key);
+    CFTypeRef v = CFBundleGetValueForInfoDictionaryKey(bundle, k);
+    CFRelease(k);
+    int out = def;
+    if (v && CFGetTypeID(v) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef)v, kCFNumberIntType, &out);
+    }
+    return out;
+}
+
+static void load_config(DriverState *drv) {
+    int ms = bundle_int("BungholeOpusFrameMs", OPUS_DEFAULT_FRAME_MS);
+    if (ms != 5 && ms != 10 && ms != 20 && ms != 40 && ms != 60) {
+        os_log_error(drv->logger, "BungholeOpusFrameMs %d not supported, using %d", ms, OPUS_DEFAULT_FRAME_MS);
+        ms = OPUS_DEFAULT_FRAME_MS;
+    }
+    drv->frameSize = SAMPLE_RATE / 1000 * ms;
+
+    int n = bundle_int("BungholePacketsPerWrite", 1);
+    if (n < 1) n = 1;
+    if (n > MAX_PACKETS_PER_WRITE) n = MAX_PACKETS_PER_WRITE;
+    drv->packetsPerWrite = n;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Initialize                                                        */
 /* ------------------------------------------------------------------ */
@@ -565,9 +679,15 @@ static OSStatus driver_Initialize(AudioServerPlugInDriverRef inDriver, AudioServ
     /* Mach timebase */
     mach_timebase_info(&gDriver->timebase);
 
-    /* Create Opus encoder */
+    load_config(gDriver);
+    atomic_store(&gDriver->outputOverruns, 0);
+    atomic_store(&gDriver->inputUnderruns, 0);
+
+    /* Create Opus encoder. Frames under 10ms need the CELT-only
+     * restricted low-delay mode. */
     int err;
-    gDriver->opusEncoder = opus_encoder_create(SAMPLE_RATE, NUM_CHANNELS, OPUS_APPLICATION_AUDIO, &err);
+    int app = gDriver->frameSize < SAMPLE_RATE / 100 ? OPUS_APPLICATION_RESTRICTED_LOWDELAY : OPUS_APPLICATION_AUDIO;
+    gDriver->opusEncoder = opus_encoder_create(SAMPLE_RATE, NUM_CHANNELS, app, &err);
     if (err != OPUS_OK) {
         os_log_error(gDriver->logger, "opus_encoder_create failed: %d", err);
         return kAudioHardwareUnspecifiedError;
@@ -1398,13 +1518,17 @@ static OSStatus driver_DoIOOperation(AudioServerPlugInDriverRef d, AudioObjectID
     if (is_output_device(id) && opID == kAudioServerPlugInIOOperationWriteMix) {
         /* Apps have mixed audio into ioMainBuffer — copy to output ring */
         float *buf = (float *)ioMainBuffer;
-        ring_write(&gDriver->outputRing, buf, ioSize);
+        uint64_t put = ring_write(&gDriver->outputRing, buf, ioSize);
+        if (put < ioSize) {
+            atomic_fetch_add_explicit(&gDriver->outputOverruns, ioSize - put, memory_order_relaxed);
+        }
     } else if (is_input_device(id) && opID == kAudioServerPlugInIOOperationReadInput) {
         /* Read from input ring into ioMainBuffer; pad with silence on underflow */
         float *buf = (float *)ioMainBuffer;
         uint64_t got = ring_read(&gDriver->inputRing, buf, ioSize);
         if (got < ioSize) {
             memset(buf + got * NUM_CHANNELS, 0, (ioSize - got) * BYTES_PER_FRAME);
+            atomic_fetch_add_explicit(&gDriver->inputUnderruns, ioSize - got, memory_order_relaxed);
         }
     }
 
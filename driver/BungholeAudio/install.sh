@@ -6,6 +6,28 @@ INSTALL_DIR="/Library/Audio/Plug-Ins/HAL"
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 DRIVER_SRC="$SCRIPT_DIR/$DRIVER_NAME"
 
+# Transport tuning, written into the installed bundle's Info.plist:
+#   --frame-ms N           Opus packet duration: 5, 10, 20 (default), 40 or 60
+#   --packets-per-write N  packets coalesced per vsock write, 1-8 (default 1)
+FRAME_MS=""
+PACKETS_PER_WRITE=""
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --frame-ms)
+            FRAME_MS="${2:-}"
+            shift 2
+            ;;
+        --packets-per-write)
+            PACKETS_PER_WRITE="${2:-}"
+            shift 2
+            ;;
+        *)
+            echo "error: unknown argument: $1" >&2
+            exit 1
+            ;;
+    esac
+done
+
 if [[ ! -d "$DRIVER_SRC" ]]; then
     echo "error: driver bundle not found: $DRIVER_SRC" >&2
     exit 1
@@ -13,7 +35,10 @@ fi
 
 if [[ $(id -u) -ne 0 ]]; then
     echo "This script requires sudo."
-    exec sudo "$0" "$@"
+    ARGS=()
+    [[ -n "$FRAME_MS" ]] && ARGS+=(--frame-ms "$FRAME_MS")
+    [[ -n "$PACKETS_PER_WRITE" ]] && ARGS+=(--packets-per-write "$PACKETS_PER_WRITE")
+    exec sudo "$0" ${ARGS[@]+"${ARGS[@]}"}
 fi
 
 # ── Install HAL driver (root) ──
@@ -25,6 +50,14 @@ rm -rf "$INSTALL_DIR/$DRIVER_NAME"
 cp -R "$DRIVER_SRC" "$INSTALL_DIR/$DRIVER_NAME"
 chown -R root:wheel "$INSTALL_DIR/$DRIVER_NAME"
 
+PLIST="$INSTALL_DIR/$DRIVER_NAME/Contents/Info.plist"
+if [[ -n "$FRAME_MS" ]]; then
+    /usr/libexec/PlistBuddy -c "Set :BungholeOpusFrameMs $FRAME_MS" "$PLIST"
+fi
+if [[ -n "$PACKETS_PER_WRITE" ]]; then
+    /usr/libexec/PlistBuddy -c "Set :BungholePacketsPerWrite $PACKETS_PER_WRITE" "$PLIST"
+fi
+
 echo "Removing quarantine attributes ..."
 xattr -dr com.apple.quarantine "$INSTALL_DIR/$DRIVER_NAME" 2>/dev/null || true
 
@@ -0,0 +1,215 @@
+package audio
+
+import (
+	"time"
+
+	"bunghole/internal/types"
+)
+
+// Jitter buffer sizing. Packets wait only while there is a hole in the
+// sequence: an in-order packet is passed on as soon as it arrives. The
+// wait adapts to the reordering seen on the link, between jitterMinWait
+// and jitterMaxWait.
+const (
+	jitterSlots   = 64 // packets held at most (~1.3s of 20ms frames)
+	jitterMinWait = 5 * time.Millisecond
+	jitterMaxWait = 80 * time.Millisecond
+	// jitterDecay is how often the wait shrinks by an eighth while no
+	// packet arrives out of order or late.
+	jitterDecay = time.Second
+	// jitterResync late packets in a row mean the sender restarted its
+	// sequence rather than the link delaying packets.
+	jitterResync = 8
+)
+
+type jitterSlot struct {
+	pkt *types.OpusPacket
+	seq uint32
+	at  time.Time // arrival
+}
+
+// jitterBuffer puts sequence-numbered packets back in order. A packet
+// that arrives out of order is held until the hole before it is filled,
+// or until it has waited the current reorder wait, at which point the
+// missing packets count as lost. Packets that arrive after their place
+// was given up are dropped as late, and make the wait longer.
+//
+// push and flush hand packets to emit in sequence order, with Lost set
+// to the number of sequence numbers skipped just before them. The zero
+// value is not ready to use; see newJitterBuffer. Not safe for concurrent
+// use.
+type jitterBuffer struct {
+	slots   [jitterSlots]jitterSlot
+	next    uint32 // next sequence number to emit
+	started bool
+	held    int
+	lateRun int // late packets in a row
+
+	wait     time.Duration
+	adjusted time.Time // last change to wait
+
+	// Totals for the stats line.
+	lost, late, reordered, duplicate uint64
+}
+
+func newJitterBuffer() *jitterBuffer {
+	return &jitterBuffer{wait: jitterMinWait}
+}
+
+// push adds pkt, which carries sequence number seq, and emits whatever
+// became ready.
+func (jb *jitterBuffer) push(pkt *types.OpusPacket, seq uint32, now time.Time, emit func(*types.OpusPacket)) {
+	if !jb.started {
+		jb.started = true
+		jb.next = seq
+		jb.adjusted = now
+	}
+
+	d := int32(seq - jb.next)
+	if d < 0 {
+		jb.lateRun++
+	} else {
+		jb.lateRun = 0
+	}
+	switch {
+	case d < -jitterSlots || (d < 0 && jb.lateRun > jitterResync):
+		// Far or persistently behind: the sender restarted. Pass on
+		// what is held and start over from this packet.
+		jb.drain(emit)
+		jb.next = seq
+		jb.lateRun = 0
+	case d < 0:
+		jb.late++
+		jb.grow(2*jb.wait, now)
+		pkt.Release()
+		return
+	case d >= jitterSlots:
+		// Far ahead: a long outage. Whatever is held is older than
+		// this packet, so it goes first.
+		jb.drain(emit)
+		jb.lost += uint64(seq - jb.next)
+		pkt.Lost = clampLost(seq - jb.next)
+		jb.next = seq
+	}
+
+	s := &jb.slots[seq%jitterSlots]
+	if s.pkt != nil {
+		jb.duplicate++
+		pkt.Release()
+		return
+	}
+	if first, ok := jb.firstHeldAfter(seq); ok {
+		// A later packet got here first: wait a little longer than this
+		// one was behind it.
+		jb.reordered++
+		jb.grow(now.Sub(first.at)*3/2, now)
+	}
+	*s = jitterSlot{pkt: pkt, seq: seq, at: now}
+	jb.held++
+	jb.flush(now, emit)
+}
+
+// flush emits the packets that are ready at now: the next one in
+// sequence, and any that have waited out the hole in front of them.
+func (jb *jitterBuffer) flush(now time.Time, emit func(*types.OpusPacket)) {
+	for jb.held > 0 {
+		s := &jb.slots[jb.next%jitterSlots]
+		if s.pkt == nil {
+			first, ok := jb.firstHeldAfter(jb.next)
+			if !ok || now.Sub(first.at) < jb.wait {
+				break
+			}
+			gap := first.seq - jb.next
+			jb.lost += uint64(gap)
+			first.pkt.Lost += clampLost(gap)
+			jb.next = first.seq
+			continue
+		}
+		jb.emitSlot(s, emit)
+	}
+	if jb.wait > jitterMinWait && now.Sub(jb.adjusted) >= jitterDecay {
+		jb.wait -= jb.wait / 8
+		if jb.wait < jitterMinWait {
+			jb.wait = jitterMinWait
+		}
+		jb.adjusted = now
+	}
+}
+
+// deadline is when the packets held behind a hole will be given up on,
+// or the zero time if nothing is waiting.
+func (jb *jitterBuffer) deadline() time.Time {
+	if jb.held == 0 {
+		return time.Time{}
+	}
+	first, ok := jb.firstHeldAfter(jb.next)
+	if !ok {
+		return time.Time{}
+	}
+	return first.at.Add(jb.wait)
+}
+
+// close releases the packets still held.
+func (jb *jitterBuffer) close() {
+	for i := range jb.slots {
+		if jb.slots[i].pkt != nil {
+			jb.slots[i].pkt.Release()
+			jb.slots[i] = jitterSlot{}
+		}
+	}
+	jb.held = 0
+}
+
+// drain emits everything held, in sequence order, counting the holes
+// between them as lost.
+func (jb *jitterBuffer) drain(emit func(*types.OpusPacket)) {
+	for jb.held > 0 {
+		s := &jb.slots[jb.next%jitterSlots]
+		if s.pkt == nil {
+			first, _ := jb.firstHeldAfter(jb.next)
+			gap := first.seq - jb.next
+			jb.lost += uint64(gap)
+			first.pkt.Lost += clampLost(gap)
+			jb.next = first.seq
+			continue
+		}
+		jb.emitSlot(s, emit)
+	}
+}
+
+func (jb *jitterBuffer) emitSlot(s *jitterSlot, emit func(*types.OpusPacket)) {
+	pkt := s.pkt
+	*s = jitterSlot{}
+	jb.held--
+	jb.next++
+	emit(pkt)
+}
+
+// firstHeldAfter returns the held packet with the lowest sequence number
+// at or after seq.
+func (jb *jitterBuffer) firstHeldAfter(seq uint32) (*jitterSlot, bool) {
+	for i := uint32(0); i < jitterSlots; i++ {
+		s := &jb.slots[(seq+i)%jitterSlots]
+		if s.pkt != nil && s.seq == seq+i {
+			return s, true
+		}
+	}
+	return nil, false
+}
+
+func (jb *jitterBuffer) grow(wait time.Duration, now time.Time) {
+	if wait > jitterMaxWait {
+		wait = jitterMaxWait
+	}
+	if wait > jb.wait {
+		jb.wait = wait
+	}
+	jb.adjusted = now
+}
+
+func clampLost(n uint32) int {
+	if n > jitterSlots {
+		return jitterSlots
+	}
+	return int(n)
+}
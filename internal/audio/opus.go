@@ -0,0 +1,100 @@
+//go:build linux || darwin
+
+package audio
+
+import (
+	"fmt"
+	"log"
+	"sync/atomic"
+	"time"
+
+	"github.com/hraban/opus"
+)
+
+// Settings for the Opus encoders bunghole runs itself (PulseAudio and
+// ScreenCaptureKit capture). Guest audio arriving over UDP or vsock is
+// already encoded and passed through as is.
+var (
+	opusFrame = 20 * time.Millisecond
+	opusFEC   = true
+	opusDTX   bool
+)
+
+// SetOpusFrame sets the Opus frame duration: 2.5, 5, 10 or 20ms. Shorter
+// frames cut capture-to-send latency and cost bitrate efficiency; in-band
+// FEC needs 10ms or more.
+func SetOpusFrame(d time.Duration) error {
+	switch d {
+	case 2500 * time.Microsecond, 5 * time.Millisecond, 10 * time.Millisecond, 20 * time.Millisecond:
+	default:
+		return fmt.Errorf("Opus frame must be 2.5ms, 5ms, 10ms or 20ms, got %v", d)
+	}
+	opusFrame = d
+	return nil
+}
+
+// SetOpusFEC toggles Opus in-band forward error correction.
+func SetOpusFEC(enabled bool) {
+	opusFEC = enabled
+}
+
+// SetOpusDTX toggles Opus discontinuous transmission: silent stretches are
+// sent as empty frames, which the pipeline does not put on the wire.
+func SetOpusDTX(enabled bool) {
+	opusDTX = enabled
+}
+
+// frameSamples is the number of samples per channel in one Opus frame.
+func frameSamples() int {
+	return int(opusFrame * sampleRate / time.Second)
+}
+
+// newOpusEncoder creates an encoder with the configured settings. Frames
+// under 10ms are CELT-only, so those use the low-delay application, which
+// also skips SILK's lookahead.
+func newOpusEncoder() (*opus.Encoder, error) {
+	app := opus.AppAudio
+	if opusFrame < 10*time.Millisecond {
+		app = opus.AppRestrictedLowdelay
+		if opusFEC {
+			log.Printf("audio: in-band FEC needs 10ms frames or longer, disabled at %v", opusFrame)
+		}
+	}
+	enc, err := opus.NewEncoder(sampleRate, channels, app)
+	if err != nil {
+		return nil, err
+	}
+	if err := enc.SetInBandFEC(opusFEC && app == opus.AppAudio); err != nil {
+		return nil, fmt.Errorf("set FEC: %w", err)
+	}
+	if err := enc.SetDTX(opusDTX); err != nil {
+		return nil, fmt.Errorf("set DTX: %w", err)
+	}
+	return enc, nil
+}
+
+// expectedLoss carries the receivers' packet loss to the encode loop, which
+// owns the encoder. -1 means unchanged since the last take.
+type expectedLoss struct {
+	pending atomic.Int32
+}
+
+func newExpectedLoss() *expectedLoss {
+	l := &expectedLoss{}
+	l.pending.Store(-1)
+	return l
+}
+
+func (l *expectedLoss) set(percent int) {
+	l.pending.Store(int32(min(max(percent, 0), 100)))
+}
+
+// apply passes a pending loss rate to enc. With FEC on, libopus spends more
+// of the bitrate on redundancy as the expected loss goes up.
+func (l *expectedLoss) apply(enc *opus.Encoder) {
+	if p := l.pending.Swap(-1); p >= 0 {
+		if err := enc.SetPacketLossPerc(int(p)); err != nil {
+			log.Printf("audio: set packet loss: %v", err)
+		}
+	}
+}
@@ -6,8 +6,9 @@ import (
 	"encoding/binary"
 	"fmt"
 	"log"
-	"sync"
+	"sync/atomic"
 	"time"
+	"unsafe"
 
 	"bunghole/internal/types"
 
@@ -17,34 +18,90 @@ import (
 )
 
 const (
-	sampleRate    = 48000
-	channels      = 2
-	frameDuration = 20 // ms
-	frameSize     = sampleRate * frameDuration / 1000 // 960 samples per channel
+	sampleRate = 48000
+	channels   = 2
 )
 
 type AudioCapture struct {
 	client  *pulse.Client
 	stream  *pulse.RecordStream
 	encoder *opus.Encoder
+	loss    *expectedLoss
 }
 
-// pcmCollector implements pulse.Writer — receives raw PCM from PulseAudio
+const (
+	// pcmRingSamples is the ring capacity in int16 samples (~340ms of
+	// stereo). It only fills if the encode loop stalls; the latency bound
+	// below trims it long before that in normal operation.
+	pcmRingSamples = 1 << 15
+	// pcmMaxLatency bounds how far the encoder may fall behind PulseAudio
+	// (a stalled encode loop); past it the oldest audio is dropped.
+	pcmMaxLatency = 60 * sampleRate / 1000 * channels
+)
+
+// pcmCollector implements pulse.Writer. It keeps the S16LE samples from
+// PulseAudio in a fixed-size single-producer/single-consumer ring (the
+// pulse client goroutine writes, the encode loop reads), the same layout
+// as the ring in BungholeAudioDriver.c: free-running head and tail
+// counters, with the index taken modulo the power-of-two capacity.
+// Write signals ready once a whole Opus frame is buffered, so the encode
+// loop runs as soon as PulseAudio delivers rather than on a timer.
 type pcmCollector struct {
-	mu     sync.Mutex
 	buf    []int16
+	head   atomic.Uint64 // samples written (producer)
+	tail   atomic.Uint64 // samples read or dropped (consumer)
 	format byte
+	frame  uint64        // samples per Opus frame, all channels
+	ready  chan struct{} // capacity 1; a frame is buffered
+
+	overruns atomic.Uint64 // samples the producer dropped because the ring was full
+}
+
+func newPCMCollector(frame int) *pcmCollector {
+	return &pcmCollector{
+		buf:    make([]int16, pcmRingSamples),
+		format: proto.FormatInt16LE,
+		frame:  uint64(frame),
+		ready:  make(chan struct{}, 1),
+	}
 }
 
+// hostLittleEndian reports whether S16LE can be copied into []int16 as is.
+var hostLittleEndian = binary.NativeEndian.Uint16([]byte{1, 0}) == 1
+
 func (p *pcmCollector) Write(data []byte) (int, error) {
-	p.mu.Lock()
-	defer p.mu.Unlock()
-
-	// Convert bytes to int16 samples (S16LE)
-	n := len(data) / 2
-	for i := 0; i < n; i++ {
-		sample := int16(binary.LittleEndian.Uint16(data[i*2 : i*2+2]))
-		p.buf = append(p.buf, sample)
+	n := uint64(len(data) / 2)
+	h := p.head.Load()
+	t := p.tail.Load()
+	if free := uint64(len(p.buf)) - (h - t); n > free {
+		// The consumer isn't keeping up at all. It drops the oldest
+		// audio when it catches up; here only the overflow is lost.
+		free -= free % channels
+		p.overruns.Add(n - free)
+		n = free
+	}
+
+	mask := uint64(len(p.buf) - 1)
+	for done := uint64(0); done < n; {
+		idx := (h + done) & mask
+		chunk := min(n-done, uint64(len(p.buf))-idx)
+		dst := p.buf[idx : idx+chunk]
+		src := data[done*2 : (done+chunk)*2]
+		if hostLittleEndian {
+			copy(unsafe.Slice((*byte)(unsafe.Pointer(&dst[0])), len(src)), src)
+		} else {
+			for i := range dst {
+				dst[i] = int16(binary.LittleEndian.Uint16(src[i*2:]))
+			}
+		}
+		done += chunk
+	}
+	p.head.Store(h + n)
+	if h+n-p.tail.Load() >= p.frame {
+		select {
+		case p.ready <- struct{}{}:
+		default:
+		}
 	}
 	return len(data), nil
 }
@@ -53,29 +110,53 @@ func (p *pcmCollector) Format() byte {
 	return p.format
 }
 
-// drain returns up to `count` int16 samples, removing them from the buffer
-func (p *pcmCollector) drain(count int) []int16 {
-	p.mu.Lock()
-	defer p.mu.Unlock()
+// drain fills dst with the next len(dst) samples and reports whether there
+// were enough. If more than pcmMaxLatency is buffered, the oldest samples
+// are skipped first so that about one frame of slack remains after this
+// read. skipped counts the samples lost since the last call, here or by
+// the producer on overflow.
+func (p *pcmCollector) drain(dst []int16) (ok bool, skipped int) {
+	h := p.head.Load()
+	t := p.tail.Load()
+	count := uint64(len(dst))
+	if avail := h - t; avail > pcmMaxLatency {
+		// Skip whole frames so the channels stay interleaved.
+		skip := (avail - 2*count) / count * count
+		t += skip
+		skipped = int(skip)
+	}
+	skipped += int(p.overruns.Swap(0))
+	if h-t < count {
+		return false, skipped
+	}
 
-	if len(p.buf) < count {
-		return nil
+	mask := uint64(len(p.buf) - 1)
+	for done := uint64(0); done < count; {
+		idx := (t + done) & mask
+		done += uint64(copy(dst[done:], p.buf[idx:]))
 	}
-	out := make([]int16, count)
-	copy(out, p.buf[:count])
-	p.buf = p.buf[count:]
-	return out
+	p.tail.Store(t + count)
+	return true, skipped
 }
 
 func NewAudioCapture() (types.AudioCapturer, error) {
-	client, err := pulse.NewClient(
-		pulse.ClientApplicationName("bunghole"),
-	)
+	return NewAudioCaptureFrom("")
+}
+
+// NewAudioCaptureFrom records from the PulseAudio server at server (a
+// server string such as "unix:/run/user/1000/pulse/native"), or from the
+// default one ($PULSE_SERVER) if server is empty.
+func NewAudioCaptureFrom(server string) (types.AudioCapturer, error) {
+	opts := []pulse.ClientOption{pulse.ClientApplicationName("bunghole")}
+	if server != "" {
+		opts = append(opts, pulse.ClientServerString(server))
+	}
+	client, err := pulse.NewClient(opts...)
 	if err != nil {
 		return nil, fmt.Errorf("pulse connect: %w", err)
 	}
 
-	enc, err := opus.NewEncoder(sampleRate, channels, opus.AppAudio)
+	enc, err := newOpusEncoder()
 	if err != nil {
 		client.Close()
 		return nil, fmt.Errorf("opus encoder: %w", err)
@@ -84,15 +165,15 @@ func NewAudioCapture() (types.AudioCapturer, error) {
 	ac := &AudioCapture{
 		client:  client,
 		encoder: enc,
+		loss:    newExpectedLoss(),
 	}
 
 	return ac, nil
 }
 
 func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct{}) {
-	collector := &pcmCollector{
-		format: proto.FormatInt16LE,
-	}
+	pcm := make([]int16, frameSamples()*channels)
+	collector := newPCMCollector(len(pcm))
 
 	// Get default sink for monitor recording
 	sink, err := ac.client.DefaultSink()
@@ -106,7 +187,7 @@ func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct
 		pulse.RecordMonitor(sink),
 		pulse.RecordStereo,
 		pulse.RecordSampleRate(sampleRate),
-		pulse.RecordBufferFragmentSize(uint32(frameSize*channels*2)),
+		pulse.RecordBufferFragmentSize(uint32(len(pcm)*2)),
 	)
 	if err != nil {
 		log.Printf("audio: failed to create record stream: %v", err)
@@ -116,41 +197,49 @@ func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct
 	stream.Start()
 
 	opusBuf := make([]byte, 4000)
-	samplesPerFrame := frameSize * channels // 960 * 2 = 1920 int16 samples per 20ms stereo frame
-
-	ticker := time.NewTicker(time.Duration(frameDuration) * time.Millisecond)
-	defer ticker.Stop()
+	var pool types.PacketPool
 
 	for {
 		select {
 		case <-stop:
 			return
-		case <-ticker.C:
-			pcm := collector.drain(samplesPerFrame)
-			if pcm == nil {
-				continue
+		case <-collector.ready:
+		}
+
+		// A chunk from PulseAudio may hold several frames.
+		for {
+			ok, skipped := collector.drain(pcm)
+			if skipped > 0 {
+				log.Printf("audio: encoder fell behind, dropped %v of PCM",
+					time.Duration(skipped/channels)*time.Second/sampleRate)
+			}
+			if !ok {
+				break
 			}
 
+			ac.loss.apply(ac.encoder)
 			encoded, err := ac.encoder.Encode(pcm, opusBuf)
 			if err != nil {
 				log.Printf("opus encode: %v", err)
 				continue
 			}
 
-			pkt := &types.OpusPacket{
-				Data:     make([]byte, encoded),
-				Duration: time.Duration(frameDuration) * time.Millisecond,
-			}
+			pkt := pool.Opus(encoded)
+			pkt.Duration = opusFrame
 			copy(pkt.Data, opusBuf[:encoded])
 
 			select {
 			case packets <- pkt:
 			default:
+				pkt.Release()
 			}
 		}
 	}
 }
 
+// SetPacketLoss tunes the encoder's expected loss from receiver reports.
+func (ac *AudioCapture) SetPacketLoss(percent int) { ac.loss.set(percent) }
+
 func (ac *AudioCapture) Close() {
 	if ac.stream != nil {
 		ac.stream.Stop()
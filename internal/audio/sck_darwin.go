@@ -34,26 +34,31 @@ import (
 )
 
 const (
-	sampleRate    = 48000
-	channels      = 2
-	frameDuration = 20                                // ms
-	frameSize     = sampleRate * frameDuration / 1000 // 960 samples/channel
+	sampleRate = 48000
+	channels   = 2
 )
 
 type AudioCapture struct {
 	handle        C.SCKAudioCaptureHandle
 	encoder       *opus.Encoder
+	loss          *expectedLoss
 	source        string
 	fallbackTried bool
 }
 
+// NewAudioCaptureFrom is NewAudioCapture. server selects a PulseAudio
+// server on Linux; ScreenCaptureKit has only the one source.
+func NewAudioCaptureFrom(server string) (types.AudioCapturer, error) {
+	return NewAudioCapture()
+}
+
 func NewAudioCapture() (types.AudioCapturer, error) {
-	enc, err := opus.NewEncoder(sampleRate, channels, opus.AppAudio)
+	enc, err := newOpusEncoder()
 	if err != nil {
 		return nil, fmt.Errorf("opus encoder: %w", err)
 	}
 
-	ac := &AudioCapture{encoder: enc}
+	ac := &AudioCapture{encoder: enc, loss: newExpectedLoss()}
 	var vmErr error
 
 	if g := vm.GetGlobal(); g != nil && g.WindowID != 0 {
@@ -79,9 +84,14 @@ func NewAudioCapture() (types.AudioCapturer, error) {
 
 func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct{}) {
 	opusBuf := make([]byte, 4000)
+	var pool types.PacketPool
+	frameSize := frameSamples()
 	pcmBuf := make([]int16, frameSize*channels)
-	ticker := time.NewTicker(time.Duration(frameDuration) * time.Millisecond)
+	// The SCK callback fills a ring on its own queue; it is polled once
+	// per Opus frame.
+	ticker := time.NewTicker(opusFrame)
 	defer ticker.Stop()
+	framesIn := func(d time.Duration) int { return int(d / opusFrame) }
 
 	emptyReads := 0
 	silentFrames := 0
@@ -117,7 +127,7 @@ func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct
 			if ret != 0 {
 				emptyReads++
 				// Window-audio streams can come up "alive" but deliver no samples.
-				if ac.source == "vm-window" && !ac.fallbackTried && emptyReads >= 300 {
+				if ac.source == "vm-window" && !ac.fallbackTried && emptyReads >= framesIn(6*time.Second) {
 					fallbackToDisplay("vm-window yielded no frames for ~6s")
 				}
 				continue
@@ -149,31 +159,34 @@ func (ac *AudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan struct
 				}
 			}
 
-			if ac.source == "vm-window" && !ac.fallbackTried && !seenAudible && silentFrames >= 200 {
+			if ac.source == "vm-window" && !ac.fallbackTried && !seenAudible && silentFrames >= framesIn(4*time.Second) {
 				fallbackToDisplay("vm-window produced only silence for ~4s")
 				continue
 			}
 
+			ac.loss.apply(ac.encoder)
 			encoded, err := ac.encoder.Encode(pcmBuf, opusBuf)
 			if err != nil {
 				log.Printf("opus encode: %v", err)
 				continue
 			}
 
-			pkt := &types.OpusPacket{
-				Data:     make([]byte, encoded),
-				Duration: time.Duration(frameDuration) * time.Millisecond,
-			}
+			pkt := pool.Opus(encoded)
+			pkt.Duration = opusFrame
 			copy(pkt.Data, opusBuf[:encoded])
 
 			select {
 			case packets <- pkt:
 			default:
+				pkt.Release()
 			}
 		}
 	}
 }
 
+// SetPacketLoss tunes the encoder's expected loss from receiver reports.
+func (ac *AudioCapture) SetPacketLoss(percent int) { ac.loss.set(percent) }
+
 func (ac *AudioCapture) Close() {
 	C.sck_audio_stop(&ac.handle)
 }
@@ -0,0 +1,111 @@
+//go:build linux
+
+package audio
+
+import (
+	"net"
+	"os"
+	"syscall"
+	"unsafe"
+)
+
+// mmsghdr is struct mmsghdr from <sys/socket.h>.
+type mmsghdr struct {
+	Hdr syscall.Msghdr
+	Len uint32
+}
+
+// mmsgReader receives up to udpBatch datagrams per recvmmsg(2) call into
+// buffers allocated once up front.
+type mmsgReader struct {
+	rc    syscall.RawConn
+	bufs  [][]byte
+	hdrs  []mmsghdr
+	iovs  []syscall.Iovec
+	names []syscall.RawSockaddrAny
+}
+
+func newDatagramReader(conn net.PacketConn) datagramReader {
+	uc, ok := conn.(*net.UDPConn)
+	if !ok {
+		return newReadFromReader(conn)
+	}
+	rc, err := uc.SyscallConn()
+	if err != nil {
+		return newReadFromReader(conn)
+	}
+	r := &mmsgReader{
+		rc:    rc,
+		bufs:  make([][]byte, udpBatch),
+		hdrs:  make([]mmsghdr, udpBatch),
+		iovs:  make([]syscall.Iovec, udpBatch),
+		names: make([]syscall.RawSockaddrAny, udpBatch),
+	}
+	slab := make([]byte, udpBatch*udpMaxDatagram)
+	for i := range r.hdrs {
+		r.bufs[i] = slab[i*udpMaxDatagram : (i+1)*udpMaxDatagram]
+		r.iovs[i].Base = &r.bufs[i][0]
+		r.iovs[i].SetLen(udpMaxDatagram)
+		r.hdrs[i].Hdr.Name = (*byte)(unsafe.Pointer(&r.names[i]))
+		r.hdrs[i].Hdr.Iov = &r.iovs[i]
+		r.hdrs[i].Hdr.Iovlen = 1
+	}
+	return r
+}
+
+func (r *mmsgReader) read() (int, error) {
+	var n int
+	var errno syscall.Errno
+	err := r.rc.Read(func(fd uintptr) bool {
+		for i := range r.hdrs {
+			r.hdrs[i].Hdr.Namelen = syscall.SizeofSockaddrAny
+			r.hdrs[i].Hdr.Flags = 0
+		}
+		for {
+			n0, _, e := syscall.Syscall6(syscall.SYS_RECVMMSG, fd,
+				uintptr(unsafe.Pointer(&r.hdrs[0])), uintptr(len(r.hdrs)),
+				syscall.MSG_DONTWAIT, 0, 0)
+			if e == syscall.EINTR {
+				continue
+			}
+			if e == syscall.EAGAIN {
+				return false // wait for the socket to become readable
+			}
+			n, errno = int(n0), e
+			return true
+		}
+	})
+	if err != nil {
+		return 0, err
+	}
+	if errno != 0 {
+		return 0, os.NewSyscallError("recvmmsg", errno)
+	}
+	return n, nil
+}
+
+func (r *mmsgReader) datagram(i int) []byte {
+	n := int(r.hdrs[i].Len)
+	if r.hdrs[i].Hdr.Flags&syscall.MSG_TRUNC != 0 {
+		return nil
+	}
+	return r.bufs[i][:n]
+}
+
+func (r *mmsgReader) from(i int) net.Addr {
+	switch sa := &r.names[i]; sa.Addr.Family {
+	case syscall.AF_INET:
+		in := (*syscall.RawSockaddrInet4)(unsafe.Pointer(sa))
+		return &net.UDPAddr{IP: net.IP(in.Addr[:]).To16(), Port: netPort(&in.Port)}
+	case syscall.AF_INET6:
+		in := (*syscall.RawSockaddrInet6)(unsafe.Pointer(sa))
+		return &net.UDPAddr{IP: append(net.IP(nil), in.Addr[:]...), Port: netPort(&in.Port)}
+	}
+	return nil
+}
+
+// netPort reads a port stored in network byte order.
+func netPort(p *uint16) int {
+	b := (*[2]byte)(unsafe.Pointer(p))
+	return int(b[0])<<8 | int(b[1])
+}
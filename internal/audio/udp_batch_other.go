@@ -0,0 +1,9 @@
+//go:build !linux
+
+package audio
+
+import "net"
+
+func newDatagramReader(conn net.PacketConn) datagramReader {
+	return newReadFromReader(conn)
+}
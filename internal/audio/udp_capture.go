@@ -5,6 +5,7 @@ import (
 	"fmt"
 	"log"
 	"net"
+	"os"
 	"strings"
 	"sync"
 	"sync/atomic"
@@ -13,8 +14,50 @@ import (
 	"bunghole/internal/types"
 )
 
-const udpOpusFrameDuration = 20 * time.Millisecond
+// Datagrams are read udpBatch at a time where the platform can (recvmmsg
+// on Linux). udpMaxDatagram bounds a datagram; longer ones are dropped.
+const (
+	udpBatch       = 32
+	udpMaxDatagram = 4096
+)
+
+// datagramReader reads a batch of datagrams into buffers it owns. The
+// slices returned by datagram stay valid until the next read.
+type datagramReader interface {
+	read() (n int, err error)
+	datagram(i int) []byte
+	from(i int) net.Addr
+}
+
+// readFromReader reads one datagram per ReadFrom call.
+type readFromReader struct {
+	conn net.PacketConn
+	buf  []byte
+	n    int
+	addr net.Addr
+}
+
+func newReadFromReader(conn net.PacketConn) *readFromReader {
+	return &readFromReader{conn: conn, buf: make([]byte, udpMaxDatagram)}
+}
 
+func (r *readFromReader) read() (int, error) {
+	n, addr, err := r.conn.ReadFrom(r.buf)
+	if err != nil {
+		return 0, err
+	}
+	r.n, r.addr = n, addr
+	return 1, nil
+}
+
+func (r *readFromReader) datagram(int) []byte { return r.buf[:r.n] }
+
+func (r *readFromReader) from(int) net.Addr { return r.addr }
+
+// UDPAudioCapture receives Opus packets from a guest agent. Datagrams with
+// a sequence header (see AppendUDPSeqHeader) go through a jitterBuffer,
+// so reordered packets are put back in order and losses reach the track
+// as timestamp gaps; bare datagrams are passed on in arrival order.
 type UDPAudioCapture struct {
 	conn net.PacketConn
 	once sync.Once
@@ -52,8 +95,8 @@ func (ac *UDPAudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan str
 		ac.Close()
 	}()
 
-	var totalPackets int64
-	var totalBytes int64
+	var totalPackets, totalBytes int64
+	var lost, late, reordered, waitNs int64
 	go func() {
 		ticker := time.NewTicker(5 * time.Second)
 		defer ticker.Stop()
@@ -66,44 +109,74 @@ func (ac *UDPAudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan str
 			case <-ticker.C:
 				p := atomic.LoadInt64(&totalPackets)
 				b := atomic.LoadInt64(&totalBytes)
-				log.Printf("audio: guest-udp stats pps=%d bps=%d total_packets=%d total_bytes=%d",
-					(p-lastPackets)/5, (b-lastBytes)/5, p, b)
+				log.Printf("audio: guest-udp stats pps=%d bps=%d total_packets=%d total_bytes=%d lost=%d late=%d reordered=%d reorder_wait=%s",
+					(p-lastPackets)/5, (b-lastBytes)/5, p, b,
+					atomic.LoadInt64(&lost), atomic.LoadInt64(&late), atomic.LoadInt64(&reordered),
+					time.Duration(atomic.LoadInt64(&waitNs)))
 				lastPackets = p
 				lastBytes = b
 			}
 		}
 	}()
 
-	buf := make([]byte, 4096)
+	var pool types.PacketPool
+	emit := func(pkt *types.OpusPacket) {
+		select {
+		case packets <- pkt:
+		default:
+			pkt.Release()
+		}
+	}
+	jb := newJitterBuffer()
+	defer jb.close()
+
+	rd := newDatagramReader(ac.conn)
+	var deadline time.Time
 	seenFirst := false
 	for {
-		n, addr, err := ac.conn.ReadFrom(buf)
+		n, err := rd.read()
+		now := time.Now()
 		if err != nil {
 			if errors.Is(err, net.ErrClosed) {
 				return
 			}
-			log.Printf("audio: udp read error: %v", err)
-			continue
-		}
-		if n <= 0 {
-			continue
-		}
-		if !seenFirst {
-			seenFirst = true
-			log.Printf("audio: first guest-udp packet from %s (%d bytes)", addr.String(), n)
+			// A deadline only runs out when held packets are due.
+			if !errors.Is(err, os.ErrDeadlineExceeded) {
+				log.Printf("audio: udp read error: %v", err)
+				continue
+			}
 		}
-		atomic.AddInt64(&totalPackets, 1)
-		atomic.AddInt64(&totalBytes, int64(n))
+		for i := 0; i < n; i++ {
+			b := rd.datagram(i)
+			if len(b) == 0 {
+				continue
+			}
+			if !seenFirst {
+				seenFirst = true
+				log.Printf("audio: first guest-udp packet from %v (%d bytes)", rd.from(i), len(b))
+			}
+			atomic.AddInt64(&totalPackets, 1)
+			atomic.AddInt64(&totalBytes, int64(len(b)))
 
-		pkt := &types.OpusPacket{
-			Data:     make([]byte, n),
-			Duration: udpOpusFrameDuration,
+			seq, data, sequenced := parseUDPSeqHeader(b)
+			pkt := pool.Opus(len(data))
+			pkt.Duration = udpPacketDuration(data)
+			copy(pkt.Data, data)
+			if sequenced {
+				jb.push(pkt, seq, now, emit)
+			} else {
+				emit(pkt)
+			}
 		}
-		copy(pkt.Data, buf[:n])
+		jb.flush(now, emit)
+		atomic.StoreInt64(&lost, int64(jb.lost))
+		atomic.StoreInt64(&late, int64(jb.late))
+		atomic.StoreInt64(&reordered, int64(jb.reordered))
+		atomic.StoreInt64(&waitNs, int64(jb.wait))
 
-		select {
-		case packets <- pkt:
-		default:
+		if dl := jb.deadline(); !dl.Equal(deadline) {
+			deadline = dl
+			_ = ac.conn.SetReadDeadline(dl)
 		}
 	}
 }
@@ -0,0 +1,45 @@
+package audio
+
+import (
+	"encoding/binary"
+	"time"
+)
+
+// Guest agents may prefix each UDP datagram with a sequence header so the
+// host can put reordered packets back in order and tell losses apart from
+// DTX gaps: the 3-byte magic "BHA", a version byte (1) and a 4-byte
+// big-endian sequence number, then the Opus packet. Datagrams without the
+// magic are taken to be bare Opus packets.
+const (
+	udpSeqMagic      = "BHA"
+	udpSeqVersion    = 1
+	UDPSeqHeaderSize = 8
+)
+
+// AppendUDPSeqHeader appends the sequence header for packet seq to dst.
+func AppendUDPSeqHeader(dst []byte, seq uint32) []byte {
+	dst = append(dst, udpSeqMagic...)
+	dst = append(dst, udpSeqVersion)
+	return binary.BigEndian.AppendUint32(dst, seq)
+}
+
+// parseUDPSeqHeader splits a datagram into its sequence number and Opus
+// packet. ok is false for bare Opus datagrams, which are returned whole.
+func parseUDPSeqHeader(b []byte) (seq uint32, pkt []byte, ok bool) {
+	if len(b) <= UDPSeqHeaderSize || string(b[:3]) != udpSeqMagic || b[3] != udpSeqVersion {
+		return 0, b, false
+	}
+	return binary.BigEndian.Uint32(b[4:]), b[UDPSeqHeaderSize:], true
+}
+
+// udpOpusFrameDuration is assumed for packets whose TOC can't be read.
+const udpOpusFrameDuration = 20 * time.Millisecond
+
+// udpPacketDuration is the duration of an Opus packet from its TOC byte,
+// or udpOpusFrameDuration if it is malformed.
+func udpPacketDuration(pkt []byte) time.Duration {
+	if d := opusPacketDuration(pkt); d > 0 {
+		return d
+	}
+	return udpOpusFrameDuration
+}
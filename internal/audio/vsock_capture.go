@@ -5,15 +5,21 @@ package audio
 import (
 	"log"
 	"net"
+	"sync"
 	"time"
 
 	"bunghole/internal/types"
 )
 
+// vsockOpusFrameDuration is assumed for packets whose TOC can't be read.
 const vsockOpusFrameDuration = 20 * time.Millisecond
 
 type VsockAudioCapture struct {
 	connCh <-chan net.Conn
+
+	mu       sync.Mutex
+	stats    types.GuestAudioStats
+	hasStats bool
 }
 
 func NewVsockAudioCapture(connCh <-chan net.Conn) *VsockAudioCapture {
@@ -39,6 +45,8 @@ func (ac *VsockAudioCapture) Run(packets chan<- *types.OpusPacket, stop <-chan s
 func (ac *VsockAudioCapture) readLoop(conn net.Conn, packets chan<- *types.OpusPacket, stop <-chan struct{}) {
 	defer conn.Close()
 
+	buf := make([]byte, maxFrameSize)
+	var pool types.PacketPool
 	seenFirst := false
 	for {
 		select {
@@ -47,26 +55,49 @@ func (ac *VsockAudioCapture) readLoop(conn net.Conn, packets chan<- *types.OpusP
 		default:
 		}
 
-		data, err := ReadFrame(conn)
+		data, isStats, err := readFlaggedFrameInto(conn, buf)
 		if err != nil {
 			return
 		}
+		if isStats {
+			st, err := parseGuestStats(data)
+			if err != nil {
+				log.Printf("audio: vsock: %v", err)
+				continue
+			}
+			ac.mu.Lock()
+			ac.stats, ac.hasStats = st, true
+			ac.mu.Unlock()
+			continue
+		}
 
 		if !seenFirst {
 			seenFirst = true
 			log.Printf("audio: first vsock packet (%d bytes)", len(data))
 		}
 
-		pkt := &types.OpusPacket{
-			Data:     data,
-			Duration: vsockOpusFrameDuration,
+		pkt := pool.Opus(len(data))
+		// The HAL driver's frame size is configurable, so every packet
+		// carries its own duration.
+		pkt.Duration = opusPacketDuration(data)
+		if pkt.Duration == 0 {
+			pkt.Duration = vsockOpusFrameDuration
 		}
+		copy(pkt.Data, data)
 
 		select {
 		case packets <- pkt:
 		default:
+			pkt.Release()
 		}
 	}
 }
 
+// GuestAudioStats returns the HAL driver's last stats record.
+func (ac *VsockAudioCapture) GuestAudioStats() (types.GuestAudioStats, bool) {
+	ac.mu.Lock()
+	defer ac.mu.Unlock()
+	return ac.stats, ac.hasStats
+}
+
 func (ac *VsockAudioCapture) Close() {}
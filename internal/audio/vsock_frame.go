@@ -4,10 +4,17 @@ import (
 	"encoding/binary"
 	"fmt"
 	"io"
+	"time"
+
+	"bunghole/internal/types"
 )
 
 const maxFrameSize = 1500
 
+// frameStatsFlag marks a frame from the guest HAL driver as a stats record
+// rather than an Opus packet (see guestStatsSize).
+const frameStatsFlag = 0x8000
+
 // WriteFrame writes a length-prefixed frame: [2-byte big-endian length][payload].
 func WriteFrame(w io.Writer, data []byte) error {
 	if len(data) > maxFrameSize {
@@ -24,17 +31,88 @@ func WriteFrame(w io.Writer, data []byte) error {
 
 // ReadFrame reads a length-prefixed frame from a stream.
 func ReadFrame(r io.Reader) ([]byte, error) {
-	var hdr [2]byte
-	if _, err := io.ReadFull(r, hdr[:]); err != nil {
-		return nil, err
+	return ReadFrameInto(r, make([]byte, maxFrameSize))
+}
+
+// ReadFrameInto reads a length-prefixed frame into buf, which must hold
+// maxFrameSize bytes, and returns the payload slice of buf. The header is
+// read through buf as well, so a read loop allocates nothing per frame.
+func ReadFrameInto(r io.Reader, buf []byte) ([]byte, error) {
+	data, stats, err := readFlaggedFrameInto(r, buf)
+	if err == nil && stats {
+		return nil, fmt.Errorf("unexpected stats frame")
 	}
-	n := binary.BigEndian.Uint16(hdr[:])
+	return data, err
+}
+
+// readFlaggedFrameInto is ReadFrameInto for streams that may interleave
+// stats frames; stats reports whether the frame carried frameStatsFlag.
+func readFlaggedFrameInto(r io.Reader, buf []byte) (data []byte, stats bool, err error) {
+	if _, err := io.ReadFull(r, buf[:2]); err != nil {
+		return nil, false, err
+	}
+	n := binary.BigEndian.Uint16(buf[:2])
+	stats = n&frameStatsFlag != 0
+	n &^= frameStatsFlag
 	if n == 0 || int(n) > maxFrameSize {
-		return nil, fmt.Errorf("invalid frame length: %d", n)
+		return nil, false, fmt.Errorf("invalid frame length: %d", n)
+	}
+	if _, err := io.ReadFull(r, buf[:n]); err != nil {
+		return nil, false, err
+	}
+	return buf[:n], stats, nil
+}
+
+// guestStatsSize is the size of a version 1 stats record: version u8,
+// frame size u16, ring fill u32, ring peak u32, then output overruns,
+// input underruns and packets sent as u64, all big-endian. Sizes are in
+// frames at the driver's 48 kHz.
+const (
+	guestStatsSize  = 35
+	guestSampleRate = 48000
+)
+
+func parseGuestStats(b []byte) (types.GuestAudioStats, error) {
+	if len(b) < guestStatsSize || b[0] != 1 {
+		return types.GuestAudioStats{}, fmt.Errorf("unsupported stats record (%d bytes, version %d)", len(b), b[0])
+	}
+	be := binary.BigEndian
+	return types.GuestAudioStats{
+		FrameDuration: time.Duration(be.Uint16(b[1:])) * time.Second / guestSampleRate,
+		RingFill:      int(be.Uint32(b[3:])),
+		RingPeak:      int(be.Uint32(b[7:])),
+		Overruns:      be.Uint64(b[11:]),
+		Underruns:     be.Uint64(b[19:]),
+		Packets:       be.Uint64(b[27:]),
+	}, nil
+}
+
+// opusPacketDuration reads the duration of an Opus packet from its TOC
+// byte (RFC 6716 section 3.1), or returns 0 if the packet is malformed.
+func opusPacketDuration(pkt []byte) time.Duration {
+	if len(pkt) == 0 {
+		return 0
+	}
+	toc := pkt[0]
+	config := int(toc >> 3)
+	var frame time.Duration
+	switch {
+	case config < 12: // SILK: 10, 20, 40, 60ms
+		frame = [4]time.Duration{10, 20, 40, 60}[config%4] * time.Millisecond
+	case config < 16: // Hybrid: 10, 20ms
+		frame = [2]time.Duration{10, 20}[config%2] * time.Millisecond
+	default: // CELT: 2.5, 5, 10, 20ms
+		frame = [4]time.Duration{2500, 5000, 10000, 20000}[config%4] * time.Microsecond
 	}
-	buf := make([]byte, n)
-	if _, err := io.ReadFull(r, buf); err != nil {
-		return nil, err
+	frames := 1
+	switch toc & 3 {
+	case 1, 2:
+		frames = 2
+	case 3:
+		if len(pkt) < 2 {
+			return 0
+		}
+		frames = int(pkt[1] & 0x3f)
 	}
-	return buf, nil
+	return time.Duration(frames) * frame
 }
@@ -0,0 +1,486 @@
+// Package bench runs the capture and encode backends on their own and
+// reports their throughput and per-stage latency as JSON, for tracking
+// driver, FFmpeg and hardware changes over time.
+package bench
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"log"
+	"os"
+	"os/exec"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+// warmupFrames are encoded or captured before measuring starts, so codec
+// and driver start-up isn't counted.
+const warmupFrames = 10
+
+// sourceWaitTimeout matches the pipeline's wait for a source-paced grab.
+const sourceWaitTimeout = 100 * time.Millisecond
+
+// Config selects what to run. Encode runs use Width x Height frames from
+// each of Motions, or from Input when set. The capture run needs Display.
+type Config struct {
+	Encode  bool
+	Capture bool
+
+	Width, Height int
+	Motions       []string
+	Input         string // raw BGRA recording, replaces Motions
+
+	Display string
+	Pacing  string // "tick" or "source", as --pacing
+
+	Frames  int
+	FPS     int
+	Bitrate int
+	GPU     int
+	Codec   string
+	GOP     int
+
+	NewCapturer func(display string, fps, gpu int) (types.MediaCapturer, error)
+	NewEncoder  func(width, height, fps, bitrateKbps, gpu int, codec string, gop int, cudaCtx, cuMemcpy2D unsafe.Pointer) (types.VideoEncoder, error)
+}
+
+// Report is the JSON document bench writes.
+type Report struct {
+	Version  int       `json:"version"`
+	Time     time.Time `json:"time"`
+	Host     Host      `json:"host"`
+	Settings Settings  `json:"settings"`
+	Runs     []Result  `json:"runs"`
+}
+
+type Host struct {
+	Name string `json:"name"`
+	OS   string `json:"os"`
+	Arch string `json:"arch"`
+	CPUs int    `json:"cpus"`
+	Go   string `json:"go"`
+}
+
+type Settings struct {
+	Codec       string `json:"codec"`
+	BitrateKbps int    `json:"bitrateKbps"`
+	FPS         int    `json:"fps"`
+	GOP         int    `json:"gop"`
+	Frames      int    `json:"frames"`
+	Warmup      int    `json:"warmup"`
+	Pacing      string `json:"pacing"`
+}
+
+// Result is one backend measured on one frame source. Durations are in
+// milliseconds. Stages are "grab" (capture runs only), "encode" (the
+// whole Encode call) and "convert" (the part of it CPU encoders spend on
+// colour conversion).
+type Result struct {
+	Name    string `json:"name"`
+	Source  string `json:"source"`
+	Encoder string `json:"encoder,omitempty"`
+	PixFmt  string `json:"pixFmt"`
+	Width   int    `json:"width"`
+	Height  int    `json:"height"`
+
+	Frames      int     `json:"frames"`
+	Unchanged   int     `json:"unchanged,omitempty"`
+	GrabFails   int     `json:"grabFailures,omitempty"`
+	WallSeconds float64 `json:"wallSeconds"`
+	FPS         float64 `json:"fps"`
+
+	Stages map[string]*Latency `json:"stages"`
+
+	BytesPerFrame    float64 `json:"bytesPerFrame"`
+	Keyframes        int     `json:"keyframes"`
+	BytesPerKeyframe float64 `json:"bytesPerKeyframe,omitempty"`
+
+	// CPUPercent is process CPU time over wall time; 100 is one core.
+	CPUPercent float64 `json:"cpuPercent"`
+	// GPUPercent is the mean nvidia-smi utilization.gpu, when available.
+	GPUPercent *float64 `json:"gpuPercent,omitempty"`
+
+	Error string `json:"error,omitempty"`
+}
+
+type Latency struct {
+	P50  float64 `json:"p50Ms"`
+	P99  float64 `json:"p99Ms"`
+	Mean float64 `json:"meanMs"`
+	Max  float64 `json:"maxMs"`
+}
+
+// Failed reports whether any run failed.
+func (r *Report) Failed() bool {
+	for _, run := range r.Runs {
+		if run.Error != "" {
+			return true
+		}
+	}
+	return false
+}
+
+func (r *Report) WriteJSON(w io.Writer) error {
+	enc := json.NewEncoder(w)
+	enc.SetIndent("", "  ")
+	return enc.Encode(r)
+}
+
+// Run runs the configured benchmarks in turn. A run that fails is
+// reported with its error and the rest still run.
+func Run(cfg Config) *Report {
+	host, _ := os.Hostname()
+	rep := &Report{
+		Version: 1,
+		Time:    time.Now().UTC(),
+		Host:    Host{Name: host, OS: runtime.GOOS, Arch: runtime.GOARCH, CPUs: runtime.NumCPU(), Go: runtime.Version()},
+		Settings: Settings{Codec: cfg.Codec, BitrateKbps: cfg.Bitrate, FPS: cfg.FPS, GOP: cfg.GOP,
+			Frames: cfg.Frames, Warmup: warmupFrames, Pacing: cfg.Pacing},
+	}
+
+	if cfg.Encode {
+		if cfg.Input != "" {
+			rep.Runs = append(rep.Runs, cfg.encodeRun("encode/file", "file:"+cfg.Input, func() (frameSource, error) {
+				return newRecorded(cfg.Input, cfg.Width, cfg.Height)
+			}))
+		} else {
+			for _, m := range cfg.Motions {
+				rep.Runs = append(rep.Runs, cfg.encodeRun("encode/"+m, "synthetic:"+m, func() (frameSource, error) {
+					return newSynthetic(m, cfg.Width, cfg.Height)
+				}))
+			}
+		}
+	}
+	if cfg.Capture {
+		rep.Runs = append(rep.Runs, cfg.captureRun())
+	}
+	return rep
+}
+
+// encodeRun feeds frames through a new encoder as fast as it takes them.
+func (cfg Config) encodeRun(name, source string, open func() (frameSource, error)) Result {
+	run := Result{Name: name, Source: source, PixFmt: "bgra", Width: cfg.Width, Height: cfg.Height}
+	log.Printf("bench: %s (%dx%d, %d frames)", name, cfg.Width, cfg.Height, cfg.Frames)
+
+	src, err := open()
+	if err != nil {
+		run.Error = err.Error()
+		return run
+	}
+	enc, err := cfg.NewEncoder(cfg.Width, cfg.Height, cfg.FPS, cfg.Bitrate, cfg.GPU, cfg.Codec, cfg.GOP, nil, nil)
+	if err != nil {
+		run.Error = err.Error()
+		return run
+	}
+	defer enc.Close()
+	if n, ok := enc.(types.EncoderNamer); ok {
+		run.Encoder = n.EncoderName()
+	}
+
+	rec := newRecorder(enc)
+	var m *meter
+	for i := 0; i < warmupFrames+cfg.Frames; i++ {
+		if i == warmupFrames {
+			m = startMeter(cfg.GPU)
+		}
+		if err := rec.encode(enc, src.frame(i), i >= warmupFrames); err != nil {
+			run.Error = err.Error()
+			break
+		}
+	}
+	if m == nil {
+		m = startMeter(-1)
+	}
+	rec.finish(&run, m)
+	return run
+}
+
+// captureRun grabs from the display at --fps (or as --pacing source
+// allows) and encodes every changed frame, the way the pipeline does but
+// on one goroutine. NvFBC frames stay in device memory and go to NVENC
+// through the capturer's CUDA context.
+func (cfg Config) captureRun() Result {
+	run := Result{Name: "capture", Source: "capture:" + cfg.Display}
+	log.Printf("bench: capture from %s (%d frames at %d fps)", cfg.Display, cfg.Frames, cfg.FPS)
+
+	cap, err := cfg.NewCapturer(cfg.Display, cfg.FPS, cfg.GPU)
+	if err != nil {
+		run.Error = fmt.Sprintf("capturer init: %v", err)
+		return run
+	}
+	defer cap.Close()
+	run.Width, run.Height = cap.Width(), cap.Height()
+
+	paced := false
+	if cfg.Pacing == "source" {
+		if sp, ok := cap.(types.SourcePacer); ok {
+			paced = sp.SetSourcePacing(sourceWaitTimeout) == nil
+		}
+		if !paced {
+			log.Printf("bench: capturer can't be paced by its source, using the ticker")
+		}
+	}
+
+	var cudaCtx, cuMemcpy2D unsafe.Pointer
+	if cp, ok := cap.(types.CUDAProvider); ok {
+		cudaCtx, cuMemcpy2D = cp.CUDAContext(), cp.CuMemcpy2D()
+	}
+	enc, err := cfg.NewEncoder(run.Width, run.Height, cfg.FPS, cfg.Bitrate, cfg.GPU, cfg.Codec, cfg.GOP, cudaCtx, cuMemcpy2D)
+	if err != nil {
+		run.Error = err.Error()
+		return run
+	}
+	defer enc.Close()
+	if n, ok := enc.(types.EncoderNamer); ok {
+		run.Encoder = n.EncoderName()
+	}
+	releaser, _ := cap.(types.FrameReleaser)
+
+	var tick <-chan time.Time
+	if !paced {
+		ticker := time.NewTicker(time.Duration(float64(time.Second) / float64(cfg.FPS)))
+		defer ticker.Stop()
+		tick = ticker.C
+	}
+
+	rec := newRecorder(enc)
+	var m *meter
+	for i := 0; i < warmupFrames+cfg.Frames; i++ {
+		measured := i >= warmupFrames
+		if i == warmupFrames {
+			m = startMeter(cfg.GPU)
+		}
+		if tick != nil {
+			<-tick
+		}
+
+		t0 := time.Now()
+		frame, err := cap.Grab()
+		if err != nil {
+			if measured {
+				run.GrabFails++
+			}
+			continue
+		}
+		if measured {
+			rec.add("grab", time.Since(t0))
+		}
+		run.PixFmt = pixFmtName(frame)
+
+		if frame.Unchanged {
+			if measured {
+				run.Unchanged++
+			}
+		} else {
+			err = rec.encode(enc, frame, measured)
+		}
+		if releaser != nil {
+			releaser.ReleaseFrame(frame)
+		}
+		if err != nil {
+			run.Error = err.Error()
+			break
+		}
+	}
+	if m == nil {
+		m = startMeter(-1)
+	}
+	rec.finish(&run, m)
+	return run
+}
+
+func pixFmtName(f *types.Frame) string {
+	name := "bgra"
+	if f.PixFmt == types.PixFmtNV12 {
+		name = "nv12"
+	}
+	if f.IsCUDA {
+		name += "-cuda"
+	}
+	if f.IsPixelBuffer {
+		name += "-iosurface"
+	}
+	return name
+}
+
+// recorder collects one run's stage latencies and packet sizes.
+type recorder struct {
+	convert types.ConvertTimer // nil: encoder doesn't report it
+
+	stages   map[string][]time.Duration
+	frames   int
+	bytes    int64
+	keys     int
+	keyBytes int64
+}
+
+func newRecorder(enc types.VideoEncoder) *recorder {
+	ct, _ := enc.(types.ConvertTimer)
+	return &recorder{convert: ct, stages: make(map[string][]time.Duration)}
+}
+
+func (r *recorder) add(stage string, d time.Duration) {
+	r.stages[stage] = append(r.stages[stage], d)
+}
+
+// encode encodes f, recording it if measured.
+func (r *recorder) encode(enc types.VideoEncoder, f *types.Frame, measured bool) error {
+	t0 := time.Now()
+	pkt, err := enc.Encode(f)
+	d := time.Since(t0)
+	if err != nil {
+		return err
+	}
+	if !measured {
+		if pkt != nil {
+			pkt.Release()
+		}
+		return nil
+	}
+
+	r.frames++
+	r.add("encode", d)
+	if r.convert != nil {
+		r.add("convert", r.convert.ConvertTime())
+	}
+	if pkt != nil {
+		r.bytes += int64(len(pkt.Data))
+		if pkt.IsKey {
+			r.keys++
+			r.keyBytes += int64(len(pkt.Data))
+		}
+		pkt.Release()
+	}
+	return nil
+}
+
+func (r *recorder) finish(run *Result, m *meter) {
+	wall, cpu, gpu := m.stop()
+	run.Frames = r.frames
+	run.WallSeconds = wall.Seconds()
+	if wall > 0 {
+		run.FPS = float64(r.frames) / wall.Seconds()
+		run.CPUPercent = 100 * cpu.Seconds() / wall.Seconds()
+	}
+	run.GPUPercent = gpu
+	run.Stages = make(map[string]*Latency, len(r.stages))
+	for name, ds := range r.stages {
+		run.Stages[name] = latency(ds)
+	}
+	if r.frames > 0 {
+		run.BytesPerFrame = float64(r.bytes) / float64(r.frames)
+	}
+	run.Keyframes = r.keys
+	if r.keys > 0 {
+		run.BytesPerKeyframe = float64(r.keyBytes) / float64(r.keys)
+	}
+}
+
+func latency(ds []time.Duration) *Latency {
+	s := append([]time.Duration(nil), ds...)
+	sort.Slice(s, func(i, j int) bool { return s[i] < s[j] })
+	var sum time.Duration
+	for _, d := range s {
+		sum += d
+	}
+	ms := func(d time.Duration) float64 { return float64(d) / float64(time.Millisecond) }
+	pct := func(p float64) time.Duration {
+		i := int(p*float64(len(s))+0.999999) - 1
+		return s[max(min(i, len(s)-1), 0)]
+	}
+	return &Latency{
+		P50:  ms(pct(0.50)),
+		P99:  ms(pct(0.99)),
+		Mean: ms(sum / time.Duration(len(s))),
+		Max:  ms(s[len(s)-1]),
+	}
+}
+
+// meter measures a run's wall time, process CPU time and, on NVIDIA, GPU
+// utilization sampled from nvidia-smi.
+type meter struct {
+	start time.Time
+	cpu0  time.Duration
+
+	stopGPU chan struct{}
+	done    chan struct{}
+	mu      sync.Mutex
+	samples []float64
+}
+
+const gpuSampleInterval = 250 * time.Millisecond
+
+// startMeter starts measuring; gpu < 0 skips GPU sampling.
+func startMeter(gpu int) *meter {
+	m := &meter{start: time.Now(), cpu0: processCPU()}
+	if gpu >= 0 && runtime.GOOS == "linux" {
+		if _, err := exec.LookPath("nvidia-smi"); err == nil {
+			m.stopGPU = make(chan struct{})
+			m.done = make(chan struct{})
+			go m.sampleGPU(gpu)
+		}
+	}
+	return m
+}
+
+func (m *meter) sampleGPU(gpu int) {
+	defer close(m.done)
+	ticker := time.NewTicker(gpuSampleInterval)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-m.stopGPU:
+			return
+		case <-ticker.C:
+		}
+		out, err := exec.Command("nvidia-smi", "--query-gpu=utilization.gpu",
+			"--format=csv,noheader,nounits", "-i", strconv.Itoa(gpu)).Output()
+		if err != nil {
+			return
+		}
+		v, err := strconv.ParseFloat(strings.TrimSpace(string(out)), 64)
+		if err != nil {
+			return
+		}
+		m.mu.Lock()
+		m.samples = append(m.samples, v)
+		m.mu.Unlock()
+	}
+}
+
+func (m *meter) stop() (wall, cpu time.Duration, gpu *float64) {
+	wall = time.Since(m.start)
+	cpu = processCPU() - m.cpu0
+	if m.stopGPU != nil {
+		close(m.stopGPU)
+		<-m.done
+		if n := len(m.samples); n > 0 {
+			var sum float64
+			for _, v := range m.samples {
+				sum += v
+			}
+			mean := sum / float64(n)
+			gpu = &mean
+		}
+	}
+	return wall, cpu, gpu
+}
+
+// processCPU returns the user and system CPU time of this process so far,
+// including driver and codec threads.
+func processCPU() time.Duration {
+	var ru syscall.Rusage
+	if err := syscall.Getrusage(syscall.RUSAGE_SELF, &ru); err != nil {
+		return 0
+	}
+	return time.Duration(ru.Utime.Nano() + ru.Stime.Nano())
+}
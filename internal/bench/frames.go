@@ -0,0 +1,148 @@
+package bench
+
+import (
+	"fmt"
+	"io"
+	"os"
+
+	"bunghole/internal/types"
+)
+
+// maxRecordedFrames bounds how much of a recorded file is loaded; longer
+// recordings are cycled over their first maxRecordedFrames frames.
+const maxRecordedFrames = 120
+
+// noiseFrames is how many distinct noise frames are cycled. Encoders only
+// reference the last frame or two, so each frame still looks new.
+const noiseFrames = 8
+
+// frameSource produces BGRA frames for the encode runs. Frames are built
+// before timing starts, so generating them costs nothing per frame.
+type frameSource interface {
+	frame(i int) *types.Frame
+}
+
+// Motions are the synthetic frame sources.
+var Motions = []string{"static", "scroll", "noise"}
+
+func newSynthetic(motion string, w, h int) (frameSource, error) {
+	stride := w * 4
+	switch motion {
+	case "static":
+		return &staticSource{f: &types.Frame{Data: desktop(w, h, 0), Width: w, Height: h, Stride: stride}}, nil
+	case "scroll":
+		// One tall page; frame i is a window into it scrolled scrollStep
+		// rows further, like a browser or terminal scrolling text.
+		pages := 4
+		return &scrollSource{page: desktop(w, h*pages, 0), w: w, h: h, rows: h * (pages - 1)}, nil
+	case "noise":
+		src := &cycleSource{}
+		for i := 0; i < noiseFrames; i++ {
+			src.frames = append(src.frames, &types.Frame{Data: noise(w, h, uint32(i+1)), Width: w, Height: h, Stride: stride})
+		}
+		return src, nil
+	}
+	return nil, fmt.Errorf("unknown motion %q (want static, scroll or noise)", motion)
+}
+
+// newRecorded loads raw BGRA frames of w x h, back to back with no header
+// (ffmpeg -f rawvideo -pix_fmt bgra).
+func newRecorded(path string, w, h int) (frameSource, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	size := w * h * 4
+	src := &cycleSource{}
+	for len(src.frames) < maxRecordedFrames {
+		buf := make([]byte, size)
+		if _, err := io.ReadFull(f, buf); err == io.EOF || err == io.ErrUnexpectedEOF {
+			break
+		} else if err != nil {
+			return nil, fmt.Errorf("read %s: %w", path, err)
+		}
+		src.frames = append(src.frames, &types.Frame{Data: buf, Width: w, Height: h, Stride: w * 4})
+	}
+	if len(src.frames) == 0 {
+		return nil, fmt.Errorf("%s holds no whole %dx%d BGRA frame", path, w, h)
+	}
+	return src, nil
+}
+
+type staticSource struct{ f *types.Frame }
+
+func (s *staticSource) frame(int) *types.Frame { return s.f }
+
+type cycleSource struct{ frames []*types.Frame }
+
+func (s *cycleSource) frame(i int) *types.Frame { return s.frames[i%len(s.frames)] }
+
+// scrollStep is how many rows the scroll source moves per frame.
+const scrollStep = 8
+
+type scrollSource struct {
+	page    []byte
+	w, h    int
+	rows    int // scroll range
+	current types.Frame
+}
+
+func (s *scrollSource) frame(i int) *types.Frame {
+	y := (i * scrollStep) % s.rows
+	stride := s.w * 4
+	s.current = types.Frame{Data: s.page[y*stride : (y+s.h)*stride], Width: s.w, Height: s.h, Stride: stride}
+	return &s.current
+}
+
+// desktop draws something that compresses like a desktop: a title bar, a
+// sidebar and lines of text-like glyphs on a light background.
+func desktop(w, h int, seed uint32) []byte {
+	buf := make([]byte, w*h*4)
+	const cellW, cellH = 8, 16
+	for y := 0; y < h; y++ {
+		row := buf[y*w*4 : (y+1)*w*4]
+		for x := 0; x < w; x++ {
+			b, g, r := byte(0xf4), byte(0xf4), byte(0xf4)
+			switch {
+			case y%(h/4+1) < 32:
+				b, g, r = 0x5a, 0x3c, 0x2e // title bar
+			case x < w/6:
+				b, g, r = 0xe0, 0xd8, 0xd0 // sidebar
+			default:
+				// A glyph cell is "ink" on a few of its pixels, picked by
+				// a hash of the cell and the position inside it.
+				cx, cy := x/cellW, y/cellH
+				line := cy%3 != 2 // blank line every third row of cells
+				if line && hash(uint32(cx), uint32(cy), seed)%5 != 0 {
+					if hash(uint32(x), uint32(y), seed^0x9e37)%3 == 0 && y%cellH > 2 && y%cellH < 13 {
+						b, g, r = 0x20, 0x20, 0x20
+					}
+				}
+			}
+			row[4*x], row[4*x+1], row[4*x+2], row[4*x+3] = b, g, r, 0xff
+		}
+	}
+	return buf
+}
+
+func noise(w, h int, seed uint32) []byte {
+	buf := make([]byte, w*h*4)
+	x := seed*2654435761 + 1
+	for i := 0; i < len(buf); i += 4 {
+		x ^= x << 13
+		x ^= x >> 17
+		x ^= x << 5
+		buf[i], buf[i+1], buf[i+2], buf[i+3] = byte(x), byte(x>>8), byte(x>>16), 0xff
+	}
+	return buf
+}
+
+func hash(a, b, c uint32) uint32 {
+	h := a*0x85ebca6b ^ b*0xc2b2ae35 ^ c*0x27d4eb2f
+	h ^= h >> 15
+	h *= 0x2c1b3c6d
+	h ^= h >> 12
+	return h
+}
@@ -0,0 +1,168 @@
+//go:build linux
+
+package capture
+
+/*
+#cgo pkg-config: x11 xfixes
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// ---------------------------------------------------------------------------
+// Cursor tracker (out-of-band cursor for --cursor-channel)
+// ---------------------------------------------------------------------------
+
+// Uses its own display connection so polling never contends with the
+// capturer's grabs. Shape changes arrive as XFixesCursorNotify events, so
+// the cursor image is only fetched when it actually changes; the position
+// is a cheap XQueryPointer round trip.
+typedef struct {
+	Display *display;
+	Window root;
+	int event_base;
+	int have_shape;                    // 0 until the first image is fetched
+} CursorTracker;
+
+static CursorTracker* cursor_tracker_open(const char *display_name) {
+	CursorTracker *t = (CursorTracker*)calloc(1, sizeof(CursorTracker));
+	if (!t) return NULL;
+
+	t->display = XOpenDisplay(display_name);
+	if (!t->display) { free(t); return NULL; }
+
+	int error_base;
+	if (!XFixesQueryExtension(t->display, &t->event_base, &error_base)) {
+		XCloseDisplay(t->display);
+		free(t);
+		return NULL;
+	}
+	t->root = DefaultRootWindow(t->display);
+	XFixesSelectCursorInput(t->display, t->root, XFixesDisplayCursorNotifyMask);
+	XSync(t->display, False);
+	return t;
+}
+
+// Reads the pointer position. When the shape changed since the last call,
+// *img receives the new cursor image (caller must XFree it).
+// Returns 0 on success, -1 if the pointer could not be queried.
+static int cursor_tracker_poll(CursorTracker *t, int *x, int *y, XFixesCursorImage **img) {
+	int changed = !t->have_shape;
+	while (XPending(t->display)) {
+		XEvent ev;
+		XNextEvent(t->display, &ev);
+		if (ev.type == t->event_base + XFixesCursorNotify) changed = 1;
+	}
+
+	Window root_ret, child;
+	int wx, wy;
+	unsigned int mask;
+	if (!XQueryPointer(t->display, t->root, &root_ret, &child, x, y, &wx, &wy, &mask)) {
+		return -1;
+	}
+
+	*img = NULL;
+	if (changed) {
+		*img = XFixesGetCursorImage(t->display);
+		if (*img) t->have_shape = 1;
+	}
+	return 0;
+}
+
+// Convert XFixes premultiplied ARGB (one pixel per unsigned long) to
+// straight RGBA bytes.
+static void cursor_image_rgba(XFixesCursorImage *img, uint8_t *dst) {
+	int n = img->width * img->height;
+	for (int i = 0; i < n; i++) {
+		unsigned long p = img->pixels[i];
+		unsigned int a = (p >> 24) & 0xFF;
+		unsigned int r = (p >> 16) & 0xFF;
+		unsigned int g = (p >> 8) & 0xFF;
+		unsigned int b = p & 0xFF;
+		if (a != 0 && a != 255) {
+			r = r * 255 / a; if (r > 255) r = 255;
+			g = g * 255 / a; if (g > 255) g = 255;
+			b = b * 255 / a; if (b > 255) b = 255;
+		}
+		dst[i * 4 + 0] = r;
+		dst[i * 4 + 1] = g;
+		dst[i * 4 + 2] = b;
+		dst[i * 4 + 3] = a;
+	}
+}
+
+static void cursor_tracker_close(CursorTracker *t) {
+	if (!t) return;
+	XCloseDisplay(t->display);
+	free(t);
+}
+*/
+import "C"
+import (
+	"fmt"
+	"sync"
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+// X11CursorSource reports the X cursor via XFixes for clients that draw
+// it themselves (--cursor-channel). It works with either capturer.
+type X11CursorSource struct {
+	mu     sync.Mutex
+	t      *C.CursorTracker
+	serial uint64
+}
+
+// NewCursorSource opens a cursor tracker on the given display.
+func NewCursorSource(displayName string) (types.CursorSource, error) {
+	cDisplay := C.CString(displayName)
+	defer C.free(unsafe.Pointer(cDisplay))
+
+	t := C.cursor_tracker_open(cDisplay)
+	if t == nil {
+		return nil, fmt.Errorf("failed to open cursor tracker on %s (XFixes required)", displayName)
+	}
+	return &X11CursorSource{t: t}, nil
+}
+
+func (s *X11CursorSource) Cursor() (*types.Cursor, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.t == nil {
+		return nil, fmt.Errorf("cursor source closed")
+	}
+
+	var x, y C.int
+	var img *C.XFixesCursorImage
+	if C.cursor_tracker_poll(s.t, &x, &y, &img) != 0 {
+		return nil, fmt.Errorf("XQueryPointer failed")
+	}
+
+	cur := &types.Cursor{X: int(x), Y: int(y)}
+	if img != nil {
+		defer C.XFree(unsafe.Pointer(img))
+		w, h := int(img.width), int(img.height)
+		shape := &types.CursorShape{
+			Width:  w,
+			Height: h,
+			HotX:   int(img.xhot),
+			HotY:   int(img.yhot),
+			RGBA:   make([]byte, w*h*4),
+		}
+		if len(shape.RGBA) > 0 {
+			C.cursor_image_rgba(img, (*C.uint8_t)(unsafe.Pointer(&shape.RGBA[0])))
+		}
+		s.serial = uint64(img.cursor_serial)
+		cur.Shape = shape
+	}
+	cur.Serial = s.serial
+	return cur, nil
+}
+
+func (s *X11CursorSource) Close() {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	C.cursor_tracker_close(s.t)
+	s.t = nil
+}
@@ -40,6 +40,10 @@ typedef struct {
 	int width;
 	int height;
 	int stride;
+	int fps;                           // capture session settings, kept
+	int with_cursor;                   // for recreating it after a mode set
+	int lost_session;                  // recreate failed; retried on next grab
+	int wait_ms;                       // source pacing: grabs block this long for a new frame (0 = off)
 } NvFBCCapturer;
 
 // Load CUDA driver API dynamically
@@ -116,7 +120,74 @@ static void nvfbc_cleanup(NvFBCCapturer *c, int has_session, int has_handle) {
 	free(c);
 }
 
-static NvFBCCapturer* nvfbc_init(const char *display_name, int fps, const char *pci_bus_id) {
+// Create a capture session with TOCUDA NV12 output (steps 6-7 of init;
+// repeated when NvFBC asks for the session to be recreated). *has_session
+// is set once the session exists, so the caller can tear it down on
+// failure.
+static int nvfbc_create_session(NvFBCCapturer *c, int *has_session) {
+	// Step 6: Create capture session
+	NVFBC_CREATE_CAPTURE_SESSION_PARAMS captureParams;
+	memset(&captureParams, 0, sizeof(captureParams));
+	captureParams.dwVersion = NVFBC_CREATE_CAPTURE_SESSION_PARAMS_VER;
+	captureParams.eCaptureType = NVFBC_CAPTURE_SHARED_CUDA;
+	captureParams.eTrackingType = NVFBC_TRACKING_DEFAULT;
+	captureParams.bWithCursor = c->with_cursor ? NVFBC_TRUE : NVFBC_FALSE;
+	captureParams.dwSamplingRateMs = c->fps > 0 ? 1000 / c->fps : 33;
+	// With source pacing, the push model wakes a blocking grab as soon as
+	// the X server presents, instead of on the next sampling tick.
+	captureParams.bPushModel = c->wait_ms > 0 ? NVFBC_TRUE : NVFBC_FALSE;
+
+	NVFBCSTATUS status = c->fn.nvFBCCreateCaptureSession(c->session, &captureParams);
+	if (status != NVFBC_SUCCESS) {
+		fprintf(stderr, "nvfbc: NvFBCCreateCaptureSession failed: %d\n", status);
+		nvfbc_log_error(c, "NvFBCCreateCaptureSession");
+		return -1;
+	}
+
+	*has_session = 1;
+
+	// Step 7: Set up TOCUDA with NV12 output
+	NVFBC_TOCUDA_SETUP_PARAMS setupParams;
+	memset(&setupParams, 0, sizeof(setupParams));
+	setupParams.dwVersion = NVFBC_TOCUDA_SETUP_PARAMS_VER;
+	setupParams.eBufferFormat = NVFBC_BUFFER_FORMAT_NV12;
+
+	status = c->fn.nvFBCToCudaSetUp(c->session, &setupParams);
+	if (status != NVFBC_SUCCESS) {
+		fprintf(stderr, "nvfbc: NvFBCToCudaSetUp failed: %d\n", status);
+		nvfbc_log_error(c, "NvFBCToCudaSetUp");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void nvfbc_destroy_session(NvFBCCapturer *c) {
+	NVFBC_DESTROY_CAPTURE_SESSION_PARAMS dcsParams;
+	memset(&dcsParams, 0, sizeof(dcsParams));
+	dcsParams.dwVersion = NVFBC_DESTROY_CAPTURE_SESSION_PARAMS_VER;
+	c->fn.nvFBCDestroyCaptureSession(c->session, &dcsParams);
+}
+
+// After a mode set NvFBC fails grabs with NVFBC_ERR_MUST_RECREATE until
+// the capture session is rebuilt. The old session's CUDA buffers go with
+// it; the next successful grab reports the new size.
+static int nvfbc_recreate_session(NvFBCCapturer *c, const char *why) {
+	if (!c->lost_session) nvfbc_destroy_session(c);
+	c->frame_ptr = 0;
+
+	int has_session = 0;
+	if (nvfbc_create_session(c, &has_session) != 0) {
+		if (has_session) nvfbc_destroy_session(c);
+		c->lost_session = 1;
+		return -1;
+	}
+	c->lost_session = 0;
+	fprintf(stderr, "nvfbc: capture session recreated %s\n", why);
+	return 0;
+}
+
+static NvFBCCapturer* nvfbc_init(const char *display_name, int fps, const char *pci_bus_id, int with_cursor) {
 	NvFBCCapturer *c = (NvFBCCapturer*)calloc(1, sizeof(NvFBCCapturer));
 	if (!c) return NULL;
 
@@ -233,35 +304,12 @@ static NvFBCCapturer* nvfbc_init(const char *display_name, int fps, const char *
 	c->width = statusParams.screenSize.w;
 	c->height = statusParams.screenSize.h;
 
-	// Step 6: Create capture session
-	NVFBC_CREATE_CAPTURE_SESSION_PARAMS captureParams;
-	memset(&captureParams, 0, sizeof(captureParams));
-	captureParams.dwVersion = NVFBC_CREATE_CAPTURE_SESSION_PARAMS_VER;
-	captureParams.eCaptureType = NVFBC_CAPTURE_SHARED_CUDA;
-	captureParams.eTrackingType = NVFBC_TRACKING_DEFAULT;
-	captureParams.bWithCursor = NVFBC_TRUE;
-	captureParams.dwSamplingRateMs = fps > 0 ? 1000 / fps : 33;
-	captureParams.bPushModel = NVFBC_FALSE;
-
-	status = c->fn.nvFBCCreateCaptureSession(c->session, &captureParams);
-	if (status != NVFBC_SUCCESS) {
-		fprintf(stderr, "nvfbc: NvFBCCreateCaptureSession failed: %d\n", status);
-		nvfbc_log_error(c, "NvFBCCreateCaptureSession");
-		nvfbc_cleanup(c, 0, 1);
-		return NULL;
-	}
-
-	// Step 7: Set up TOCUDA with NV12 output
-	NVFBC_TOCUDA_SETUP_PARAMS setupParams;
-	memset(&setupParams, 0, sizeof(setupParams));
-	setupParams.dwVersion = NVFBC_TOCUDA_SETUP_PARAMS_VER;
-	setupParams.eBufferFormat = NVFBC_BUFFER_FORMAT_NV12;
-
-	status = c->fn.nvFBCToCudaSetUp(c->session, &setupParams);
-	if (status != NVFBC_SUCCESS) {
-		fprintf(stderr, "nvfbc: NvFBCToCudaSetUp failed: %d\n", status);
-		nvfbc_log_error(c, "NvFBCToCudaSetUp");
-		nvfbc_cleanup(c, 1, 1);
+	// Steps 6-7: Create the capture session and set up TOCUDA
+	c->fps = fps;
+	c->with_cursor = with_cursor;
+	int has_session = 0;
+	if (nvfbc_create_session(c, &has_session) != 0) {
+		nvfbc_cleanup(c, has_session, 1);
 		return NULL;
 	}
 
@@ -273,7 +321,22 @@ static NvFBCCapturer* nvfbc_init(const char *display_name, int fps, const char *
 	return c;
 }
 
-// Returns: 0=success (new frame), 1=reused last frame, -1=error
+// Switch to source pacing: rebuild the capture session in push mode and
+// make grabs wait up to timeout_ms for a new frame.
+static int nvfbc_set_source_pacing(NvFBCCapturer *c, int timeout_ms) {
+	c->wait_ms = timeout_ms;
+	int ret = nvfbc_recreate_session(c, "for source pacing");
+	if (fn_cuCtxSetCurrent) fn_cuCtxSetCurrent(c->cuda_ctx);
+	if (ret != 0) {
+		// The next grab recreates it without the push model.
+		c->wait_ms = 0;
+		return -1;
+	}
+	return 0;
+}
+
+// Returns: 0=success (new frame), 1=reused last frame, -1=error. With
+// source pacing, 1 also means no new frame arrived within wait_ms.
 static int nvfbc_grab(NvFBCCapturer *c) {
 	struct timespec t0, t1;
 	clock_gettime(CLOCK_MONOTONIC, &t0);
@@ -285,13 +348,32 @@ static int nvfbc_grab(NvFBCCapturer *c) {
 	NVFBC_TOCUDA_GRAB_FRAME_PARAMS grabParams;
 	memset(&grabParams, 0, sizeof(grabParams));
 	grabParams.dwVersion = NVFBC_TOCUDA_GRAB_FRAME_PARAMS_VER;
-	grabParams.dwFlags = NVFBC_TOCUDA_GRAB_FLAGS_FORCE_REFRESH
-	                   | NVFBC_TOCUDA_GRAB_FLAGS_NOWAIT;
+	if (c->wait_ms > 0) {
+		// Block until NvFBC has a frame newer than the last grab. A new
+		// session has no last frame, so its first grab forces one.
+		grabParams.dwFlags = c->frame_ptr ? NVFBC_TOCUDA_GRAB_FLAGS_NOFLAGS
+		                                  : NVFBC_TOCUDA_GRAB_FLAGS_FORCE_REFRESH;
+		grabParams.dwTimeoutMs = c->wait_ms;
+	} else {
+		grabParams.dwFlags = NVFBC_TOCUDA_GRAB_FLAGS_FORCE_REFRESH
+		                   | NVFBC_TOCUDA_GRAB_FLAGS_NOWAIT;
+		grabParams.dwTimeoutMs = 0;
+	}
 	grabParams.pCUDADeviceBuffer = (void*)&c->grab_ptr;
 	grabParams.pFrameGrabInfo = &c->grab_info;
-	grabParams.dwTimeoutMs = 0;
+
+	if (c->lost_session && nvfbc_recreate_session(c, "after mode change") != 0) {
+		if (fn_cuCtxSetCurrent) fn_cuCtxSetCurrent(c->cuda_ctx);
+		return -1;
+	}
 
 	NVFBCSTATUS status = c->fn.nvFBCToCudaGrabFrame(c->session, &grabParams);
+	if (status == NVFBC_ERR_MUST_RECREATE) {
+		if (nvfbc_recreate_session(c, "after mode change") == 0) {
+			c->grab_ptr = 0;
+			status = c->fn.nvFBCToCudaGrabFrame(c->session, &grabParams);
+		}
+	}
 
 	// NvFBC with bExternallyManagedContext=FALSE manages its own CUDA context
 	// internally. After the grab, restore our context for the encoder.
@@ -337,7 +419,12 @@ static int nvfbc_grab(NvFBCCapturer *c) {
 
 	// Success — update frame_ptr from grab target
 	c->frame_ptr = c->grab_ptr;
-	new_count++;
+	int stale = c->wait_ms > 0 && !c->grab_info.bIsNewFrame;
+	if (stale) {
+		reuse_count++;
+	} else {
+		new_count++;
+	}
 
 	// Update dimensions from grab info (may differ on resolution change)
 	c->width = c->grab_info.dwWidth;
@@ -370,7 +457,7 @@ static int nvfbc_grab(NvFBCCapturer *c) {
 		last_report = t1;
 	}
 
-	return 0;
+	return stale ? 1 : 0;
 }
 
 // Return the last captured frame's CUDA device pointer as a void* for Go.
@@ -380,29 +467,24 @@ static void* nvfbc_frame_ptr(NvFBCCapturer *c) {
 
 // Download the NV12 CUDA frame to CPU memory. Caller must free the returned buffer.
 // Returns NULL on failure. *out_size receives the total byte size.
-static uint8_t* nvfbc_download_frame(NvFBCCapturer *c, int *out_size) {
-	if (!fn_cuMemcpyDtoH || !c->frame_ptr) return NULL;
-	int total = c->stride * c->height * 3 / 2; // NV12
-	uint8_t *buf = (uint8_t*)malloc(total);
-	if (!buf) return NULL;
-	CUresult r = fn_cuMemcpyDtoH(buf, c->frame_ptr, total);
+// Copies the NV12 frame at src (a pointer from nvfbc_frame_ptr) into size
+// bytes of host memory at dst.
+static int nvfbc_download_frame(NvFBCCapturer *c, void *src, uint8_t *dst, size_t size) {
+	if (!fn_cuMemcpyDtoH || !src) return -1;
+	if (fn_cuCtxSetCurrent) fn_cuCtxSetCurrent(c->cuda_ctx);
+	CUresult r = fn_cuMemcpyDtoH(dst, (CUdeviceptr)(uintptr_t)src, size);
 	if (r != CUDA_SUCCESS) {
 		fprintf(stderr, "nvfbc: cuMemcpyDtoH failed: %d\n", r);
-		free(buf);
-		return NULL;
+		return -1;
 	}
-	*out_size = total;
-	return buf;
+	return 0;
 }
 
 static void nvfbc_destroy(NvFBCCapturer *c) {
 	if (!c) return;
 
-	if (c->fn.nvFBCDestroyCaptureSession) {
-		NVFBC_DESTROY_CAPTURE_SESSION_PARAMS dcsParams;
-		memset(&dcsParams, 0, sizeof(dcsParams));
-		dcsParams.dwVersion = NVFBC_DESTROY_CAPTURE_SESSION_PARAMS_VER;
-		c->fn.nvFBCDestroyCaptureSession(c->session, &dcsParams);
+	if (c->fn.nvFBCDestroyCaptureSession && !c->lost_session) {
+		nvfbc_destroy_session(c);
 	}
 
 	if (c->fn.nvFBCDestroyHandle) {
@@ -430,9 +512,8 @@ static void* get_cuMemcpy2D_ptr(void) {
 import "C"
 import (
 	"fmt"
-	"image"
-	"image/color"
 	"log"
+	"time"
 	"unsafe"
 
 	"bunghole/internal/types"
@@ -440,8 +521,9 @@ import (
 
 // NvfbcCapturer captures frames via NvFBC TOCUDA (zero-copy GPU capture).
 type NvfbcCapturer struct {
-	c   *C.NvFBCCapturer
-	fps int
+	c     *C.NvFBCCapturer
+	fps   int
+	paced bool
 }
 
 // NewNvFBCCapturer creates an NvFBC TOCUDA capturer for the given PCI bus ID.
@@ -451,11 +533,15 @@ func NewNvFBCCapturer(displayName string, fps int, pciBusID string) (types.Media
 	cBusID := C.CString(pciBusID)
 	defer C.free(unsafe.Pointer(cBusID))
 
-	c := C.nvfbc_init(cDisplay, C.int(fps), cBusID)
+	withCursor := C.int(1)
+	if cursorChannel {
+		withCursor = 0
+	}
+	c := C.nvfbc_init(cDisplay, C.int(fps), cBusID, withCursor)
 	if c == nil {
 		return nil, fmt.Errorf("failed to initialize NvFBC capture")
 	}
-	log.Printf("capture: NvFBC (%dx%d)", int(c.width), int(c.height))
+	log.Printf("capture: NvFBC (%dx%d, cursor %s)", int(c.width), int(c.height), cursorMode())
 	return &NvfbcCapturer{c: c, fps: fps}, nil
 }
 
@@ -469,15 +555,26 @@ func (c *NvfbcCapturer) Grab() (*types.Frame, error) {
 	}
 
 	return &types.Frame{
-		Ptr:    unsafe.Pointer(C.nvfbc_frame_ptr(c.c)),
-		Width:  int(c.c.width),
-		Height: int(c.c.height),
-		Stride: int(c.c.stride),
-		IsCUDA: true,
-		PixFmt: types.PixFmtNV12,
+		Ptr:       unsafe.Pointer(C.nvfbc_frame_ptr(c.c)),
+		Width:     int(c.c.width),
+		Height:    int(c.c.height),
+		Stride:    int(c.c.stride),
+		IsCUDA:    true,
+		PixFmt:    types.PixFmtNV12,
+		Unchanged: c.paced && ret == 1,
 	}, nil
 }
 
+// SetSourcePacing makes Grab block until NvFBC has a new frame, using a
+// push-model capture session, instead of forcing a refresh on every call.
+func (c *NvfbcCapturer) SetSourcePacing(timeout time.Duration) error {
+	if C.nvfbc_set_source_pacing(c.c, C.int(timeout.Milliseconds())) != 0 {
+		return fmt.Errorf("NvFBC push-model session failed")
+	}
+	c.paced = true
+	return nil
+}
+
 // CUDAContext returns the CUDA context for the encoder to share.
 func (c *NvfbcCapturer) CUDAContext() unsafe.Pointer {
 	return unsafe.Pointer(c.c.cuda_ctx)
@@ -488,61 +585,15 @@ func (c *NvfbcCapturer) CuMemcpy2D() unsafe.Pointer {
 	return unsafe.Pointer(C.get_cuMemcpy2D_ptr())
 }
 
-// GrabImage grabs a frame and returns it as a Go image (for debug endpoint).
-func (c *NvfbcCapturer) GrabImage() (image.Image, error) {
-	if C.nvfbc_grab(c.c) != 0 {
-		return nil, fmt.Errorf("NvFBC grab failed")
-	}
-	w := int(c.c.width)
-	h := int(c.c.height)
-	stride := int(c.c.stride)
-
-	var outSize C.int
-	buf := C.nvfbc_download_frame(c.c, &outSize)
-	if buf == nil {
+// DownloadFrame copies f, an NV12 frame in device memory, to host memory.
+func (c *NvfbcCapturer) DownloadFrame(f *types.Frame) ([]byte, error) {
+	buf := make([]byte, f.Stride*f.Height*3/2)
+	if C.nvfbc_download_frame(c.c, f.Ptr, (*C.uint8_t)(unsafe.Pointer(&buf[0])), C.size_t(len(buf))) != 0 {
 		return nil, fmt.Errorf("failed to download CUDA frame")
 	}
-	defer C.free(unsafe.Pointer(buf))
-
-	nv12 := C.GoBytes(unsafe.Pointer(buf), outSize)
-	return nv12ToImage(nv12, w, h, stride), nil
+	return buf, nil
 }
 
 func (c *NvfbcCapturer) Close() {
 	C.nvfbc_destroy(c.c)
 }
-
-// nv12ToImage converts NV12 pixel data to an RGBA image.
-func nv12ToImage(nv12 []byte, w, h, stride int) image.Image {
-	img := image.NewRGBA(image.Rect(0, 0, w, h))
-	yOff := 0
-	uvOff := stride * h
-	for y := 0; y < h; y++ {
-		for x := 0; x < w; x++ {
-			yVal := int(nv12[yOff+y*stride+x])
-			uvIdx := uvOff + (y/2)*stride + (x&^1)
-			uVal := int(nv12[uvIdx]) - 128
-			vVal := int(nv12[uvIdx+1]) - 128
-			r := yVal + (91881*vVal+32768)>>16
-			g := yVal - (22554*uVal+46802*vVal+32768)>>16
-			b := yVal + (116130*uVal+32768)>>16
-			if r < 0 {
-				r = 0
-			} else if r > 255 {
-				r = 255
-			}
-			if g < 0 {
-				g = 0
-			} else if g > 255 {
-				g = 255
-			}
-			if b < 0 {
-				b = 0
-			} else if b > 255 {
-				b = 255
-			}
-			img.SetRGBA(x, y, color.RGBA{uint8(r), uint8(g), uint8(b), 255})
-		}
-	}
-	return img
-}
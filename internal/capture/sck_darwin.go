@@ -14,24 +14,41 @@ typedef struct {
 	void *filter;
 	int width;
 	int height;
+	int fps;
+	uint32_t display_id;
 } SCKCaptureHandle;
 
 int  sck_capture_start_display(int fps, SCKCaptureHandle *out);
 int  sck_capture_start_window(uint32_t window_id, int fps, int w, int h, SCKCaptureHandle *out);
-int  sck_capture_grab(SCKCaptureHandle *h, uint8_t **buf, int *stride, int *w, int *h_out);
+int  sck_capture_grab(SCKCaptureHandle *h, void **pixel_buffer, int *stride, int *w, int *h_out);
+void sck_capture_release(void *pixel_buffer);
+int  sck_capture_download(void *pixel_buffer, uint8_t *dst, int stride);
+int  sck_capture_wait(SCKCaptureHandle *h, int timeout_ms);
+int  sck_capture_follow_display(SCKCaptureHandle *h);
 void sck_capture_stop(SCKCaptureHandle *h);
 */
 import "C"
 import (
 	"fmt"
+	"time"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
+// displayCheckInterval is how often a display capturer checks for a mode
+// change.
+const displayCheckInterval = time.Second
+
+// sckFrameBuffers is how many grabbed frames may be outstanding at once.
+// Each holds a surface of the stream's pool (queueDepth in sck_darwin.m).
+const sckFrameBuffers = 2
+
 // DisplayCapturer wraps ScreenCaptureKit display capture.
 type DisplayCapturer struct {
-	handle C.SCKCaptureHandle
+	handle    C.SCKCaptureHandle
+	lastCheck time.Time
+	waitMs    int // source pacing: Grab waits this long for a new frame (0 = off)
 }
 
 // NewCapturer creates a ScreenCaptureKit display capturer.
@@ -47,21 +64,25 @@ func (c *DisplayCapturer) Width() int  { return int(c.handle.width) }
 func (c *DisplayCapturer) Height() int { return int(c.handle.height) }
 
 func (c *DisplayCapturer) Grab() (*types.Frame, error) {
-	var buf *C.uint8_t
-	var stride, w, h C.int
-
-	if ret := C.sck_capture_grab(&c.handle, &buf, &stride, &w, &h); ret != 0 {
-		return nil, fmt.Errorf("no frame available")
+	if now := time.Now(); now.Sub(c.lastCheck) >= displayCheckInterval {
+		c.lastCheck = now
+		C.sck_capture_follow_display(&c.handle)
 	}
+	return sckGrab(&c.handle, c.waitMs)
+}
 
-	return &types.Frame{
-		Ptr:    unsafe.Pointer(buf),
-		Width:  int(w),
-		Height: int(h),
-		Stride: int(stride),
-	}, nil
+// SetSourcePacing makes Grab wait for the stream's next frame callback
+// instead of returning the latest frame straight away.
+func (c *DisplayCapturer) SetSourcePacing(timeout time.Duration) error {
+	c.waitMs = int(timeout.Milliseconds())
+	return nil
 }
 
+func (c *DisplayCapturer) FrameBuffers() int           { return sckFrameBuffers }
+func (c *DisplayCapturer) ReleaseFrame(f *types.Frame) { sckRelease(f) }
+
+func (c *DisplayCapturer) DownloadFrame(f *types.Frame) ([]byte, error) { return sckDownload(f) }
+
 func (c *DisplayCapturer) Close() {
 	C.sck_capture_stop(&c.handle)
 }
@@ -70,6 +91,7 @@ func (c *DisplayCapturer) Close() {
 type WindowCapturer struct {
 	handle        C.SCKCaptureHandle
 	width, height int
+	waitMs        int
 }
 
 // NewWindowCapturer creates a ScreenCaptureKit window capturer.
@@ -92,21 +114,60 @@ func (c *WindowCapturer) Width() int  { return c.width }
 func (c *WindowCapturer) Height() int { return c.height }
 
 func (c *WindowCapturer) Grab() (*types.Frame, error) {
-	var buf *C.uint8_t
+	return sckGrab(&c.handle, c.waitMs)
+}
+
+// SetSourcePacing: see DisplayCapturer.SetSourcePacing.
+func (c *WindowCapturer) SetSourcePacing(timeout time.Duration) error {
+	c.waitMs = int(timeout.Milliseconds())
+	return nil
+}
+
+func (c *WindowCapturer) FrameBuffers() int           { return sckFrameBuffers }
+func (c *WindowCapturer) ReleaseFrame(f *types.Frame) { sckRelease(f) }
+
+func (c *WindowCapturer) DownloadFrame(f *types.Frame) ([]byte, error) { return sckDownload(f) }
+
+func (c *WindowCapturer) Close() {
+	C.sck_capture_stop(&c.handle)
+}
+
+// sckGrab returns the stream's latest frame as a retained NV12
+// CVPixelBuffer, released by sckRelease. With waitMs > 0 it first waits
+// that long for one newer than the last grab, and marks the frame
+// Unchanged if none came.
+func sckGrab(handle *C.SCKCaptureHandle, waitMs int) (*types.Frame, error) {
+	fresh := true
+	if waitMs > 0 {
+		fresh = C.sck_capture_wait(handle, C.int(waitMs)) != 0
+	}
+
+	var pb unsafe.Pointer
 	var stride, w, h C.int
 
-	if ret := C.sck_capture_grab(&c.handle, &buf, &stride, &w, &h); ret != 0 {
+	if ret := C.sck_capture_grab(handle, &pb, &stride, &w, &h); ret != 0 {
 		return nil, fmt.Errorf("no frame available")
 	}
 
 	return &types.Frame{
-		Ptr:    unsafe.Pointer(buf),
-		Width:  int(w),
-		Height: int(h),
-		Stride: int(stride),
+		Ptr:           pb,
+		Width:         int(w),
+		Height:        int(h),
+		Stride:        int(stride),
+		IsPixelBuffer: true,
+		PixFmt:        types.PixFmtNV12,
+		Unchanged:     !fresh,
 	}, nil
 }
 
-func (c *WindowCapturer) Close() {
-	C.sck_capture_stop(&c.handle)
+func sckRelease(f *types.Frame) {
+	C.sck_capture_release(f.Ptr)
+}
+
+func sckDownload(f *types.Frame) ([]byte, error) {
+	buf := make([]byte, f.Stride*f.Height*3/2)
+	if C.sck_capture_download(f.Ptr, (*C.uint8_t)(unsafe.Pointer(&buf[0])), C.int(f.Stride)) != 0 {
+		return nil, fmt.Errorf("lock pixel buffer failed")
+	}
+	return buf, nil
 }
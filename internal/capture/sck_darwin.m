@@ -7,6 +7,8 @@
 #include <string.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
 
 typedef struct {
     void *stream;          // SCStream*
@@ -14,16 +16,22 @@ typedef struct {
     void *filter;          // SCContentFilter*
     int width;
     int height;
+    int fps;
+    uint32_t display_id;   // CGDirectDisplayID for display capture, 0 for windows
 } SCKCaptureHandle;
 
-// Latest captured frame data (CF types managed manually, not ARC)
+// Latest captured frame (CF types managed manually, not ARC). The pixel
+// buffer is never locked: grabs hand out retained references that the
+// encoder submits to VideoToolbox as-is.
 typedef struct {
-    uint8_t *data;
-    int stride;
-    int width;
-    int height;
     CMSampleBufferRef sampleBuffer;
     CVPixelBufferRef pixelBuffer;
+    int stride;            // bytes per row of the luma plane
+    int width;
+    int height;
+    uint64_t seq;          // frames delivered so far
+    uint64_t taken;        // seq as of the last grab
+    pthread_cond_t ready;  // signaled on every delivered frame
     pthread_mutex_t lock;
 } SCKCaptureFrame;
 
@@ -42,19 +50,15 @@ typedef struct {
     CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
     if (!pixelBuffer) return;
 
-    CVReturn lockResult = CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
-    if (lockResult != kCVReturnSuccess) return;
-
-    uint8_t *baseAddress = (uint8_t *)CVPixelBufferGetBaseAddress(pixelBuffer);
-    int stride = (int)CVPixelBufferGetBytesPerRow(pixelBuffer);
+    int stride = (int)CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0);
     int width = (int)CVPixelBufferGetWidth(pixelBuffer);
     int height = (int)CVPixelBufferGetHeight(pixelBuffer);
 
     pthread_mutex_lock(&self.frame->lock);
 
-    // Release previous buffer
+    // Drop our reference to the previous buffer; grabs still holding it
+    // keep it alive until they release it.
     if (self.frame->pixelBuffer) {
-        CVPixelBufferUnlockBaseAddress(self.frame->pixelBuffer, kCVPixelBufferLock_ReadOnly);
         CVPixelBufferRelease(self.frame->pixelBuffer);
     }
     if (self.frame->sampleBuffer) {
@@ -66,10 +70,11 @@ typedef struct {
     CVPixelBufferRetain(pixelBuffer);
     self.frame->sampleBuffer = sampleBuffer;
     self.frame->pixelBuffer = pixelBuffer;
-    self.frame->data = baseAddress;
     self.frame->stride = stride;
     self.frame->width = width;
     self.frame->height = height;
+    self.frame->seq++;
+    pthread_cond_broadcast(&self.frame->ready);
 
     pthread_mutex_unlock(&self.frame->lock);
 }
@@ -82,19 +87,33 @@ typedef struct {
 
 // ---- Shared helpers ----
 
-static int sck_start_stream(SCContentFilter *filter, int fps, int w, int h,
-                            SCKCaptureHandle *out) {
+static SCStreamConfiguration *sck_make_config(int fps, int w, int h) {
     SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
     config.width = w;
     config.height = h;
     config.minimumFrameInterval = CMTimeMake(1, fps);
-    config.queueDepth = 3;
-    config.pixelFormat = kCVPixelFormatType_32BGRA;
+    // Grabbed frames and the encoder's in-flight frame hold surfaces from
+    // the stream's pool, so it needs a few more than the default 3.
+    config.queueDepth = 5;
+    // NV12 in the encoder's BT.601 video range: VideoToolbox encodes the
+    // IOSurface without a conversion pass.
+    config.pixelFormat = kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange;
+    config.colorMatrix = kCGDisplayStreamYCbCrMatrix_ITU_R_601_4;
+    // A window larger or smaller than w x h (a VM streamed at another size
+    // than its guest display) is scaled on the GPU while compositing.
+    config.scalesToFit = YES;
     config.showsCursor = YES;
+    return config;
+}
+
+static int sck_start_stream(SCContentFilter *filter, int fps, int w, int h,
+                            SCKCaptureHandle *out) {
+    SCStreamConfiguration *config = sck_make_config(fps, w, h);
 
     SCKCaptureDelegate *delegate = [[SCKCaptureDelegate alloc] init];
     SCKCaptureFrame *frame = calloc(1, sizeof(SCKCaptureFrame));
     pthread_mutex_init(&frame->lock, NULL);
+    pthread_cond_init(&frame->ready, NULL);
     delegate.frame = frame;
 
     NSError *err = nil;
@@ -107,6 +126,7 @@ static int sck_start_stream(SCContentFilter *filter, int fps, int w, int h,
     if (err) {
         NSLog(@"sck_start_stream: addStreamOutput error: %@", err);
         pthread_mutex_destroy(&frame->lock);
+        pthread_cond_destroy(&frame->ready);
         free(frame);
         return -1;
     }
@@ -124,6 +144,7 @@ static int sck_start_stream(SCContentFilter *filter, int fps, int w, int h,
 
     if (startResult != 0) {
         pthread_mutex_destroy(&frame->lock);
+        pthread_cond_destroy(&frame->ready);
         free(frame);
         return -1;
     }
@@ -133,6 +154,7 @@ static int sck_start_stream(SCContentFilter *filter, int fps, int w, int h,
     out->filter = (void *)CFBridgingRetain(filter);
     out->width = w;
     out->height = h;
+    out->fps = fps;
     return 0;
 }
 
@@ -176,6 +198,7 @@ int sck_capture_start_display(int fps, SCKCaptureHandle *out) {
 
         int ret = sck_start_stream(filter, fps, w, h, out);
         if (ret == 0) {
+            out->display_id = mainDisplay.displayID;
             NSLog(@"sck_capture_start_display: capturing %dx%d @ %d fps", w, h, fps);
         }
         return ret;
@@ -248,28 +271,119 @@ int sck_capture_start_window(uint32_t windowID, int fps, int w, int h, SCKCaptur
     }
 }
 
+// Follow a display mode change. SCK keeps delivering frames at the size
+// the stream was configured with (scaling the new mode into it), so the
+// stream is reconfigured to the display's new size; frames at that size
+// follow and the pipeline reopens its encoders for them.
+// Returns 1 if the stream was reconfigured, 0 if nothing changed, -1 on error.
+int sck_capture_follow_display(SCKCaptureHandle *h) {
+    @autoreleasepool {
+        if (!h->display_id || !h->stream) return 0;
+
+        CGRect bounds = CGDisplayBounds((CGDirectDisplayID)h->display_id);
+        int w = (int)bounds.size.width;
+        int hh = (int)bounds.size.height;
+        if (w <= 0 || hh <= 0 || (w == h->width && hh == h->height)) return 0;
+
+        SCStream *stream = (__bridge SCStream *)h->stream;
+        __block int result = 0;
+        dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+        [stream updateConfiguration:sck_make_config(h->fps, w, hh)
+                  completionHandler:^(NSError *error) {
+            if (error) {
+                NSLog(@"sck_capture_follow_display: updateConfiguration error: %@", error);
+                result = -1;
+            }
+            dispatch_semaphore_signal(sem);
+        }];
+        if (dispatch_semaphore_wait(sem, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC)) != 0) {
+            NSLog(@"sck_capture_follow_display: timed out reconfiguring stream");
+            return -1;
+        }
+        if (result != 0) return -1;
+
+        NSLog(@"sck_capture_follow_display: display is now %dx%d (was %dx%d)", w, hh, h->width, h->height);
+        h->width = w;
+        h->height = hh;
+        return 1;
+    }
+}
+
 // ---- Shared grab / stop ----
 
-int sck_capture_grab(SCKCaptureHandle *h, uint8_t **buf, int *stride, int *w, int *h_out) {
+// Returns a retained reference to the latest frame's pixel buffer, to be
+// dropped with sck_capture_release.
+int sck_capture_grab(SCKCaptureHandle *h, void **pixel_buffer, int *stride, int *w, int *h_out) {
     SCKCaptureDelegate *delegate = (__bridge SCKCaptureDelegate *)h->delegate;
     SCKCaptureFrame *frame = delegate.frame;
 
     pthread_mutex_lock(&frame->lock);
 
-    if (!frame->data) {
+    if (!frame->pixelBuffer) {
         pthread_mutex_unlock(&frame->lock);
         return -1;
     }
 
-    *buf = frame->data;
+    *pixel_buffer = (void *)CVPixelBufferRetain(frame->pixelBuffer);
     *stride = frame->stride;
     *w = frame->width;
     *h_out = frame->height;
+    frame->taken = frame->seq;
 
     pthread_mutex_unlock(&frame->lock);
     return 0;
 }
 
+void sck_capture_release(void *pixel_buffer) {
+    CVPixelBufferRelease((CVPixelBufferRef)pixel_buffer);
+}
+
+// Copies a grabbed frame to dst as NV12 with the luma plane's stride, the
+// chroma rows following the luma rows. Returns 0 on success.
+int sck_capture_download(void *pixel_buffer, uint8_t *dst, int stride) {
+    CVPixelBufferRef pb = (CVPixelBufferRef)pixel_buffer;
+    if (CVPixelBufferLockBaseAddress(pb, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess) return -1;
+
+    int height = (int)CVPixelBufferGetHeight(pb);
+    for (int plane = 0; plane < 2; plane++) {
+        const uint8_t *src = CVPixelBufferGetBaseAddressOfPlane(pb, plane);
+        size_t src_stride = CVPixelBufferGetBytesPerRowOfPlane(pb, plane);
+        size_t n = src_stride < (size_t)stride ? src_stride : (size_t)stride;
+        int rows = plane == 0 ? height : height / 2;
+        uint8_t *out = dst + (plane == 0 ? 0 : (size_t)stride * height);
+        for (int y = 0; y < rows; y++) {
+            memcpy(out + (size_t)y * stride, src + y * src_stride, n);
+        }
+    }
+
+    CVPixelBufferUnlockBaseAddress(pb, kCVPixelBufferLock_ReadOnly);
+    return 0;
+}
+
+// Source pacing: wait up to timeout_ms for a frame delivered since the
+// last grab. Returns 1 if there is one, 0 on timeout.
+int sck_capture_wait(SCKCaptureHandle *h, int timeout_ms) {
+    SCKCaptureDelegate *delegate = (__bridge SCKCaptureDelegate *)h->delegate;
+    SCKCaptureFrame *frame = delegate.frame;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long long ns = (long long)now.tv_usec * 1000 + (long long)timeout_ms * 1000000;
+    struct timespec deadline = {
+        .tv_sec = now.tv_sec + (time_t)(ns / 1000000000),
+        .tv_nsec = (long)(ns % 1000000000),
+    };
+
+    pthread_mutex_lock(&frame->lock);
+    int rc = 0;
+    while (frame->seq == frame->taken && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&frame->ready, &frame->lock, &deadline);
+    }
+    int fresh = frame->seq != frame->taken;
+    pthread_mutex_unlock(&frame->lock);
+    return fresh;
+}
+
 void sck_capture_stop(SCKCaptureHandle *h) {
     @autoreleasepool {
         if (!h) return;
@@ -290,7 +404,6 @@ void sck_capture_stop(SCKCaptureHandle *h) {
             if (frame) {
                 pthread_mutex_lock(&frame->lock);
                 if (frame->pixelBuffer) {
-                    CVPixelBufferUnlockBaseAddress(frame->pixelBuffer, kCVPixelBufferLock_ReadOnly);
                     CVPixelBufferRelease(frame->pixelBuffer);
                 }
                 if (frame->sampleBuffer) {
@@ -298,6 +411,7 @@ void sck_capture_stop(SCKCaptureHandle *h) {
                 }
                 pthread_mutex_unlock(&frame->lock);
                 pthread_mutex_destroy(&frame->lock);
+                pthread_cond_destroy(&frame->ready);
                 free(frame);
             }
             (void)delegate;
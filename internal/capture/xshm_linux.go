@@ -3,13 +3,18 @@
 package capture
 
 /*
-#cgo pkg-config: x11 xext xfixes
+#cgo pkg-config: x11 xext xfixes xdamage xrandr
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XShm.h>
 #include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xrandr.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <poll.h>
+#include <time.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,78 +22,262 @@ package capture
 // XShm capturer (fallback when NvFBC is unavailable)
 // ---------------------------------------------------------------------------
 
+// Maximum number of dirty rectangles tracked per frame. Past this the
+// frame is treated as fully damaged.
+#define XSHM_MAX_RECTS 64
+
+// Number of shm-backed images in the capture ring: one filling, one queued
+// and one being encoded.
+#define XSHM_BUFFERS 3
+
 typedef struct {
-	Display *display;
-	Window root;
 	XShmSegmentInfo shminfo;
 	XImage *image;
+
+	// Damage accumulated since this buffer was last filled
+	XRectangle pending[XSHM_MAX_RECTS];
+	int npending;                      // -1 = whole frame
+	XRectangle cursor_rect;            // cursor footprint blended into it
+} XShmBuffer;
+
+typedef struct {
+	Display *display;
+	Window root;
+	int screen;
 	int width;
 	int height;
+	int rr_event_base;                 // -1 when XRandR is unavailable
+
+	XShmBuffer bufs[XSHM_BUFFERS];
+	int nbufs;
+	int cur;                           // buffer filled by the last grab
+	XImage *image;                     // bufs[cur].image
+
+	// XDamage tracking (damage == 0 when disabled or unavailable)
+	Damage damage;
+	int damage_event_base;
+	XserverRegion region;
+	int full_refresh;                  // next grab reports the whole frame
+	XRectangle rects[XSHM_MAX_RECTS];  // dirty rectangles of the last grab
+	int nrects;                        // -1 = whole frame
+	XRectangle cursor_rect;            // where the cursor was composited last
+	unsigned long cursor_serial;
+	int draw_cursor;                   // 0 = cursor is sent out of band
+	int pointer_x, pointer_y;          // source pacing: last polled pointer position
 } XShmCapturer;
 
+// The default Xlib error handler exits the process. A mode set can race a
+// grab (XShmGetImage of an image larger than the new root fails with
+// BadMatch), so errors are logged instead and the failing request reports
+// failure to its caller.
+static int xshm_error_handler(Display *d, XErrorEvent *e) {
+	static int logged = 0;
+	if (logged < 10) {
+		char msg[128];
+		XGetErrorText(d, e->error_code, msg, sizeof(msg));
+		fprintf(stderr, "xshm: X error: %s (request %d.%d)\n", msg, e->request_code, e->minor_code);
+		logged++;
+	}
+	return 0;
+}
+
+static int xshm_buffer_init(XShmCapturer *c, XShmBuffer *b) {
+	b->image = XShmCreateImage(c->display,
+		DefaultVisual(c->display, c->screen),
+		DefaultDepth(c->display, c->screen),
+		ZPixmap, NULL, &b->shminfo,
+		c->width, c->height);
+	if (!b->image) return -1;
+
+	b->shminfo.shmid = shmget(IPC_PRIVATE,
+		b->image->bytes_per_line * b->image->height,
+		IPC_CREAT | 0600);
+	if (b->shminfo.shmid < 0) {
+		XDestroyImage(b->image);
+		b->image = NULL;
+		return -1;
+	}
+
+	b->shminfo.shmaddr = b->image->data = (char*)shmat(b->shminfo.shmid, NULL, 0);
+	b->shminfo.readOnly = False;
+
+	if (!XShmAttach(c->display, &b->shminfo)) {
+		shmdt(b->shminfo.shmaddr);
+		shmctl(b->shminfo.shmid, IPC_RMID, NULL);
+		XDestroyImage(b->image);
+		b->image = NULL;
+		return -1;
+	}
+
+	// Mark for removal so it's cleaned up when we detach
+	shmctl(b->shminfo.shmid, IPC_RMID, NULL);
+
+	b->npending = -1;
+	return 0;
+}
+
+static void xshm_buffer_destroy(XShmCapturer *c, XShmBuffer *b) {
+	if (!b->image) return;
+	XShmDetach(c->display, &b->shminfo);
+	shmdt(b->shminfo.shmaddr);
+	XDestroyImage(b->image);
+	b->image = NULL;
+}
+
+// Reallocate buffer idx if it was created for another screen size. Only
+// called for a buffer no consumer holds.
+// Returns: 0 = unchanged, 1 = reallocated, -1 = allocation failed.
+static int xshm_fit_buffer(XShmCapturer *c, int idx) {
+	XShmBuffer *b = &c->bufs[idx];
+	if (b->image && b->image->width == c->width && b->image->height == c->height) return 0;
+	xshm_buffer_destroy(c, b);
+	if (xshm_buffer_init(c, b) != 0) return -1;
+	memset(&b->cursor_rect, 0, sizeof(b->cursor_rect));
+	XSync(c->display, False);
+	return 1;
+}
+
+// Adopt a new screen size. Buffers are reallocated lazily, as they come
+// free, so frames still being encoded at the old size stay valid.
+static void xshm_set_size(XShmCapturer *c, int width, int height) {
+	if (width == c->width && height == c->height) return;
+	fprintf(stderr, "xshm: screen resized %dx%d -> %dx%d\n", c->width, c->height, width, height);
+	c->width = width;
+	c->height = height;
+	c->full_refresh = 1;
+	c->nrects = -1;
+	memset(&c->cursor_rect, 0, sizeof(c->cursor_rect));
+	for (int i = 0; i < c->nbufs; i++) c->bufs[i].npending = -1;
+}
+
+// Drain pending events. DamageNotify events only count (the damage
+// region is read directly); RRScreenChangeNotify updates Xlib's idea of
+// the screen size, which is then adopted. Returns 1 if the screen was
+// damaged or resized.
+static int xshm_poll_events(XShmCapturer *c) {
+	int changed = 0, damaged = 0;
+	while (XPending(c->display)) {
+		XEvent ev;
+		XNextEvent(c->display, &ev);
+		if (c->rr_event_base >= 0 && ev.type == c->rr_event_base + RRScreenChangeNotify) {
+			XRRUpdateConfiguration(&ev);
+			changed = 1;
+		} else if (c->damage && ev.type == c->damage_event_base + XDamageNotify) {
+			damaged = 1;
+		}
+	}
+	if (changed) {
+		xshm_set_size(c, DisplayWidth(c->display, c->screen), DisplayHeight(c->display, c->screen));
+	}
+	return changed || damaged;
+}
+
+// Returns 1 if the pointer moved since the last call. A composited cursor
+// moving over an otherwise static screen causes no damage.
+static int xshm_pointer_moved(XShmCapturer *c) {
+	Window root, child;
+	int x, y, wx, wy;
+	unsigned int mask;
+	if (!XQueryPointer(c->display, c->root, &root, &child, &x, &y, &wx, &wy, &mask)) return 0;
+	if (x == c->pointer_x && y == c->pointer_y) return 0;
+	c->pointer_x = x;
+	c->pointer_y = y;
+	return 1;
+}
+
+static long xshm_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Source pacing: wait up to timeout_ms for the screen to change. The
+// damage object reports (XDamageReportNonEmpty) when its region goes from
+// empty to non-empty, and every damaged grab empties it, so one
+// DamageNotify arrives per frame's worth of drawing. With a composited
+// cursor the pointer is also polled every poll_ms. Returns 1 if something
+// changed, 0 on timeout.
+static int xshm_wait_frame(XShmCapturer *c, int timeout_ms, int poll_ms) {
+	int fd = ConnectionNumber(c->display);
+	long deadline = xshm_now_ms() + timeout_ms;
+	for (;;) {
+		if (xshm_poll_events(c)) return 1;
+		if (c->draw_cursor && xshm_pointer_moved(c)) return 1;
+
+		long left = deadline - xshm_now_ms();
+		if (left <= 0) return 0;
+		if (c->draw_cursor && left > poll_ms) left = poll_ms;
+		struct pollfd p = { .fd = fd, .events = POLLIN };
+		poll(&p, 1, (int)left);
+	}
+}
+
+// After a failed grab, pick up a size change that arrived without an
+// XRandR event (or before it was read).
+static void xshm_check_geometry(XShmCapturer *c) {
+	Window root;
+	int x, y;
+	unsigned int w, h, border, depth;
+	if (XGetGeometry(c->display, c->root, &root, &x, &y, &w, &h, &border, &depth)) {
+		xshm_set_size(c, (int)w, (int)h);
+	}
+}
+
 static XShmCapturer* xshm_init(const char *display_name) {
 	XShmCapturer *c = (XShmCapturer*)calloc(1, sizeof(XShmCapturer));
 	if (!c) return NULL;
 
 	c->display = XOpenDisplay(display_name);
 	if (!c->display) { free(c); return NULL; }
-
-	int screen = DefaultScreen(c->display);
-	c->root = RootWindow(c->display, screen);
-	c->width = DisplayWidth(c->display, screen);
-	c->height = DisplayHeight(c->display, screen);
-
-	c->image = XShmCreateImage(c->display,
-		DefaultVisual(c->display, screen),
-		DefaultDepth(c->display, screen),
-		ZPixmap, NULL, &c->shminfo,
-		c->width, c->height);
-	if (!c->image) {
-		XCloseDisplay(c->display);
-		free(c);
-		return NULL;
+	XSetErrorHandler(xshm_error_handler);
+
+	c->screen = DefaultScreen(c->display);
+	c->root = RootWindow(c->display, c->screen);
+	c->width = DisplayWidth(c->display, c->screen);
+	c->height = DisplayHeight(c->display, c->screen);
+
+	int rr_error_base;
+	if (XRRQueryExtension(c->display, &c->rr_event_base, &rr_error_base)) {
+		XRRSelectInput(c->display, c->root, RRScreenChangeNotifyMask);
+	} else {
+		c->rr_event_base = -1;
 	}
 
-	c->shminfo.shmid = shmget(IPC_PRIVATE,
-		c->image->bytes_per_line * c->image->height,
-		IPC_CREAT | 0600);
-	if (c->shminfo.shmid < 0) {
-		XDestroyImage(c->image);
-		XCloseDisplay(c->display);
-		free(c);
-		return NULL;
+	// A short ring still works (pipelining just overlaps less), so only
+	// the first buffer is mandatory.
+	for (int i = 0; i < XSHM_BUFFERS; i++) {
+		if (xshm_buffer_init(c, &c->bufs[i]) != 0) break;
+		c->nbufs++;
 	}
-
-	c->shminfo.shmaddr = c->image->data = (char*)shmat(c->shminfo.shmid, NULL, 0);
-	c->shminfo.readOnly = False;
-
-	if (!XShmAttach(c->display, &c->shminfo)) {
-		shmdt(c->shminfo.shmaddr);
-		shmctl(c->shminfo.shmid, IPC_RMID, NULL);
-		XDestroyImage(c->image);
+	if (c->nbufs == 0) {
 		XCloseDisplay(c->display);
 		free(c);
 		return NULL;
 	}
+	XSync(c->display, False);
 
-	// Mark for removal so it's cleaned up when we detach
-	shmctl(c->shminfo.shmid, IPC_RMID, NULL);
-
+	c->cur = 0;
+	c->image = c->bufs[0].image;
+	c->nrects = -1;
+	c->draw_cursor = 1;
 	return c;
 }
 
-static int xshm_grab(XShmCapturer *c) {
-	if (!XShmGetImage(c->display, c->root, c->image, 0, 0, AllPlanes)) {
-		return -1;
-	}
+// Enable XDamage tracking on the root window. Returns 0 on success, -1 if
+// the extension is unavailable (the capturer keeps doing full grabs).
+static int xshm_enable_damage(XShmCapturer *c) {
+	int error_base;
+	if (!XDamageQueryExtension(c->display, &c->damage_event_base, &error_base)) return -1;
+
+	c->damage = XDamageCreate(c->display, c->root, XDamageReportNonEmpty);
+	if (!c->damage) return -1;
+	c->region = XFixesCreateRegion(c->display, NULL, 0);
+	c->full_refresh = 1;
 	XSync(c->display, False);
 	return 0;
 }
 
-static void xshm_composite_cursor(XShmCapturer *c) {
-	XFixesCursorImage *cursor = XFixesGetCursorImage(c->display);
-	if (!cursor) return;
-
+static void xshm_blend_cursor(XShmCapturer *c, XImage *img, XFixesCursorImage *cursor) {
 	int cx = cursor->x - cursor->xhot;
 	int cy = cursor->y - cursor->yhot;
 
@@ -107,8 +296,8 @@ static void xshm_composite_cursor(XShmCapturer *c) {
 			unsigned char cg = (pixel >> 8) & 0xFF;
 			unsigned char cb = (pixel >> 16) & 0xFF;
 
-			int offset = dy * c->image->bytes_per_line + dx * 4;
-			unsigned char *dst = (unsigned char*)c->image->data + offset;
+			int offset = dy * img->bytes_per_line + dx * 4;
+			unsigned char *dst = (unsigned char*)img->data + offset;
 
 			if (a == 255) {
 				dst[0] = cb;
@@ -121,14 +310,169 @@ static void xshm_composite_cursor(XShmCapturer *c) {
 			}
 		}
 	}
-	XFree(cursor);
+}
+
+// Full-frame grab into ring buffer idx.
+static int xshm_grab(XShmCapturer *c, int idx) {
+	XShmBuffer *b = &c->bufs[idx];
+	if (!XShmGetImage(c->display, c->root, b->image, 0, 0, AllPlanes)) {
+		xshm_check_geometry(c);
+		return -1;
+	}
+	XSync(c->display, False);
+
+	XFixesCursorImage *cursor = c->draw_cursor ? XFixesGetCursorImage(c->display) : NULL;
+	if (cursor) {
+		xshm_blend_cursor(c, b->image, cursor);
+		XFree(cursor);
+	}
+	c->cur = idx;
+	c->image = b->image;
+	return 0;
+}
+
+// Append a rectangle (clipped to the screen) to a dirty list; *n == -1
+// means the list already covers the whole frame.
+static void xshm_add_rect(XShmCapturer *c, XRectangle *list, int *n,
+                          int x, int y, int w, int h) {
+	if (*n < 0) return;
+	if (x < 0) { w += x; x = 0; }
+	if (y < 0) { h += y; y = 0; }
+	if (x + w > c->width) w = c->width - x;
+	if (y + h > c->height) h = c->height - y;
+	if (w <= 0 || h <= 0) return;
+	if (*n >= XSHM_MAX_RECTS) { *n = -1; return; }
+	XRectangle *r = &list[(*n)++];
+	r->x = x; r->y = y; r->width = w; r->height = h;
+}
+
+static int xshm_cmp_rect_y(const void *a, const void *b) {
+	return ((const XRectangle*)a)->y - ((const XRectangle*)b)->y;
+}
+
+// Fetch full-width row bands [y, y+h) into an shm image. XShmGetImage
+// always writes with the image's own stride, so sub-rects are widened to
+// the full row and fetched as a band at the matching offset.
+static int xshm_fetch_band(XShmCapturer *c, XImage *img, int y, int h) {
+	XImage band = *img;
+	band.height = h;
+	band.data = img->data + (size_t)y * img->bytes_per_line;
+	return XShmGetImage(c->display, c->root, &band, 0, y, AllPlanes) ? 0 : -1;
+}
+
+// Refetch everything stale in buffer b, merging its pending rects into
+// row bands.
+static int xshm_fetch_pending(XShmCapturer *c, XShmBuffer *b) {
+	if (b->npending < 0) {
+		return XShmGetImage(c->display, c->root, b->image, 0, 0, AllPlanes) ? 0 : -1;
+	}
+	if (b->npending == 0) return 0;
+
+	qsort(b->pending, b->npending, sizeof(XRectangle), xshm_cmp_rect_y);
+	int y0 = b->pending[0].y;
+	int y1 = y0 + b->pending[0].height;
+	for (int i = 1; i <= b->npending; i++) {
+		if (i < b->npending && b->pending[i].y <= y1) {
+			int end = b->pending[i].y + b->pending[i].height;
+			if (end > y1) y1 = end;
+			continue;
+		}
+		if (xshm_fetch_band(c, b->image, y0, y1 - y0) != 0) return -1;
+		if (i < b->npending) {
+			y0 = b->pending[i].y;
+			y1 = y0 + b->pending[i].height;
+		}
+	}
+	return 0;
+}
+
+// Damage-driven grab into ring buffer idx. Damage reported since the last
+// grab is queued on every buffer; idx then refetches only the rows that
+// went stale since it was last filled (plus its own and the new cursor
+// footprint). c->rects reports what changed relative to the previous frame.
+// Returns: 0 = frame changed, 1 = unchanged since last grab, -1 = error.
+static int xshm_grab_damaged(XShmCapturer *c, int idx) {
+	c->nrects = c->full_refresh ? -1 : 0;
+
+	XDamageSubtract(c->display, c->damage, None, c->region);
+	int n = 0;
+	XRectangle *dr = XFixesFetchRegion(c->display, c->region, &n);
+	if (dr) {
+		for (int i = 0; i < n; i++) {
+			xshm_add_rect(c, c->rects, &c->nrects, dr[i].x, dr[i].y, dr[i].width, dr[i].height);
+		}
+		XFree(dr);
+	}
+
+	// Without a composited cursor cr stays empty and never counts as moved.
+	XFixesCursorImage *cursor = c->draw_cursor ? XFixesGetCursorImage(c->display) : NULL;
+	XRectangle cr = {0};
+	if (cursor) {
+		cr.x = cursor->x - cursor->xhot;
+		cr.y = cursor->y - cursor->yhot;
+		cr.width = cursor->width;
+		cr.height = cursor->height;
+	}
+	int cursor_moved = cr.x != c->cursor_rect.x || cr.y != c->cursor_rect.y ||
+	                   cr.width != c->cursor_rect.width || cr.height != c->cursor_rect.height ||
+	                   (cursor && cursor->cursor_serial != c->cursor_serial);
+
+	if (c->nrects == 0 && !cursor_moved) {
+		if (cursor) XFree(cursor);
+		return 1;
+	}
+
+	// The cursor is blended into the buffers, so its old footprint must be
+	// restored and the new one redrawn whenever anything is refetched.
+	xshm_add_rect(c, c->rects, &c->nrects, c->cursor_rect.x, c->cursor_rect.y, c->cursor_rect.width, c->cursor_rect.height);
+	xshm_add_rect(c, c->rects, &c->nrects, cr.x, cr.y, cr.width, cr.height);
+
+	// Everything that changed is now stale in every buffer of the ring.
+	for (int i = 0; i < c->nbufs; i++) {
+		XShmBuffer *o = &c->bufs[i];
+		if (c->nrects < 0) { o->npending = -1; continue; }
+		for (int r = 0; r < c->nrects; r++) {
+			xshm_add_rect(c, o->pending, &o->npending,
+				c->rects[r].x, c->rects[r].y, c->rects[r].width, c->rects[r].height);
+		}
+	}
+
+	XShmBuffer *b = &c->bufs[idx];
+	xshm_add_rect(c, b->pending, &b->npending, b->cursor_rect.x, b->cursor_rect.y, b->cursor_rect.width, b->cursor_rect.height);
+	xshm_add_rect(c, b->pending, &b->npending, cr.x, cr.y, cr.width, cr.height);
+
+	int ret = xshm_fetch_pending(c, b);
+	XSync(c->display, False);
+
+	if (ret != 0) {
+		c->full_refresh = 1;
+		b->npending = -1;
+		if (cursor) XFree(cursor);
+		xshm_check_geometry(c);
+		return -1;
+	}
+	c->full_refresh = 0;
+	b->npending = 0;
+
+	if (cursor) {
+		xshm_blend_cursor(c, b->image, cursor);
+		c->cursor_serial = cursor->cursor_serial;
+		XFree(cursor);
+	}
+	b->cursor_rect = cr;
+	c->cursor_rect = cr;
+	c->cur = idx;
+	c->image = b->image;
+	return 0;
 }
 
 static void xshm_destroy(XShmCapturer *c) {
 	if (!c) return;
-	XShmDetach(c->display, &c->shminfo);
-	shmdt(c->shminfo.shmaddr);
-	XDestroyImage(c->image);
+	if (c->region) XFixesDestroyRegion(c->display, c->region);
+	if (c->damage) XDamageDestroy(c->display, c->damage);
+	for (int i = 0; i < c->nbufs; i++) {
+		xshm_buffer_destroy(c, &c->bufs[i]);
+	}
 	XCloseDisplay(c->display);
 	free(c);
 }
@@ -137,22 +481,41 @@ import "C"
 import (
 	"fmt"
 	"image"
-	"image/color"
 	"log"
 	"os/exec"
 	"strings"
+	"sync"
+	"time"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
 // XshmCapturer captures frames via X11 shared memory (CPU fallback).
+//
+// Frames come from a ring of shm segments and stay valid until passed to
+// ReleaseFrame, so the encoder can read one buffer while the X server
+// fills the next.
 type XshmCapturer struct {
-	c   *C.XShmCapturer
-	fps int
+	c      *C.XShmCapturer
+	fps    int
+	damage [C.XSHM_BUFFERS][]image.Rectangle // per ring buffer, reused across grabs
+
+	grabMu sync.Mutex // serializes Grab and SetSourcePacing
+	waitMs int        // source pacing: Grab waits this long for damage (0 = off)
+
+	mu   sync.Mutex
+	refs [C.XSHM_BUFFERS]int            // outstanding frames per ring buffer
+	ptrs [C.XSHM_BUFFERS]unsafe.Pointer // pixel data per ring buffer, for ReleaseFrame
+
+	frames sync.Pool // *types.Frame headers, recycled by ReleaseFrame
 }
 
-var experimentalNvFBC bool
+var (
+	experimentalNvFBC bool
+	damageTracking    bool
+	cursorChannel     bool
+)
 
 // SetExperimentalNvFBC toggles the Linux NvFBC capture probe.
 //
@@ -161,6 +524,23 @@ func SetExperimentalNvFBC(enabled bool) {
 	experimentalNvFBC = enabled
 }
 
+// SetDamageTracking toggles XDamage-driven capture for the XShm capturer.
+//
+// When enabled, only regions reported damaged by the X server are refetched
+// and Grab marks frames as Unchanged when nothing on screen moved.
+func SetDamageTracking(enabled bool) {
+	damageTracking = enabled
+}
+
+// SetCursorChannel controls whether capturers composite the cursor.
+//
+// When enabled, frames are captured without the cursor and the client
+// draws it from the shape and position reported by a CursorSource, so
+// moving the mouse alone no longer changes the frame.
+func SetCursorChannel(enabled bool) {
+	cursorChannel = enabled
+}
+
 // NewCapturer creates a screen capturer.
 //
 // Linux defaults to XShm. NvFBC can be enabled with --experimental-nvfbc.
@@ -176,7 +556,12 @@ func NewCapturer(displayName string, fps, gpu int) (types.MediaCapturer, error)
 			log.Printf("capture: experimental NvFBC probe failed: %v; falling back to XShm", err)
 		}
 	}
+	return NewXShmCapturer(displayName, fps)
+}
 
+// NewXShmCapturer creates an XShm capturer, whose frames are in host
+// memory, regardless of --experimental-nvfbc.
+func NewXShmCapturer(displayName string, fps int) (types.MediaCapturer, error) {
 	cDisplay := C.CString(displayName)
 	defer C.free(unsafe.Pointer(cDisplay))
 
@@ -184,8 +569,30 @@ func NewCapturer(displayName string, fps, gpu int) (types.MediaCapturer, error)
 	if xshm == nil {
 		return nil, fmt.Errorf("failed to initialize XShm capture on %s", displayName)
 	}
-	log.Printf("capture: XShm (%dx%d)", int(xshm.width), int(xshm.height))
-	return &XshmCapturer{c: xshm, fps: fps}, nil
+	if cursorChannel {
+		xshm.draw_cursor = 0
+	}
+	mode := "full"
+	if damageTracking {
+		if C.xshm_enable_damage(xshm) == 0 {
+			mode = "damage"
+		} else {
+			log.Printf("capture: XDamage unavailable on %s, using full-frame grabs", displayName)
+		}
+	}
+	log.Printf("capture: XShm (%dx%d, %s, %d buffers, cursor %s)", int(xshm.width), int(xshm.height), mode, int(xshm.nbufs), cursorMode())
+	c := &XshmCapturer{c: xshm, fps: fps}
+	for i := 0; i < int(xshm.nbufs); i++ {
+		c.ptrs[i] = unsafe.Pointer(xshm.bufs[i].image.data)
+	}
+	return c, nil
+}
+
+func cursorMode() string {
+	if cursorChannel {
+		return "channel"
+	}
+	return "composited"
 }
 
 func rawPCIBusIDForGPU(gpu int) (string, error) {
@@ -210,45 +617,157 @@ func (c *XshmCapturer) Width() int  { return int(c.c.width) }
 func (c *XshmCapturer) Height() int { return int(c.c.height) }
 
 func (c *XshmCapturer) Grab() (*types.Frame, error) {
-	if C.xshm_grab(c.c) != 0 {
+	c.grabMu.Lock()
+	defer c.grabMu.Unlock()
+
+	// Picks up XRandR mode changes; frames are then grabbed at the new
+	// size, and the pipeline reopens its encoders when it sees one. When
+	// source-paced, first waits for damage; on timeout the damage grab
+	// below reports the frame unchanged.
+	if c.waitMs > 0 {
+		C.xshm_wait_frame(c.c, C.int(c.waitMs), C.int(1000/max(c.fps, 1)))
+	} else {
+		C.xshm_poll_events(c.c)
+	}
+
+	idx := c.acquireBuffer()
+	if idx < 0 {
+		return nil, fmt.Errorf("all %d XShm buffers in use", int(c.c.nbufs))
+	}
+	switch C.xshm_fit_buffer(c.c, C.int(idx)) {
+	case -1:
+		c.mu.Lock()
+		c.refs[idx]--
+		c.ptrs[idx] = nil
+		c.mu.Unlock()
+		return nil, fmt.Errorf("XShm buffer allocation at %dx%d failed", int(c.c.width), int(c.c.height))
+	case 1:
+		c.mu.Lock()
+		c.ptrs[idx] = unsafe.Pointer(c.c.bufs[idx].image.data)
+		c.mu.Unlock()
+		c.damage[idx] = c.damage[idx][:0]
+	}
+
+	if c.c.damage == 0 {
+		if C.xshm_grab(c.c, C.int(idx)) != 0 {
+			c.unref(idx)
+			return nil, fmt.Errorf("XShmGetImage failed")
+		}
+		return c.frame(idx), nil
+	}
+
+	switch C.xshm_grab_damaged(c.c, C.int(idx)) {
+	case 1:
+		// Unchanged: hand out the previous frame's buffer instead.
+		c.unref(idx)
+		prev := int(c.c.cur)
+		c.ref(prev)
+		frame := c.frame(prev)
+		frame.Unchanged = true
+		frame.Damage = c.damage[prev][:0]
+		return frame, nil
+	case 0:
+		frame := c.frame(idx)
+		if n := int(c.c.nrects); n >= 0 {
+			damage := c.damage[idx][:0]
+			for i := 0; i < n; i++ {
+				r := c.c.rects[i]
+				damage = append(damage, image.Rect(int(r.x), int(r.y),
+					int(r.x)+int(r.width), int(r.y)+int(r.height)))
+			}
+			c.damage[idx] = damage
+			frame.Damage = damage
+		}
+		return frame, nil
+	default:
+		c.unref(idx)
 		return nil, fmt.Errorf("XShmGetImage failed")
 	}
-	C.xshm_composite_cursor(c.c)
+}
 
-	return &types.Frame{
-		Ptr:    unsafe.Pointer(c.c.image.data),
-		Width:  int(c.c.width),
-		Height: int(c.c.height),
-		Stride: int(c.c.image.bytes_per_line),
-	}, nil
+// SetSourcePacing makes Grab wait for XDamage events instead of grabbing
+// unconditionally, turning on damage tracking if --xdamage
+// didn't. A composited cursor is polled once per frame interval as well,
+// since moving it damages nothing.
+func (c *XshmCapturer) SetSourcePacing(timeout time.Duration) error {
+	c.grabMu.Lock()
+	defer c.grabMu.Unlock()
+	if c.c.damage == 0 {
+		if C.xshm_enable_damage(c.c) != 0 {
+			return fmt.Errorf("XDamage unavailable")
+		}
+		log.Printf("capture: XShm damage tracking enabled for source pacing")
+	}
+	c.waitMs = int(timeout.Milliseconds())
+	return nil
 }
 
-// GrabImage grabs a frame and returns it as a Go image (for debug endpoint).
-func (c *XshmCapturer) GrabImage() (image.Image, error) {
-	if C.xshm_grab(c.c) != 0 {
-		return nil, fmt.Errorf("XShmGetImage failed")
+func (c *XshmCapturer) frame(idx int) *types.Frame {
+	img := c.c.bufs[idx].image
+	f, _ := c.frames.Get().(*types.Frame)
+	if f == nil {
+		f = new(types.Frame)
 	}
-	C.xshm_composite_cursor(c.c)
-	w := int(c.c.width)
-	h := int(c.c.height)
-	stride := int(c.c.image.bytes_per_line)
-	size := stride * h
-	bgra := C.GoBytes(unsafe.Pointer(c.c.image.data), C.int(size))
-	return bgraToImage(bgra, w, h, stride), nil
+	*f = types.Frame{
+		Ptr:    unsafe.Pointer(img.data),
+		Width:  int(img.width),
+		Height: int(img.height),
+		Stride: int(img.bytes_per_line),
+	}
+	return f
 }
 
-func (c *XshmCapturer) Close() {
-	C.xshm_destroy(c.c)
+// acquireBuffer reserves a free ring buffer for the next grab, preferring
+// the last-filled one (it has the least stale damage). Returns -1 if every
+// buffer is still held by a consumer.
+func (c *XshmCapturer) acquireBuffer() int {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	n := int(c.c.nbufs)
+	cur := int(c.c.cur)
+	for i := 0; i < n; i++ {
+		idx := (cur + i) % n
+		if c.refs[idx] == 0 {
+			c.refs[idx]++
+			return idx
+		}
+	}
+	return -1
 }
 
-// bgraToImage converts BGRA pixel data to an RGBA image.
-func bgraToImage(bgra []byte, w, h, stride int) image.Image {
-	img := image.NewRGBA(image.Rect(0, 0, w, h))
-	for y := 0; y < h; y++ {
-		for x := 0; x < w; x++ {
-			off := y*stride + x*4
-			img.SetRGBA(x, y, color.RGBA{bgra[off+2], bgra[off+1], bgra[off], 255})
+func (c *XshmCapturer) ref(idx int) {
+	c.mu.Lock()
+	c.refs[idx]++
+	c.mu.Unlock()
+}
+
+func (c *XshmCapturer) unref(idx int) {
+	c.mu.Lock()
+	if c.refs[idx] > 0 {
+		c.refs[idx]--
+	}
+	c.mu.Unlock()
+}
+
+// FrameBuffers returns the number of frames that may be outstanding at once.
+func (c *XshmCapturer) FrameBuffers() int { return int(c.c.nbufs) }
+
+// ReleaseFrame hands a frame's shm buffer back to the ring. f itself is
+// recycled for a later Grab, so the caller must not use it afterwards.
+func (c *XshmCapturer) ReleaseFrame(f *types.Frame) {
+	c.mu.Lock()
+	for i, p := range c.ptrs {
+		if p != nil && p == f.Ptr {
+			if c.refs[i] > 0 {
+				c.refs[i]--
+			}
+			break
 		}
 	}
-	return img
+	c.mu.Unlock()
+	c.frames.Put(f)
+}
+
+func (c *XshmCapturer) Close() {
+	C.xshm_destroy(c.c)
 }
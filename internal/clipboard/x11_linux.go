@@ -3,93 +3,363 @@
 package clipboard
 
 /*
-#cgo pkg-config: x11
+#cgo pkg-config: x11 xfixes
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
+#include <X11/extensions/Xfixes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-
-static Display *clip_display = NULL;
-static Window clip_window;
-static Atom CLIPBOARD;
-static Atom UTF8_STRING;
-static Atom TARGETS;
-static Atom BUNGHOLE_SEL;
-static char *owned_text = NULL;
-static int own_len = 0;
-
-static int clip_init(const char *display_name) {
-	clip_display = XOpenDisplay(display_name);
-	if (!clip_display) return -1;
-
-	CLIPBOARD = XInternAtom(clip_display, "CLIPBOARD", False);
-	UTF8_STRING = XInternAtom(clip_display, "UTF8_STRING", False);
-	TARGETS = XInternAtom(clip_display, "TARGETS", False);
-	BUNGHOLE_SEL = XInternAtom(clip_display, "BUNGHOLE_SEL", False);
-
-	clip_window = XCreateSimpleWindow(clip_display,
-		DefaultRootWindow(clip_display),
+#include <unistd.h>
+
+// Largest clipboard text taken from or served to other applications.
+#define CLIP_MAX (16 << 20)
+// Concurrent INCR transfers to requestors of our text.
+#define CLIP_MAX_SENDS 8
+// An INCR transfer whose requestor took no chunk for this long is dropped.
+#define CLIP_SEND_TIMEOUT_MS 10000
+
+// An INCR transfer of our text to one requestor: chunks are written each
+// time it deletes the property.
+typedef struct {
+	Window requestor;
+	Atom property;
+	Atom target;
+	char *text;     // own copy, so a newer clip_set doesn't cut it off
+	int len;
+	int off;
+	int done;       // the empty closing chunk has been written
+	long last_ms;   // when the last chunk was written
+} ClipSend;
+
+// One clipboard connection per handler, since several desktops can be
+// served from one process. The handler's Run goroutine is the only one
+// that touches the display; other goroutines only write to wake_wr.
+typedef struct {
+	Display *display;
+	Window window;
+	Atom CLIPBOARD, UTF8_STRING, TARGETS, INCR, BUNGHOLE_SEL;
+	int xfixes_event;
+	int wake_rd, wake_wr;
+
+	char *owned;         // text we own the selection with
+	int owned_len;
+	int chunk;           // largest property written in one request
+
+	char *recv;          // INCR transfer from the owner in progress
+	int recv_len;
+	int recv_cap;
+	int receiving;
+
+	ClipSend sends[CLIP_MAX_SENDS];
+} ClipCtx;
+
+static ClipCtx *clip_open(const char *display_name) {
+	ClipCtx *c = (ClipCtx*)calloc(1, sizeof(ClipCtx));
+	if (!c) return NULL;
+	c->display = XOpenDisplay(display_name);
+	if (!c->display) { free(c); return NULL; }
+
+	int error_base;
+	if (!XFixesQueryExtension(c->display, &c->xfixes_event, &error_base)) {
+		XCloseDisplay(c->display);
+		free(c);
+		return NULL;
+	}
+	int fds[2];
+	if (pipe(fds) != 0) {
+		XCloseDisplay(c->display);
+		free(c);
+		return NULL;
+	}
+	c->wake_rd = fds[0];
+	c->wake_wr = fds[1];
+	fcntl(c->wake_rd, F_SETFL, O_NONBLOCK);
+	fcntl(c->wake_wr, F_SETFL, O_NONBLOCK);
+
+	c->CLIPBOARD = XInternAtom(c->display, "CLIPBOARD", False);
+	c->UTF8_STRING = XInternAtom(c->display, "UTF8_STRING", False);
+	c->TARGETS = XInternAtom(c->display, "TARGETS", False);
+	c->INCR = XInternAtom(c->display, "INCR", False);
+	c->BUNGHOLE_SEL = XInternAtom(c->display, "BUNGHOLE_SEL", False);
+
+	long max = XExtendedMaxRequestSize(c->display);
+	if (max == 0) max = XMaxRequestSize(c->display);
+	c->chunk = (int)(max * 4) - 1024;
+	if (c->chunk > (256 << 10)) c->chunk = 256 << 10;
+
+	c->window = XCreateSimpleWindow(c->display, DefaultRootWindow(c->display),
 		0, 0, 1, 1, 0, 0, 0);
+	// PropertyChangeMask: INCR chunks from the owner arrive as property
+	// changes on our window.
+	XSelectInput(c->display, c->window, PropertyChangeMask);
+	XFixesSelectSelectionInput(c->display, c->window, c->CLIPBOARD,
+		XFixesSetSelectionOwnerNotifyMask);
+
+	// Pick up whatever is on the clipboard already.
+	if (XGetSelectionOwner(c->display, c->CLIPBOARD) != None) {
+		XConvertSelection(c->display, c->CLIPBOARD, c->UTF8_STRING, c->BUNGHOLE_SEL,
+			c->window, CurrentTime);
+	}
+	XFlush(c->display);
+	return c;
+}
 
+// Set clipboard content (take ownership)
+static void clip_set(ClipCtx *c, const char *text, int len) {
+	char *t = (char*)malloc(len + 1);
+	if (!t) return;
+	memcpy(t, text, len);
+	t[len] = 0;
+	free(c->owned);
+	c->owned = t;
+	c->owned_len = len;
+
+	XSetSelectionOwner(c->display, c->CLIPBOARD, c->window, CurrentTime);
+	XFlush(c->display);
+}
+
+static void clip_wake(ClipCtx *c) {
+	char b = 0;
+	// A full pipe already has a wakeup pending.
+	if (write(c->wake_wr, &b, 1) < 0) return;
+}
+
+// clip_wait blocks until an X event is queued or clip_wake is called.
+// Returns 1 when woken.
+static int clip_wait(ClipCtx *c) {
+	if (XPending(c->display)) return 0;
+	struct pollfd fds[2] = {
+		{ ConnectionNumber(c->display), POLLIN, 0 },
+		{ c->wake_rd, POLLIN, 0 },
+	};
+	while (poll(fds, 2, -1) < 0 && errno == EINTR) {}
+	if (fds[1].revents & POLLIN) {
+		char buf[64];
+		while (read(c->wake_rd, buf, sizeof(buf)) > 0) {}
+		return 1;
+	}
 	return 0;
 }
 
-// Set clipboard content (take ownership)
-static void clip_set(const char *text, int len) {
-	if (!clip_display) return;
+// Append property data to the INCR transfer being received.
+static void recv_append(ClipCtx *c, const unsigned char *data, int n) {
+	if (c->recv_len < 0) return;
+	if (c->recv_len + n > CLIP_MAX) {
+		c->recv_len = -1; // too large: dropped when it ends
+		return;
+	}
+	if (c->recv_len + n > c->recv_cap) {
+		int cap = c->recv_cap ? c->recv_cap * 2 : 64 << 10;
+		while (cap < c->recv_len + n) cap *= 2;
+		char *r = (char*)realloc(c->recv, cap);
+		if (!r) { c->recv_len = -1; return; }
+		c->recv = r;
+		c->recv_cap = cap;
+	}
+	memcpy(c->recv + c->recv_len, data, n);
+	c->recv_len += n;
+}
+
+// Read (and delete) BUNGHOLE_SEL on our window. Returns its type, or None.
+static Atom read_sel(ClipCtx *c, unsigned char **data, unsigned long *n) {
+	Atom type;
+	int format;
+	unsigned long bytes_after;
+	*data = NULL;
+	*n = 0;
+	XGetWindowProperty(c->display, c->window, c->BUNGHOLE_SEL,
+		0, CLIP_MAX / 4, True, AnyPropertyType,
+		&type, &format, n, &bytes_after, data);
+	if (format != 8 && type != c->INCR) *n = 0;
+	return type;
+}
+
+static int take_text(const unsigned char *data, int n, char **out_text, int *out_len) {
+	*out_text = (char*)malloc(n + 1);
+	if (!*out_text) return 0;
+	memcpy(*out_text, data, n);
+	(*out_text)[n] = 0;
+	*out_len = n;
+	return 1;
+}
+
+static long clip_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-	if (owned_text) free(owned_text);
-	owned_text = (char*)malloc(len + 1);
-	memcpy(owned_text, text, len);
-	owned_text[len] = 0;
-	own_len = len;
+// Requestors of our text may be gone by the time we write to them. The
+// default Xlib handler exits the process on any error, so BadWindow is
+// ignored; other errors go to the handler installed before (XShm's logs).
+static XErrorHandler clip_prev_handler;
 
-	XSetSelectionOwner(clip_display, CLIPBOARD, clip_window, CurrentTime);
-	XFlush(clip_display);
+static int clip_error_handler(Display *d, XErrorEvent *e) {
+	if (e->error_code == BadWindow) return 0;
+	return clip_prev_handler ? clip_prev_handler(d, e) : 0;
 }
 
-// Request clipboard content from current owner
-static void clip_request() {
-	if (!clip_display) return;
-	XConvertSelection(clip_display, CLIPBOARD, UTF8_STRING, BUNGHOLE_SEL,
-		clip_window, CurrentTime);
-	XFlush(clip_display);
+static void clip_install_error_handler(void) {
+	clip_prev_handler = XSetErrorHandler(clip_error_handler);
 }
 
-// Process one X event, returns:
+static ClipSend *find_send(ClipCtx *c, Window w, Atom prop) {
+	for (int i = 0; i < CLIP_MAX_SENDS; i++) {
+		ClipSend *s = &c->sends[i];
+		if (s->text && s->requestor == w && s->property == prop) return s;
+	}
+	return NULL;
+}
+
+static void end_send(ClipCtx *c, ClipSend *s) {
+	Window w = s->requestor;
+	free(s->text);
+	memset(s, 0, sizeof(*s));
+	for (int i = 0; i < CLIP_MAX_SENDS; i++) {
+		if (c->sends[i].text && c->sends[i].requestor == w) return;
+	}
+	XSelectInput(c->display, w, NoEventMask);
+}
+
+// Drop the transfers to a requestor window that was destroyed.
+static void drop_sends(ClipCtx *c, Window w) {
+	for (int i = 0; i < CLIP_MAX_SENDS; i++) {
+		ClipSend *s = &c->sends[i];
+		if (s->text && s->requestor == w) {
+			free(s->text);
+			memset(s, 0, sizeof(*s));
+		}
+	}
+}
+
+// End transfers whose requestor stopped taking chunks.
+static void reap_sends(ClipCtx *c) {
+	long now = clip_now_ms();
+	for (int i = 0; i < CLIP_MAX_SENDS; i++) {
+		ClipSend *s = &c->sends[i];
+		if (s->text && now - s->last_ms > CLIP_SEND_TIMEOUT_MS) end_send(c, s);
+	}
+}
+
+// Answer a request for our text, starting an INCR transfer when it
+// doesn't fit in one request. Returns 0 if the request was refused
+// because CLIP_MAX_SENDS transfers are in progress.
+static int serve_text(ClipCtx *c, XSelectionRequestEvent *req, XSelectionEvent *resp) {
+	if (c->owned_len <= c->chunk) {
+		XChangeProperty(c->display, req->requestor, req->property,
+			req->target, 8, PropModeReplace,
+			(unsigned char*)c->owned, c->owned_len);
+		resp->property = req->property;
+		return 1;
+	}
+	reap_sends(c);
+	ClipSend *s = NULL;
+	for (int i = 0; i < CLIP_MAX_SENDS && !s; i++) {
+		if (!c->sends[i].text) s = &c->sends[i];
+	}
+	if (!s) return 0;
+	s->text = (char*)malloc(c->owned_len);
+	if (!s->text) return 1;
+	memcpy(s->text, c->owned, c->owned_len);
+	s->len = c->owned_len;
+	s->requestor = req->requestor;
+	s->property = req->property;
+	s->target = req->target;
+	s->last_ms = clip_now_ms();
+
+	// StructureNotifyMask: DestroyNotify if the requestor goes away.
+	XSelectInput(c->display, req->requestor, PropertyChangeMask | StructureNotifyMask);
+	long total = s->len;
+	XChangeProperty(c->display, req->requestor, req->property,
+		c->INCR, 32, PropModeReplace, (unsigned char*)&total, 1);
+	resp->property = req->property;
+	return 1;
+}
+
+// Process one queued X event, returns:
 //   1 = got clipboard text (stored in out_text/out_len)
-//   2 = selection request handled (we served our text to another app)
-//   0 = other event
-static int clip_process_event(char **out_text, int *out_len) {
+//   2 = event handled
+//   3 = a request for our text was refused (too many INCR transfers)
+//   0 = no event pending
+static int clip_process_event(ClipCtx *c, char **out_text, int *out_len) {
+	if (!XPending(c->display)) return 0;
 	XEvent ev;
-	if (!XPending(clip_display)) return 0;
-
-	XNextEvent(clip_display, &ev);
+	XNextEvent(c->display, &ev);
+
+	// Another app took the clipboard: ask it for the text.
+	if (ev.type == c->xfixes_event + XFixesSelectionNotify) {
+		XFixesSelectionNotifyEvent *sn = (XFixesSelectionNotifyEvent*)&ev;
+		if (sn->owner != None && sn->owner != c->window) {
+			XConvertSelection(c->display, c->CLIPBOARD, c->UTF8_STRING, c->BUNGHOLE_SEL,
+				c->window, sn->selection_timestamp);
+			XFlush(c->display);
+		}
+		return 2;
+	}
 
-	// We received clipboard data we requested
+	// The owner answered our request
 	if (ev.type == SelectionNotify) {
-		if (ev.xselection.property == None) return 0;
-
-		Atom type;
-		int format;
-		unsigned long nitems, bytes_after;
-		unsigned char *data = NULL;
-
-		XGetWindowProperty(clip_display, clip_window, BUNGHOLE_SEL,
-			0, 1024*1024, True, AnyPropertyType,
-			&type, &format, &nitems, &bytes_after, &data);
-
-		if (data && nitems > 0) {
-			*out_text = (char*)malloc(nitems + 1);
-			memcpy(*out_text, data, nitems);
-			(*out_text)[nitems] = 0;
-			*out_len = (int)nitems;
-			XFree(data);
-			return 1;
+		if (ev.xselection.property == None) return 2;
+		unsigned char *data;
+		unsigned long n;
+		Atom type = read_sel(c, &data, &n);
+		int got = 0;
+		if (type == c->INCR) {
+			// Deleting the property (read_sel did) asks for the first chunk.
+			c->receiving = 1;
+			c->recv_len = 0;
+		} else if (data && n > 0) {
+			got = take_text(data, (int)n, out_text, out_len);
 		}
 		if (data) XFree(data);
-		return 0;
+		XFlush(c->display);
+		return got ? 1 : 2;
+	}
+
+	if (ev.type == PropertyNotify) {
+		XPropertyEvent *pe = &ev.xproperty;
+		// Next chunk of an INCR transfer from the owner; empty ends it.
+		if (pe->window == c->window && pe->atom == c->BUNGHOLE_SEL &&
+				pe->state == PropertyNewValue && c->receiving) {
+			unsigned char *data;
+			unsigned long n;
+			read_sel(c, &data, &n);
+			int got = 0;
+			if (n > 0) {
+				recv_append(c, data, (int)n);
+			} else {
+				c->receiving = 0;
+				if (c->recv_len > 0) got = take_text((unsigned char*)c->recv, c->recv_len, out_text, out_len);
+				free(c->recv);
+				c->recv = NULL;
+				c->recv_len = c->recv_cap = 0;
+			}
+			if (data) XFree(data);
+			XFlush(c->display);
+			return got ? 1 : 2;
+		}
+		// A requestor took the last chunk of ours: write the next one.
+		if (pe->state == PropertyDelete) {
+			ClipSend *s = find_send(c, pe->window, pe->atom);
+			if (!s) return 2;
+			if (s->done) {
+				end_send(c, s);
+			} else {
+				int n = s->len - s->off;
+				if (n > c->chunk) n = c->chunk;
+				XChangeProperty(c->display, s->requestor, s->property, s->target, 8,
+					PropModeReplace, (unsigned char*)s->text + s->off, n);
+				s->off += n;
+				s->last_ms = clip_now_ms();
+				if (n == 0) s->done = 1;
+			}
+			XFlush(c->display);
+		}
+		return 2;
 	}
 
 	// Another app is requesting our clipboard content
@@ -103,127 +373,187 @@ static int clip_process_event(char **out_text, int *out_len) {
 		resp.target = req->target;
 		resp.time = req->time;
 		resp.property = None;
+		int served = 1;
+		if (req->property == None) req->property = req->target; // obsolete clients
 
-		if (req->target == TARGETS) {
-			Atom targets[] = { TARGETS, UTF8_STRING, XA_STRING };
-			XChangeProperty(clip_display, req->requestor, req->property,
+		if (req->target == c->TARGETS) {
+			Atom targets[] = { c->TARGETS, c->UTF8_STRING, XA_STRING };
+			XChangeProperty(c->display, req->requestor, req->property,
 				XA_ATOM, 32, PropModeReplace,
 				(unsigned char*)targets, 3);
 			resp.property = req->property;
-		} else if ((req->target == UTF8_STRING || req->target == XA_STRING) && owned_text) {
-			XChangeProperty(clip_display, req->requestor, req->property,
-				req->target, 8, PropModeReplace,
-				(unsigned char*)owned_text, own_len);
-			resp.property = req->property;
+		} else if ((req->target == c->UTF8_STRING || req->target == XA_STRING) && c->owned) {
+			served = serve_text(c, req, &resp);
 		}
 
-		XSendEvent(clip_display, req->requestor, False, 0, (XEvent*)&resp);
-		XFlush(clip_display);
+		XSendEvent(c->display, req->requestor, False, 0, (XEvent*)&resp);
+		XFlush(c->display);
+		return served ? 2 : 3;
+	}
+
+	if (ev.type == DestroyNotify) {
+		drop_sends(c, ev.xdestroywindow.window);
 		return 2;
 	}
 
-	// Clipboard owner changed (someone else copied something)
+	// We lost ownership — someone else set the clipboard
 	if (ev.type == SelectionClear) {
-		// We lost ownership — someone else set the clipboard
-		if (owned_text) {
-			free(owned_text);
-			owned_text = NULL;
-			own_len = 0;
-		}
+		free(c->owned);
+		c->owned = NULL;
+		c->owned_len = 0;
 	}
-
-	return 0;
-}
-
-static void clip_watch_owner_change() {
-	if (!clip_display) return;
-	// We'll poll for owner changes via XGetSelectionOwner
-}
-
-static int clip_we_own() {
-	if (!clip_display) return 0;
-	return XGetSelectionOwner(clip_display, CLIPBOARD) == clip_window ? 1 : 0;
+	return 2;
 }
 
-static void clip_destroy() {
-	if (!clip_display) return;
-	if (owned_text) free(owned_text);
-	XDestroyWindow(clip_display, clip_window);
-	XCloseDisplay(clip_display);
-	clip_display = NULL;
+static void clip_close(ClipCtx *c) {
+	free(c->owned);
+	free(c->recv);
+	for (int i = 0; i < CLIP_MAX_SENDS; i++) free(c->sends[i].text);
+	XDestroyWindow(c->display, c->window);
+	XCloseDisplay(c->display);
+	close(c->wake_rd);
+	close(c->wake_wr);
+	free(c);
 }
 */
 import "C"
 import (
 	"fmt"
 	"log"
-	"time"
+	"sync"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
+// ClipboardHandler syncs the CLIPBOARD selection of one X display with
+// the client. It waits on the X connection: XFixes reports each new
+// selection owner, so there is no polling, and texts too large for one
+// request move in INCR chunks both ways.
 type ClipboardHandler struct {
+	ctx         *C.ClipCtx
 	lastContent string
 	sendFn      func(string) // callback to send clipboard to client
+
+	mu      sync.Mutex
+	pending *string // text from the client for Run to take ownership with
+	started bool
+	closed  bool
+	done    chan struct{}
 }
 
+var errorHandlerOnce sync.Once
+
 func NewClipboardHandler(displayName string, sendFn func(string)) (types.ClipboardSync, error) {
+	errorHandlerOnce.Do(func() { C.clip_install_error_handler() })
+
 	cDisplay := C.CString(displayName)
 	defer C.free(unsafe.Pointer(cDisplay))
 
-	if C.clip_init(cDisplay) != 0 {
-		return nil, fmt.Errorf("failed to open display for clipboard: %s", displayName)
+	ctx := C.clip_open(cDisplay)
+	if ctx == nil {
+		return nil, fmt.Errorf("failed to open display for clipboard (XFixes required): %s", displayName)
 	}
 
-	return &ClipboardHandler{sendFn: sendFn}, nil
+	return &ClipboardHandler{ctx: ctx, sendFn: sendFn, done: make(chan struct{})}, nil
 }
 
-// SetFromClient sets the X11 clipboard with content received from the browser
+// SetFromClient sets the X11 clipboard with content received from the
+// browser. Run takes ownership with it on its own thread.
 func (ch *ClipboardHandler) SetFromClient(text string) {
-	ch.lastContent = text
-	cText := C.CString(text)
-	defer C.free(unsafe.Pointer(cText))
-	C.clip_set(cText, C.int(len(text)))
+	ch.mu.Lock()
+	defer ch.mu.Unlock()
+	if ch.closed {
+		return
+	}
+	ch.pending = &text
+	C.clip_wake(ch.ctx)
 }
 
-// Run monitors the clipboard for changes and processes X events
+// Run processes X events until stop is closed or the handler is closed.
 func (ch *ClipboardHandler) Run(stop <-chan struct{}) {
-	ticker := time.NewTicker(250 * time.Millisecond)
-	defer ticker.Stop()
+	ch.mu.Lock()
+	if ch.closed {
+		ch.mu.Unlock()
+		return
+	}
+	ch.started = true
+	ch.mu.Unlock()
+	defer close(ch.done)
+
+	go func() {
+		select {
+		case <-stop:
+			ch.wake()
+		case <-ch.done:
+		}
+	}()
 
 	for {
+		C.clip_wait(ch.ctx)
+		ch.mu.Lock()
+		text, closed := ch.pending, ch.closed
+		ch.pending = nil
+		ch.mu.Unlock()
+		if closed {
+			return
+		}
 		select {
 		case <-stop:
 			return
-		case <-ticker.C:
-			// Process any pending X events
-			for {
-				var outText *C.char
-				var outLen C.int
-				result := C.clip_process_event(&outText, &outLen)
-				if result == 0 {
-					break
-				}
-				if result == 1 && outText != nil {
-					text := C.GoStringN(outText, outLen)
-					C.free(unsafe.Pointer(outText))
-					if text != ch.lastContent {
-						ch.lastContent = text
-						ch.sendFn(text)
-					}
-				}
-			}
+		default:
+		}
+		if text != nil {
+			ch.lastContent = *text
+			cText := C.CString(*text)
+			C.clip_set(ch.ctx, cText, C.int(len(*text)))
+			C.free(unsafe.Pointer(cText))
+		}
 
-			// If we don't own the clipboard, request its content
-			if C.clip_we_own() == 0 {
-				C.clip_request()
+		for {
+			var outText *C.char
+			var outLen C.int
+			result := C.clip_process_event(ch.ctx, &outText, &outLen)
+			if result == 0 {
+				break
+			}
+			if result == 3 {
+				log.Printf("clipboard: refused a paste of our text, %d large transfers already in progress", int(C.CLIP_MAX_SENDS))
+			}
+			if result == 1 && outText != nil {
+				text := C.GoStringN(outText, outLen)
+				C.free(unsafe.Pointer(outText))
+				if text != ch.lastContent {
+					ch.lastContent = text
+					ch.sendFn(text)
+				}
 			}
 		}
 	}
 }
 
+func (ch *ClipboardHandler) wake() {
+	ch.mu.Lock()
+	defer ch.mu.Unlock()
+	if !ch.closed {
+		C.clip_wake(ch.ctx)
+	}
+}
+
+// Close stops Run, if it is running, and closes the display connection.
 func (ch *ClipboardHandler) Close() {
-	C.clip_destroy()
+	ch.mu.Lock()
+	if ch.closed {
+		ch.mu.Unlock()
+		return
+	}
+	ch.closed = true
+	started := ch.started
+	C.clip_wake(ch.ctx)
+	ch.mu.Unlock()
+	if started {
+		<-ch.done
+	}
+	C.clip_close(ch.ctx)
 	log.Println("clipboard handler closed")
 }
@@ -0,0 +1,557 @@
+#include "colorconv.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLORCONV_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COLORCONV_HAVE_NEON 1
+#endif
+
+#define COLORCONV_MAX_THREADS 8
+
+// Fixed-point coefficients. Luma uses 14 fractional bits; chroma is computed
+// from the sum of two vertically averaged pixels, so it shifts by 15.
+typedef struct {
+	int yr, yg, yb;
+	int ur, ug, ub;
+	int vr, vg, vb;
+} ColorCoeffs;
+
+static const ColorCoeffs coeffs_bt601 = {
+	 4207,  8260,  1604,
+	-2428, -4768,  7196,
+	 7196, -6026, -1170,
+};
+
+static const ColorCoeffs coeffs_bt709 = {
+	 2992, 10064,  1016,
+	-1649, -5547,  7196,
+	 7196, -6536,  -660,
+};
+
+// Converts one pair of source rows. y1 is NULL for the last row of an
+// odd-height frame (r1 then aliases r0). For NV12, u is the interleaved
+// UV row and v is unused.
+typedef void (*row_pair_fn)(const uint8_t *r0, const uint8_t *r1, int width,
+                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                            int nv12, const ColorCoeffs *k);
+
+typedef struct {
+	struct ColorConv *cc;
+	int idx;
+	pthread_t thread;
+} ColorConvWorker;
+
+struct ColorConv {
+	int width;
+	int height;
+	int scale;                         // source pixels per output pixel, per axis
+	int nv12;
+	ColorCoeffs k;
+	row_pair_fn kernel;
+	const char *kernel_name;
+
+	int nthreads;                      // including the calling thread
+	ColorConvWorker workers[COLORCONV_MAX_THREADS];
+	pthread_mutex_t mu;
+	pthread_cond_t start_cv;
+	pthread_cond_t done_cv;
+	unsigned long generation;
+	int pending;
+	int quit;
+
+	// Current job (valid while generation is in flight)
+	const uint8_t *src;
+	int stride;
+	uint8_t *dst[3];
+	int dst_linesize[3];
+
+	int64_t last_ns;
+};
+
+// ---------------------------------------------------------------------------
+// Scalar kernel (reference; also handles SIMD tails)
+// ---------------------------------------------------------------------------
+
+static inline uint8_t luma_px(const uint8_t *p, const ColorCoeffs *k) {
+	return (uint8_t)(((k->yb * p[0] + k->yg * p[1] + k->yr * p[2] + 8192) >> 14) + 16);
+}
+
+static void scalar_span(const uint8_t *r0, const uint8_t *r1, int x, int width,
+                        uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                        int nv12, const ColorCoeffs *k) {
+	for (; x < width; x += 2) {
+		const uint8_t *a0 = r0 + 4 * x;
+		const uint8_t *a1 = r1 + 4 * x;
+		int has_right = x + 1 < width;
+		const uint8_t *b0 = has_right ? a0 + 4 : a0;
+		const uint8_t *b1 = has_right ? a1 + 4 : a1;
+
+		y0[x] = luma_px(a0, k);
+		if (has_right) y0[x + 1] = luma_px(b0, k);
+		if (y1) {
+			y1[x] = luma_px(a1, k);
+			if (has_right) y1[x + 1] = luma_px(b1, k);
+		}
+
+		// Vertical rounding average, then horizontal sum (matches the
+		// pavgb / vrhadd + pairwise-add order of the SIMD kernels).
+		int sb = ((a0[0] + a1[0] + 1) >> 1) + ((b0[0] + b1[0] + 1) >> 1);
+		int sg = ((a0[1] + a1[1] + 1) >> 1) + ((b0[1] + b1[1] + 1) >> 1);
+		int sr = ((a0[2] + a1[2] + 1) >> 1) + ((b0[2] + b1[2] + 1) >> 1);
+
+		uint8_t cu = (uint8_t)(((k->ub * sb + k->ug * sg + k->ur * sr + 16384) >> 15) + 128);
+		uint8_t cv = (uint8_t)(((k->vb * sb + k->vg * sg + k->vr * sr + 16384) >> 15) + 128);
+		if (nv12) {
+			u[x] = cu;
+			u[x + 1] = cv;
+		} else {
+			u[x / 2] = cu;
+			v[x / 2] = cv;
+		}
+	}
+}
+
+static void scalar_row_pair(const uint8_t *r0, const uint8_t *r1, int width,
+                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                            int nv12, const ColorCoeffs *k) {
+	scalar_span(r0, r1, 0, width, y0, y1, u, v, nv12, k);
+}
+
+// ---------------------------------------------------------------------------
+// Scaled kernel — box-filtered downscale by cc->scale
+// ---------------------------------------------------------------------------
+
+// Averages the scale x scale source block at blk into px (BGR).
+static inline void box_avg(const uint8_t *blk, int stride, int scale, int shift, uint8_t px[3]) {
+	int sb = 0, sg = 0, sr = 0;
+	for (int j = 0; j < scale; j++) {
+		const uint8_t *q = blk + (size_t)j * stride;
+		for (int i = 0; i < scale; i++, q += 4) {
+			sb += q[0];
+			sg += q[1];
+			sr += q[2];
+		}
+	}
+	int rnd = 1 << (shift - 1);
+	px[0] = (uint8_t)((sb + rnd) >> shift);
+	px[1] = (uint8_t)((sg + rnd) >> shift);
+	px[2] = (uint8_t)((sr + rnd) >> shift);
+}
+
+// Converts output row pair p. Each output pixel is the average of its
+// source block; chroma then averages the (up to) four output pixels of its
+// 2x2 group, so it covers a 2*scale square of the source.
+static void scaled_row_pair(ColorConv *cc, int p) {
+	int s = cc->scale;
+	int shift = (s == 4) ? 4 : 2;
+	int y = p * 2;
+	int rows = (y + 1 < cc->height) ? 2 : 1;
+	const uint8_t *src = cc->src + (size_t)y * s * cc->stride;
+	uint8_t *yrow[2] = {
+		cc->dst[0] + (size_t)y * cc->dst_linesize[0],
+		cc->dst[0] + (size_t)(y + 1) * cc->dst_linesize[0],
+	};
+	uint8_t *u = cc->dst[1] + (size_t)p * cc->dst_linesize[1];
+	uint8_t *v = cc->nv12 ? NULL : cc->dst[2] + (size_t)p * cc->dst_linesize[2];
+	const ColorCoeffs *k = &cc->k;
+
+	for (int x = 0; x < cc->width; x += 2) {
+		int cols = (x + 1 < cc->width) ? 2 : 1;
+		int sb = 0, sg = 0, sr = 0;
+		for (int dy = 0; dy < rows; dy++) {
+			const uint8_t *blk = src + (size_t)dy * s * cc->stride + (size_t)4 * x * s;
+			for (int dx = 0; dx < cols; dx++, blk += 4 * s) {
+				uint8_t px[3];
+				box_avg(blk, cc->stride, s, shift, px);
+				yrow[dy][x + dx] = luma_px(px, k);
+				sb += px[0];
+				sg += px[1];
+				sr += px[2];
+			}
+		}
+
+		// The chroma coefficients expect the sum of two pixels.
+		int n = rows * cols;
+		sb = (sb * 2 + n / 2) / n;
+		sg = (sg * 2 + n / 2) / n;
+		sr = (sr * 2 + n / 2) / n;
+
+		uint8_t cu = (uint8_t)(((k->ub * sb + k->ug * sg + k->ur * sr + 16384) >> 15) + 128);
+		uint8_t cv = (uint8_t)(((k->vb * sb + k->vg * sg + k->vr * sr + 16384) >> 15) + 128);
+		if (cc->nv12) {
+			u[x] = cu;
+			u[x + 1] = cv;
+		} else {
+			u[x / 2] = cu;
+			v[x / 2] = cv;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// AVX2 kernel — 16 pixels per iteration
+// ---------------------------------------------------------------------------
+
+#ifdef COLORCONV_HAVE_AVX2
+
+static long long pack_coef4(int b, int g, int r) {
+	return (long long)((uint64_t)(uint16_t)b |
+	                   ((uint64_t)(uint16_t)g << 16) |
+	                   ((uint64_t)(uint16_t)r << 32));
+}
+
+// 8 BGRA pixels → 8 int32 weighted sums, in pixel order.
+__attribute__((target("avx2")))
+static inline __m256i avx2_dot8(__m256i px, __m256i coef) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), coef);
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), coef);
+	return _mm256_hadd_epi32(lo, hi);
+}
+
+// 16 BGRA pixels → 16 luma bytes.
+__attribute__((target("avx2")))
+static inline __m128i avx2_luma16(__m256i pa, __m256i pb, __m256i cy) {
+	const __m256i rnd = _mm256_set1_epi32(8192);
+	__m256i ya = _mm256_srai_epi32(_mm256_add_epi32(avx2_dot8(pa, cy), rnd), 14);
+	__m256i yb = _mm256_srai_epi32(_mm256_add_epi32(avx2_dot8(pb, cy), rnd), 14);
+	__m256i y16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(ya, yb), _MM_SHUFFLE(3, 1, 2, 0));
+	y16 = _mm256_add_epi16(y16, _mm256_set1_epi16(16));
+	__m256i y8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(y16, y16), _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm256_castsi256_si128(y8);
+}
+
+// 8 vertically averaged pixels → 4 horizontal pair sums as 16-bit BGRA,
+// ordered (pair0, pair1 | pair2, pair3).
+__attribute__((target("avx2")))
+static inline __m256i avx2_pair_sums(__m256i avg) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_unpacklo_epi8(avg, zero);
+	__m256i hi = _mm256_unpackhi_epi8(avg, zero);
+	lo = _mm256_add_epi16(lo, _mm256_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm256_add_epi16(hi, _mm256_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm256_unpacklo_epi64(lo, hi);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_chroma8(__m256i sa, __m256i sb, __m256i coef) {
+	const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+	__m256i c = _mm256_hadd_epi32(_mm256_madd_epi16(sa, coef), _mm256_madd_epi16(sb, coef));
+	c = _mm256_permutevar8x32_epi32(c, order);
+	c = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(16384)), 15);
+	return _mm256_add_epi32(c, _mm256_set1_epi32(128));
+}
+
+__attribute__((target("avx2")))
+static void avx2_row_pair(const uint8_t *r0, const uint8_t *r1, int width,
+                          uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                          int nv12, const ColorCoeffs *k) {
+	const __m256i cy = _mm256_set1_epi64x(pack_coef4(k->yb, k->yg, k->yr));
+	const __m256i cu = _mm256_set1_epi64x(pack_coef4(k->ub, k->ug, k->ur));
+	const __m256i cv = _mm256_set1_epi64x(pack_coef4(k->vb, k->vg, k->vr));
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16) {
+		__m256i p0a = _mm256_loadu_si256((const __m256i*)(r0 + 4 * x));
+		__m256i p0b = _mm256_loadu_si256((const __m256i*)(r0 + 4 * x + 32));
+		__m256i p1a = _mm256_loadu_si256((const __m256i*)(r1 + 4 * x));
+		__m256i p1b = _mm256_loadu_si256((const __m256i*)(r1 + 4 * x + 32));
+
+		_mm_storeu_si128((__m128i*)(y0 + x), avx2_luma16(p0a, p0b, cy));
+		if (y1) _mm_storeu_si128((__m128i*)(y1 + x), avx2_luma16(p1a, p1b, cy));
+
+		__m256i sa = avx2_pair_sums(_mm256_avg_epu8(p0a, p1a));
+		__m256i sb = avx2_pair_sums(_mm256_avg_epu8(p0b, p1b));
+		__m256i cu8 = avx2_chroma8(sa, sb, cu);
+		__m256i cv8 = avx2_chroma8(sa, sb, cv);
+
+		if (nv12) {
+			__m256i uv = _mm256_or_si256(cu8, _mm256_slli_epi32(cv8, 8));
+			uv = _mm256_permute4x64_epi64(_mm256_packus_epi32(uv, uv), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(u + x), _mm256_castsi256_si128(uv));
+		} else {
+			__m256i u16 = _mm256_packus_epi32(cu8, cu8);
+			__m256i v16 = _mm256_packus_epi32(cv8, cv8);
+			__m256i u8 = _mm256_packus_epi16(u16, u16);
+			__m256i v8 = _mm256_packus_epi16(v16, v16);
+			int32_t w[4] = {
+				_mm256_cvtsi256_si32(u8), _mm256_extract_epi32(u8, 4),
+				_mm256_cvtsi256_si32(v8), _mm256_extract_epi32(v8, 4),
+			};
+			memcpy(u + x / 2, &w[0], 8);
+			memcpy(v + x / 2, &w[2], 8);
+		}
+	}
+	scalar_span(r0, r1, x, width, y0, y1, u, v, nv12, k);
+}
+
+#endif // COLORCONV_HAVE_AVX2
+
+// ---------------------------------------------------------------------------
+// NEON kernel — 16 pixels per iteration
+// ---------------------------------------------------------------------------
+
+#ifdef COLORCONV_HAVE_NEON
+
+static inline int32x4_t neon_dot4(int16x4_t b, int16x4_t g, int16x4_t r,
+                                  int cb, int cg, int cr) {
+	int32x4_t acc = vmull_n_s16(b, (int16_t)cb);
+	acc = vmlal_n_s16(acc, g, (int16_t)cg);
+	return vmlal_n_s16(acc, r, (int16_t)cr);
+}
+
+static inline uint8x8_t neon_luma8(uint8x8_t b8, uint8x8_t g8, uint8x8_t r8,
+                                   const ColorCoeffs *k) {
+	int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(b8));
+	int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(g8));
+	int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(r8));
+	const int32x4_t rnd = vdupq_n_s32(8192);
+	int32x4_t lo = vshrq_n_s32(vaddq_s32(neon_dot4(vget_low_s16(b), vget_low_s16(g), vget_low_s16(r), k->yb, k->yg, k->yr), rnd), 14);
+	int32x4_t hi = vshrq_n_s32(vaddq_s32(neon_dot4(vget_high_s16(b), vget_high_s16(g), vget_high_s16(r), k->yb, k->yg, k->yr), rnd), 14);
+	int16x8_t y = vaddq_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)), vdupq_n_s16(16));
+	return vqmovun_s16(y);
+}
+
+static inline uint8x16_t neon_luma16(uint8x16x4_t p, const ColorCoeffs *k) {
+	return vcombine_u8(
+		neon_luma8(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2]), k),
+		neon_luma8(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]), k));
+}
+
+// sb/sg/sr hold 8 horizontal pair sums of vertically averaged pixels.
+static inline uint8x8_t neon_chroma8(int16x8_t sb, int16x8_t sg, int16x8_t sr,
+                                     int cb, int cg, int cr) {
+	const int32x4_t rnd = vdupq_n_s32(16384);
+	const int32x4_t off = vdupq_n_s32(128);
+	int32x4_t lo = vaddq_s32(vshrq_n_s32(vaddq_s32(neon_dot4(vget_low_s16(sb), vget_low_s16(sg), vget_low_s16(sr), cb, cg, cr), rnd), 15), off);
+	int32x4_t hi = vaddq_s32(vshrq_n_s32(vaddq_s32(neon_dot4(vget_high_s16(sb), vget_high_s16(sg), vget_high_s16(sr), cb, cg, cr), rnd), 15), off);
+	return vqmovun_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+}
+
+static void neon_row_pair(const uint8_t *r0, const uint8_t *r1, int width,
+                          uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                          int nv12, const ColorCoeffs *k) {
+	int x = 0;
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x4_t p0 = vld4q_u8(r0 + 4 * x);
+		uint8x16x4_t p1 = vld4q_u8(r1 + 4 * x);
+
+		vst1q_u8(y0 + x, neon_luma16(p0, k));
+		if (y1) vst1q_u8(y1 + x, neon_luma16(p1, k));
+
+		int16x8_t sb = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[0], p1.val[0])));
+		int16x8_t sg = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[1], p1.val[1])));
+		int16x8_t sr = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[2], p1.val[2])));
+
+		uint8x8_t cu = neon_chroma8(sb, sg, sr, k->ub, k->ug, k->ur);
+		uint8x8_t cv = neon_chroma8(sb, sg, sr, k->vb, k->vg, k->vr);
+
+		if (nv12) {
+			uint8x8x2_t uv = { { cu, cv } };
+			vst2_u8(u + x, uv);
+		} else {
+			vst1_u8(u + x / 2, cu);
+			vst1_u8(v + x / 2, cv);
+		}
+	}
+	scalar_span(r0, r1, x, width, y0, y1, u, v, nv12, k);
+}
+
+#endif // COLORCONV_HAVE_NEON
+
+// ---------------------------------------------------------------------------
+// Slicing and thread pool
+// ---------------------------------------------------------------------------
+
+static void colorconv_slice(ColorConv *cc, int idx) {
+	int pairs = (cc->height + 1) / 2;
+	int p0 = (int)((long long)pairs * idx / cc->nthreads);
+	int p1 = (int)((long long)pairs * (idx + 1) / cc->nthreads);
+
+	if (cc->scale > 1) {
+		for (int p = p0; p < p1; p++) scaled_row_pair(cc, p);
+		return;
+	}
+
+	for (int p = p0; p < p1; p++) {
+		int y = p * 2;
+		int has_second = y + 1 < cc->height;
+		const uint8_t *r0 = cc->src + (size_t)y * cc->stride;
+		const uint8_t *r1 = has_second ? r0 + cc->stride : r0;
+		uint8_t *y0 = cc->dst[0] + (size_t)y * cc->dst_linesize[0];
+		uint8_t *y1 = has_second ? y0 + cc->dst_linesize[0] : NULL;
+		uint8_t *u = cc->dst[1] + (size_t)p * cc->dst_linesize[1];
+		uint8_t *v = cc->nv12 ? NULL : cc->dst[2] + (size_t)p * cc->dst_linesize[2];
+		cc->kernel(r0, r1, cc->width, y0, y1, u, v, cc->nv12, &cc->k);
+	}
+}
+
+static void* colorconv_worker(void *arg) {
+	ColorConvWorker *w = (ColorConvWorker*)arg;
+	ColorConv *cc = w->cc;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&cc->mu);
+	for (;;) {
+		while (!cc->quit && cc->generation == seen) {
+			pthread_cond_wait(&cc->start_cv, &cc->mu);
+		}
+		if (cc->quit) break;
+		seen = cc->generation;
+		pthread_mutex_unlock(&cc->mu);
+
+		colorconv_slice(cc, w->idx);
+
+		pthread_mutex_lock(&cc->mu);
+		if (--cc->pending == 0) pthread_cond_signal(&cc->done_cv);
+	}
+	pthread_mutex_unlock(&cc->mu);
+	return NULL;
+}
+
+static int default_threads(int width, int height) {
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1) ncpu = 1;
+	// Roughly one thread per 1080p worth of pixels, plus one.
+	int n = 1 + (int)(((long long)width * height) / (1920 * 1080));
+	if (n > 4) n = 4;
+	if (n > ncpu) n = (int)ncpu;
+	return n;
+}
+
+static void pick_kernel(ColorConv *cc) {
+	cc->kernel = scalar_row_pair;
+	cc->kernel_name = "scalar";
+
+	const char *force = getenv("BUNGHOLE_COLORCONV");
+	if (force && strcmp(force, "scalar") == 0) return;
+
+#ifdef COLORCONV_HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		cc->kernel = avx2_row_pair;
+		cc->kernel_name = "avx2";
+	}
+#endif
+#ifdef COLORCONV_HAVE_NEON
+	cc->kernel = neon_row_pair;
+	cc->kernel_name = "neon";
+#endif
+}
+
+int colorconv_scale_for(int src_w, int src_h, int dst_w, int dst_h) {
+	if (dst_w <= 0 || dst_h <= 0) return 0;
+	for (int s = 1; s <= COLORCONV_MAX_SCALE; s *= 2) {
+		// Callers round the scaled size down to even, so up to 2*s - 1
+		// source pixels per axis may be left uncovered.
+		if (dst_w * s <= src_w && src_w < (dst_w + 2) * s &&
+		    dst_h * s <= src_h && src_h < (dst_h + 2) * s) {
+			return s;
+		}
+	}
+	return 0;
+}
+
+ColorConv* colorconv_create(int width, int height, int scale, int dst_format,
+                            int colorspace, int threads) {
+	if (width <= 0 || height <= 0) return NULL;
+	if (scale != 1 && scale != 2 && scale != 4) return NULL;
+
+	ColorConv *cc = (ColorConv*)calloc(1, sizeof(ColorConv));
+	if (!cc) return NULL;
+
+	cc->width = width;
+	cc->height = height;
+	cc->scale = scale;
+	cc->nv12 = (dst_format == COLORCONV_NV12);
+	cc->k = (colorspace == COLORCONV_BT709) ? coeffs_bt709 : coeffs_bt601;
+	pick_kernel(cc);
+	if (scale > 1) cc->kernel_name = scale == 2 ? "scalar/2" : "scalar/4";
+
+	if (threads <= 0) threads = default_threads(width * scale, height * scale);
+	if (threads > COLORCONV_MAX_THREADS) threads = COLORCONV_MAX_THREADS;
+
+	pthread_mutex_init(&cc->mu, NULL);
+	pthread_cond_init(&cc->start_cv, NULL);
+	pthread_cond_init(&cc->done_cv, NULL);
+
+	// Slot 0 is the calling thread; spawn the rest.
+	cc->nthreads = 1;
+	for (int i = 1; i < threads; i++) {
+		ColorConvWorker *w = &cc->workers[i];
+		w->cc = cc;
+		w->idx = i;
+		if (pthread_create(&w->thread, NULL, colorconv_worker, w) != 0) break;
+		cc->nthreads++;
+	}
+	return cc;
+}
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void colorconv_run_slices(ColorConv *cc) {
+	if (cc->nthreads == 1) {
+		colorconv_slice(cc, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&cc->mu);
+	cc->pending = cc->nthreads - 1;
+	cc->generation++;
+	pthread_cond_broadcast(&cc->start_cv);
+	pthread_mutex_unlock(&cc->mu);
+
+	colorconv_slice(cc, 0);
+
+	pthread_mutex_lock(&cc->mu);
+	while (cc->pending > 0) pthread_cond_wait(&cc->done_cv, &cc->mu);
+	pthread_mutex_unlock(&cc->mu);
+}
+
+void colorconv_run(ColorConv *cc, const uint8_t *bgra, int stride,
+                   uint8_t *const dst[3], const int dst_linesize[3]) {
+	int64_t t0 = now_ns();
+	cc->src = bgra;
+	cc->stride = stride;
+	for (int i = 0; i < 3; i++) {
+		cc->dst[i] = dst[i];
+		cc->dst_linesize[i] = dst_linesize[i];
+	}
+	colorconv_run_slices(cc);
+	cc->last_ns = now_ns() - t0;
+}
+
+int64_t colorconv_last_ns(ColorConv *cc) { return cc->last_ns; }
+
+const char* colorconv_kernel_name(ColorConv *cc) { return cc->kernel_name; }
+
+int colorconv_threads(ColorConv *cc) { return cc->nthreads; }
+
+void colorconv_destroy(ColorConv *cc) {
+	if (!cc) return;
+	pthread_mutex_lock(&cc->mu);
+	cc->quit = 1;
+	pthread_cond_broadcast(&cc->start_cv);
+	pthread_mutex_unlock(&cc->mu);
+	for (int i = 1; i < cc->nthreads; i++) {
+		pthread_join(cc->workers[i].thread, NULL);
+	}
+	pthread_cond_destroy(&cc->done_cv);
+	pthread_cond_destroy(&cc->start_cv);
+	pthread_mutex_destroy(&cc->mu);
+	free(cc);
+}
@@ -0,0 +1,51 @@
+#ifndef BUNGHOLE_COLORCONV_H
+#define BUNGHOLE_COLORCONV_H
+
+#include <stdint.h>
+
+// ---------------------------------------------------------------------------
+// BGRA → NV12 / I420 color conversion (replaces sws_scale on the CPU path).
+//
+// Limited-range BT.601 or BT.709, 2x2 box-filtered chroma. Scalar, AVX2 and
+// NEON kernels produce bit-identical output; the kernel is picked at runtime
+// from CPU features. Rows are split into slices across a small pthread pool.
+//
+// The source may also be box-downscaled by 2 or 4 in the same pass (encode
+// ladder renditions); that path is scalar, since it reads each source pixel
+// once and writes a quarter or a sixteenth as many.
+// ---------------------------------------------------------------------------
+
+#define COLORCONV_NV12 0
+#define COLORCONV_I420 1
+
+#define COLORCONV_BT601 0
+#define COLORCONV_BT709 1
+
+typedef struct ColorConv ColorConv;
+
+#define COLORCONV_MAX_SCALE 4
+
+// width/height are the output size; the source is scale (1, 2 or 4) times
+// larger in each direction. threads <= 0 picks a default from the source
+// size and online CPU count.
+ColorConv* colorconv_create(int width, int height, int scale, int dst_format,
+                            int colorspace, int threads);
+
+// Integer downscale factor that maps a src_w x src_h source onto a
+// dst_w x dst_h output, or 0 if there is none.
+int colorconv_scale_for(int src_w, int src_h, int dst_w, int dst_h);
+
+// Convert one frame. dst/dst_linesize follow AVFrame data/linesize layout:
+// NV12 uses planes 0 (Y) and 1 (UV); I420 uses planes 0, 1 (U) and 2 (V).
+void colorconv_run(ColorConv *cc, const uint8_t *bgra, int stride,
+                   uint8_t *const dst[3], const int dst_linesize[3]);
+
+// Wall time of the last colorconv_run, in nanoseconds.
+int64_t colorconv_last_ns(ColorConv *cc);
+
+const char* colorconv_kernel_name(ColorConv *cc);
+int colorconv_threads(ColorConv *cc);
+
+void colorconv_destroy(ColorConv *cc);
+
+#endif
@@ -3,20 +3,70 @@
 package encode
 
 /*
-#cgo pkg-config: libavcodec libavutil libswscale
+#cgo pkg-config: libavcodec libavutil
 #cgo CFLAGS: -I${SRCDIR}/../../cvendor
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_cuda.h>
-#include <libswscale/swscale.h>
+#include <dlfcn.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "colorconv.h"
 #include "cuda_defs.h"
 
+// Keyframe options shared by both encoders. forced-idr makes a frame sent
+// with pict_type I an IDR (NVENC and x264/x265 otherwise force a plain
+// I-frame, which a joining decoder can't start from). With intra_refresh,
+// periodic IDRs are replaced by a column of intra blocks sweeping across
+// the picture over keyint frames. Returns 1 if intra refresh is active.
+static int enc_set_keyframe_opts(AVCodecContext *ctx, int intra_refresh) {
+	av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+	if (!intra_refresh) return 0;
+	if (strcmp(ctx->codec->name, "libx265") == 0) {
+		return av_opt_set(ctx->priv_data, "x265-params", "intra-refresh=1", 0) >= 0;
+	}
+	return av_opt_set(ctx->priv_data, "intra-refresh", "1", 0) >= 0;
+}
+
+// x264 and x265 only apply regions of interest with adaptive quantization
+// on, which their ultrafast presets turn off. Runs after
+// enc_set_keyframe_opts, whose x265-params it replaces with a superset.
+static void enc_enable_roi(AVCodecContext *ctx, int intra_refresh) {
+	if (strcmp(ctx->codec->name, "libx264") == 0) {
+		av_opt_set_int(ctx->priv_data, "aq-mode", 1, 0);
+	} else if (strcmp(ctx->codec->name, "libx265") == 0) {
+		av_opt_set(ctx->priv_data, "x265-params",
+			intra_refresh ? "intra-refresh=1:aq-mode=1" : "aq-mode=1", 0);
+	}
+}
+
+// Attaches damage hints to the next frame: n rectangles in encode pixels
+// (left, top, right, bottom) whose QP is lowered by qp. Encoders round
+// them out to whole macroblocks/CTUs; ones that don't read
+// AV_FRAME_DATA_REGIONS_OF_INTEREST ignore it. Forced keyframes refresh
+// the whole picture, so they get none.
+static void enc_set_roi(AVFrame *f, const int32_t *rects, int n, int qp) {
+	av_frame_remove_side_data(f, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+	if (n <= 0 || f->pict_type == AV_PICTURE_TYPE_I) return;
+	AVFrameSideData *sd = av_frame_new_side_data(f, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+		(size_t)n * sizeof(AVRegionOfInterest));
+	if (!sd) return;
+	AVRegionOfInterest *roi = (AVRegionOfInterest*)sd->data;
+	for (int i = 0; i < n; i++, rects += 4) {
+		roi[i].self_size = sizeof(AVRegionOfInterest);
+		roi[i].left = rects[0];
+		roi[i].top = rects[1];
+		roi[i].right = rects[2];
+		roi[i].bottom = rects[3];
+		roi[i].qoffset = (AVRational){-qp, 51}; // offsets are a share of the QP range
+	}
+}
+
 // ---------------------------------------------------------------------------
-// CPU encoder — sws_scale BGRA→NV12/YUV420P, then avcodec_send_frame.
+// CPU encoder — colorconv BGRA→NV12/YUV420P, then avcodec_send_frame.
 // Used when XShm fallback is active (no CUDA context).
 // ---------------------------------------------------------------------------
 
@@ -24,15 +74,17 @@ typedef struct {
 	AVCodecContext *ctx;
 	AVFrame *frame;
 	AVPacket *pkt;
-	struct SwsContext *sws;
+	ColorConv *cc;
 	int width;
 	int height;
 	int64_t pts;
+	int intra_refresh;
 } CPUEncoder;
 
 static CPUEncoder* cpu_encoder_init(int width, int height, int fps,
                                      int bitrate_kbps, int keyint,
-                                     int gpu_index, const char *codec_name) {
+                                     int gpu_index, const char *codec_name,
+                                     int intra_refresh, int allow_hw, int roi) {
 	CPUEncoder *e = (CPUEncoder*)calloc(1, sizeof(CPUEncoder));
 	if (!e) return NULL;
 
@@ -44,10 +96,10 @@ static CPUEncoder* cpu_encoder_init(int width, int height, int fps,
 	int is_hevc = (strcmp(codec_name, "h265") == 0);
 
 	if (is_hevc) {
-		codec = avcodec_find_encoder_by_name("hevc_nvenc");
+		if (allow_hw) codec = avcodec_find_encoder_by_name("hevc_nvenc");
 		if (!codec) codec = avcodec_find_encoder_by_name("libx265");
 	} else {
-		codec = avcodec_find_encoder_by_name("h264_nvenc");
+		if (allow_hw) codec = avcodec_find_encoder_by_name("h264_nvenc");
 		if (!codec) codec = avcodec_find_encoder_by_name("libx264");
 	}
 	if (!codec) return NULL;
@@ -90,6 +142,8 @@ static CPUEncoder* cpu_encoder_init(int width, int height, int fps,
 		e->ctx->pix_fmt = AV_PIX_FMT_YUV420P;
 	}
 
+	e->intra_refresh = enc_set_keyframe_opts(e->ctx, intra_refresh);
+	if (roi) enc_enable_roi(e->ctx, e->intra_refresh);
 	e->ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
 
 	if (avcodec_open2(e->ctx, codec, NULL) < 0) {
@@ -106,12 +160,11 @@ static CPUEncoder* cpu_encoder_init(int width, int height, int fps,
 
 	e->pkt = av_packet_alloc();
 
-	e->sws = sws_getContext(
-		width, height, AV_PIX_FMT_BGRA,
-		width, height, e->ctx->pix_fmt,
-		SWS_FAST_BILINEAR, NULL, NULL, NULL);
+	e->cc = colorconv_create(width, height, 1,
+		e->ctx->pix_fmt == AV_PIX_FMT_NV12 ? COLORCONV_NV12 : COLORCONV_I420,
+		COLORCONV_BT601, 0);
 
-	if (!e->sws) {
+	if (!e->cc) {
 		av_packet_free(&e->pkt);
 		av_frame_free(&e->frame);
 		avcodec_free_context(&e->ctx);
@@ -122,18 +175,34 @@ static CPUEncoder* cpu_encoder_init(int width, int height, int fps,
 	return e;
 }
 
+// Rebuilds the color converter for a src_w x src_h source. Sources larger
+// than the encode size are box-downscaled on the way in, so ladder
+// renditions encode straight from the full-size capture.
+// Returns 0 on success, -1 if the source doesn't map onto the encode size.
+static int cpu_encoder_set_source(CPUEncoder *e, int src_w, int src_h) {
+	int scale = colorconv_scale_for(src_w, src_h, e->width, e->height);
+	if (!scale) return -1;
+	ColorConv *cc = colorconv_create(e->width, e->height, scale,
+		e->ctx->pix_fmt == AV_PIX_FMT_NV12 ? COLORCONV_NV12 : COLORCONV_I420,
+		COLORCONV_BT601, 0);
+	if (!cc) return -1;
+	colorconv_destroy(e->cc);
+	e->cc = cc;
+	return 0;
+}
+
 static int cpu_encoder_encode(CPUEncoder *e, const uint8_t *bgra, int stride,
+                               int force_key, const int32_t *roi, int nroi, int roi_qp,
                                uint8_t **out_buf, int *out_size, int *is_key) {
 	*out_size = 0;
 
-	const uint8_t *src_data[1] = { bgra };
-	int src_linesize[1] = { stride };
-
+	// Convert BGRA straight into the encoder's frame planes
 	av_frame_make_writable(e->frame);
-	sws_scale(e->sws, src_data, src_linesize, 0, e->height,
-	          e->frame->data, e->frame->linesize);
+	colorconv_run(e->cc, bgra, stride, e->frame->data, e->frame->linesize);
 
 	e->frame->pts = e->pts++;
+	e->frame->pict_type = force_key ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	enc_set_roi(e->frame, roi, nroi, roi_qp);
 
 	int ret = avcodec_send_frame(e->ctx, e->frame);
 	if (ret < 0) return -1;
@@ -150,11 +219,23 @@ static int cpu_encoder_encode(CPUEncoder *e, const uint8_t *bgra, int stride,
 
 static void cpu_encoder_unref(CPUEncoder *e) { av_packet_unref(e->pkt); }
 
+// Runtime bitrate change. h264_nvenc/hevc_nvenc and libx264 reconfigure
+// the running session on the next avcodec_send_frame when bit_rate differs
+// from what they were opened with; libx265 has no reconfigure path.
+static void enc_set_bitrate(AVCodecContext *ctx, int kbps) {
+	ctx->bit_rate = (int64_t)kbps * 1000;
+	if (ctx->rc_max_rate > 0) ctx->rc_max_rate = ctx->bit_rate;
+}
+
+static int enc_can_reconfigure(AVCodecContext *ctx) {
+	return strcmp(ctx->codec->name, "libx265") != 0;
+}
+
 static const char* cpu_encoder_name(CPUEncoder *e) { return e->ctx->codec->name; }
 
 static void cpu_encoder_destroy(CPUEncoder *e) {
 	if (!e) return;
-	if (e->sws) sws_freeContext(e->sws);
+	if (e->cc) colorconv_destroy(e->cc);
 	if (e->pkt) av_packet_free(&e->pkt);
 	if (e->frame) av_frame_free(&e->frame);
 	if (e->ctx) avcodec_free_context(&e->ctx);
@@ -165,8 +246,71 @@ static void cpu_encoder_destroy(CPUEncoder *e) {
 // CUDA encoder — receives NV12 CUDA device pointer from NvFBC,
 // wraps it in an AVFrame with AV_PIX_FMT_CUDA, encodes via NVENC.
 // Zero CPU involvement in the video path.
+//
+// Two input modes:
+//   copy (default) — NvFBC's buffer is copied into a frame from the
+//     hw_frames_ctx pool with cuMemcpy2DAsync on the encoder's CUDA stream.
+//     NVENC reads its input on the same stream, so the copy never blocks
+//     the CPU.
+//   zero-copy — NvFBC's buffer itself is wrapped as the AVFrame (no-op
+//     free callback; NvFBC owns the memory) and registered with NVENC
+//     directly. Relies on NVENC having consumed the input by the time the
+//     packet is returned, which holds with zerolatency and no B-frames.
 // ---------------------------------------------------------------------------
 
+// CUDA driver entry points used by the encoder beyond cuMemcpy2D. libcuda
+// is already loaded by the NvFBC capturer, so they're resolved with
+// RTLD_NOLOAD. If any are missing the encoder falls back to synchronous
+// copies on the legacy default stream, which still need the context push.
+static PFN_cuCtxPushCurrent    fn_enc_cuCtxPushCurrent = NULL;
+static PFN_cuCtxPopCurrent     fn_enc_cuCtxPopCurrent = NULL;
+static PFN_cuStreamCreate      fn_enc_cuStreamCreate = NULL;
+static PFN_cuStreamDestroy     fn_enc_cuStreamDestroy = NULL;
+static PFN_cuStreamSynchronize fn_enc_cuStreamSynchronize = NULL;
+static void *fn_enc_cuMemcpy2DAsync = NULL;
+
+static int cuda_encoder_load_syms(void) {
+	if (fn_enc_cuMemcpy2DAsync) return 0;
+
+	void *lib = dlopen("libcuda.so.1", RTLD_LAZY | RTLD_NOLOAD);
+	if (!lib) lib = dlopen("libcuda.so", RTLD_LAZY | RTLD_NOLOAD);
+	if (!lib) return -1;
+
+	fn_enc_cuCtxPushCurrent = (PFN_cuCtxPushCurrent)dlsym(lib, "cuCtxPushCurrent_v2");
+	fn_enc_cuCtxPopCurrent = (PFN_cuCtxPopCurrent)dlsym(lib, "cuCtxPopCurrent_v2");
+	fn_enc_cuStreamCreate = (PFN_cuStreamCreate)dlsym(lib, "cuStreamCreate");
+	fn_enc_cuStreamDestroy = (PFN_cuStreamDestroy)dlsym(lib, "cuStreamDestroy_v2");
+	fn_enc_cuStreamSynchronize = (PFN_cuStreamSynchronize)dlsym(lib, "cuStreamSynchronize");
+	void *async = dlsym(lib, "cuMemcpy2DAsync_v2");
+
+	// Keep the handle: libcuda stays loaded for the process lifetime anyway.
+	if (!fn_enc_cuCtxPushCurrent || !fn_enc_cuCtxPopCurrent || !fn_enc_cuStreamCreate ||
+	    !fn_enc_cuStreamDestroy || !fn_enc_cuStreamSynchronize || !async) {
+		return -1;
+	}
+	fn_enc_cuMemcpy2DAsync = async;
+	return 0;
+}
+
+typedef struct {
+	size_t srcXInBytes, srcY;
+	int srcMemoryType; // CU_MEMORYTYPE_DEVICE = 2
+	const void *srcHost;
+	CUdeviceptr srcDevice;
+	void *srcArray;
+	size_t srcPitch;
+	size_t dstXInBytes, dstY;
+	int dstMemoryType;
+	void *dstHost;
+	CUdeviceptr dstDevice;
+	void *dstArray;
+	size_t dstPitch;
+	size_t WidthInBytes, Height;
+} MY_CUDA_MEMCPY2D;
+
+typedef CUresult (*PFN_cuMemcpy2D)(const MY_CUDA_MEMCPY2D *);
+typedef CUresult (*PFN_cuMemcpy2DAsync)(const MY_CUDA_MEMCPY2D *, CUstream);
+
 typedef struct {
 	AVCodecContext *ctx;
 	AVBufferRef *hw_device_ctx;
@@ -177,12 +321,29 @@ typedef struct {
 	int height;
 	int64_t pts;
 	void *cuMemcpy2D_fn; // cuMemcpy2D function pointer (passed from capturer via Go)
+	CUcontext cuda_ctx;
+	CUstream stream;     // copy + NVENC I/O stream; NULL = legacy default stream
+	int zero_copy;       // wrap NvFBC's buffer instead of copying
+	int warned_delay;
+	int intra_refresh;
 } CUDAEncoder;
 
+static void cuda_encoder_free_buffers(CUDAEncoder *e) {
+	if (e->hw_frames_ctx) av_buffer_unref(&e->hw_frames_ctx);
+	if (e->hw_device_ctx) av_buffer_unref(&e->hw_device_ctx);
+	if (e->stream) {
+		fn_enc_cuCtxPushCurrent(e->cuda_ctx);
+		fn_enc_cuStreamDestroy(e->stream);
+		fn_enc_cuCtxPopCurrent(NULL);
+	}
+	free(e);
+}
+
 static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
                                        int bitrate_kbps, int keyint,
                                        int gpu_index, const char *codec_name,
-                                       void *cuda_ctx_ptr, void *cuMemcpy2D_fn) {
+                                       void *cuda_ctx_ptr, void *cuMemcpy2D_fn,
+                                       int zero_copy, int intra_refresh) {
 	CUcontext cuda_ctx = (CUcontext)cuda_ctx_ptr;
 	CUDAEncoder *e = (CUDAEncoder*)calloc(1, sizeof(CUDAEncoder));
 	if (!e) return NULL;
@@ -191,29 +352,45 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 	e->height = height;
 	e->pts = 0;
 	e->cuMemcpy2D_fn = cuMemcpy2D_fn;
+	e->cuda_ctx = cuda_ctx;
+	e->zero_copy = zero_copy;
+
+	// Dedicated non-blocking stream, shared with FFmpeg so NVENC's input
+	// reads are ordered after our copies without a host-side sync.
+	if (cuda_encoder_load_syms() == 0) {
+		fn_enc_cuCtxPushCurrent(cuda_ctx);
+		// flags 1 = CU_STREAM_NON_BLOCKING
+		if (fn_enc_cuStreamCreate(&e->stream, 1) != CUDA_SUCCESS) {
+			e->stream = NULL;
+		}
+		fn_enc_cuCtxPopCurrent(NULL);
+	}
+	if (!e->stream) {
+		fprintf(stderr, "cuda_enc: no CUDA stream, falling back to synchronous copies\n");
+	}
 
 	// Create hw device context from existing CUDA context
 	e->hw_device_ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
-	if (!e->hw_device_ctx) { free(e); return NULL; }
+	if (!e->hw_device_ctx) { cuda_encoder_free_buffers(e); return NULL; }
 
 	AVHWDeviceContext *device_ctx = (AVHWDeviceContext*)e->hw_device_ctx->data;
 	AVCUDADeviceContext *cuda_device_ctx = (AVCUDADeviceContext*)device_ctx->hwctx;
 	cuda_device_ctx->cuda_ctx = cuda_ctx;
+	cuda_device_ctx->stream = e->stream;
 	// Let FFmpeg manage the internal CUDA state
 	cuda_device_ctx->internal = NULL;
 
 	int ret = av_hwdevice_ctx_init(e->hw_device_ctx);
 	if (ret < 0) {
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
-	// Create hw frames context
+	// Create hw frames context (copy mode draws from its pool; zero-copy
+	// mode only uses it to describe the wrapped NvFBC buffer)
 	e->hw_frames_ctx = av_hwframe_ctx_alloc(e->hw_device_ctx);
 	if (!e->hw_frames_ctx) {
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
@@ -222,13 +399,11 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 	frames_ctx->sw_format = AV_PIX_FMT_NV12;
 	frames_ctx->width = width;
 	frames_ctx->height = height;
-	frames_ctx->initial_pool_size = 1;
+	frames_ctx->initial_pool_size = zero_copy ? 0 : 2;
 
 	ret = av_hwframe_ctx_init(e->hw_frames_ctx);
 	if (ret < 0) {
-		av_buffer_unref(&e->hw_frames_ctx);
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
@@ -242,17 +417,13 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 		codec = avcodec_find_encoder_by_name("h264_nvenc");
 	}
 	if (!codec) {
-		av_buffer_unref(&e->hw_frames_ctx);
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
 	e->ctx = avcodec_alloc_context3(codec);
 	if (!e->ctx) {
-		av_buffer_unref(&e->hw_frames_ctx);
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
@@ -283,14 +454,13 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 		av_opt_set_int(e->ctx->priv_data, "gpu", gpu_index, 0);
 	}
 
+	e->intra_refresh = enc_set_keyframe_opts(e->ctx, intra_refresh);
 	e->ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
 
 	ret = avcodec_open2(e->ctx, codec, NULL);
 	if (ret < 0) {
 		avcodec_free_context(&e->ctx);
-		av_buffer_unref(&e->hw_frames_ctx);
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
@@ -298,9 +468,7 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 	e->frame = av_frame_alloc();
 	if (!e->frame) {
 		avcodec_free_context(&e->ctx);
-		av_buffer_unref(&e->hw_frames_ctx);
-		av_buffer_unref(&e->hw_device_ctx);
-		free(e);
+		cuda_encoder_free_buffers(e);
 		return NULL;
 	}
 
@@ -309,89 +477,115 @@ static CUDAEncoder* cuda_encoder_init(int width, int height, int fps,
 	return e;
 }
 
-// Encode an NV12 frame from a CUDA device pointer.
-// cuda_ptr is the device pointer to the NV12 frame, stride is the row pitch.
-static int cuda_encoder_encode(CUDAEncoder *e, unsigned long long cuda_ptr,
-                                int stride,
-                                uint8_t **out_buf, int *out_size, int *is_key) {
-	*out_size = 0;
-
-	// Get a fresh frame from the hw_frames_ctx
-	av_frame_unref(e->frame);
-	int ret = av_hwframe_get_buffer(e->hw_frames_ctx, e->frame, 0);
-	if (ret < 0) return -1;
-
-	// Copy NvFBC's CUDA buffer into the AVFrame's CUDA buffer.
-	// Both are on the same GPU so this is a fast device-to-device copy.
-	// NV12 layout: Y plane = stride * height, UV plane = stride * height/2
+// NvFBC owns the wrapped buffer; the AVBufferRef only tracks NVENC's hold.
+static void cuda_encoder_wrap_free(void *opaque, uint8_t *data) {
+	(void)opaque;
+	(void)data;
+}
 
+// Point e->frame at NvFBC's NV12 buffer without copying.
+static int cuda_encoder_wrap(CUDAEncoder *e, CUdeviceptr src, int stride) {
 	size_t y_size = (size_t)stride * e->height;
 
-	CUdeviceptr src_y = (CUdeviceptr)cuda_ptr;
-	CUdeviceptr src_uv = src_y + y_size;
+	e->frame->buf[0] = av_buffer_create((uint8_t*)(uintptr_t)src, y_size * 3 / 2,
+	                                    cuda_encoder_wrap_free, NULL, 0);
+	if (!e->frame->buf[0]) return -1;
+	e->frame->hw_frames_ctx = av_buffer_ref(e->hw_frames_ctx);
+	if (!e->frame->hw_frames_ctx) return -1;
+
+	e->frame->format = AV_PIX_FMT_CUDA;
+	e->frame->width = e->width;
+	e->frame->height = e->height;
+	e->frame->data[0] = (uint8_t*)(uintptr_t)src;
+	e->frame->data[1] = (uint8_t*)(uintptr_t)(src + y_size);
+	e->frame->linesize[0] = stride;
+	e->frame->linesize[1] = stride;
+	return 0;
+}
 
-	CUdeviceptr dst_y = (CUdeviceptr)e->frame->data[0];
-	CUdeviceptr dst_uv = (CUdeviceptr)e->frame->data[1];
-	int dst_stride_y = e->frame->linesize[0];
-	int dst_stride_uv = e->frame->linesize[1];
+// Copy NvFBC's NV12 buffer into a pooled frame (async on e->stream when
+// available). NV12 layout: Y plane = stride * height, UV plane = stride * height/2
+static int cuda_encoder_copy(CUDAEncoder *e, CUdeviceptr src_y, int stride) {
+	int ret = av_hwframe_get_buffer(e->hw_frames_ctx, e->frame, 0);
+	if (ret < 0) return -1;
+
+	CUdeviceptr src_uv = src_y + (size_t)stride * e->height;
+
+	MY_CUDA_MEMCPY2D cp[2] = {{0}};
+	cp[0].srcMemoryType = 2;
+	cp[0].srcDevice = src_y;
+	cp[0].srcPitch = stride;
+	cp[0].dstMemoryType = 2;
+	cp[0].dstDevice = (CUdeviceptr)e->frame->data[0];
+	cp[0].dstPitch = e->frame->linesize[0];
+	cp[0].WidthInBytes = e->width;
+	cp[0].Height = e->height;
+
+	cp[1].srcMemoryType = 2;
+	cp[1].srcDevice = src_uv;
+	cp[1].srcPitch = stride;
+	cp[1].dstMemoryType = 2;
+	cp[1].dstDevice = (CUdeviceptr)e->frame->data[1];
+	cp[1].dstPitch = e->frame->linesize[1];
+	cp[1].WidthInBytes = e->width;
+	cp[1].Height = e->height / 2;
+
+	if (e->stream) {
+		PFN_cuMemcpy2DAsync fn_async = (PFN_cuMemcpy2DAsync)fn_enc_cuMemcpy2DAsync;
+		fn_enc_cuCtxPushCurrent(e->cuda_ctx);
+		CUresult r = fn_async(&cp[0], e->stream);
+		if (r == CUDA_SUCCESS) r = fn_async(&cp[1], e->stream);
+		fn_enc_cuCtxPopCurrent(NULL);
+		if (r != CUDA_SUCCESS) {
+			fprintf(stderr, "cuda_enc: async plane copy failed: %d\n", r);
+			return -1;
+		}
+		return 0;
+	}
 
 	if (!e->cuMemcpy2D_fn) {
 		fprintf(stderr, "cuda_enc: cuMemcpy2D_fn not set\n");
 		return -1;
 	}
-
-	typedef struct {
-		size_t srcXInBytes, srcY;
-		int srcMemoryType; // CU_MEMORYTYPE_DEVICE = 2
-		const void *srcHost;
-		CUdeviceptr srcDevice;
-		void *srcArray;
-		size_t srcPitch;
-		size_t dstXInBytes, dstY;
-		int dstMemoryType;
-		void *dstHost;
-		CUdeviceptr dstDevice;
-		void *dstArray;
-		size_t dstPitch;
-		size_t WidthInBytes, Height;
-	} MY_CUDA_MEMCPY2D;
-
-	typedef CUresult (*PFN_cuMemcpy2D)(const MY_CUDA_MEMCPY2D *);
+	// The encode thread isn't the one NvFBC made the context current on.
+	if (!fn_enc_cuCtxPushCurrent || !fn_enc_cuCtxPopCurrent) {
+		fprintf(stderr, "cuda_enc: cuCtxPushCurrent not available\n");
+		return -1;
+	}
 	PFN_cuMemcpy2D fn_memcpy2d = (PFN_cuMemcpy2D)e->cuMemcpy2D_fn;
-
-	// Copy Y plane
-	MY_CUDA_MEMCPY2D cp_y = {0};
-	cp_y.srcMemoryType = 2;
-	cp_y.srcDevice = src_y;
-	cp_y.srcPitch = stride;
-	cp_y.dstMemoryType = 2;
-	cp_y.dstDevice = dst_y;
-	cp_y.dstPitch = dst_stride_y;
-	cp_y.WidthInBytes = e->width;
-	cp_y.Height = e->height;
-	CUresult r = fn_memcpy2d(&cp_y);
+	fn_enc_cuCtxPushCurrent(e->cuda_ctx);
+	CUresult r = fn_memcpy2d(&cp[0]);
 	if (r != CUDA_SUCCESS) {
 		fprintf(stderr, "cuda_enc: Y plane copy failed: %d\n", r);
-		return -1;
+	} else {
+		r = fn_memcpy2d(&cp[1]);
+		if (r != CUDA_SUCCESS) {
+			fprintf(stderr, "cuda_enc: UV plane copy failed: %d\n", r);
+		}
 	}
+	fn_enc_cuCtxPopCurrent(NULL);
+	return r == CUDA_SUCCESS ? 0 : -1;
+}
 
-	// Copy UV plane
-	MY_CUDA_MEMCPY2D cp_uv = {0};
-	cp_uv.srcMemoryType = 2;
-	cp_uv.srcDevice = src_uv;
-	cp_uv.srcPitch = stride;
-	cp_uv.dstMemoryType = 2;
-	cp_uv.dstDevice = dst_uv;
-	cp_uv.dstPitch = dst_stride_uv;
-	cp_uv.WidthInBytes = e->width;
-	cp_uv.Height = e->height / 2;
-	r = fn_memcpy2d(&cp_uv);
-	if (r != CUDA_SUCCESS) {
-		fprintf(stderr, "cuda_enc: UV plane copy failed: %d\n", r);
-		return -1;
-	}
+// Encode an NV12 frame from a CUDA device pointer.
+// cuda_ptr is the device pointer to the NV12 frame, stride is the row pitch.
+// When this returns, NvFBC's buffer is no longer referenced and may be
+// overwritten by the next grab.
+static int cuda_encoder_encode(CUDAEncoder *e, unsigned long long cuda_ptr,
+                                int stride, int force_key,
+                                const int32_t *roi, int nroi, int roi_qp,
+                                uint8_t **out_buf, int *out_size, int *is_key) {
+	*out_size = 0;
+
+	av_frame_unref(e->frame);
+	int ret = e->zero_copy
+		? cuda_encoder_wrap(e, (CUdeviceptr)cuda_ptr, stride)
+		: cuda_encoder_copy(e, (CUdeviceptr)cuda_ptr, stride);
+	if (ret < 0) return -1;
 
 	e->frame->pts = e->pts++;
+	e->frame->pict_type = force_key ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	enc_set_roi(e->frame, roi, nroi, roi_qp);
 
 	ret = avcodec_send_frame(e->ctx, e->frame);
 	if (ret < 0) {
@@ -400,7 +594,21 @@ static int cuda_encoder_encode(CUDAEncoder *e, unsigned long long cuda_ptr,
 	}
 
 	ret = avcodec_receive_packet(e->ctx, e->pkt);
-	if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+	if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+		// No packet means NVENC may still be reading the input. The pooled
+		// copy is safe once the stream drains; a wrapped NvFBC buffer
+		// is not, so say so once.
+		if (e->stream) {
+			fn_enc_cuCtxPushCurrent(e->cuda_ctx);
+			fn_enc_cuStreamSynchronize(e->stream);
+			fn_enc_cuCtxPopCurrent(NULL);
+		}
+		if (e->zero_copy && !e->warned_delay) {
+			fprintf(stderr, "cuda_enc: encoder buffered a zero-copy frame; NvFBC may overwrite it\n");
+			e->warned_delay = 1;
+		}
+		return 0;
+	}
 	if (ret < 0) {
 		fprintf(stderr, "cuda_enc: avcodec_receive_packet failed: %d\n", ret);
 		return -1;
@@ -421,27 +629,65 @@ static void cuda_encoder_destroy(CUDAEncoder *e) {
 	if (e->pkt) av_packet_free(&e->pkt);
 	if (e->frame) av_frame_free(&e->frame);
 	if (e->ctx) avcodec_free_context(&e->ctx);
-	if (e->hw_frames_ctx) av_buffer_unref(&e->hw_frames_ctx);
-	if (e->hw_device_ctx) av_buffer_unref(&e->hw_device_ctx);
-	free(e);
+	cuda_encoder_free_buffers(e);
 }
 */
 import "C"
 import (
 	"fmt"
+	"strings"
+	"time"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
-// cpuEncoder wraps the CPU-based encoder (sws_scale BGRA→NV12 + NVENC/libx264).
+// cpuEncoder wraps the CPU-based encoder (colorconv BGRA→NV12 + NVENC/libx264).
 type cpuEncoder struct {
-	e *C.CPUEncoder
+	e          *C.CPUEncoder
+	p          openParams
+	name       string
+	reconf     bool    // runtime rate change supported (read off the encode goroutine)
+	nvenc      bool    // holds one of p.gpu's NVENC sessions
+	roi        []int32 // damage regions for the frame being encoded
+	rate       rateState
+	keyframe   keyframeFlag
+	srcW, srcH int // source size the converter is set up for
+	packets    types.PacketPool
 }
 
 // cudaEncoder wraps the CUDA-based encoder (NV12 CUDA ptr → NVENC).
 type cudaEncoder struct {
-	e *C.CUDAEncoder
+	e                   *C.CUDAEncoder
+	p                   openParams
+	cudaCtx, cuMemcpy2D unsafe.Pointer
+	rate                rateState
+	keyframe            keyframeFlag
+	roi                 []int32
+	packets             types.PacketPool
+}
+
+var cudaZeroCopy bool
+
+func cBool(b bool) C.int {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+// cRects passes roiRects' output to C.
+func cRects(r []int32) (*C.int32_t, C.int) {
+	if len(r) == 0 {
+		return nil, 0
+	}
+	return (*C.int32_t)(unsafe.Pointer(&r[0])), C.int(len(r) / 4)
+}
+
+// SetCUDAZeroCopy makes the CUDA encoder wrap the capturer's NV12 device
+// buffer as the NVENC input instead of copying it into its own frame pool.
+func SetCUDAZeroCopy(enabled bool) {
+	cudaZeroCopy = enabled
 }
 
 func NewEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int, cudaCtx, cuMemcpy2D unsafe.Pointer) (types.VideoEncoder, error) {
@@ -449,37 +695,77 @@ func NewEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int,
 	if keyint <= 0 {
 		keyint = fps * 2
 	}
-
-	cCodec := C.CString(codec)
-	defer C.free(unsafe.Pointer(cCodec))
+	p := openParams{fps: fps, keyint: keyint, gpu: gpu, codec: codec}
 
 	if cudaCtx != nil {
-		// CUDA path: zero-copy from NvFBC CUDA buffer to NVENC
-		e := C.cuda_encoder_init(
-			C.int(width), C.int(height), C.int(fps),
-			C.int(bitrateKbps), C.int(keyint), C.int(gpu),
-			cCodec, cudaCtx, cuMemcpy2D)
+		// CUDA path: NvFBC CUDA buffer to NVENC, never touching the CPU.
+		// The CPU encoder only takes host BGRA, so there is no fallback
+		// here; the caller has to capture differently.
+		if !acquireNVENC(gpu) {
+			return nil, fmt.Errorf("%w: NVENC session limit reached on GPU %d", types.ErrNoDeviceEncoder, gpu)
+		}
+		e := openCUDA(p, width, height, bitrateKbps, cudaCtx, cuMemcpy2D)
 		if e != nil {
 			name := C.GoString(C.cuda_encoder_name(e))
-			fmt.Printf("video encoder: %s CUDA (%dx%d @ %d kbps)\n", name, width, height, bitrateKbps)
-			return &cudaEncoder{e: e}, nil
+			input := "async copy"
+			if cudaZeroCopy {
+				input = "zero-copy"
+			} else if e.stream == nil {
+				input = "sync copy"
+			}
+			fmt.Printf("video encoder: %s CUDA (%dx%d @ %d kbps, %s, %s)\n", name, width, height, bitrateKbps, input,
+				refreshMode(e.intra_refresh != 0, name))
+			return &cudaEncoder{e: e, p: p, cudaCtx: cudaCtx, cuMemcpy2D: cuMemcpy2D,
+				rate: newRateState(bitrateKbps, fps)}, nil
 		}
-		fmt.Println("CUDA encoder init failed, falling back to CPU encoder")
+		releaseNVENC(gpu)
+		return nil, fmt.Errorf("%w: CUDA encoder init failed", types.ErrNoDeviceEncoder)
 	}
 
 	// CPU fallback path
-	e := C.cpu_encoder_init(
-		C.int(width), C.int(height), C.int(fps),
-		C.int(bitrateKbps), C.int(keyint), C.int(gpu), cCodec)
+	hw := acquireNVENC(gpu)
+	if !hw {
+		fmt.Printf("NVENC session limit reached on GPU %d, using a software encoder\n", gpu)
+	}
+	e := openCPU(p, width, height, bitrateKbps, hw)
 	if e == nil {
+		if hw {
+			releaseNVENC(gpu)
+		}
 		if codec == "h265" {
 			return nil, fmt.Errorf("failed to initialize video encoder (tried hardware h265 then libx265)")
 		}
 		return nil, fmt.Errorf("failed to initialize video encoder (tried hardware h264 then libx264)")
 	}
 	name := C.GoString(C.cpu_encoder_name(e))
-	fmt.Printf("video encoder: %s (%dx%d @ %d kbps)\n", name, width, height, bitrateKbps)
-	return &cpuEncoder{e: e}, nil
+	nvenc := strings.HasSuffix(name, "_nvenc")
+	if hw && !nvenc {
+		releaseNVENC(gpu) // no NVENC in this FFmpeg build
+	}
+	fmt.Printf("video encoder: %s (%dx%d @ %d kbps, colorconv %s x%d, %s)\n", name, width, height, bitrateKbps,
+		C.GoString(C.colorconv_kernel_name(e.cc)), int(C.colorconv_threads(e.cc)),
+		refreshMode(e.intra_refresh != 0, name))
+	return &cpuEncoder{e: e, p: p, name: name, reconf: C.enc_can_reconfigure(e.ctx) != 0, nvenc: nvenc,
+		rate: newRateState(bitrateKbps, fps), srcW: width, srcH: height}, nil
+}
+
+// openCPU opens the colorconv + codec encoder. hw allows NVENC; without it
+// the software codec is used.
+func openCPU(p openParams, width, height, kbps int, hw bool) *C.CPUEncoder {
+	cCodec := C.CString(p.codec)
+	defer C.free(unsafe.Pointer(cCodec))
+	return C.cpu_encoder_init(
+		C.int(width), C.int(height), C.int(p.fps),
+		C.int(kbps), C.int(p.keyint), C.int(p.gpu), cCodec, cBool(intraRefresh), cBool(hw), cBool(damageQP > 0))
+}
+
+func openCUDA(p openParams, width, height, kbps int, cudaCtx, cuMemcpy2D unsafe.Pointer) *C.CUDAEncoder {
+	cCodec := C.CString(p.codec)
+	defer C.free(unsafe.Pointer(cCodec))
+	return C.cuda_encoder_init(
+		C.int(width), C.int(height), C.int(p.fps),
+		C.int(kbps), C.int(p.keyint), C.int(p.gpu),
+		cCodec, cudaCtx, cuMemcpy2D, cBool(cudaZeroCopy), cBool(intraRefresh))
 }
 
 // cpuEncoder — BGRA CPU buffer path
@@ -496,8 +782,23 @@ func (enc *cpuEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error) {
 		srcPtr = unsafe.Pointer(&frame.Data[0])
 	}
 
+	if frame.Width != enc.srcW || frame.Height != enc.srcH {
+		if C.cpu_encoder_set_source(enc.e, C.int(frame.Width), C.int(frame.Height)) != 0 {
+			return nil, fmt.Errorf("cannot scale %dx%d source to %dx%d", frame.Width, frame.Height, enc.e.width, enc.e.height)
+		}
+		enc.srcW, enc.srcH = frame.Width, frame.Height
+	}
+
+	if kbps, ok := enc.rate.take(); ok {
+		C.enc_set_bitrate(enc.e.ctx, C.int(kbps))
+	}
+
+	enc.roi = roiRects(enc.roi, frame.Damage, frame.Width, frame.Height, int(enc.e.width), int(enc.e.height))
+	roi, nroi := cRects(enc.roi)
+
 	ret := C.cpu_encoder_encode(enc.e,
-		(*C.uint8_t)(srcPtr), C.int(frame.Stride),
+		(*C.uint8_t)(srcPtr), C.int(frame.Stride), cBool(enc.keyframe.take()),
+		roi, nroi, C.int(damageQP),
 		&outBuf, &outSize, &isKey)
 
 	if ret != 0 {
@@ -507,17 +808,65 @@ func (enc *cpuEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error) {
 		return nil, nil
 	}
 
-	data := C.GoBytes(unsafe.Pointer(outBuf), outSize)
+	out := packetFrom(&enc.packets, unsafe.Pointer(outBuf), int(outSize), isKey != 0)
 	C.cpu_encoder_unref(enc.e)
+	return out, nil
+}
+
+func (enc *cpuEncoder) RequestKeyframe() { enc.keyframe.request() }
+
+// RequestRefresh boosts the next frame's bitrate. libx265 can't change
+// rate at runtime, so it encodes the frame as usual.
+func (enc *cpuEncoder) RequestRefresh() {
+	if enc.reconf {
+		enc.rate.refresh()
+	}
+}
+
+func (enc *cpuEncoder) EncoderName() string { return enc.name }
 
-	return &types.EncodedFrame{
-		Data:  data,
-		IsKey: isKey != 0,
-	}, nil
+func (enc *cpuEncoder) ConvertTime() time.Duration {
+	return time.Duration(C.colorconv_last_ns(enc.e.cc))
+}
+
+func (enc *cpuEncoder) SetBitrate(kbps int) error {
+	if !enc.reconf {
+		return fmt.Errorf("%s: runtime bitrate change not supported", enc.name)
+	}
+	enc.rate.setBitrate(kbps)
+	return nil
+}
+
+func (enc *cpuEncoder) SetFrameRate(fps int) error {
+	if !enc.reconf {
+		return fmt.Errorf("%s: runtime rate change not supported", enc.name)
+	}
+	enc.rate.setFrameRate(fps)
+	return nil
+}
+
+// Resize reopens the codec at width x height. The converter is rebuilt on
+// the next Encode from that frame's size. On failure the old codec stays.
+func (enc *cpuEncoder) Resize(width, height int) error {
+	if width == int(enc.e.width) && height == int(enc.e.height) {
+		return nil
+	}
+	e := openCPU(enc.p, width, height, enc.rate.codecKbps(), enc.nvenc)
+	if e == nil {
+		return fmt.Errorf("%s: reopen at %dx%d failed", enc.name, width, height)
+	}
+	C.cpu_encoder_destroy(enc.e)
+	enc.e = e
+	enc.srcW, enc.srcH = width, height
+	fmt.Printf("video encoder: %s reopened at %dx%d\n", enc.name, width, height)
+	return nil
 }
 
 func (enc *cpuEncoder) Close() {
 	C.cpu_encoder_destroy(enc.e)
+	if enc.nvenc {
+		releaseNVENC(enc.p.gpu)
+	}
 }
 
 // cudaEncoder — NV12 CUDA device pointer path
@@ -526,6 +875,9 @@ func (enc *cudaEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error)
 	if !frame.IsCUDA {
 		return nil, fmt.Errorf("CUDA encoder received non-CUDA frame")
 	}
+	if frame.Width != int(enc.e.width) || frame.Height != int(enc.e.height) {
+		return nil, fmt.Errorf("CUDA frame is %dx%d, encoder is %dx%d", frame.Width, frame.Height, enc.e.width, enc.e.height)
+	}
 
 	var outBuf *C.uint8_t
 	var outSize C.int
@@ -534,7 +886,15 @@ func (enc *cudaEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error)
 	// frame.Ptr is a CUdeviceptr (uint64) stored as unsafe.Pointer
 	cudaPtr := C.ulonglong(uintptr(frame.Ptr))
 
-	ret := C.cuda_encoder_encode(enc.e, cudaPtr, C.int(frame.Stride),
+	if kbps, ok := enc.rate.take(); ok {
+		C.enc_set_bitrate(enc.e.ctx, C.int(kbps))
+	}
+
+	enc.roi = roiRects(enc.roi, frame.Damage, frame.Width, frame.Height, frame.Width, frame.Height)
+	roi, nroi := cRects(enc.roi)
+
+	ret := C.cuda_encoder_encode(enc.e, cudaPtr, C.int(frame.Stride), cBool(enc.keyframe.take()),
+		roi, nroi, C.int(damageQP),
 		&outBuf, &outSize, &isKey)
 
 	if ret != 0 {
@@ -544,15 +904,46 @@ func (enc *cudaEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error)
 		return nil, nil
 	}
 
-	data := C.GoBytes(unsafe.Pointer(outBuf), outSize)
+	out := packetFrom(&enc.packets, unsafe.Pointer(outBuf), int(outSize), isKey != 0)
 	C.cuda_encoder_unref(enc.e)
+	return out, nil
+}
+
+func (enc *cudaEncoder) RequestKeyframe() { enc.keyframe.request() }
+
+func (enc *cudaEncoder) RequestRefresh() { enc.rate.refresh() }
 
-	return &types.EncodedFrame{
-		Data:  data,
-		IsKey: isKey != 0,
-	}, nil
+func (enc *cudaEncoder) EncoderName() string { return C.GoString(C.cuda_encoder_name(enc.e)) }
+
+// The CUDA path is always NVENC, which reconfigures in place wherever the
+// GPU reports dynamic bitrate support (FFmpeg keeps the opened rate otherwise).
+func (enc *cudaEncoder) SetBitrate(kbps int) error {
+	enc.rate.setBitrate(kbps)
+	return nil
+}
+
+func (enc *cudaEncoder) SetFrameRate(fps int) error {
+	enc.rate.setFrameRate(fps)
+	return nil
+}
+
+// Resize reopens NVENC and its frame pool at width x height on the
+// capturer's CUDA context. On failure the old codec stays.
+func (enc *cudaEncoder) Resize(width, height int) error {
+	if width == int(enc.e.width) && height == int(enc.e.height) {
+		return nil
+	}
+	e := openCUDA(enc.p, width, height, enc.rate.codecKbps(), enc.cudaCtx, enc.cuMemcpy2D)
+	if e == nil {
+		return fmt.Errorf("CUDA encoder: reopen at %dx%d failed", width, height)
+	}
+	C.cuda_encoder_destroy(enc.e)
+	enc.e = e
+	fmt.Printf("video encoder: %s CUDA reopened at %dx%d\n", C.GoString(C.cuda_encoder_name(e)), width, height)
+	return nil
 }
 
 func (enc *cudaEncoder) Close() {
 	C.cuda_encoder_destroy(enc.e)
+	releaseNVENC(enc.p.gpu)
 }
@@ -0,0 +1,33 @@
+package encode
+
+import "sync/atomic"
+
+var intraRefresh bool
+
+// SetIntraRefresh replaces periodic IDR frames with intra refresh, where a
+// band of intra-coded blocks sweeps the picture once per GOP. Frame sizes
+// stay flat instead of spiking every keyint, at the cost of slower
+// recovery for a decoder that didn't ask for a keyframe. Encoders without
+// intra refresh keep periodic IDRs.
+func SetIntraRefresh(enabled bool) {
+	intraRefresh = enabled
+}
+
+// keyframeFlag carries a RequestKeyframe to the next Encode call.
+type keyframeFlag struct {
+	pending atomic.Bool
+}
+
+func (k *keyframeFlag) request() { k.pending.Store(true) }
+
+func (k *keyframeFlag) take() bool { return k.pending.Swap(false) }
+
+func refreshMode(intra bool, codecName string) string {
+	if intra {
+		return "intra refresh"
+	}
+	if intraRefresh {
+		return "periodic IDR, intra refresh unsupported by " + codecName
+	}
+	return "periodic IDR"
+}
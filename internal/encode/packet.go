@@ -0,0 +1,17 @@
+package encode
+
+import (
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+// packetFrom copies an n-byte packet out of the codec into a frame from
+// pool, so the codec's packet can be unreferenced right away without a
+// heap allocation per frame.
+func packetFrom(pool *types.PacketPool, data unsafe.Pointer, n int, isKey bool) *types.EncodedFrame {
+	f := pool.Frame(n)
+	copy(f.Data, unsafe.Slice((*byte)(data), n))
+	f.IsKey = isKey
+	return f
+}
@@ -0,0 +1,24 @@
+//go:build !race
+
+// The race detector makes sync.Pool drop items at random.
+
+package encode
+
+import (
+	"testing"
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+func TestPacketFromAllocs(t *testing.T) {
+	var pool types.PacketPool
+	codec := make([]byte, 64<<10)
+
+	if n := testing.AllocsPerRun(1000, func() {
+		f := packetFrom(&pool, unsafe.Pointer(&codec[0]), len(codec), true)
+		f.Release()
+	}); n != 0 {
+		t.Errorf("packetFrom: %v allocs per frame, want 0", n)
+	}
+}
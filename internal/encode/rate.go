@@ -0,0 +1,76 @@
+package encode
+
+import "sync"
+
+// refreshBoost multiplies the bitrate of a refresh frame.
+const refreshBoost = 8
+
+// rateState holds a runtime bitrate/frame-rate change until the encoding
+// goroutine applies it between frames: the codec context must not be
+// touched while avcodec_send_frame runs on another thread.
+type rateState struct {
+	mu    sync.Mutex
+	fps0  int // frame rate the codec was opened with
+	kbps  int
+	fps   int
+	dirty bool
+
+	boost, boosted bool // refresh frame requested / being encoded
+}
+
+func newRateState(kbps, fps int) rateState {
+	return rateState{fps0: fps, kbps: kbps, fps: fps}
+}
+
+func (r *rateState) setBitrate(kbps int) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	if kbps != r.kbps {
+		r.kbps = kbps
+		r.dirty = true
+	}
+}
+
+func (r *rateState) setFrameRate(fps int) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	fps = min(max(fps, 1), r.fps0)
+	if fps != r.fps {
+		r.fps = fps
+		r.dirty = true
+	}
+}
+
+// refresh gives the next frame refreshBoost times the bitrate. The frame
+// after it goes back to the normal rate.
+func (r *rateState) refresh() {
+	r.mu.Lock()
+	r.boost = true
+	r.mu.Unlock()
+}
+
+// codecKbps is the bitrate to open a new codec context with.
+func (r *rateState) codecKbps() int {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	return r.kbps * r.fps0 / r.fps
+}
+
+// take returns the bitrate to program into the codec, if it changed.
+// Timestamps stay at the opened frame rate, so rate control budgets
+// bit_rate/fps0 per frame; when fewer frames are fed, the codec bitrate
+// is scaled up so the stream still averages kbps.
+func (r *rateState) take() (codecKbps int, ok bool) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	kbps := r.kbps * r.fps0 / r.fps
+	switch {
+	case r.boost:
+		r.boost, r.boosted, r.dirty = false, true, false
+		return kbps * refreshBoost, true
+	case r.boosted || r.dirty:
+		r.boosted, r.dirty = false, false
+		return kbps, true
+	}
+	return 0, false
+}
@@ -0,0 +1,8 @@
+package encode
+
+// openParams are the settings an encoder was opened with, kept so Resize
+// can reopen the codec at a new size on its own.
+type openParams struct {
+	fps, keyint, gpu int
+	codec            string
+}
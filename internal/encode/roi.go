@@ -0,0 +1,50 @@
+package encode
+
+import "image"
+
+var damageQP int
+
+// roiMaxArea is the share of the frame (in 1/16ths) past which damage
+// hints are dropped: lowering QP over most of the picture only shifts
+// bits around under CBR.
+const roiMaxArea = 8
+
+// roiMaxRects caps the regions attached to one frame.
+const roiMaxRects = 64
+
+// SetDamageQP makes encoders lower the QP of the regions a damage-tracking
+// capturer reports changed by qp for that frame, so small changes such as
+// typed text get bits ahead of the static background. Unchanged blocks
+// still cost only a skip. 0 turns it off.
+func SetDamageQP(qp int) {
+	damageQP = qp
+}
+
+// roiRects converts a frame's damage into encoder regions for an
+// encW x encH picture scaled down from srcW x srcH, as left, top, right,
+// bottom quadruples appended to dst[:0]. It returns nil when there is
+// nothing worth hinting: no damage list, too many rectangles, or damage
+// covering most of the frame.
+func roiRects(dst []int32, damage []image.Rectangle, srcW, srcH, encW, encH int) []int32 {
+	if damageQP <= 0 || len(damage) == 0 || len(damage) > roiMaxRects || encW <= 0 || encH <= 0 {
+		return nil
+	}
+	bounds := image.Rect(0, 0, srcW, srcH)
+	area := 0
+	dst = dst[:0]
+	for _, r := range damage {
+		r = r.Intersect(bounds)
+		if r.Empty() {
+			continue
+		}
+		area += r.Dx() * r.Dy()
+		// Round outwards so scaled regions still cover every changed pixel.
+		dst = append(dst,
+			int32(r.Min.X*encW/srcW), int32(r.Min.Y*encH/srcH),
+			int32((r.Max.X*encW+srcW-1)/srcW), int32((r.Max.Y*encH+srcH-1)/srcH))
+	}
+	if len(dst) == 0 || area*16 > srcW*srcH*roiMaxArea {
+		return nil
+	}
+	return dst
+}
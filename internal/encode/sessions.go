@@ -0,0 +1,45 @@
+package encode
+
+import "sync"
+
+// GeForce drivers cap how many NVENC sessions may be open at once on a
+// GPU, counted across processes. With several desktops in one process the
+// encoder keeps its own count per GPU, so a pipeline that would go over
+// the cap opens a software encoder instead of failing at avcodec_open2.
+var (
+	nvencMu    sync.Mutex
+	nvencLimit int         // 0 = no limit
+	nvencUsed  map[int]int // open sessions per GPU index
+)
+
+// SetNVENCSessionLimit caps the NVENC sessions this process opens per GPU.
+// 0 means no limit.
+func SetNVENCSessionLimit(n int) {
+	nvencMu.Lock()
+	nvencLimit = n
+	nvencMu.Unlock()
+}
+
+// acquireNVENC reserves an NVENC session on gpu. It returns false when
+// gpu already has the maximum open.
+func acquireNVENC(gpu int) bool {
+	nvencMu.Lock()
+	defer nvencMu.Unlock()
+	if nvencUsed == nil {
+		nvencUsed = make(map[int]int)
+	}
+	if nvencLimit > 0 && nvencUsed[gpu] >= nvencLimit {
+		return false
+	}
+	nvencUsed[gpu]++
+	return true
+}
+
+// releaseNVENC gives back a session taken with acquireNVENC.
+func releaseNVENC(gpu int) {
+	nvencMu.Lock()
+	defer nvencMu.Unlock()
+	if nvencUsed[gpu] > 0 {
+		nvencUsed[gpu]--
+	}
+}
@@ -3,25 +3,106 @@
 package encode
 
 /*
-#cgo pkg-config: libavcodec libavutil libswscale
+#cgo pkg-config: libavcodec libavutil
+#cgo LDFLAGS: -framework VideoToolbox -framework CoreVideo -framework CoreFoundation
+#include <VideoToolbox/VideoToolbox.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
-#include <libswscale/swscale.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "colorconv.h"
 
 typedef struct {
 	AVCodecContext *ctx;
 	AVFrame *frame;
 	AVPacket *pkt;
-	struct SwsContext *sws;
+	ColorConv *cc;
 	int width;
 	int height;
 	int64_t pts;
+	int intra_refresh;
+	int passthrough;              // ctx takes CVPixelBuffers (AV_PIX_FMT_VIDEOTOOLBOX)
+	CVPixelBufferPoolRef pool;    // encode-size buffers: NV12 with passthrough, else BGRA
+	VTPixelTransferSessionRef xfer; // scales/converts pixel buffers that can't go as-is
+	int64_t convert_ns;           // time spent converting in the last encode
 } VTBEncoder;
 
-static VTBEncoder* vtb_encoder_init(int width, int height, int fps, int bitrate_kbps, int keyint, int gpu_index, const char *codec_name) {
+// The converter writes I420 for the software fallbacks, NV12 otherwise.
+static int vtb_colorconv_format(VTBEncoder *e) {
+	return e->ctx->pix_fmt == AV_PIX_FMT_YUV420P ? COLORCONV_I420 : COLORCONV_NV12;
+}
+
+// forced-idr makes a frame sent with pict_type I an IDR in the x264/x265
+// fallbacks; VideoToolbox maps it to kVTEncodeFrameOptionKey_ForceKeyFrame
+// by itself. Intra refresh is only available in the software fallbacks.
+// Returns 1 if intra refresh is active.
+static int vtb_set_keyframe_opts(AVCodecContext *ctx, int intra_refresh) {
+	av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+	if (!intra_refresh) return 0;
+	if (strcmp(ctx->codec->name, "libx264") == 0) {
+		return av_opt_set(ctx->priv_data, "intra-refresh", "1", 0) >= 0;
+	}
+	if (strcmp(ctx->codec->name, "libx265") == 0) {
+		return av_opt_set(ctx->priv_data, "x265-params", "intra-refresh=1", 0) >= 0;
+	}
+	return 0;
+}
+
+// Opens codec at width x height. With passthrough the context takes
+// CVPixelBuffers in AVFrame data[3] and VideoToolbox encodes them without
+// FFmpeg copying them into a buffer of its own.
+static AVCodecContext* vtb_open_codec(const AVCodec *codec, int width, int height, int fps, int bitrate_kbps,
+                                      int keyint, int intra_refresh, int passthrough, int *intra_active) {
+	AVCodecContext *ctx = avcodec_alloc_context3(codec);
+	if (!ctx) return NULL;
+
+	ctx->width = width;
+	ctx->height = height;
+	ctx->time_base = (AVRational){1, fps};
+	ctx->framerate = (AVRational){fps, 1};
+	ctx->pix_fmt = AV_PIX_FMT_NV12;
+	ctx->bit_rate = (int64_t)bitrate_kbps * 1000;
+	ctx->gop_size = keyint;
+	ctx->max_b_frames = 0;
+
+	if (strcmp(codec->name, "h264_videotoolbox") == 0) {
+		av_opt_set(ctx->priv_data, "realtime", "1", 0);
+		av_opt_set(ctx->priv_data, "allow_sw", "1", 0);
+		av_opt_set(ctx->priv_data, "profile", "baseline", 0);
+	} else if (strcmp(codec->name, "hevc_videotoolbox") == 0) {
+		av_opt_set(ctx->priv_data, "realtime", "1", 0);
+		av_opt_set(ctx->priv_data, "allow_sw", "1", 0);
+		av_opt_set(ctx->priv_data, "profile", "main", 0);
+	} else if (strcmp(codec->name, "libx265") == 0) {
+		av_opt_set(ctx->priv_data, "preset", "ultrafast", 0);
+		av_opt_set(ctx->priv_data, "tune", "zerolatency", 0);
+		ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+	} else {
+		// libx264 fallback
+		av_opt_set(ctx->priv_data, "preset", "ultrafast", 0);
+		av_opt_set(ctx->priv_data, "tune", "zerolatency", 0);
+		av_opt_set(ctx->priv_data, "profile", "baseline", 0);
+		ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+	}
+	if (passthrough) {
+		ctx->pix_fmt = AV_PIX_FMT_VIDEOTOOLBOX;
+		ctx->sw_pix_fmt = AV_PIX_FMT_NV12;
+	}
+
+	*intra_active = vtb_set_keyframe_opts(ctx, intra_refresh);
+	ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
+	if (avcodec_open2(ctx, codec, NULL) < 0) {
+		avcodec_free_context(&ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+static VTBEncoder* vtb_encoder_init(int width, int height, int fps, int bitrate_kbps, int keyint, int gpu_index, const char *codec_name, int intra_refresh) {
 	VTBEncoder *e = (VTBEncoder*)calloc(1, sizeof(VTBEncoder));
 	if (!e) return NULL;
 
@@ -39,91 +120,104 @@ static VTBEncoder* vtb_encoder_init(int width, int height, int fps, int bitrate_
 		codec = avcodec_find_encoder_by_name("h264_videotoolbox");
 		if (!codec) codec = avcodec_find_encoder_by_name("libx264");
 	}
-	if (!codec) return NULL;
-
-	e->ctx = avcodec_alloc_context3(codec);
-	if (!e->ctx) { free(e); return NULL; }
+	if (!codec) { free(e); return NULL; }
 
-	e->ctx->width = width;
-	e->ctx->height = height;
-	e->ctx->time_base = (AVRational){1, fps};
-	e->ctx->framerate = (AVRational){fps, 1};
-	e->ctx->pix_fmt = AV_PIX_FMT_NV12;
-	e->ctx->bit_rate = (int64_t)bitrate_kbps * 1000;
-	e->ctx->gop_size = keyint;
-	e->ctx->max_b_frames = 0;
-
-	if (strcmp(codec->name, "h264_videotoolbox") == 0) {
-		av_opt_set(e->ctx->priv_data, "realtime", "1", 0);
-		av_opt_set(e->ctx->priv_data, "allow_sw", "1", 0);
-		av_opt_set(e->ctx->priv_data, "profile", "baseline", 0);
-		e->ctx->pix_fmt = AV_PIX_FMT_NV12;
-	} else if (strcmp(codec->name, "hevc_videotoolbox") == 0) {
-		av_opt_set(e->ctx->priv_data, "realtime", "1", 0);
-		av_opt_set(e->ctx->priv_data, "allow_sw", "1", 0);
-		av_opt_set(e->ctx->priv_data, "profile", "main", 0);
-		e->ctx->pix_fmt = AV_PIX_FMT_NV12;
-	} else if (strcmp(codec->name, "libx265") == 0) {
-		av_opt_set(e->ctx->priv_data, "preset", "ultrafast", 0);
-		av_opt_set(e->ctx->priv_data, "tune", "zerolatency", 0);
-		e->ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-	} else {
-		// libx264 fallback
-		av_opt_set(e->ctx->priv_data, "preset", "ultrafast", 0);
-		av_opt_set(e->ctx->priv_data, "tune", "zerolatency", 0);
-		av_opt_set(e->ctx->priv_data, "profile", "baseline", 0);
-		e->ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+	// VideoToolbox takes pixel buffers as-is; FFmpeg builds that can't
+	// open it that way get NV12 AVFrames like the software fallbacks.
+	if (strstr(codec->name, "_videotoolbox")) {
+		e->ctx = vtb_open_codec(codec, width, height, fps, bitrate_kbps, keyint, intra_refresh, 1, &e->intra_refresh);
+		e->passthrough = e->ctx != NULL;
 	}
-
-	e->ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
-
-	if (avcodec_open2(e->ctx, codec, NULL) < 0) {
-		avcodec_free_context(&e->ctx);
-		free(e);
-		return NULL;
+	if (!e->ctx) {
+		e->ctx = vtb_open_codec(codec, width, height, fps, bitrate_kbps, keyint, intra_refresh, 0, &e->intra_refresh);
 	}
+	if (!e->ctx) { free(e); return NULL; }
 
 	e->frame = av_frame_alloc();
-	e->frame->format = e->ctx->pix_fmt;
-	e->frame->width = width;
-	e->frame->height = height;
-	av_frame_get_buffer(e->frame, 0);
+	if (!e->passthrough) {
+		e->frame->format = e->ctx->pix_fmt;
+		e->frame->width = width;
+		e->frame->height = height;
+		av_frame_get_buffer(e->frame, 0);
+	}
 
 	e->pkt = av_packet_alloc();
 
-	// Set up swscale for BGRA -> NV12/YUV420P conversion
-	e->sws = sws_getContext(
-		width, height, AV_PIX_FMT_BGRA,
-		width, height, e->ctx->pix_fmt,
-		SWS_FAST_BILINEAR, NULL, NULL, NULL);
-
-	if (!e->sws) {
-		av_packet_free(&e->pkt);
-		av_frame_free(&e->frame);
-		avcodec_free_context(&e->ctx);
-		free(e);
-		return NULL;
+	// With passthrough, captured pixel buffers never need the converter
+	// (or its worker threads); it is created with the first frame that
+	// does.
+	if (!e->passthrough) {
+		e->cc = colorconv_create(width, height, 1, vtb_colorconv_format(e), COLORCONV_BT601, 0);
+		if (!e->cc) {
+			av_packet_free(&e->pkt);
+			av_frame_free(&e->frame);
+			avcodec_free_context(&e->ctx);
+			free(e);
+			return NULL;
+		}
 	}
 
 	return e;
 }
 
-// Returns: 0 = success, -1 = error. out_size=0 means no output yet.
-static int vtb_encoder_encode(VTBEncoder *e, const uint8_t *bgra, int stride,
-                          uint8_t **out_buf, int *out_size, int *is_key) {
-	*out_size = 0;
+// Rebuilds the color converter for a src_w x src_h source; larger sources
+// are box-downscaled on the way in (ladder renditions).
+// Returns 0 on success, -1 if the source doesn't map onto the encode size.
+static int vtb_encoder_set_source(VTBEncoder *e, int src_w, int src_h) {
+	int scale = colorconv_scale_for(src_w, src_h, e->width, e->height);
+	if (!scale) return -1;
+	ColorConv *cc = colorconv_create(e->width, e->height, scale, vtb_colorconv_format(e), COLORCONV_BT601, 0);
+	if (!cc) return -1;
+	colorconv_destroy(e->cc);
+	e->cc = cc;
+	return 0;
+}
 
-	// Convert BGRA to encoder pixel format
-	const uint8_t *src_data[1] = { bgra };
-	int src_linesize[1] = { stride };
+static int64_t vtb_now_ns(void) {
+	return (int64_t)clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
 
-	av_frame_make_writable(e->frame);
-	sws_scale(e->sws, src_data, src_linesize, 0, e->height,
-	          e->frame->data, e->frame->linesize);
+// Returns a buffer of the encode size from the encoder's pool, creating
+// the pool on first use. The caller owns the buffer.
+static CVPixelBufferRef vtb_pool_buffer(VTBEncoder *e) {
+	if (!e->pool) {
+		int fmt = e->passthrough ? kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange : kCVPixelFormatType_32BGRA;
+		CFNumberRef w = CFNumberCreate(NULL, kCFNumberIntType, &e->width);
+		CFNumberRef h = CFNumberCreate(NULL, kCFNumberIntType, &e->height);
+		CFNumberRef f = CFNumberCreate(NULL, kCFNumberIntType, &fmt);
+		CFDictionaryRef surface = CFDictionaryCreate(NULL, NULL, NULL, 0,
+			&kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+		const void *keys[] = {kCVPixelBufferWidthKey, kCVPixelBufferHeightKey,
+			kCVPixelBufferPixelFormatTypeKey, kCVPixelBufferIOSurfacePropertiesKey};
+		const void *vals[] = {w, h, f, surface};
+		CFDictionaryRef attrs = CFDictionaryCreate(NULL, keys, vals, 4,
+			&kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+		CVReturn rc = CVPixelBufferPoolCreate(NULL, NULL, attrs, &e->pool);
+		CFRelease(attrs);
+		CFRelease(surface);
+		CFRelease(f);
+		CFRelease(h);
+		CFRelease(w);
+		if (rc != kCVReturnSuccess) {
+			fprintf(stderr, "vtb: CVPixelBufferPoolCreate failed: %d\n", (int)rc);
+			e->pool = NULL;
+			return NULL;
+		}
+	}
+	CVPixelBufferRef pb = NULL;
+	if (CVPixelBufferPoolCreatePixelBuffer(NULL, e->pool, &pb) != kCVReturnSuccess) return NULL;
+	return pb;
+}
+
+// Returns: 0 = success, -1 = error. out_size=0 means no output yet.
+static int vtb_encoder_send(VTBEncoder *e, AVFrame *frame, int force_key,
+                            uint8_t **out_buf, int *out_size, int *is_key) {
+	*out_size = 0;
 
-	e->frame->pts = e->pts++;
+	frame->pts = e->pts++;
+	frame->pict_type = force_key ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
 
-	int ret = avcodec_send_frame(e->ctx, e->frame);
+	int ret = avcodec_send_frame(e->ctx, frame);
 	if (ret < 0) return -1;
 
 	ret = avcodec_receive_packet(e->ctx, e->pkt);
@@ -138,6 +232,145 @@ static int vtb_encoder_encode(VTBEncoder *e, const uint8_t *bgra, int stride,
 	return 0;
 }
 
+static void vtb_release_pixel_buffer(void *opaque, uint8_t *data) {
+	CVPixelBufferRelease((CVPixelBufferRef)data);
+}
+
+// Encodes an encode-size NV12 pixel buffer as-is (passthrough only). Takes
+// over the caller's reference to pb.
+static int vtb_encoder_send_pixel_buffer(VTBEncoder *e, CVPixelBufferRef pb, int force_key,
+                                         uint8_t **out_buf, int *out_size, int *is_key) {
+	*out_size = 0;
+	av_frame_unref(e->frame);
+	e->frame->buf[0] = av_buffer_create((uint8_t*)pb, 1, vtb_release_pixel_buffer, NULL, AV_BUFFER_FLAG_READONLY);
+	if (!e->frame->buf[0]) {
+		CVPixelBufferRelease(pb);
+		return -1;
+	}
+	e->frame->data[3] = (uint8_t*)pb;
+	e->frame->format = AV_PIX_FMT_VIDEOTOOLBOX;
+	e->frame->width = e->width;
+	e->frame->height = e->height;
+
+	int ret = vtb_encoder_send(e, e->frame, force_key, out_buf, out_size, is_key);
+	av_frame_unref(e->frame);
+	return ret;
+}
+
+// Encodes a BGRA frame: the converter writes straight into the encoder's
+// frame planes, or with passthrough into a pooled pixel buffer's planes.
+static int vtb_encoder_encode(VTBEncoder *e, const uint8_t *bgra, int stride, int force_key,
+                          uint8_t **out_buf, int *out_size, int *is_key) {
+	*out_size = 0;
+	if (!e->cc && vtb_encoder_set_source(e, e->width, e->height) != 0) return -1;
+
+	if (e->passthrough) {
+		CVPixelBufferRef pb = vtb_pool_buffer(e);
+		if (!pb) return -1;
+		CVPixelBufferLockBaseAddress(pb, 0);
+		uint8_t *dst[3] = {CVPixelBufferGetBaseAddressOfPlane(pb, 0), CVPixelBufferGetBaseAddressOfPlane(pb, 1), NULL};
+		int dst_linesize[3] = {(int)CVPixelBufferGetBytesPerRowOfPlane(pb, 0), (int)CVPixelBufferGetBytesPerRowOfPlane(pb, 1), 0};
+		colorconv_run(e->cc, bgra, stride, dst, dst_linesize);
+		CVPixelBufferUnlockBaseAddress(pb, 0);
+		e->convert_ns = colorconv_last_ns(e->cc);
+		return vtb_encoder_send_pixel_buffer(e, pb, force_key, out_buf, out_size, is_key);
+	}
+
+	av_frame_make_writable(e->frame);
+	colorconv_run(e->cc, bgra, stride, e->frame->data, e->frame->linesize);
+	e->convert_ns = colorconv_last_ns(e->cc);
+	return vtb_encoder_send(e, e->frame, force_key, out_buf, out_size, is_key);
+}
+
+// Encodes a captured NV12 pixel buffer. An encode-size buffer goes to
+// VideoToolbox untouched. Anything else (a scaled ladder rendition, or a
+// codec that takes AVFrames) is first transferred by VTPixelTransferSession
+// into a pooled buffer of the encode size: NV12 to encode as-is, or BGRA
+// for the converter, which then runs unscaled.
+static int vtb_encoder_encode_pixel_buffer(VTBEncoder *e, void *pixel_buffer, int force_key,
+                                           uint8_t **out_buf, int *out_size, int *is_key) {
+	*out_size = 0;
+	CVPixelBufferRef src = (CVPixelBufferRef)pixel_buffer;
+
+	if (e->passthrough && (int)CVPixelBufferGetWidth(src) == e->width && (int)CVPixelBufferGetHeight(src) == e->height) {
+		e->convert_ns = 0;
+		CVPixelBufferRetain(src);
+		return vtb_encoder_send_pixel_buffer(e, src, force_key, out_buf, out_size, is_key);
+	}
+
+	int64_t t0 = vtb_now_ns();
+	if (!e->xfer) {
+		OSStatus st = VTPixelTransferSessionCreate(NULL, &e->xfer);
+		if (st != noErr) {
+			fprintf(stderr, "vtb: VTPixelTransferSessionCreate failed: %d\n", (int)st);
+			e->xfer = NULL;
+			return -1;
+		}
+	}
+	CVPixelBufferRef pb = vtb_pool_buffer(e);
+	if (!pb) return -1;
+	if (VTPixelTransferSessionTransferImage(e->xfer, src, pb) != noErr) {
+		CVPixelBufferRelease(pb);
+		return -1;
+	}
+
+	if (e->passthrough) {
+		e->convert_ns = vtb_now_ns() - t0;
+		return vtb_encoder_send_pixel_buffer(e, pb, force_key, out_buf, out_size, is_key);
+	}
+
+	if (!e->cc && vtb_encoder_set_source(e, e->width, e->height) != 0) {
+		CVPixelBufferRelease(pb);
+		return -1;
+	}
+	av_frame_make_writable(e->frame);
+	CVPixelBufferLockBaseAddress(pb, kCVPixelBufferLock_ReadOnly);
+	colorconv_run(e->cc, CVPixelBufferGetBaseAddress(pb), (int)CVPixelBufferGetBytesPerRow(pb),
+		e->frame->data, e->frame->linesize);
+	CVPixelBufferUnlockBaseAddress(pb, kCVPixelBufferLock_ReadOnly);
+	CVPixelBufferRelease(pb);
+	e->convert_ns = vtb_now_ns() - t0;
+	return vtb_encoder_send(e, e->frame, force_key, out_buf, out_size, is_key);
+}
+
+// FFmpeg keeps the VTCompressionSession in the encoder's private context
+// and has no reconfigure path for it, so the session is reached through
+// the leading fields of VTEncContext (unchanged since the encoder was
+// added). codec_id is checked before the session pointer is trusted.
+typedef struct {
+	const void *av_class;
+	enum AVCodecID codec_id;
+	VTCompressionSessionRef session;
+} VTEncContextPrefix;
+
+static VTCompressionSessionRef vtb_encoder_session(VTBEncoder *e) {
+	if (!strstr(e->ctx->codec->name, "_videotoolbox")) return NULL;
+	VTEncContextPrefix *vt = (VTEncContextPrefix*)e->ctx->priv_data;
+	if (vt->codec_id != e->ctx->codec_id) return NULL;
+	return vt->session;
+}
+
+// Whether the bitrate can change without reopening: VideoToolbox through
+// its session, libx264 through FFmpeg's reconfigure; libx265 not at all.
+static int vtb_encoder_can_reconfigure(VTBEncoder *e) {
+	if (strstr(e->ctx->codec->name, "_videotoolbox")) return vtb_encoder_session(e) != NULL;
+	return strcmp(e->ctx->codec->name, "libx265") != 0;
+}
+
+// Runtime bitrate change. VideoToolbox takes AverageBitRate on the live
+// session; libx264 picks up bit_rate on the next avcodec_send_frame.
+static void vtb_encoder_set_bitrate(VTBEncoder *e, int kbps) {
+	e->ctx->bit_rate = (int64_t)kbps * 1000;
+	VTCompressionSessionRef session = vtb_encoder_session(e);
+	if (!session) return;
+
+	SInt64 bps = (SInt64)kbps * 1000;
+	CFNumberRef n = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &bps);
+	OSStatus st = VTSessionSetProperty(session, kVTCompressionPropertyKey_AverageBitRate, n);
+	CFRelease(n);
+	if (st != noErr) fprintf(stderr, "vtb: set AverageBitRate failed: %d\n", (int)st);
+}
+
 static void vtb_encoder_unref_packet(VTBEncoder *e) {
 	av_packet_unref(e->pkt);
 }
@@ -146,9 +379,20 @@ static const char* vtb_encoder_name(VTBEncoder *e) {
 	return e->ctx->codec->name;
 }
 
+static const char* vtb_encoder_colorconv(VTBEncoder *e, char *buf, int n) {
+	if (!e->cc) return "colorconv on demand";
+	snprintf(buf, n, "colorconv %s x%d", colorconv_kernel_name(e->cc), colorconv_threads(e->cc));
+	return buf;
+}
+
 static void vtb_encoder_destroy(VTBEncoder *e) {
 	if (!e) return;
-	if (e->sws) sws_freeContext(e->sws);
+	if (e->cc) colorconv_destroy(e->cc);
+	if (e->xfer) {
+		VTPixelTransferSessionInvalidate(e->xfer);
+		CFRelease(e->xfer);
+	}
+	if (e->pool) CVPixelBufferPoolRelease(e->pool);
 	if (e->pkt) av_packet_free(&e->pkt);
 	if (e->frame) av_frame_free(&e->frame);
 	if (e->ctx) avcodec_free_context(&e->ctx);
@@ -158,13 +402,28 @@ static void vtb_encoder_destroy(VTBEncoder *e) {
 import "C"
 import (
 	"fmt"
+	"time"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
 type vtbEncoder struct {
-	e *C.VTBEncoder
+	e          *C.VTBEncoder
+	p          openParams
+	name       string
+	reconf     bool // runtime rate change supported (read off the encode goroutine)
+	rate       rateState
+	keyframe   keyframeFlag
+	srcW, srcH int // source size the converter is set up for
+	packets    types.PacketPool
+}
+
+func cBool(b bool) C.int {
+	if b {
+		return 1
+	}
+	return 0
 }
 
 func NewEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int, cudaCtx, cuMemcpy2D unsafe.Pointer) (types.VideoEncoder, error) {
@@ -172,9 +431,8 @@ func NewEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int,
 	if keyint <= 0 {
 		keyint = fps * 2 // default: keyframe every 2 seconds
 	}
-	cCodec := C.CString(codec)
-	defer C.free(unsafe.Pointer(cCodec))
-	e := C.vtb_encoder_init(C.int(width), C.int(height), C.int(fps), C.int(bitrateKbps), C.int(keyint), C.int(gpu), cCodec)
+	p := openParams{fps: fps, keyint: keyint, gpu: gpu, codec: codec}
+	e := openVTB(p, width, height, bitrateKbps)
 	if e == nil {
 		if codec == "h265" {
 			return nil, fmt.Errorf("failed to initialize video encoder (tried hardware h265 then libx265)")
@@ -182,8 +440,22 @@ func NewEncoder(width, height, fps, bitrateKbps, gpu int, codec string, gop int,
 		return nil, fmt.Errorf("failed to initialize video encoder (tried hardware h264 then libx264)")
 	}
 	name := C.GoString(C.vtb_encoder_name(e))
-	fmt.Printf("video encoder: %s (%dx%d @ %d kbps)\n", name, width, height, bitrateKbps)
-	return &vtbEncoder{e: e}, nil
+	input := "NV12 frames"
+	if e.passthrough != 0 {
+		input = "pixel buffers as-is"
+	}
+	var cc [64]C.char
+	fmt.Printf("video encoder: %s (%dx%d @ %d kbps, %s, %s, %s)\n", name, width, height, bitrateKbps,
+		input, C.GoString(C.vtb_encoder_colorconv(e, &cc[0], C.int(len(cc)))),
+		refreshMode(e.intra_refresh != 0, name))
+	return &vtbEncoder{e: e, p: p, name: name, reconf: C.vtb_encoder_can_reconfigure(e) != 0,
+		rate: newRateState(bitrateKbps, fps), srcW: width, srcH: height}, nil
+}
+
+func openVTB(p openParams, width, height, kbps int) *C.VTBEncoder {
+	cCodec := C.CString(p.codec)
+	defer C.free(unsafe.Pointer(cCodec))
+	return C.vtb_encoder_init(C.int(width), C.int(height), C.int(p.fps), C.int(kbps), C.int(p.keyint), C.int(p.gpu), cCodec, cBool(intraRefresh))
 }
 
 func (enc *vtbEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error) {
@@ -191,18 +463,45 @@ func (enc *vtbEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error) {
 	var outSize C.int
 	var isKey C.int
 
-	// Use zero-copy pointer if available, otherwise fall back to Go slice
-	var srcPtr unsafe.Pointer
-	if frame.Ptr != nil {
-		srcPtr = frame.Ptr
-	} else {
-		srcPtr = unsafe.Pointer(&frame.Data[0])
+	if kbps, ok := enc.rate.take(); ok {
+		C.vtb_encoder_set_bitrate(enc.e, C.int(kbps))
 	}
 
-	ret := C.vtb_encoder_encode(enc.e,
-		(*C.uint8_t)(srcPtr),
-		C.int(frame.Stride),
-		&outBuf, &outSize, &isKey)
+	var ret C.int
+	if frame.IsPixelBuffer {
+		// Pixel buffers reach the converter (if at all) already scaled to
+		// the encode size.
+		if w, h := int(enc.e.width), int(enc.e.height); enc.srcW != w || enc.srcH != h {
+			if C.vtb_encoder_set_source(enc.e, C.int(w), C.int(h)) != 0 {
+				return nil, fmt.Errorf("cannot reset converter to %dx%d", w, h)
+			}
+			enc.srcW, enc.srcH = w, h
+		}
+		ret = C.vtb_encoder_encode_pixel_buffer(enc.e, frame.Ptr,
+			cBool(enc.keyframe.take()),
+			&outBuf, &outSize, &isKey)
+	} else {
+		// Use zero-copy pointer if available, otherwise fall back to Go slice
+		var srcPtr unsafe.Pointer
+		if frame.Ptr != nil {
+			srcPtr = frame.Ptr
+		} else {
+			srcPtr = unsafe.Pointer(&frame.Data[0])
+		}
+
+		if frame.Width != enc.srcW || frame.Height != enc.srcH {
+			if C.vtb_encoder_set_source(enc.e, C.int(frame.Width), C.int(frame.Height)) != 0 {
+				return nil, fmt.Errorf("cannot scale %dx%d source to %dx%d", frame.Width, frame.Height, enc.e.width, enc.e.height)
+			}
+			enc.srcW, enc.srcH = frame.Width, frame.Height
+		}
+
+		ret = C.vtb_encoder_encode(enc.e,
+			(*C.uint8_t)(srcPtr),
+			C.int(frame.Stride),
+			cBool(enc.keyframe.take()),
+			&outBuf, &outSize, &isKey)
+	}
 
 	if ret != 0 {
 		return nil, fmt.Errorf("encode failed")
@@ -211,13 +510,59 @@ func (enc *vtbEncoder) Encode(frame *types.Frame) (*types.EncodedFrame, error) {
 		return nil, nil
 	}
 
-	data := C.GoBytes(unsafe.Pointer(outBuf), outSize)
+	out := packetFrom(&enc.packets, unsafe.Pointer(outBuf), int(outSize), isKey != 0)
 	C.vtb_encoder_unref_packet(enc.e)
+	return out, nil
+}
+
+func (enc *vtbEncoder) RequestKeyframe() { enc.keyframe.request() }
+
+// RequestRefresh boosts the next frame's bitrate, if the codec can change
+// rate at runtime.
+func (enc *vtbEncoder) RequestRefresh() {
+	if enc.reconf {
+		enc.rate.refresh()
+	}
+}
+
+func (enc *vtbEncoder) EncoderName() string { return enc.name }
+
+func (enc *vtbEncoder) ConvertTime() time.Duration {
+	return time.Duration(enc.e.convert_ns)
+}
+
+func (enc *vtbEncoder) SetBitrate(kbps int) error {
+	if !enc.reconf {
+		return fmt.Errorf("%s: runtime bitrate change not supported", enc.name)
+	}
+	enc.rate.setBitrate(kbps)
+	return nil
+}
 
-	return &types.EncodedFrame{
-		Data:  data,
-		IsKey: isKey != 0,
-	}, nil
+func (enc *vtbEncoder) SetFrameRate(fps int) error {
+	if !enc.reconf {
+		return fmt.Errorf("%s: runtime rate change not supported", enc.name)
+	}
+	enc.rate.setFrameRate(fps)
+	return nil
+}
+
+// Resize reopens the codec (and its VTCompressionSession) at width x
+// height. The converter is rebuilt on the next Encode from that frame's
+// size. On failure the old codec stays.
+func (enc *vtbEncoder) Resize(width, height int) error {
+	if width == int(enc.e.width) && height == int(enc.e.height) {
+		return nil
+	}
+	e := openVTB(enc.p, width, height, enc.rate.codecKbps())
+	if e == nil {
+		return fmt.Errorf("%s: reopen at %dx%d failed", enc.name, width, height)
+	}
+	C.vtb_encoder_destroy(enc.e)
+	enc.e = e
+	enc.srcW, enc.srcH = width, height
+	fmt.Printf("video encoder: %s reopened at %dx%d\n", enc.name, width, height)
+	return nil
 }
 
 func (enc *vtbEncoder) Close() {
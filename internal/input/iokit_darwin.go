@@ -98,6 +98,14 @@ func NewInputHandler(displayName string) (types.EventInjector, error) {
 	return &InputHandler{}, nil
 }
 
+// InjectBatch posts events in order. CGEventPost hands each event to the
+// window server directly, so there is no buffer to flush at the end.
+func (ih *InputHandler) InjectBatch(events []types.InputEvent) {
+	for _, ev := range events {
+		ih.Inject(ev)
+	}
+}
+
 func (ih *InputHandler) Inject(event types.InputEvent) {
 	switch event.Type {
 	case "mousemove":
@@ -11,78 +11,77 @@ package input
 #include <stdlib.h>
 #include <string.h>
 
-static Display* input_display = NULL;
+// One X connection per handler, since several desktops can be served
+// from one process. InputHandler serializes calls on it.
+typedef struct {
+	Display *display;
+	// Accumulate sub-step scroll deltas
+	double scroll_x, scroll_y;
+} InputCtx;
 
-static int input_init(const char *display_name) {
-	input_display = XOpenDisplay(display_name);
-	if (!input_display) return -1;
-	return 0;
+static InputCtx *input_open(const char *display_name) {
+	InputCtx *c = (InputCtx*)calloc(1, sizeof(InputCtx));
+	if (!c) return NULL;
+	c->display = XOpenDisplay(display_name);
+	if (!c->display) { free(c); return NULL; }
+	return c;
 }
 
-static void input_mouse_move_abs(int x, int y) {
-	if (!input_display) return;
-	XTestFakeMotionEvent(input_display, DefaultScreen(input_display), x, y, 0);
-	XFlush(input_display);
+static void input_mouse_move_abs(InputCtx *c, int x, int y) {
+	XTestFakeMotionEvent(c->display, DefaultScreen(c->display), x, y, 0);
 }
 
-static void input_mouse_move_rel(int dx, int dy) {
-	if (!input_display) return;
-	XWarpPointer(input_display, None, None, 0, 0, 0, 0, dx, dy);
-	XFlush(input_display);
+static void input_mouse_move_rel(InputCtx *c, int dx, int dy) {
+	XWarpPointer(c->display, None, None, 0, 0, 0, 0, dx, dy);
 }
 
-static void input_mouse_button(int button, int press) {
-	if (!input_display) return;
-	XTestFakeButtonEvent(input_display, button, press, 0);
-	XFlush(input_display);
+static void input_mouse_button(InputCtx *c, int button, int press) {
+	XTestFakeButtonEvent(c->display, button, press, 0);
 }
 
-// Accumulate sub-step scroll deltas
-static double scroll_accum_x = 0, scroll_accum_y = 0;
-
-static void input_mouse_scroll(double dx, double dy) {
-	if (!input_display) return;
+static void input_click(InputCtx *c, int button) {
+	XTestFakeButtonEvent(c->display, button, True, 0);
+	XTestFakeButtonEvent(c->display, button, False, 0);
+}
 
-	scroll_accum_y += dy;
-	scroll_accum_x += dx;
+static void input_mouse_scroll(InputCtx *c, double dx, double dy) {
+	c->scroll_y += dy;
+	c->scroll_x += dx;
 
 	// Fire scroll events for each 40px of accumulated delta
-	while (scroll_accum_y <= -40) {
-		XTestFakeButtonEvent(input_display, 4, True, 0);
-		XTestFakeButtonEvent(input_display, 4, False, 0);
-		scroll_accum_y += 40;
+	while (c->scroll_y <= -40) {
+		input_click(c, 4);
+		c->scroll_y += 40;
 	}
-	while (scroll_accum_y >= 40) {
-		XTestFakeButtonEvent(input_display, 5, True, 0);
-		XTestFakeButtonEvent(input_display, 5, False, 0);
-		scroll_accum_y -= 40;
+	while (c->scroll_y >= 40) {
+		input_click(c, 5);
+		c->scroll_y -= 40;
 	}
-	while (scroll_accum_x <= -40) {
-		XTestFakeButtonEvent(input_display, 6, True, 0);
-		XTestFakeButtonEvent(input_display, 6, False, 0);
-		scroll_accum_x += 40;
+	while (c->scroll_x <= -40) {
+		input_click(c, 6);
+		c->scroll_x += 40;
 	}
-	while (scroll_accum_x >= 40) {
-		XTestFakeButtonEvent(input_display, 7, True, 0);
-		XTestFakeButtonEvent(input_display, 7, False, 0);
-		scroll_accum_x -= 40;
+	while (c->scroll_x >= 40) {
+		input_click(c, 7);
+		c->scroll_x -= 40;
 	}
-	XFlush(input_display);
 }
 
-static void input_key(unsigned int keysym, int press) {
-	if (!input_display) return;
-	KeyCode kc = XKeysymToKeycode(input_display, keysym);
+static void input_key(InputCtx *c, unsigned int keysym, int press) {
+	KeyCode kc = XKeysymToKeycode(c->display, keysym);
 	if (kc == 0) return;
-	XTestFakeKeyEvent(input_display, kc, press, 0);
-	XFlush(input_display);
+	XTestFakeKeyEvent(c->display, kc, press, 0);
 }
 
-static void input_destroy() {
-	if (input_display) {
-		XCloseDisplay(input_display);
-		input_display = NULL;
-	}
+// The helpers above only queue requests in Xlib's output buffer; one
+// flush sends a whole batch.
+static void input_flush(InputCtx *c) {
+	XFlush(c->display);
+}
+
+static void input_close(InputCtx *c) {
+	XCloseDisplay(c->display);
+	free(c);
 }
 */
 import "C"
@@ -90,52 +89,91 @@ import (
 	"fmt"
 	"log"
 	"strings"
+	"sync"
 	"unsafe"
 
 	"bunghole/internal/types"
 )
 
-type InputHandler struct{}
+// InputHandler injects one desktop's input through its own X connection.
+// Xlib connections aren't safe for concurrent use, so mu serializes the
+// calls; ctx is nil once closed.
+type InputHandler struct {
+	mu  sync.Mutex
+	ctx *C.InputCtx
+}
 
 func NewInputHandler(displayName string) (types.EventInjector, error) {
 	cDisplay := C.CString(displayName)
 	defer C.free(unsafe.Pointer(cDisplay))
 
-	if C.input_init(cDisplay) != 0 {
+	ctx := C.input_open(cDisplay)
+	if ctx == nil {
 		return nil, fmt.Errorf("failed to open display for input: %s", displayName)
 	}
-	return &InputHandler{}, nil
+	return &InputHandler{ctx: ctx}, nil
 }
 
 func (ih *InputHandler) Inject(event types.InputEvent) {
+	ih.mu.Lock()
+	defer ih.mu.Unlock()
+	if ih.ctx == nil {
+		return
+	}
+	ih.inject(event)
+	C.input_flush(ih.ctx)
+}
+
+// InjectBatch queues every event and flushes once, so a batch costs one
+// write to the X server instead of one per event.
+func (ih *InputHandler) InjectBatch(events []types.InputEvent) {
+	ih.mu.Lock()
+	defer ih.mu.Unlock()
+	if ih.ctx == nil {
+		return
+	}
+	for _, ev := range events {
+		ih.inject(ev)
+	}
+	C.input_flush(ih.ctx)
+}
+
+// inject queues one event. Must be called with ih.mu held.
+func (ih *InputHandler) inject(event types.InputEvent) {
+	c := ih.ctx
 	switch event.Type {
 	case "mousemove":
 		if event.Relative {
-			C.input_mouse_move_rel(C.int(event.X), C.int(event.Y))
+			C.input_mouse_move_rel(c, C.int(event.DX), C.int(event.DY))
 		} else {
-			C.input_mouse_move_abs(C.int(event.X), C.int(event.Y))
+			C.input_mouse_move_abs(c, C.int(event.X), C.int(event.Y))
 		}
 	case "mousedown":
-		C.input_mouse_button(C.int(jsButtonToX11(event.Button)), C.int(1))
+		C.input_mouse_button(c, C.int(jsButtonToX11(event.Button)), C.int(1))
 	case "mouseup":
-		C.input_mouse_button(C.int(jsButtonToX11(event.Button)), C.int(0))
+		C.input_mouse_button(c, C.int(jsButtonToX11(event.Button)), C.int(0))
 	case "wheel":
-		C.input_mouse_scroll(C.double(event.DX), C.double(event.DY))
+		C.input_mouse_scroll(c, C.double(event.DX), C.double(event.DY))
 	case "keydown":
 		keysym := codeToKeysym(event.Code, event.Key)
 		if keysym != 0 {
-			C.input_key(C.uint(keysym), C.int(1))
+			C.input_key(c, C.uint(keysym), C.int(1))
 		}
 	case "keyup":
 		keysym := codeToKeysym(event.Code, event.Key)
 		if keysym != 0 {
-			C.input_key(C.uint(keysym), C.int(0))
+			C.input_key(c, C.uint(keysym), C.int(0))
 		}
 	}
 }
 
 func (ih *InputHandler) Close() {
-	C.input_destroy()
+	ih.mu.Lock()
+	defer ih.mu.Unlock()
+	if ih.ctx != nil {
+		C.input_close(ih.ctx)
+		ih.ctx = nil
+	}
 }
 
 func jsButtonToX11(button int) int {
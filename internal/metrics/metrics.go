@@ -0,0 +1,248 @@
+// Package metrics implements the handful of Prometheus metric types
+// bunghole exports (counters, gauges, histograms and scrape-time
+// collectors) and writes them in the Prometheus text exposition format.
+// All record paths are lock-free so pipeline stages can use them per frame.
+package metrics
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Labels are constant labels attached to one metric series.
+type Labels map[string]string
+
+// Counter is a monotonically increasing count.
+type Counter struct {
+	v atomic.Uint64
+}
+
+func (c *Counter) Inc()         { c.v.Add(1) }
+func (c *Counter) Add(n uint64) { c.v.Add(n) }
+
+// Gauge is a value that can go up and down.
+type Gauge struct {
+	bits atomic.Uint64
+}
+
+func (g *Gauge) Set(v float64)  { g.bits.Store(math.Float64bits(v)) }
+func (g *Gauge) Value() float64 { return math.Float64frombits(g.bits.Load()) }
+
+// Histogram counts observations into fixed cumulative buckets.
+type Histogram struct {
+	bounds  []float64       // upper bounds, ascending; +Inf is implicit
+	counts  []atomic.Uint64 // len(bounds)+1, non-cumulative
+	sumBits atomic.Uint64
+}
+
+func newHistogram(bounds []float64) *Histogram {
+	return &Histogram{bounds: bounds, counts: make([]atomic.Uint64, len(bounds)+1)}
+}
+
+func (h *Histogram) Observe(v float64) {
+	h.counts[sort.SearchFloat64s(h.bounds, v)].Add(1)
+	for {
+		old := h.sumBits.Load()
+		if h.sumBits.CompareAndSwap(old, math.Float64bits(math.Float64frombits(old)+v)) {
+			return
+		}
+	}
+}
+
+// ObserveDuration records d in seconds.
+func (h *Histogram) ObserveDuration(d time.Duration) { h.Observe(d.Seconds()) }
+
+// ExponentialBuckets returns n bucket bounds starting at start, each factor
+// times the previous one.
+func ExponentialBuckets(start, factor float64, n int) []float64 {
+	b := make([]float64, n)
+	for i := range b {
+		b[i] = start
+		start *= factor
+	}
+	return b
+}
+
+// Sample is one series reported by a Collector.
+type Sample struct {
+	Labels Labels
+	Value  float64
+}
+
+type series struct {
+	labels string // rendered {k="v",...}, or empty
+	write  func(w *bufio.Writer, name, labels string)
+}
+
+type family struct {
+	name, help, typ string
+	series          []series
+	collect         func() []Sample // scrape-time family, nil otherwise
+}
+
+// Registry holds metric families in registration order.
+type Registry struct {
+	mu       sync.Mutex
+	families []*family
+	byName   map[string]*family
+}
+
+func NewRegistry() *Registry {
+	return &Registry{byName: make(map[string]*family)}
+}
+
+// family returns the family for name, creating it on first use. Registering
+// the same name again with other labels adds a series to it.
+func (r *Registry) family(name, help, typ string) *family {
+	if f, ok := r.byName[name]; ok {
+		if f.typ != typ {
+			panic(fmt.Sprintf("metrics: %s registered as %s and %s", name, f.typ, typ))
+		}
+		return f
+	}
+	f := &family{name: name, help: help, typ: typ}
+	r.families = append(r.families, f)
+	r.byName[name] = f
+	return f
+}
+
+func (r *Registry) Counter(name, help string, labels Labels) *Counter {
+	c := &Counter{}
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	f := r.family(name, help, "counter")
+	f.series = append(f.series, series{renderLabels(labels), func(w *bufio.Writer, name, l string) {
+		fmt.Fprintf(w, "%s%s %d\n", name, l, c.v.Load())
+	}})
+	return c
+}
+
+func (r *Registry) Gauge(name, help string, labels Labels) *Gauge {
+	g := &Gauge{}
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	f := r.family(name, help, "gauge")
+	f.series = append(f.series, series{renderLabels(labels), func(w *bufio.Writer, name, l string) {
+		fmt.Fprintf(w, "%s%s %s\n", name, l, formatFloat(g.Value()))
+	}})
+	return g
+}
+
+func (r *Registry) Histogram(name, help string, labels Labels, bounds []float64) *Histogram {
+	h := newHistogram(bounds)
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	f := r.family(name, help, "histogram")
+	f.series = append(f.series, series{renderLabels(labels), func(w *bufio.Writer, name, l string) {
+		h.write(w, name, l)
+	}})
+	return h
+}
+
+// Collector registers a gauge family whose series are produced by collect
+// on every scrape. Use it for values that are cheap to read on demand but
+// not worth tracking continuously (per-session transport stats).
+func (r *Registry) Collector(name, help string, collect func() []Sample) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	f := r.family(name, help, "gauge")
+	f.collect = collect
+}
+
+// WriteText writes every family in the Prometheus text format (0.0.4).
+func (r *Registry) WriteText(out io.Writer) error {
+	r.mu.Lock()
+	families := make([]family, len(r.families))
+	for i, f := range r.families {
+		families[i] = *f
+		families[i].series = append([]series(nil), f.series...)
+	}
+	r.mu.Unlock()
+
+	w := bufio.NewWriter(out)
+	for _, f := range families {
+		var samples []Sample
+		if f.collect != nil {
+			if samples = f.collect(); len(samples) == 0 {
+				continue
+			}
+		}
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s %s\n", f.name, f.help, f.name, f.typ)
+		for _, s := range f.series {
+			s.write(w, f.name, s.labels)
+		}
+		for _, s := range samples {
+			fmt.Fprintf(w, "%s%s %s\n", f.name, renderLabels(s.Labels), formatFloat(s.Value))
+		}
+	}
+	return w.Flush()
+}
+
+func (h *Histogram) write(w *bufio.Writer, name, labels string) {
+	var cum uint64
+	for i, b := range h.bounds {
+		cum += h.counts[i].Load()
+		fmt.Fprintf(w, "%s_bucket%s %d\n", name, withLabel(labels, "le", formatFloat(b)), cum)
+	}
+	cum += h.counts[len(h.bounds)].Load()
+	fmt.Fprintf(w, "%s_bucket%s %d\n", name, withLabel(labels, "le", "+Inf"), cum)
+	fmt.Fprintf(w, "%s_sum%s %s\n", name, labels, formatFloat(math.Float64frombits(h.sumBits.Load())))
+	fmt.Fprintf(w, "%s_count%s %d\n", name, labels, cum)
+}
+
+func renderLabels(l Labels) string {
+	if len(l) == 0 {
+		return ""
+	}
+	keys := make([]string, 0, len(l))
+	for k := range l {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	var b strings.Builder
+	b.WriteByte('{')
+	for i, k := range keys {
+		if i > 0 {
+			b.WriteByte(',')
+		}
+		b.WriteString(k)
+		b.WriteString(`="`)
+		b.WriteString(escapeLabel(l[k]))
+		b.WriteByte('"')
+	}
+	b.WriteByte('}')
+	return b.String()
+}
+
+// withLabel appends k="v" to an already rendered label set.
+func withLabel(labels, k, v string) string {
+	kv := k + `="` + v + `"`
+	if labels == "" {
+		return "{" + kv + "}"
+	}
+	return labels[:len(labels)-1] + "," + kv + "}"
+}
+
+var labelEscaper = strings.NewReplacer(`\`, `\\`, `"`, `\"`, "\n", `\n`)
+
+func escapeLabel(v string) string { return labelEscaper.Replace(v) }
+
+func formatFloat(v float64) string {
+	switch {
+	case math.IsInf(v, +1):
+		return "+Inf"
+	case math.IsInf(v, -1):
+		return "-Inf"
+	case math.IsNaN(v):
+		return "NaN"
+	}
+	return strconv.FormatFloat(v, 'g', -1, 64)
+}
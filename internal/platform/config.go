@@ -17,4 +17,26 @@ type Config struct {
 	DiskGB          int    // macOS: VM disk size in GB (used with setup)
 
 	VsockAudioCh <-chan net.Conn // macOS VM: vsock audio connections from guest
+
+	// Linux: several desktops served by one process (--desktops). When
+	// set, Display and StartX are not used.
+	Desktops []Desktop
+
+	// Linux: desktops kept started ahead of time and handed out on demand
+	// (--desktop-pool), at most DesktopLimit at a time (--desktop-limit).
+	// Init sets NewDesktop when DesktopPool > 0; it returns a ready
+	// desktop and a function that stops it again.
+	DesktopPool  int
+	DesktopLimit int
+	NewDesktop   func(name string) (Desktop, func(), error)
+}
+
+// Desktop is one of several desktops served by a single process. Init
+// starts an X server and desktop session for each one without a Display,
+// and fills in Display and AudioServer.
+type Desktop struct {
+	Name        string
+	Display     string
+	GPU         int
+	AudioServer string // PulseAudio server of the desktop's session ("" = default)
 }
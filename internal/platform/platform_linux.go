@@ -6,6 +6,8 @@ import (
 	"fmt"
 	"log"
 	"os"
+	"sync"
+	"time"
 
 	"bunghole/internal/xserver"
 
@@ -13,6 +15,12 @@ import (
 )
 
 func Init(cfg *Config) (func(), error) {
+	if cfg.DesktopPool > 0 {
+		return initPool(cfg)
+	}
+	if len(cfg.Desktops) > 0 {
+		return initDesktops(cfg)
+	}
 	if cfg.StartX || cfg.Display == "" {
 		if cfg.Display == "" {
 			cfg.Display = os.Getenv("DISPLAY")
@@ -43,6 +51,108 @@ func Init(cfg *Config) (func(), error) {
 	return func() {}, nil
 }
 
+// initDesktops starts an X server and desktop session for every desktop
+// that has no display yet, all in parallel. Each desktop keeps its own
+// PulseAudio server; XAUTHORITY points at one file holding every cookie.
+func initDesktops(cfg *Config) (func(), error) {
+	var gpus []int
+	var started []*Desktop
+	for i := range cfg.Desktops {
+		if cfg.Desktops[i].Display == "" {
+			gpus = append(gpus, cfg.Desktops[i].GPU)
+			started = append(started, &cfg.Desktops[i])
+		}
+	}
+	if len(gpus) == 0 {
+		return func() {}, nil
+	}
+
+	servers, err := xserver.StartXServers(cfg.Resolution, gpus)
+	if err != nil {
+		return nil, fmt.Errorf("failed to start X servers: %v", err)
+	}
+	stop := func() {
+		for _, xs := range servers {
+			xs.Stop()
+		}
+	}
+
+	var wg sync.WaitGroup
+	for i, xs := range servers {
+		d := started[i]
+		d.Display = xs.Display
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			if err := xs.StartDesktopSession(cfg.Resolution, cfg.User); err != nil {
+				log.Printf("warning: desktop %s: failed to start desktop session: %v", d.Name, err)
+			}
+			d.AudioServer = xs.PulseServer
+		}()
+	}
+	wg.Wait()
+
+	xauth, err := xserver.MergeXauthority(os.Getenv("XAUTHORITY"), servers)
+	if err != nil {
+		stop()
+		return nil, err
+	}
+	os.Setenv("XAUTHORITY", xauth)
+	for _, d := range cfg.Desktops {
+		log.Printf("desktop %s: display %s, gpu %d", d.Name, d.Display, d.GPU)
+	}
+
+	return func() {
+		stop()
+		os.Remove(xauth)
+	}, nil
+}
+
+// poolWait is how long NewDesktop waits for a pooled desktop when all of
+// them are still starting.
+const poolWait = 30 * time.Second
+
+// initPool starts the --desktops desktops, if any, and a pool of
+// cfg.DesktopPool more that cfg.NewDesktop hands out.
+func initPool(cfg *Config) (func(), error) {
+	stopDesktops := func() {}
+	if len(cfg.Desktops) > 0 {
+		stop, err := initDesktops(cfg)
+		if err != nil {
+			return nil, err
+		}
+		stopDesktops = stop
+	}
+
+	pool, err := xserver.NewPool(cfg.Resolution, cfg.User, cfg.GPU, cfg.DesktopPool, os.Getenv("XAUTHORITY"))
+	if err != nil {
+		stopDesktops()
+		return nil, fmt.Errorf("failed to start desktop pool: %v", err)
+	}
+	os.Setenv("XAUTHORITY", pool.Xauthority())
+	log.Printf("desktop pool: keeping %d desktop(s) ready on gpu %d", cfg.DesktopPool, cfg.GPU)
+
+	cfg.NewDesktop = func(name string) (Desktop, func(), error) {
+		xs, err := pool.Get(poolWait)
+		if err != nil {
+			return Desktop{}, nil, err
+		}
+		log.Printf("desktop %s: display %s, gpu %d (from pool)", name, xs.Display, cfg.GPU)
+		d := Desktop{
+			Name:        name,
+			Display:     xs.Display,
+			GPU:         cfg.GPU,
+			AudioServer: xs.PulseServer,
+		}
+		return d, xs.Stop, nil
+	}
+
+	return func() {
+		pool.Close()
+		stopDesktops()
+	}, nil
+}
+
 var savedTermios *unix.Termios
 
 func SaveTermState() {
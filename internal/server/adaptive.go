@@ -0,0 +1,121 @@
+package server
+
+import (
+	"time"
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+// Adaptive frame rate (--adaptive-fps). The capture stage already encodes
+// a screen that stopped changing only once per staticFrameInterval, but
+// only capturers that report Unchanged frames get there. With adaptive
+// frame rate, frames in host memory from other capturers are hashed to
+// find static ones, and their grabs slow down towards one per
+// staticFrameInterval as well, since each is a full copy. Once the screen
+// has been static for refreshAfter, one refresh frame is encoded with
+// extra bits so text that was coded while it changed turns crisp.
+// Controller input puts capture back to every tick at once.
+const (
+	// idleAfter is how long a hashed screen stays static before grabs
+	// slow down. The interval then doubles on every static grab.
+	idleAfter = 500 * time.Millisecond
+	// refreshAfter is how long the screen stays static before the refresh
+	// frame.
+	refreshAfter = 2 * time.Second
+	// inputActive is how long grabs stay at the full rate after input.
+	inputActive = time.Second
+)
+
+// idleState tracks how long the captured screen has been static. Only
+// touched by the capture stage.
+type idleState struct {
+	reports  bool // the capturer reported an Unchanged frame: don't hash
+	hash     uint64
+	hashed   bool
+	changed  time.Time     // last grab that differed from the one before
+	interval time.Duration // grab interval while idle (hashed frames only)
+	next     time.Time     // earliest idle grab
+	refresh  bool          // the refresh frame for this static stretch is due
+}
+
+// wake resets idle tracking when capture starts or resumes.
+func (is *idleState) wake(now time.Time) {
+	is.hashed = false
+	is.active(now)
+}
+
+func (is *idleState) active(now time.Time) {
+	is.changed = now
+	is.interval = 0
+	is.next = time.Time{}
+	is.refresh = true
+}
+
+// input records controller input: grab every tick again.
+func (is *idleState) input() {
+	is.interval = 0
+	is.next = time.Time{}
+}
+
+// skipTick reports whether a tick at now can go without a grab.
+func (is *idleState) skipTick(now time.Time) bool {
+	return is.interval > 0 && now.Before(is.next)
+}
+
+// observe reports whether frame shows the same picture as the previous
+// grab, hashing it if the capturer doesn't say.
+func (is *idleState) observe(frame *types.Frame, now time.Time, frameDur time.Duration) bool {
+	static := frame.Unchanged
+	if static {
+		is.reports = true
+	} else if h, ok := frameHash(frame); ok && !is.reports {
+		static = is.hashed && h == is.hash
+		is.hash, is.hashed = h, true
+		if static && now.Sub(is.changed) >= idleAfter {
+			is.interval = min(max(2*is.interval, frameDur), staticFrameInterval)
+			is.next = now.Add(is.interval)
+		}
+	}
+	if !static {
+		is.active(now)
+	}
+	return static
+}
+
+// refreshDue reports, once per static stretch, that the screen has been
+// static long enough for the refresh frame.
+func (is *idleState) refreshDue(now time.Time) bool {
+	if !is.refresh || now.Sub(is.changed) < refreshAfter {
+		return false
+	}
+	is.refresh = false
+	return true
+}
+
+// frameHash hashes every pixel of a BGRA frame in host memory, so even a
+// one-pixel change ends a static stretch.
+func frameHash(f *types.Frame) (uint64, bool) {
+	if f.IsCUDA || f.IsPixelBuffer || f.PixFmt != types.PixFmtBGRA {
+		return 0, false
+	}
+	base := f.Ptr
+	if base == nil {
+		if len(f.Data) == 0 {
+			return 0, false
+		}
+		base = unsafe.Pointer(&f.Data[0])
+	}
+	words := f.Width / 2
+	h := uint64(14695981039346656037) // FNV-1a, a word at a time
+	for y := 0; y < f.Height; y++ {
+		p := unsafe.Add(base, y*f.Stride)
+		for _, w := range unsafe.Slice((*uint64)(p), words) {
+			h = (h ^ w) * 1099511628211
+		}
+		if f.Width%2 != 0 { // odd width: the last pixel isn't in a word
+			h = (h ^ uint64(*(*uint32)(unsafe.Add(p, words*8)))) * 1099511628211
+		}
+	}
+	return h, true
+}
@@ -0,0 +1,135 @@
+package server
+
+import (
+	"log"
+	"sync/atomic"
+	"time"
+
+	"bunghole/internal/session"
+	"bunghole/internal/types"
+
+	"github.com/pion/webrtc/v4"
+)
+
+const (
+	// abrInterval is how often the encoder target follows the estimate.
+	abrInterval = 500 * time.Millisecond
+	// abrHeadroom is the share of the estimate given to video; the rest
+	// covers audio, RTP/SRTP overhead and estimator overshoot.
+	abrHeadroom = 0.85
+	// abrDeadband avoids reconfiguring the encoder for small wobbles.
+	abrDeadband = 0.05
+)
+
+// bandwidthConfig returns the estimator settings for new sessions, or nil
+// when neither ABR nor the rendition ladder needs an estimate.
+func (s *Server) bandwidthConfig() *session.BandwidthConfig {
+	if s.cfg.ABR == "off" && s.cfg.Ladder <= 1 {
+		return nil
+	}
+	return &session.BandwidthConfig{
+		InitialBps: s.cfg.Bitrate * 1000,
+		MinBps:     s.cfg.MinBitrate * 1000,
+		MaxBps:     s.cfg.Bitrate * 1000,
+	}
+}
+
+// bandwidthEstimate returns the send bitrate the full-resolution encode
+// should fit, in bps (0 = no estimate yet). The "controller" policy follows
+// the controller session, falling back to the slowest viewer when there is
+// no controller; "slowest" follows the slowest of all sessions. Viewers the
+// ladder moved to a smaller rendition don't count.
+func (s *Server) bandwidthEstimate(track *webrtc.TrackLocalStaticSample) int {
+	s.mu.Lock()
+	ctrl := s.ctrl
+	sessions := make([]*session.Session, 0, len(s.viewers)+1)
+	for _, v := range s.viewers {
+		if v.VideoTrack() == track {
+			sessions = append(sessions, v)
+		}
+	}
+	s.mu.Unlock()
+
+	if ctrl != nil {
+		if s.cfg.ABR != "slowest" {
+			return ctrl.EstimatedBitrate()
+		}
+		sessions = append(sessions, ctrl)
+	}
+
+	slowest := 0
+	for _, sess := range sessions {
+		if est := sess.EstimatedBitrate(); est > 0 && (slowest == 0 || est < slowest) {
+			slowest = est
+		}
+	}
+	return slowest
+}
+
+// rateStage retunes the full-resolution encoder to the bandwidth estimate.
+// Below a quarter of --bitrate it also halves the frame rate (every other
+// capture tick is skipped via grabEvery), trading smoothness for per-frame
+// quality; full rate comes back above a third. Smaller renditions keep
+// their fixed ladder bitrate: viewers move between them instead.
+func (s *Server) rateStage(r *rendition, grabEvery *atomic.Int32, st *pipelineStats, stop <-chan struct{}) {
+	rc, ok := r.enc.(types.RateController)
+	if !ok {
+		log.Printf("abr: encoder has no runtime rate control, bitrate stays at %d kbps", s.cfg.Bitrate)
+		return
+	}
+
+	ticker := time.NewTicker(abrInterval)
+	defer ticker.Stop()
+
+	cur := s.cfg.Bitrate
+	div := 1
+	st.bitrate.Store(int64(cur))
+	s.metrics.videoTarget.Set(float64(cur))
+	for {
+		select {
+		case <-stop:
+			return
+		case <-ticker.C:
+		}
+
+		est := s.bandwidthEstimate(r.track)
+		if est <= 0 {
+			continue
+		}
+		target := min(max(int(float64(est)*abrHeadroom/1000), s.cfg.MinBitrate), s.cfg.Bitrate)
+
+		newDiv := div
+		if target < s.cfg.Bitrate/4 {
+			newDiv = 2
+		} else if target > s.cfg.Bitrate/3 {
+			newDiv = 1
+		}
+		if newDiv != div && s.cfg.FPS >= 2 {
+			if err := rc.SetFrameRate(s.cfg.FPS / newDiv); err != nil {
+				log.Printf("abr: %v; bitrate stays at %d kbps", err, cur)
+				return
+			}
+			grabEvery.Store(int32(newDiv))
+			log.Printf("abr: frame rate %d fps (target %d kbps)", s.cfg.FPS/newDiv, target)
+			div = newDiv
+		}
+
+		if abs(target-cur) <= int(float64(cur)*abrDeadband) {
+			continue
+		}
+		if err := rc.SetBitrate(target); err != nil {
+			log.Printf("abr: %v; bitrate stays at %d kbps", err, cur)
+			return
+		}
+		cur = target
+		st.bitrate.Store(int64(cur))
+		s.metrics.videoTarget.Set(float64(cur))
+	}
+}
+
+func abs(x int) int {
+	if x < 0 {
+		return -x
+	}
+	return x
+}
@@ -0,0 +1,198 @@
+package server
+
+import (
+	"bytes"
+	"encoding/base64"
+	"encoding/json"
+	"image"
+	"image/png"
+	"log"
+	"sync"
+	"time"
+
+	"bunghole/internal/types"
+)
+
+// CursorSourceFactory opens an out-of-band cursor source for the given display.
+type CursorSourceFactory func(display string) (types.CursorSource, error)
+
+// maxCursorShapes bounds the shape cache. Desktops cycle through a handful
+// of cursors; past this the cache (and what each client has seen) resets.
+const maxCursorShapes = 64
+
+// cursorShapeMsg is sent once per shape per client; clients cache it by serial.
+type cursorShapeMsg struct {
+	Type   string `json:"type"` // "shape"
+	Serial uint64 `json:"serial"`
+	Width  int    `json:"width"`
+	Height int    `json:"height"`
+	HotX   int    `json:"hotX"`
+	HotY   int    `json:"hotY"`
+	PNG    string `json:"png"` // data: URL, usable directly as a CSS cursor
+}
+
+// cursorPosMsg is sent whenever the pointer moves or changes shape.
+type cursorPosMsg struct {
+	Type   string `json:"type"` // "pos"
+	Serial uint64 `json:"serial"`
+	X      int    `json:"x"`
+	Y      int    `json:"y"`
+}
+
+type cursorSub struct {
+	send func([]byte)
+	sent map[uint64]bool // shapes this client already has
+}
+
+// cursorHub fans cursor updates out to controller sessions. It outlives
+// individual pipelines, so a client reconnecting to a restarted pipeline
+// still gets the last known cursor straight away.
+type cursorHub struct {
+	mu     sync.Mutex
+	subs   map[*cursorSub]struct{}
+	shapes map[uint64][]byte // encoded cursorShapeMsg by serial
+	serial uint64
+	pos    []byte // last cursorPosMsg
+}
+
+func newCursorHub() *cursorHub {
+	return &cursorHub{
+		subs:   make(map[*cursorSub]struct{}),
+		shapes: make(map[uint64][]byte),
+	}
+}
+
+type cursorSend struct {
+	send func([]byte)
+	msg  []byte
+}
+
+// queueLocked appends the messages sub is missing for the current cursor.
+func (h *cursorHub) queueLocked(out []cursorSend, sub *cursorSub) []cursorSend {
+	if h.pos == nil {
+		return out
+	}
+	if shape, ok := h.shapes[h.serial]; ok && !sub.sent[h.serial] {
+		sub.sent[h.serial] = true
+		out = append(out, cursorSend{sub.send, shape})
+	}
+	return append(out, cursorSend{sub.send, h.pos})
+}
+
+// subscribe registers send and immediately sends it the current cursor.
+func (h *cursorHub) subscribe(send func([]byte)) func() {
+	sub := &cursorSub{send: send, sent: make(map[uint64]bool)}
+
+	h.mu.Lock()
+	h.subs[sub] = struct{}{}
+	out := h.queueLocked(nil, sub)
+	h.mu.Unlock()
+
+	for _, o := range out {
+		o.send(o.msg)
+	}
+	return func() {
+		h.mu.Lock()
+		delete(h.subs, sub)
+		h.mu.Unlock()
+	}
+}
+
+// update records cur and sends it to every subscriber if anything changed.
+func (h *cursorHub) update(cur *types.Cursor) {
+	var shapeMsg []byte
+	if cur.Shape != nil {
+		h.mu.Lock()
+		_, cached := h.shapes[cur.Serial]
+		h.mu.Unlock()
+		if !cached {
+			var err error
+			if shapeMsg, err = encodeCursorShape(cur.Serial, cur.Shape); err != nil {
+				log.Printf("cursor: encode shape: %v", err)
+			}
+		}
+	}
+	pos, _ := json.Marshal(cursorPosMsg{Type: "pos", Serial: cur.Serial, X: cur.X, Y: cur.Y})
+
+	h.mu.Lock()
+	if shapeMsg != nil {
+		if len(h.shapes) >= maxCursorShapes {
+			h.shapes = make(map[uint64][]byte)
+			for sub := range h.subs {
+				sub.sent = make(map[uint64]bool)
+			}
+		}
+		h.shapes[cur.Serial] = shapeMsg
+	}
+	if bytes.Equal(pos, h.pos) {
+		h.mu.Unlock()
+		return
+	}
+	h.serial = cur.Serial
+	h.pos = pos
+	var out []cursorSend
+	for sub := range h.subs {
+		out = h.queueLocked(out, sub)
+	}
+	h.mu.Unlock()
+
+	for _, o := range out {
+		o.send(o.msg)
+	}
+}
+
+func encodeCursorShape(serial uint64, shape *types.CursorShape) ([]byte, error) {
+	img := &image.NRGBA{
+		Pix:    shape.RGBA,
+		Stride: shape.Width * 4,
+		Rect:   image.Rect(0, 0, shape.Width, shape.Height),
+	}
+	var buf bytes.Buffer
+	if err := png.Encode(&buf, img); err != nil {
+		return nil, err
+	}
+	return json.Marshal(cursorShapeMsg{
+		Type:   "shape",
+		Serial: serial,
+		Width:  shape.Width,
+		Height: shape.Height,
+		HotX:   shape.HotX,
+		HotY:   shape.HotY,
+		PNG:    "data:image/png;base64," + base64.StdEncoding.EncodeToString(buf.Bytes()),
+	})
+}
+
+// cursorStage polls the cursor source once per frame interval and feeds the
+// hub while gate is open. Failing to open the source is not fatal: the
+// stream just has no cursor.
+func (s *Server) cursorStage(frameDur time.Duration, gate *pauseGate, stop <-chan struct{}) {
+	src, err := s.cfg.NewCursorSource(s.cfg.Display)
+	if err != nil {
+		log.Printf("cursor: source init failed (continuing without cursor): %v", err)
+		return
+	}
+	defer src.Close()
+
+	ticker := time.NewTicker(frameDur)
+	defer ticker.Stop()
+
+	var fails int
+	for {
+		if _, ok := gate.wait(stop); !ok {
+			return
+		}
+		select {
+		case <-stop:
+			return
+		case <-ticker.C:
+		}
+		cur, err := src.Cursor()
+		if err != nil {
+			if fails++; fails <= 5 {
+				log.Printf("cursor: %v", err)
+			}
+			continue
+		}
+		s.cursors.update(cur)
+	}
+}
@@ -0,0 +1,297 @@
+package server
+
+import (
+	"fmt"
+	"log"
+	"time"
+	"unsafe"
+
+	"bunghole/internal/session"
+	"bunghole/internal/types"
+
+	"github.com/pion/webrtc/v4"
+)
+
+// ladderScales are the rendition sizes relative to the capture, in ladder
+// order: full, half and quarter resolution.
+var ladderScales = []int{1, 2, 4}
+
+var ladderNames = []string{"full", "half", "quarter"}
+
+const (
+	// ladderInterval is how often viewers are re-bound to a rendition.
+	// Slower than ABR: every switch costs the viewer an IDR.
+	ladderInterval = 2 * time.Second
+	// ladderUpMargin is how much more than a rendition's bitrate the
+	// estimate must allow before a viewer moves up to it.
+	ladderUpMargin = 1.25
+	// ladderMinWidth keeps renditions from shrinking into uselessness.
+	ladderMinWidth = 320
+
+	// A viewer's estimate can't grow past what its rendition sends, so it
+	// rarely shows the margin for the next one up. A viewer whose link is
+	// clean is moved up on trial instead, and the higher rate is the
+	// probe: it goes back down if loss or RTT rise within ladderTrial, or
+	// the estimate still doesn't cover the new rendition by then. Failed
+	// trials back off from ladderTrialBackoff up to ladderTrialMaxBackoff.
+	ladderTrial           = 3 * ladderInterval
+	ladderTrialBackoff    = 10 * time.Second
+	ladderTrialMaxBackoff = 2 * time.Minute
+	ladderTrialMaxLoss    = 0.02
+	ladderTrialMaxRTTRise = 50 * time.Millisecond
+)
+
+// rendition is one rung of the encode ladder: an encoder and the shared
+// track it feeds. Rung 0 is full resolution and carries the controller.
+type rendition struct {
+	name      string
+	scale     int
+	width     int // encode size; owned by the encode stage once running
+	height    int
+	bitrate   int // kbps
+	enc       types.VideoEncoder
+	track     *webrtc.TrackLocalStaticSample
+	keyframes keyframeGate // shared by all sessions bound to this rendition
+	metrics   *renditionMetrics
+}
+
+// ladderBitrate returns the target for rung i. Each rung has a quarter of
+// the pixels of the one above; giving it 40% of the bitrate raises bits per
+// pixel as resolution drops, which small pictures need.
+func ladderBitrate(kbps, i int) int {
+	for ; i > 0; i-- {
+		kbps = max(kbps*2/5, 100)
+	}
+	return kbps
+}
+
+// newLadder creates the encoders and tracks for the configured renditions.
+// Scaled renditions are box-downscaled by the encoder's color converter
+// from the same BGRA capture (macOS pixel buffers by VTPixelTransferSession);
+// GPU-resident (NvFBC CUDA) frames can only feed the full-resolution encode.
+func (s *Server) newLadder(cap types.MediaCapturer, cudaCtx, cuMemcpy2D unsafe.Pointer) ([]*rendition, error) {
+	n := min(max(s.cfg.Ladder, 1), len(ladderScales))
+	if n > 1 && cudaCtx != nil {
+		log.Printf("warning: --ladder %d ignored: NvFBC frames are in GPU memory, encoding full resolution only", s.cfg.Ladder)
+		n = 1
+	}
+
+	var rends []*rendition
+	for i := 0; i < n; i++ {
+		scale := ladderScales[i]
+		w, h := renditionSize(cap.Width(), cap.Height(), scale)
+		if scale > 1 {
+			if w < ladderMinWidth {
+				log.Printf("ladder: %s rendition would be %dx%d, stopping at %d renditions", ladderNames[i], w, h, i)
+				break
+			}
+		}
+
+		r := &rendition{
+			name:    ladderNames[i],
+			scale:   scale,
+			width:   w,
+			height:  h,
+			bitrate: ladderBitrate(s.cfg.Bitrate, i),
+			metrics: s.metrics.rendition(ladderNames[i]),
+		}
+		var err error
+		if i == 0 {
+			r.enc, err = s.cfg.NewEncoder(w, h, s.cfg.FPS, r.bitrate,
+				s.cfg.GPU, s.cfg.Codec, s.cfg.GOP, cudaCtx, cuMemcpy2D)
+		} else {
+			r.enc, err = s.cfg.NewEncoder(w, h, s.cfg.FPS, r.bitrate,
+				s.cfg.GPU, s.cfg.Codec, s.cfg.GOP, nil, nil)
+		}
+		if err != nil {
+			err = fmt.Errorf("encoder init: %w", err)
+		} else {
+			trackID := "video"
+			if i > 0 {
+				trackID = "video-" + r.name
+			}
+			if r.track, err = newVideoTrack(s.cfg.Codec, trackID); err != nil {
+				r.enc.Close()
+			}
+		}
+		if err != nil {
+			for _, prev := range rends {
+				prev.enc.Close()
+			}
+			if i == 0 {
+				return nil, err
+			}
+			return nil, fmt.Errorf("%s rendition: %w", r.name, err)
+		}
+		rends = append(rends, r)
+	}
+
+	if len(rends) > 1 {
+		for _, r := range rends {
+			log.Printf("ladder: %s 1/%d @ %d kbps", r.name, r.scale, r.bitrate)
+		}
+	}
+	return rends, nil
+}
+
+// renditionSize is the encode size of a 1/scale rendition of a w x h
+// capture. Scaled sizes are rounded down to even for 4:2:0.
+func renditionSize(w, h, scale int) (int, int) {
+	if scale == 1 {
+		return w, h
+	}
+	return (w / scale) &^ 1, (h / scale) &^ 1
+}
+
+// newVideoTrack creates a shared video track for the configured codec.
+// All renditions use the same capability so sessions can switch between
+// them without renegotiating.
+func newVideoTrack(codec, id string) (*webrtc.TrackLocalStaticSample, error) {
+	var videoMimeType, videoFmtp string
+	if codec == "h265" {
+		videoMimeType = webrtc.MimeTypeH265
+		videoFmtp = "profile-id=1"
+	} else {
+		videoMimeType = webrtc.MimeTypeH264
+		videoFmtp = "level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42001f"
+	}
+
+	track, err := webrtc.NewTrackLocalStaticSample(
+		webrtc.RTPCodecCapability{
+			MimeType:    videoMimeType,
+			ClockRate:   90000,
+			SDPFmtpLine: videoFmtp,
+		},
+		id, "bunghole",
+	)
+	if err != nil {
+		return nil, fmt.Errorf("create video track: %w", err)
+	}
+	return track, nil
+}
+
+// renditionFor returns the rendition whose track is t, or nil.
+func renditionFor(rends []*rendition, t *webrtc.TrackLocalStaticSample) *rendition {
+	for _, r := range rends {
+		if r.track == t {
+			return r
+		}
+	}
+	return nil
+}
+
+// ladderViewer is the ladder stage's state for one viewer.
+type ladderViewer struct {
+	backoff   time.Duration
+	nextTrial time.Time // earliest next trial upgrade
+	trialEnd  time.Time // zero unless on trial
+	trialRTT  time.Duration
+}
+
+// ladderStage binds each viewer to the best rendition its bandwidth
+// estimate can carry. Moving down happens as soon as the current rendition
+// no longer fits; moving up needs ladderUpMargin of headroom so a viewer
+// near a boundary doesn't flap between renditions, or a successful trial
+// (see ladderTrial).
+func (s *Server) ladderStage(rends []*rendition, stop <-chan struct{}) {
+	ticker := time.NewTicker(ladderInterval)
+	defer ticker.Stop()
+
+	state := make(map[string]*ladderViewer)
+	for {
+		select {
+		case <-stop:
+			return
+		case <-ticker.C:
+		}
+
+		s.mu.Lock()
+		viewers := make([]*session.Session, 0, len(s.viewers))
+		for _, v := range s.viewers {
+			viewers = append(viewers, v)
+		}
+		s.mu.Unlock()
+
+		now := time.Now()
+		seen := make(map[string]*ladderViewer, len(viewers))
+		for _, v := range viewers {
+			lv := state[v.ID]
+			if lv == nil {
+				lv = &ladderViewer{backoff: ladderTrialBackoff, nextTrial: now.Add(ladderTrialBackoff)}
+			}
+			seen[v.ID] = lv
+			s.ladderStep(v, lv, rends, now)
+		}
+		state = seen
+	}
+}
+
+// ladderStep re-binds one viewer.
+func (s *Server) ladderStep(v *session.Session, lv *ladderViewer, rends []*rendition, now time.Time) {
+	ls := v.LinkStats()
+	est := ls.EstimatedBitrate
+	if est <= 0 {
+		return
+	}
+	budget := float64(est) * abrHeadroom / 1000
+
+	cur := 0
+	for i, r := range rends {
+		if r.track == v.VideoTrack() {
+			cur = i
+		}
+	}
+	want := len(rends) - 1
+	for i, r := range rends {
+		need := float64(r.bitrate)
+		if i < cur {
+			need *= ladderUpMargin
+		}
+		if need <= budget {
+			want = i
+			break
+		}
+	}
+	why := ""
+	clean := ls.Valid && ls.FractionLost <= ladderTrialMaxLoss
+
+	switch {
+	case !lv.trialEnd.IsZero():
+		// On trial: loss, RTT growth or an estimate that no longer
+		// covers the rendition it came from end it early.
+		failed := !clean || ls.RTT > lv.trialRTT+ladderTrialMaxRTTRise ||
+			float64(rends[cur+1].bitrate) > budget
+		if !failed && now.Before(lv.trialEnd) {
+			return
+		}
+		lv.trialEnd = time.Time{}
+		if !failed && float64(rends[cur].bitrate) <= budget {
+			lv.backoff = ladderTrialBackoff
+			lv.nextTrial = now.Add(lv.backoff)
+			log.Printf("ladder: viewer %s kept %s after trial (estimate %d kbps)", v.ID, rends[cur].name, est/1000)
+			return
+		}
+		lv.backoff = min(lv.backoff*2, ladderTrialMaxBackoff)
+		lv.nextTrial = now.Add(lv.backoff)
+		want = max(want, cur+1)
+		why = ", trial failed"
+
+	case want == cur && cur > 0 && clean && !now.Before(lv.nextTrial) &&
+		float64(rends[cur].bitrate) <= budget:
+		// Fits where it is with a clean link: try the next one up.
+		want = cur - 1
+		lv.trialEnd = now.Add(ladderTrial)
+		lv.trialRTT = ls.RTT
+		why = ", trial"
+	}
+	if want == cur {
+		return
+	}
+
+	if err := v.SetVideoTrack(rends[want].track); err != nil {
+		log.Printf("ladder: viewer %s: %v", v.ID, err)
+		lv.trialEnd = time.Time{}
+		return
+	}
+	log.Printf("ladder: viewer %s %s -> %s (estimate %d kbps%s)", v.ID, rends[cur].name, rends[want].name, est/1000, why)
+}
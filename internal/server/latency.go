@@ -0,0 +1,133 @@
+package server
+
+import (
+	"encoding/binary"
+	"time"
+
+	"bunghole/internal/metrics"
+	"bunghole/internal/session"
+)
+
+// Capture timestamps (--capture-timestamps). Each access unit gets an SEI
+// user_data_unregistered message with the wall-clock time its frame was
+// grabbed, in Unix microseconds. The web client reads it from the encoded
+// frame, translates it to its own clock with a ping over the "latency"
+// data channel, and reports capture-to-display percentiles back, which
+// /metrics exports. Decoders skip SEI they don't know, so other WHEP
+// clients are unaffected.
+
+// captureSEIUUID identifies bunghole's capture time SEI.
+var captureSEIUUID = [16]byte{'b', 'u', 'n', 'g', 'h', 'o', 'l', 'e', '-', 'c', 'a', 'p', 't', 'u', 'r', 'e'}
+
+// glassReportTTL is how long a client's last report stays on /metrics.
+const glassReportTTL = 30 * time.Second
+
+// captureStamp inserts capture time SEI into one send stage's frames.
+// A nil *captureStamp leaves frames alone.
+type captureStamp struct {
+	h265 bool
+	buf  []byte
+}
+
+func (s *Server) newCaptureStamp() *captureStamp {
+	if !s.cfg.CaptureTimes {
+		return nil
+	}
+	return &captureStamp{h265: s.cfg.Codec == "h265"}
+}
+
+// apply returns au with the SEI inserted before its first slice. The
+// result lives in cs's buffer until the next call.
+func (cs *captureStamp) apply(au []byte, at time.Time) []byte {
+	if cs == nil || at.IsZero() {
+		return au
+	}
+	pos := firstVCL(au, cs.h265)
+	if pos < 0 {
+		return au
+	}
+	b := append(cs.buf[:0], au[:pos]...)
+	b = appendCaptureSEI(b, cs.h265, at)
+	b = append(b, au[pos:]...)
+	cs.buf = b
+	return b
+}
+
+// firstVCL returns the offset of the start code of au's first slice NAL
+// unit, or -1 if there is none.
+func firstVCL(au []byte, h265 bool) int {
+	for i := 0; i+3 < len(au); i++ {
+		if au[i] != 0 || au[i+1] != 0 || au[i+2] != 1 {
+			continue
+		}
+		hdr := au[i+3]
+		var vcl bool
+		if h265 {
+			vcl = hdr>>1&0x3f < 32
+		} else {
+			t := hdr & 0x1f
+			vcl = t >= 1 && t <= 5
+		}
+		if vcl {
+			if i > 0 && au[i-1] == 0 {
+				return i - 1 // 4-byte start code
+			}
+			return i
+		}
+		i += 2
+	}
+	return -1
+}
+
+// appendCaptureSEI appends a start code and the capture time SEI NAL unit.
+func appendCaptureSEI(b []byte, h265 bool, at time.Time) []byte {
+	b = append(b, 0, 0, 0, 1)
+	if h265 {
+		b = append(b, 39<<1, 1) // PREFIX_SEI_NUT, layer 0, TemporalId 0
+	} else {
+		b = append(b, 6) // SEI
+	}
+	var payload [2 + 16 + 8]byte
+	payload[0] = 5 // user_data_unregistered
+	payload[1] = 16 + 8
+	copy(payload[2:], captureSEIUUID[:])
+	binary.BigEndian.PutUint64(payload[18:], uint64(at.UnixMicro()))
+	// Emulation prevention: no 00 00 0x (x <= 3) inside the NAL unit.
+	zeros := 0
+	for _, c := range payload {
+		if zeros >= 2 && c <= 3 {
+			b = append(b, 3)
+			zeros = 0
+		}
+		b = append(b, c)
+		if c == 0 {
+			zeros++
+		} else {
+			zeros = 0
+		}
+	}
+	return append(b, 0x80) // rbsp_trailing_bits
+}
+
+// glassReport records the controller client's latest latency report.
+func (m *serverMetrics) glassReport(r session.LatencyReport) {
+	m.glassFrames.Add(uint64(r.Frames))
+	m.mu.Lock()
+	m.glass, m.glassAt = r, time.Now()
+	m.mu.Unlock()
+}
+
+// glassSamples exports the latest report as quantiles until it goes stale.
+func (m *serverMetrics) glassSamples() []metrics.Sample {
+	m.mu.Lock()
+	r, at := m.glass, m.glassAt
+	m.mu.Unlock()
+	if at.IsZero() || time.Since(at) > glassReportTTL {
+		return nil
+	}
+	return []metrics.Sample{
+		{Labels: metrics.Labels{"quantile": "0.5"}, Value: r.P50 / 1000},
+		{Labels: metrics.Labels{"quantile": "0.9"}, Value: r.P90 / 1000},
+		{Labels: metrics.Labels{"quantile": "0.99"}, Value: r.P99 / 1000},
+	}
+}
@@ -0,0 +1,151 @@
+package server
+
+import (
+	"log"
+	"sync"
+	"time"
+)
+
+// pauseGate parks the capture side of a warm pipeline while no session is
+// connected. The capturer, encoders and CUDA context stay allocated, so
+// resuming costs nothing but the next tick.
+type pauseGate struct {
+	mu      sync.Mutex
+	resumed chan struct{} // nil while running; closed on resume
+}
+
+func (g *pauseGate) pause() {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	if g.resumed == nil {
+		g.resumed = make(chan struct{})
+	}
+}
+
+func (g *pauseGate) resume() {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	if g.resumed != nil {
+		close(g.resumed)
+		g.resumed = nil
+	}
+}
+
+// wait blocks while the gate is paused. It reports whether it had to wait,
+// and returns false for ok once stop is closed.
+func (g *pauseGate) wait(stop <-chan struct{}) (waited, ok bool) {
+	waited, _, ok = g.waitOrPoke(stop, nil)
+	return waited, ok
+}
+
+// waitOrPoke is wait that also returns, with woke set and the gate still
+// paused, when poke fires.
+func (g *pauseGate) waitOrPoke(stop, poke <-chan struct{}) (waited, woke, ok bool) {
+	g.mu.Lock()
+	resumed := g.resumed
+	g.mu.Unlock()
+	if resumed == nil {
+		return false, false, true
+	}
+	select {
+	case <-resumed:
+		return true, false, true
+	case <-poke:
+		return true, true, true
+	case <-stop:
+		return true, false, false
+	}
+}
+
+// idlePipelineLocked is called when the last session leaves. With
+// --prewarm, or while a thumbnail stream is open, the pipeline stays warm;
+// with --linger it stays warm for that long; otherwise it stops now.
+// Must be called with s.mu held.
+func (s *Server) idlePipelineLocked() {
+	if s.pipeStop == nil {
+		return
+	}
+	if !s.cfg.Prewarm && s.thumbStreams == 0 && s.cfg.Linger <= 0 {
+		s.stopPipelineLocked()
+		return
+	}
+
+	s.pipeGate.pause()
+	if s.cfg.Prewarm {
+		log.Printf("pipeline idle (paused, prewarmed)")
+		return
+	}
+	if s.thumbStreams > 0 {
+		log.Printf("pipeline idle (paused, %d thumbnail stream(s))", s.thumbStreams)
+		return
+	}
+	log.Printf("pipeline idle (paused, stopping in %v)", s.cfg.Linger)
+
+	// Only the newest idle period's timer may stop the pipeline.
+	if s.lingerTimer != nil {
+		s.lingerTimer.Stop()
+	}
+	stop := s.pipeStop
+	var t *time.Timer
+	t = time.AfterFunc(s.cfg.Linger, func() {
+		s.mu.Lock()
+		defer s.mu.Unlock()
+		// A session may have arrived, the timer been replaced by a later
+		// idle period's, or the pipeline been replaced, while the timer
+		// was firing. t is set before s.mu is released.
+		if s.lingerTimer == t && s.pipeStop == stop && s.ctrl == nil && len(s.viewers) == 0 && s.thumbStreams == 0 {
+			log.Printf("pipeline linger expired")
+			s.stopPipelineLocked()
+		}
+	})
+	s.lingerTimer = t
+}
+
+// wakePipelineLocked resumes a warm pipeline for a new session.
+// Must be called with s.mu held.
+func (s *Server) wakePipelineLocked() {
+	if s.lingerTimer != nil {
+		s.lingerTimer.Stop()
+		s.lingerTimer = nil
+	}
+	s.pipeGate.resume()
+}
+
+// Prewarm starts the pipeline before the first session so that the first
+// offer only waits for the next frame, not for capturer and encoder init.
+// Failure is not fatal: the pipeline is retried on the first offer.
+func (s *Server) Prewarm() {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	t0 := time.Now()
+	if err := s.ensurePipelineLocked(); err != nil {
+		log.Printf("prewarm failed (pipeline starts on first offer): %v", err)
+		return
+	}
+	if s.ctrl == nil && len(s.viewers) == 0 {
+		s.pipeGate.pause()
+	}
+	log.Printf("pipeline prewarmed in %v", time.Since(t0).Round(time.Millisecond))
+}
+
+// holdPipeline keeps the pipeline allocated for a thumbnail stream, paused
+// while no session is connected, until release is called.
+func (s *Server) holdPipeline() (release func(), err error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	if err := s.ensurePipelineLocked(); err != nil {
+		return nil, err
+	}
+	s.thumbStreams++
+	if s.ctrl == nil && len(s.viewers) == 0 {
+		s.pipeGate.pause()
+	}
+	return func() {
+		s.mu.Lock()
+		defer s.mu.Unlock()
+		s.thumbStreams--
+		s.maybeStopPipelineLocked()
+	}, nil
+}
@@ -0,0 +1,214 @@
+package server
+
+import (
+	"log"
+	"net/http"
+	"sync"
+	"time"
+
+	"bunghole/internal/metrics"
+	"bunghole/internal/session"
+	"bunghole/internal/types"
+)
+
+var (
+	// latencyBuckets cover 250µs to ~260ms: a 60 fps frame budget sits
+	// in the middle, so both fast hosts and stalls are resolved.
+	latencyBuckets = metrics.ExponentialBuckets(0.00025, 2, 11)
+	// frameBytesBuckets cover 1 KiB to 4 MiB per encoded frame.
+	frameBytesBuckets = metrics.ExponentialBuckets(1024, 2, 13)
+)
+
+// serverMetrics are exported on /metrics. They live on the Server, not the
+// pipeline, so counters keep counting across pipeline restarts.
+type serverMetrics struct {
+	reg *metrics.Registry
+
+	grab        *metrics.Histogram
+	grabFails   *metrics.Counter
+	skipped     *metrics.Counter
+	idleTicks   *metrics.Counter
+	refreshes   *metrics.Counter
+	dropped     *metrics.Counter
+	audioQueue  *metrics.Gauge
+	audioLoss   *metrics.Gauge
+	audioDTX    *metrics.Counter
+	audioLost   *metrics.Counter
+	videoTarget *metrics.Gauge
+
+	inputLag       *metrics.Histogram
+	inputCoalesced *metrics.Counter
+	glassFrames    *metrics.Counter
+
+	mu         sync.Mutex
+	renditions map[string]*renditionMetrics
+	links      []sessionLink // read once per scrape
+	glass      session.LatencyReport
+	glassAt    time.Time
+}
+
+// renditionMetrics are the per-encoder series, labeled by rendition.
+type renditionMetrics struct {
+	convert     *metrics.Histogram
+	encode      *metrics.Histogram
+	send        *metrics.Histogram
+	frameBytes  *metrics.Histogram
+	keyBytes    *metrics.Histogram
+	encodeFails *metrics.Counter
+	forcedIDRs  *metrics.Counter
+	resizes     *metrics.Counter
+}
+
+func (s *Server) newMetrics() *serverMetrics {
+	reg := metrics.NewRegistry()
+	m := &serverMetrics{
+		reg:         reg,
+		grab:        reg.Histogram("bunghole_grab_seconds", "Time spent in Grab per captured frame.", nil, latencyBuckets),
+		grabFails:   reg.Counter("bunghole_grab_failures_total", "Grabs that returned an error.", nil),
+		skipped:     reg.Counter("bunghole_skipped_frames_total", "Unchanged frames that were not encoded.", nil),
+		idleTicks:   reg.Counter("bunghole_idle_ticks_total", "Capture ticks not grabbed because the screen was static (--adaptive-fps).", nil),
+		refreshes:   reg.Counter("bunghole_refresh_frames_total", "Refresh frames encoded with extra bits after the screen stopped changing (--adaptive-fps).", nil),
+		dropped:     reg.Counter("bunghole_dropped_ticks_total", "Capture ticks lost to a full pipeline (no free buffer or superseded frame).", nil),
+		audioQueue:  reg.Gauge("bunghole_audio_queue_depth", "Opus packets waiting to be written to the audio track.", nil),
+		audioLoss:   reg.Gauge("bunghole_audio_expected_loss_percent", "Packet loss the Opus encoder sizes in-band FEC for (worst session).", nil),
+		audioDTX:    reg.Counter("bunghole_audio_dtx_frames_total", "Silent DTX frames that were not sent.", nil),
+		audioLost:   reg.Counter("bunghole_audio_lost_packets_total", "Guest audio packets lost between the guest and the host.", nil),
+		videoTarget: reg.Gauge("bunghole_video_target_kbps", "Current target bitrate of the full-resolution encoder.", nil),
+		renditions:  make(map[string]*renditionMetrics),
+
+		inputLag:       reg.Histogram("bunghole_input_lag_seconds", "Time from an input event's arrival to the injector flush that carried it (oldest event per flush).", nil, latencyBuckets),
+		inputCoalesced: reg.Counter("bunghole_input_coalesced_total", "Pointer moves merged into a later move before injection.", nil),
+		glassFrames:    reg.Counter("bunghole_glass_latency_frames_total", "Frames the controller's client measured capture-to-display latency for (--capture-timestamps).", nil),
+	}
+	reg.Collector("bunghole_glass_latency_seconds", "Capture-to-display latency quantiles from the controller client's last report (--capture-timestamps).", m.glassSamples)
+
+	reg.Collector("bunghole_sessions", "Connected sessions by role.", func() []metrics.Sample {
+		ctrl, viewers := s.sessionsSnapshot()
+		n := 0.0
+		if ctrl != nil {
+			n = 1
+		}
+		return []metrics.Sample{
+			{Labels: metrics.Labels{"role": "controller"}, Value: n},
+			{Labels: metrics.Labels{"role": "viewer"}, Value: float64(len(viewers))},
+		}
+	})
+	guestAudio := func(get func(types.GuestAudioStats) float64) func() []metrics.Sample {
+		return func() []metrics.Sample {
+			s.mu.Lock()
+			gr, _ := s.audio.(types.GuestAudioReporter)
+			s.mu.Unlock()
+			if gr == nil {
+				return nil
+			}
+			st, ok := gr.GuestAudioStats()
+			if !ok {
+				return nil
+			}
+			return []metrics.Sample{{Value: get(st)}}
+		}
+	}
+	reg.Collector("bunghole_guest_audio_frame_seconds", "Duration of the Opus packets the guest audio driver sends.",
+		guestAudio(func(st types.GuestAudioStats) float64 { return st.FrameDuration.Seconds() }))
+	reg.Collector("bunghole_guest_audio_ring_frames", "Guest driver output ring fill at its last report.",
+		guestAudio(func(st types.GuestAudioStats) float64 { return float64(st.RingFill) }))
+	reg.Collector("bunghole_guest_audio_ring_peak_frames", "Highest guest driver output ring fill between its last two reports.",
+		guestAudio(func(st types.GuestAudioStats) float64 { return float64(st.RingPeak) }))
+	reg.Collector("bunghole_guest_audio_overrun_frames", "Cumulative output frames the guest driver dropped on a full ring.",
+		guestAudio(func(st types.GuestAudioStats) float64 { return float64(st.Overruns) }))
+	reg.Collector("bunghole_guest_audio_underrun_frames", "Cumulative input frames the guest driver padded with silence.",
+		guestAudio(func(st types.GuestAudioStats) float64 { return float64(st.Underruns) }))
+
+	linkStat := func(get func(session.LinkStats) float64) func() []metrics.Sample {
+		return func() []metrics.Sample {
+			m.mu.Lock()
+			links := m.links
+			m.mu.Unlock()
+			var out []metrics.Sample
+			for _, ls := range links {
+				if ls.stats.Valid {
+					out = append(out, metrics.Sample{Labels: ls.labels, Value: get(ls.stats)})
+				}
+			}
+			return out
+		}
+	}
+	reg.Collector("bunghole_session_rtt_seconds", "Round-trip time from the receiver's RTCP reports.",
+		linkStat(func(ls session.LinkStats) float64 { return ls.RTT.Seconds() }))
+	reg.Collector("bunghole_session_jitter_seconds", "Interarrival jitter of the video stream reported by the receiver.",
+		linkStat(func(ls session.LinkStats) float64 { return ls.Jitter.Seconds() }))
+	reg.Collector("bunghole_session_fraction_lost", "Fraction of video packets lost in the receiver's last report interval.",
+		linkStat(func(ls session.LinkStats) float64 { return ls.FractionLost }))
+	reg.Collector("bunghole_session_packets_lost", "Cumulative video packets lost as reported by the receiver.",
+		linkStat(func(ls session.LinkStats) float64 { return float64(ls.PacketsLost) }))
+	reg.Collector("bunghole_session_estimated_bitrate_bps", "Send-side bandwidth estimate for the session.",
+		linkStat(func(ls session.LinkStats) float64 { return float64(ls.EstimatedBitrate) }))
+	return m
+}
+
+// rendition returns the series for the named rendition, registering them
+// the first time a pipeline runs it.
+func (m *serverMetrics) rendition(name string) *renditionMetrics {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	if rm, ok := m.renditions[name]; ok {
+		return rm
+	}
+	l := metrics.Labels{"rendition": name}
+	rm := &renditionMetrics{
+		convert:     m.reg.Histogram("bunghole_convert_seconds", "Time spent converting BGRA to YUV inside Encode (CPU encoders only).", l, latencyBuckets),
+		encode:      m.reg.Histogram("bunghole_encode_seconds", "Time spent in Encode per frame, including conversion.", l, latencyBuckets),
+		send:        m.reg.Histogram("bunghole_send_seconds", "Time spent in WriteSample per encoded frame.", l, latencyBuckets),
+		frameBytes:  m.reg.Histogram("bunghole_frame_bytes", "Encoded frame size.", l, frameBytesBuckets),
+		keyBytes:    m.reg.Histogram("bunghole_keyframe_bytes", "Encoded keyframe size.", l, frameBytesBuckets),
+		encodeFails: m.reg.Counter("bunghole_encode_failures_total", "Encode calls that returned an error.", l),
+		forcedIDRs:  m.reg.Counter("bunghole_forced_keyframes_total", "IDRs forced by session keyframe requests.", l),
+		resizes:     m.reg.Counter("bunghole_encoder_resizes_total", "Encoder reopens after the capture size changed.", l),
+	}
+	m.renditions[name] = rm
+	return rm
+}
+
+type sessionLink struct {
+	labels metrics.Labels
+	stats  session.LinkStats
+}
+
+func (s *Server) sessionsSnapshot() (*session.Session, []*session.Session) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	viewers := make([]*session.Session, 0, len(s.viewers))
+	for _, v := range s.viewers {
+		viewers = append(viewers, v)
+	}
+	return s.ctrl, viewers
+}
+
+// linkStats reads every session's transport stats. GetStats is called
+// outside s.mu.
+func (s *Server) linkStats() []sessionLink {
+	ctrl, viewers := s.sessionsSnapshot()
+	var out []sessionLink
+	if ctrl != nil {
+		out = append(out, sessionLink{metrics.Labels{"session": ctrl.ID, "role": "controller"}, ctrl.LinkStats()})
+	}
+	for _, v := range viewers {
+		out = append(out, sessionLink{metrics.Labels{"session": v.ID, "role": "viewer"}, v.LinkStats()})
+	}
+	return out
+}
+
+func (s *Server) handleMetrics(w http.ResponseWriter, r *http.Request) {
+	if !s.checkAuth(w, r) {
+		return
+	}
+	links := s.linkStats()
+	s.metrics.mu.Lock()
+	s.metrics.links = links
+	s.metrics.mu.Unlock()
+
+	w.Header().Set("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+	if err := s.metrics.reg.WriteText(w); err != nil {
+		log.Printf("metrics: write: %v", err)
+	}
+}
@@ -0,0 +1,859 @@
+package server
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"bunghole/internal/audio"
+	"bunghole/internal/session"
+	"bunghole/internal/types"
+
+	"github.com/pion/webrtc/v4"
+	"github.com/pion/webrtc/v4/pkg/media"
+)
+
+// Queue depths between pipeline stages. A raw frame is superseded by the
+// next grab, so the capture→encode queue keeps only the newest frame and
+// drops the oldest on overflow. Encoded frames can't be dropped without
+// breaking the decoder's reference chain, so the encode→send queue applies
+// backpressure to the encoder instead (which in turn drops raw frames).
+const (
+	rawQueueDepth     = 1
+	encodedQueueDepth = 2
+)
+
+// rawFrame is a captured frame waiting for the encoder.
+type rawFrame struct {
+	frame   *types.Frame
+	dur     time.Duration // media time covered, including skipped/dropped ticks
+	ref     *frameRef
+	refresh bool      // encode with extra bits: the screen has been static (--adaptive-fps)
+	at      time.Time // when Grab returned the frame
+}
+
+// frameRef counts the rendition encoders still holding a captured frame.
+// Refs are recycled through frameRefs once the frame is released.
+type frameRef struct {
+	n atomic.Int32
+}
+
+var frameRefs = sync.Pool{New: func() any { return new(frameRef) }}
+
+// sendFrame is an encoded frame waiting for WriteSample. The send stage
+// releases pkt once it is written.
+type sendFrame struct {
+	pkt *types.EncodedFrame
+	dur time.Duration
+	at  time.Time // capture time of the frame it encodes
+}
+
+// frameSlots bounds the frames between Grab and the end of Encode by the
+// number of buffers the capturer can hand out. The capture stage takes a
+// slot before grabbing; whoever finishes with the frame releases it.
+type frameSlots struct {
+	free     chan struct{}
+	releaser types.FrameReleaser // nil: capturer reuses a single buffer
+}
+
+func newFrameSlots(cap types.MediaCapturer) *frameSlots {
+	n := 1
+	releaser, _ := cap.(types.FrameReleaser)
+	if releaser != nil {
+		n = max(releaser.FrameBuffers(), 1)
+	}
+	fs := &frameSlots{free: make(chan struct{}, n), releaser: releaser}
+	for i := 0; i < n; i++ {
+		fs.free <- struct{}{}
+	}
+	return fs
+}
+
+func (fs *frameSlots) tryAcquire() bool {
+	select {
+	case <-fs.free:
+		return true
+	default:
+		return false
+	}
+}
+
+// acquire waits for a free slot; false if stop closed first.
+func (fs *frameSlots) acquire(stop <-chan struct{}) bool {
+	select {
+	case <-fs.free:
+		return true
+	case <-stop:
+		return false
+	}
+}
+
+// release hands f's buffer back to the capturer and frees its slot.
+// f is nil when the grab failed.
+func (fs *frameSlots) release(f *types.Frame) {
+	if f != nil && fs.releaser != nil {
+		fs.releaser.ReleaseFrame(f)
+	}
+	fs.free <- struct{}{}
+}
+
+// put drops one rendition's hold on a queued frame; the last one to let go
+// releases it.
+func (fs *frameSlots) put(rf rawFrame) {
+	if rf.ref.n.Add(-1) == 0 {
+		fs.release(rf.frame)
+		frameRefs.Put(rf.ref)
+	}
+}
+
+// keyframeMinInterval rate-limits forced IDRs: sessions that join or
+// report loss within one interval share a single IDR.
+const keyframeMinInterval = 500 * time.Millisecond
+
+// keyframeGate coalesces keyframe requests from the sessions on one
+// rendition into forced IDRs on its encoder. request may be called from any
+// goroutine; the rest only from the encode stage.
+type keyframeGate struct {
+	pending atomic.Bool
+	last    time.Time // last IDR out of the encoder
+}
+
+func (g *keyframeGate) request() { g.pending.Store(true) }
+
+// take reports whether the next frame should be forced to an IDR.
+func (g *keyframeGate) take(now time.Time) bool {
+	if !g.pending.Load() || now.Sub(g.last) < keyframeMinInterval {
+		return false
+	}
+	g.pending.Store(false)
+	g.last = now
+	return true
+}
+
+// sent records an IDR leaving the encoder. A natural IDR satisfies any
+// request still waiting out the interval.
+func (g *keyframeGate) sent(now time.Time) {
+	g.pending.Store(false)
+	g.last = now
+}
+
+// feedback wires a new session's RTCP into the pipeline, and its input
+// injection into the metrics. Keyframe requests go to whichever rendition
+// the session is bound to at the time.
+func (s *Server) feedback(rends []*rendition) session.Feedback {
+	return session.Feedback{
+		Bandwidth: s.bandwidthConfig(),
+		OnKeyframeRequest: func(sess *session.Session) {
+			if r := renditionFor(rends, sess.VideoTrack()); r != nil {
+				r.keyframes.request()
+			}
+		},
+		OnInputBatch: func(lag time.Duration, coalesced int) {
+			s.inputAt.Store(time.Now().UnixNano())
+			s.metrics.inputLag.ObserveDuration(lag)
+			s.metrics.inputCoalesced.Add(uint64(coalesced))
+		},
+		OnLatencyReport: s.metrics.glassReport,
+	}
+}
+
+// pipelineStats holds the --stats counters. Stages run on separate
+// goroutines, so everything is atomic; counters are reset on each report.
+type pipelineStats struct {
+	loops       atomic.Int64
+	grabFails   atomic.Int64
+	encodeFails atomic.Int64
+	encodeNils  atomic.Int64
+	skipped     atomic.Int64
+	dropped     atomic.Int64
+	keyframes   atomic.Int64 // forced IDRs
+
+	lastGrab   atomic.Int64 // ns
+	lastEncode atomic.Int64
+	lastSend   atomic.Int64
+
+	bitrate atomic.Int64 // current encoder target, kbps
+
+	// Heap allocations (all goroutines) as of the last report; only
+	// touched by the goroutine calling report.
+	mallocs uint64
+}
+
+// heapMallocs returns the process's cumulative heap allocation count.
+func heapMallocs() uint64 {
+	var ms runtime.MemStats
+	runtime.ReadMemStats(&ms)
+	return ms.Mallocs
+}
+
+// report logs and resets the counters. allocs/frame is every heap
+// allocation in the process per capture tick, so it includes sessions and
+// RTCP, but a regression on the per-frame path shows up as a step.
+func (st *pipelineStats) report() {
+	loops := st.loops.Swap(0)
+	mallocs := heapMallocs()
+	allocs := float64(mallocs-st.mallocs) / float64(max(loops, 1))
+	st.mallocs = mallocs
+
+	log.Printf("pipeline: loops=%d grabFail=%d encFail=%d encNil=%d skipped=%d dropped=%d idr=%d kbps=%d allocs/frame=%.1f | last: grab=%v enc=%v send=%v",
+		loops, st.grabFails.Swap(0), st.encodeFails.Swap(0), st.encodeNils.Swap(0),
+		st.skipped.Swap(0), st.dropped.Swap(0), st.keyframes.Swap(0), st.bitrate.Load(), allocs,
+		time.Duration(st.lastGrab.Load()).Round(time.Microsecond),
+		time.Duration(st.lastEncode.Load()).Round(time.Microsecond),
+		time.Duration(st.lastSend.Load()).Round(time.Microsecond))
+}
+
+// runPipeline runs the capture, encode and send stages on their own
+// goroutines so that grabbing frame N+1 overlaps encoding frame N. Each
+// rendition gets its own encode and send stage fed from the one capture. It
+// writes to shared tracks and stops when pipeStop is closed. Cleanup of
+// cap/encoders/audio is done in defer, after all stages have exited.
+func (s *Server) runPipeline(cap types.MediaCapturer, rends []*rendition, audioTrack *webrtc.TrackLocalStaticSample, gate *pauseGate, stop chan struct{}) {
+	defer s.pipeWg.Done()
+	defer func() {
+		s.mu.Lock()
+		// Only nil out if these are still our resources
+		if s.capturer == cap {
+			s.capturer = nil
+		}
+		if len(s.renditions) > 0 && s.renditions[0] == rends[0] {
+			s.renditions = nil
+		}
+		if s.audio != nil {
+			s.audio.Close()
+			s.audio = nil
+		}
+		if s.audioTrack == audioTrack {
+			s.audioTrack = nil
+		}
+		if s.pipeGate == gate {
+			s.pipeGate = nil
+		}
+		s.mu.Unlock()
+
+		// Close encoders before capturer (encoder uses CUDA context owned by capturer)
+		for _, r := range rends {
+			r.enc.Close()
+		}
+		cap.Close()
+		log.Printf("%spipeline stopped", s.logPrefix)
+	}()
+
+	s.startAudio(audioTrack, stop)
+
+	frameDur := time.Duration(float64(time.Second) / float64(s.cfg.FPS))
+
+	var st pipelineStats
+	st.bitrate.Store(int64(s.cfg.Bitrate))
+	s.metrics.videoTarget.Set(float64(s.cfg.Bitrate))
+	raws := make([]chan rawFrame, len(rends))
+	for i := range raws {
+		raws[i] = make(chan rawFrame, rawQueueDepth)
+	}
+
+	slots := newFrameSlots(cap)
+
+	// Capture ticks per grab; raised by the rate stage on weak links.
+	var grabEvery atomic.Int32
+	grabEvery.Store(1)
+
+	var wg sync.WaitGroup
+	if s.cfg.ABR != "off" {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			s.rateStage(rends[0], &grabEvery, &st, stop)
+		}()
+	}
+	if len(rends) > 1 {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			s.ladderStage(rends, stop)
+		}()
+	}
+	if s.cfg.NewCursorSource != nil {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			s.cursorStage(frameDur, gate, stop)
+		}()
+	}
+	// Capture and encode stay on their own OS threads: their cgo calls
+	// keep per-thread state (CUDA's current context, the X connection's
+	// buffers), and with several pipelines in one process they would
+	// otherwise hop between threads that other desktops also use.
+	wg.Add(1)
+	go func() {
+		defer wg.Done()
+		runtime.LockOSThread()
+		s.captureStage(cap, frameDur, &grabEvery, slots, raws, gate, &st, stop)
+	}()
+	for i, r := range rends {
+		encoded := make(chan sendFrame, encodedQueueDepth)
+		wg.Add(2)
+		go func() {
+			defer wg.Done()
+			runtime.LockOSThread()
+			encodeStage(r, slots, raws[i], encoded, &st, stop)
+		}()
+		stamp := s.newCaptureStamp()
+		go func() {
+			defer wg.Done()
+			sendStage(r, encoded, stamp, &st, stop)
+		}()
+	}
+
+	var statsC <-chan time.Time
+	if s.cfg.Stats {
+		st.mallocs = heapMallocs()
+		statsTicker := time.NewTicker(5 * time.Second)
+		defer statsTicker.Stop()
+		statsC = statsTicker.C
+	}
+
+	for {
+		select {
+		case <-stop:
+			wg.Wait()
+			// Frames still queued go back to the capturer before it closes.
+			for _, raw := range raws {
+				drainRaw(raw, slots)
+			}
+			return
+		case <-statsC:
+			st.report()
+		}
+	}
+}
+
+// startAudio starts audio capture for the pipeline (non-fatal if it fails).
+func (s *Server) startAudio(audioTrack *webrtc.TrackLocalStaticSample, stop chan struct{}) {
+	var (
+		ac  types.AudioCapturer
+		err error
+	)
+	if s.cfg.AudioUDPListen != "" {
+		ac, err = audio.NewUDPAudioCapture(s.cfg.AudioUDPListen)
+		if err == nil {
+			log.Printf("audio: source=guest-udp listen=%s", s.cfg.AudioUDPListen)
+		}
+	} else if s.cfg.VsockAudioCh != nil {
+		// Vsock first when available (VM mode) — the guest HAL driver
+		// sends Opus directly over vsock, no host-side SCK needed.
+		ac = audio.NewVsockAudioCapture(s.cfg.VsockAudioCh)
+		log.Printf("audio: source=guest-vsock")
+		err = nil
+	} else {
+		// Host desktop mode — capture via ScreenCaptureKit, or the
+		// desktop's PulseAudio server on Linux.
+		ac, err = audio.NewAudioCaptureFrom(s.cfg.AudioServer)
+	}
+	if err != nil {
+		log.Printf("audio capture init failed (continuing without audio): %v", err)
+		return
+	}
+
+	s.mu.Lock()
+	s.audio = ac
+	s.mu.Unlock()
+
+	audioPkts := make(chan *types.OpusPacket, 10)
+	go ac.Run(audioPkts, stop)
+	go s.audioStage(ac, audioTrack, audioPkts, stop)
+}
+
+// maxDTXRun caps the silence one DTX packet spans, so a silent desktop
+// still sends a packet now and then and RTP timestamps can't wrap.
+const maxDTXRun = 10 * time.Second
+
+// audioLossInterval is how often receiver-reported audio loss is passed
+// to the Opus encoder.
+const audioLossInterval = 2 * time.Second
+
+// audioStage writes Opus packets to the audio track. Packets of two bytes
+// or less are DTX frames (a TOC byte, no audio). Only the first of a run
+// is sent, once the run ends, with a duration spanning all of it: the next
+// packet's timestamp skips the silence while sequence numbers stay
+// contiguous, so receivers don't count it as loss. Packets the capturer
+// reports as lost in transport are skipped with PrevDroppedPackets, which
+// advances both, so receivers conceal them. For capturers that encode
+// themselves it also feeds the worst audio loss any session reports back
+// to the encoder.
+func (s *Server) audioStage(ac types.AudioCapturer, audioTrack *webrtc.TrackLocalStaticSample, audioPkts <-chan *types.OpusPacket, stop <-chan struct{}) {
+	var lossC <-chan time.Time
+	lt, _ := ac.(types.LossTuner)
+	if lt != nil {
+		ticker := time.NewTicker(audioLossInterval)
+		defer ticker.Stop()
+		lossC = ticker.C
+	}
+
+	var held *types.OpusPacket // first DTX frame of the current run
+	var silence time.Duration  // duration of the run so far
+	sendHeld := func() {
+		audioTrack.WriteSample(media.Sample{Data: held.Data, Duration: silence})
+		held.Release()
+		held, silence = nil, 0
+	}
+	defer func() {
+		if held != nil {
+			held.Release()
+		}
+	}()
+
+	for {
+		select {
+		case <-stop:
+			return
+		case <-lossC:
+			percent := int(s.worstAudioLoss()*100 + 0.5)
+			s.metrics.audioLoss.Set(float64(percent))
+			lt.SetPacketLoss(percent)
+		case pkt := <-audioPkts:
+			s.metrics.audioQueue.Set(float64(len(audioPkts)))
+			if held != nil && (len(pkt.Data) > 2 || pkt.Lost > 0 || silence >= maxDTXRun) {
+				sendHeld()
+			}
+			if len(pkt.Data) <= 2 && pkt.Lost == 0 {
+				if held == nil {
+					held = pkt
+				} else {
+					s.metrics.audioDTX.Inc()
+					pkt.Release()
+				}
+				silence += pkt.Duration
+				continue
+			}
+			if pkt.Lost > 0 {
+				s.metrics.audioLost.Add(uint64(pkt.Lost))
+			}
+			audioTrack.WriteSample(media.Sample{
+				Data:               pkt.Data,
+				Duration:           pkt.Duration,
+				PrevDroppedPackets: uint16(min(pkt.Lost, math.MaxUint16)),
+			})
+			pkt.Release()
+		}
+	}
+}
+
+// worstAudioLoss is the highest fraction of audio packets lost that any
+// session reported in its last receiver report.
+func (s *Server) worstAudioLoss() float64 {
+	ctrl, sessions := s.sessionsSnapshot()
+	if ctrl != nil {
+		sessions = append(sessions, ctrl)
+	}
+	worst := 0.0
+	for _, sess := range sessions {
+		if loss, ok := sess.AudioLoss(); ok && loss > worst {
+			worst = loss
+		}
+	}
+	return worst
+}
+
+// drainRaw releases the frames left in a raw queue.
+func drainRaw(raw chan rawFrame, slots *frameSlots) {
+	for {
+		select {
+		case rf := <-raw:
+			slots.put(rf)
+		default:
+			return
+		}
+	}
+}
+
+// sourceWaitTimeout bounds how long a source-paced Grab waits for the
+// source. A timed-out grab counts as unchanged, so it also sets how often a
+// static screen is re-checked.
+const sourceWaitTimeout = 100 * time.Millisecond
+
+// staticFrameInterval is how often a screen that isn't changing is still
+// encoded, so RTP keeps flowing and the GOP keeps advancing.
+const staticFrameInterval = time.Second
+
+// captureStage grabs a frame and queues it for every rendition's encoder
+// (one raw queue each). It grabs on every tick, or with --pacing source as
+// soon as the capturer has a new frame (see sourcePacing). While gate is
+// paused it grabs nothing, and the encoders downstream idle on their empty
+// queues. With --adaptive-fps a static screen is also grabbed less often
+// and sharpened by one refresh frame (see idleState).
+func (s *Server) captureStage(cap types.MediaCapturer, frameDur time.Duration, grabEvery *atomic.Int32, slots *frameSlots, raws []chan rawFrame, gate *pauseGate, st *pipelineStats, stop <-chan struct{}) {
+	paced := s.cfg.Pacing == "source" && sourcePacing(cap, frameDur)
+
+	var ticker *time.Ticker
+	var wait *time.Timer // source-paced: sleeps out the frame rate cap
+	if paced {
+		wait = time.NewTimer(0)
+		<-wait.C
+		defer wait.Stop()
+	} else {
+		ticker = time.NewTicker(frameDur)
+		defer ticker.Stop()
+	}
+
+	// Unchanged frames are skipped, but one is still queued every
+	// staticFrameInterval. A source-paced grab only comes back unchanged
+	// when it timed out.
+	var lastQueued time.Time
+	var idle idleState
+	adaptive := s.cfg.AdaptiveFPS
+
+	// Media time not yet attached to a queued frame. Every tick adds one
+	// frame duration, or when source-paced, the time since the previous
+	// grab returned, so the RTP timestamp stays in step with wall-clock
+	// time across skipped, dropped and failed grabs. carry holds the time
+	// of frames taken back from each rendition's queue.
+	var pendingDur time.Duration
+	carry := make([]time.Duration, len(raws))
+
+	// Source pacing: the previous grab's time and the earliest the next
+	// frame may be queued.
+	var lastGrab, earliest time.Time
+
+	var tick int64
+	for {
+		waited, ok := s.parkCapture(cap, slots, gate, stop)
+		if !ok {
+			return
+		}
+		if waited {
+			// Paused time is not media time, and the session that woke
+			// us needs a picture now: don't skip the first grab as
+			// unchanged. Its IDR is requested when the session connects.
+			pendingDur = 0
+			lastQueued = time.Time{}
+			idle.wake(time.Now())
+			lastGrab, earliest = time.Time{}, time.Time{}
+			if !paced {
+				ticker.Reset(frameDur)
+			}
+		}
+
+		if paced {
+			// Hold the frame rate to --fps (halved with grabEvery on
+			// weak links), then take a buffer slot, waiting for the
+			// encoder if need be. Grab blocks until the source has a
+			// frame, so it runs last.
+			if d := time.Until(earliest); d > 0 {
+				wait.Reset(d)
+				select {
+				case <-stop:
+					return
+				case <-wait.C:
+				}
+			}
+			if !slots.acquire(stop) {
+				return
+			}
+			st.loops.Add(1)
+		} else {
+			select {
+			case <-stop:
+				return
+			case <-ticker.C:
+			}
+			st.loops.Add(1)
+			pendingDur += frameDur
+
+			// At a reduced frame rate the skipped ticks just add media time.
+			tick++
+			if n := int64(grabEvery.Load()); n > 1 && tick%n != 0 {
+				continue
+			}
+			if adaptive {
+				now := time.Now()
+				if now.Sub(time.Unix(0, s.inputAt.Load())) < inputActive {
+					idle.input()
+				} else if idle.skipTick(now) {
+					s.metrics.idleTicks.Inc()
+					continue
+				}
+			}
+
+			if !slots.tryAcquire() {
+				// No free buffer. Frames still sitting in the queues are
+				// superseded by the one we're about to grab: take them back.
+				// The buffer is free once no rendition holds it.
+				for i, raw := range raws {
+					select {
+					case old := <-raw:
+						carry[i] += old.dur
+						slots.put(old)
+					default:
+					}
+				}
+				st.dropped.Add(1)
+				s.metrics.dropped.Inc()
+				if !slots.tryAcquire() {
+					// An encoder still holds it; skip this tick.
+					continue
+				}
+			}
+		}
+
+		t0 := time.Now()
+		frame, err := cap.Grab()
+		if err != nil {
+			st.grabFails.Add(1)
+			s.metrics.grabFails.Inc()
+			slots.release(nil)
+			if paced {
+				// Don't spin on a capturer that fails without waiting.
+				earliest = time.Now().Add(frameDur)
+			}
+			continue
+		}
+		now := time.Now()
+		grabTime := now.Sub(t0)
+		st.lastGrab.Store(int64(grabTime))
+		s.metrics.grab.ObserveDuration(grabTime)
+		if s.snap.want.Load() {
+			s.snap.fill(copySnapshot(cap, frame))
+		}
+		if paced {
+			if lastGrab.IsZero() {
+				pendingDur += frameDur
+			} else {
+				pendingDur += now.Sub(lastGrab)
+			}
+			lastGrab = now
+		}
+
+		unchanged := frame.Unchanged
+		if adaptive {
+			unchanged = idle.observe(frame, now, frameDur)
+		}
+		refresh := unchanged && adaptive && idle.refreshDue(now)
+		if refresh {
+			s.metrics.refreshes.Inc()
+		} else if unchanged && now.Sub(lastQueued) < staticFrameInterval {
+			st.skipped.Add(1)
+			s.metrics.skipped.Inc()
+			slots.release(frame)
+			continue
+		}
+		lastQueued = now
+
+		if paced {
+			// On average one frame per interval, but a frame may come
+			// up to half an interval early, so a source whose refresh
+			// isn't a multiple of --fps isn't held back to a beat of
+			// the two rates.
+			interval := frameDur * time.Duration(max(grabEvery.Load(), 1))
+			earliest = maxTime(earliest.Add(interval), now.Add(interval/2))
+		}
+
+		ref := frameRefs.Get().(*frameRef)
+		ref.n.Store(int32(len(raws)))
+		for i, raw := range raws {
+			pushRaw(raw, rawFrame{frame: frame, dur: pendingDur + carry[i], ref: ref, refresh: refresh, at: now}, func(old rawFrame) {
+				st.dropped.Add(1)
+				s.metrics.dropped.Inc()
+				slots.put(old)
+			})
+			carry[i] = 0
+		}
+		pendingDur = 0
+	}
+}
+
+// parkCapture waits out a paused gate like gate.wait, grabbing a frame
+// for each snapshot requested in the meantime.
+func (s *Server) parkCapture(cap types.MediaCapturer, slots *frameSlots, gate *pauseGate, stop <-chan struct{}) (waited, ok bool) {
+	for {
+		w, woke, ok := gate.waitOrPoke(stop, s.snap.wake)
+		waited = waited || w
+		if !woke || !ok {
+			return waited, ok
+		}
+		if !s.snap.want.Load() {
+			continue // poked while running, and served since
+		}
+		if !slots.acquire(stop) {
+			return waited, false
+		}
+		frame, err := cap.Grab()
+		if err != nil {
+			slots.release(nil)
+			s.snap.fill(nil, fmt.Errorf("grab failed: %w", err))
+			continue
+		}
+		s.snap.fill(copySnapshot(cap, frame))
+		slots.release(frame)
+	}
+}
+
+// sourcePacing switches cap to source pacing if it supports it: Grab then
+// waits for the source (a blocking NvFBC grab, XDamage events, or the next
+// ScreenCaptureKit frame callback) instead of being polled on a ticker,
+// which saves up to a frame of latency and the beat between the ticker and
+// the display refresh. Reports whether it did.
+func sourcePacing(cap types.MediaCapturer, frameDur time.Duration) bool {
+	sp, ok := cap.(types.SourcePacer)
+	if !ok {
+		log.Printf("pipeline: capturer can't be paced by its source, using a %v ticker", frameDur)
+		return false
+	}
+	if err := sp.SetSourcePacing(sourceWaitTimeout); err != nil {
+		log.Printf("pipeline: source pacing: %v; using a %v ticker", err, frameDur)
+		return false
+	}
+	log.Printf("pipeline: capture paced by source, at most every %v", frameDur)
+	return true
+}
+
+func maxTime(a, b time.Time) time.Time {
+	if a.After(b) {
+		return a
+	}
+	return b
+}
+
+// pushRaw queues f, dropping the oldest queued frames if the queue is full.
+// A dropped frame's duration is folded into f. Only the capture stage pushes,
+// so the loop terminates as soon as the encoder or a drop makes room.
+func pushRaw(raw chan rawFrame, f rawFrame, drop func(rawFrame)) {
+	for {
+		select {
+		case raw <- f:
+			return
+		default:
+		}
+		select {
+		case old := <-raw:
+			f.dur += old.dur
+			f.refresh = f.refresh || old.refresh
+			drop(old)
+		default:
+		}
+	}
+}
+
+// encodeStage encodes one rendition's queued frames and hands them to its
+// send stage. When the capture size changes (a mode set on the captured
+// display) the encoder is reopened in place at the new size; the track and
+// its sessions stay up and the first frame at the new size is an IDR.
+func encodeStage(r *rendition, slots *frameSlots, raw chan rawFrame, encoded chan sendFrame, st *pipelineStats, stop <-chan struct{}) {
+	var carryDur time.Duration // duration of frames that produced no output
+	var srcW, srcH int         // capture size the encoder is set up for
+	enc, kf, m := r.enc, &r.keyframes, r.metrics
+	kr, _ := enc.(types.KeyframeRequester)
+	ct, _ := enc.(types.ConvertTimer)
+	rz, _ := enc.(types.Resizer)
+	rr, _ := enc.(types.Refresher)
+
+	for {
+		var rf rawFrame
+		select {
+		case <-stop:
+			return
+		case rf = <-raw:
+		}
+
+		if f := rf.frame; f.Width != srcW || f.Height != srcH {
+			resize(r, rz, f.Width, f.Height)
+			srcW, srcH = f.Width, f.Height
+		}
+
+		t1 := time.Now()
+		if kr != nil && kf.take(t1) {
+			kr.RequestKeyframe()
+			st.keyframes.Add(1)
+			m.forcedIDRs.Inc()
+		}
+		if rr != nil && rf.refresh {
+			rr.RequestRefresh()
+		}
+		out, err := enc.Encode(rf.frame)
+		// Encoders copy, convert or retain the input before returning, so the
+		// capture buffer is free again once every rendition is done.
+		slots.put(rf)
+		if err != nil {
+			m.encodeFails.Inc()
+			if st.encodeFails.Add(1) <= 5 {
+				log.Printf("encode error: %v", err)
+			}
+			carryDur += rf.dur
+			continue
+		}
+		encodeTime := time.Since(t1)
+		st.lastEncode.Store(int64(encodeTime))
+		m.encode.ObserveDuration(encodeTime)
+		if ct != nil {
+			m.convert.ObserveDuration(ct.ConvertTime())
+		}
+
+		if out == nil {
+			st.encodeNils.Add(1)
+			carryDur += rf.dur
+			continue
+		}
+		m.frameBytes.Observe(float64(len(out.Data)))
+		if out.IsKey {
+			kf.sent(t1)
+			m.keyBytes.Observe(float64(len(out.Data)))
+		}
+
+		select {
+		case encoded <- sendFrame{pkt: out, dur: rf.dur + carryDur, at: rf.at}:
+			carryDur = 0
+		case <-stop:
+			return
+		}
+	}
+}
+
+// resize reopens a rendition's encoder for a w x h capture, if that
+// changes its encode size.
+func resize(r *rendition, rz types.Resizer, w, h int) {
+	ew, eh := renditionSize(w, h, r.scale)
+	if ew == r.width && eh == r.height {
+		return
+	}
+	if rz == nil {
+		log.Printf("pipeline: capture is now %dx%d but the %s encoder cannot resize", w, h, r.name)
+		return
+	}
+	if err := rz.Resize(ew, eh); err != nil {
+		log.Printf("pipeline: %s rendition: %v", r.name, err)
+		return
+	}
+	r.width, r.height = ew, eh
+	r.metrics.resizes.Inc()
+	log.Printf("pipeline: capture is now %dx%d, %s rendition encodes %dx%d", w, h, r.name, ew, eh)
+}
+
+// sendStage writes encoded frames to a rendition's shared video track,
+// with their capture time when stamp is set.
+func sendStage(r *rendition, encoded chan sendFrame, stamp *captureStamp, st *pipelineStats, stop <-chan struct{}) {
+	for {
+		var sf sendFrame
+		select {
+		case <-stop:
+			return
+		case sf = <-encoded:
+		}
+
+		t2 := time.Now()
+		// WriteSample broadcasts to all bound PeerConnections.
+		// Ignore errors — they occur when no PCs are bound yet.
+		r.track.WriteSample(media.Sample{
+			Data:     stamp.apply(sf.pkt.Data, sf.at),
+			Duration: sf.dur,
+		})
+		// The packetizer copies payloads into its RTP packets, so the
+		// buffer can go back to the encoder's pool.
+		sf.pkt.Release()
+		sendTime := time.Since(t2)
+		st.lastSend.Store(int64(sendTime))
+		r.metrics.send.ObserveDuration(sendTime)
+	}
+}
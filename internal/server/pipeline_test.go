@@ -0,0 +1,54 @@
+//go:build !race
+
+// The race detector makes sync.Pool drop items at random.
+
+package server
+
+import (
+	"testing"
+
+	"bunghole/internal/types"
+)
+
+// pooledCapturer hands out frames from a fixed set of buffers.
+type pooledCapturer struct {
+	frames []types.Frame
+	next   int
+}
+
+func (c *pooledCapturer) Width() int  { return 64 }
+func (c *pooledCapturer) Height() int { return 64 }
+func (c *pooledCapturer) Close()      {}
+
+func (c *pooledCapturer) Grab() (*types.Frame, error) {
+	f := &c.frames[c.next%len(c.frames)]
+	c.next++
+	return f, nil
+}
+
+func (c *pooledCapturer) FrameBuffers() int           { return len(c.frames) }
+func (c *pooledCapturer) ReleaseFrame(f *types.Frame) {}
+
+// TestFrameCycleAllocs runs a captured frame through the hand-off between
+// capture and three rendition encoders, which must not allocate per frame.
+func TestFrameCycleAllocs(t *testing.T) {
+	cap := &pooledCapturer{frames: make([]types.Frame, 3)}
+	slots := newFrameSlots(cap)
+	stop := make(chan struct{})
+	const renditions = 3
+
+	if n := testing.AllocsPerRun(1000, func() {
+		if !slots.acquire(stop) {
+			t.Fatal("no free slot")
+		}
+		frame, _ := cap.Grab()
+		ref := frameRefs.Get().(*frameRef)
+		ref.n.Store(renditions)
+		rf := rawFrame{frame: frame, ref: ref}
+		for i := 0; i < renditions; i++ {
+			slots.put(rf)
+		}
+	}); n != 0 {
+		t.Errorf("frame cycle: %v allocs per frame, want 0", n)
+	}
+}
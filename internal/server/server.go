@@ -3,8 +3,9 @@ package server
 import (
 	"context"
 	"crypto/tls"
+	"encoding/json"
+	"errors"
 	"fmt"
-	"image/png"
 	"io"
 	"log"
 	"net"
@@ -13,17 +14,16 @@ import (
 	"runtime"
 	"strings"
 	"sync"
+	"sync/atomic"
 	"time"
 	"unsafe"
 
-	"bunghole/internal/audio"
 	"bunghole/internal/session"
 	"bunghole/internal/types"
 	"bunghole/web"
 
 	"github.com/google/uuid"
 	"github.com/pion/webrtc/v4"
-	"github.com/pion/webrtc/v4/pkg/media"
 )
 
 // CapturerFactory creates a screen capturer for the given display.
@@ -34,6 +34,7 @@ type EncoderFactory func(width, height, fps, bitrateKbps, gpu int, codec string,
 
 // Config holds all server configuration.
 type Config struct {
+	Name           string // desktop name when serving several (see ServeDesktops)
 	Display        string
 	Token          string
 	FPS            int
@@ -43,9 +44,22 @@ type Config struct {
 	GOP            int
 	Addr           string
 	Stats          bool
+	ABR            string // "controller", "slowest" or "off"
+	MinBitrate     int    // kbps floor for ABR
+	Ladder         int    // renditions to encode for viewers (1 = full resolution only)
+	Pacing         string // "tick" (fixed --fps ticker) or "source" (capturer's own frame clock)
+	AdaptiveFPS    bool   // slow capture on a static screen and send a refresh frame (see idleState)
+	CaptureTimes   bool   // send frame capture times in SEI for glass-to-glass latency (see captureStamp)
 	AudioUDPListen string
+	AudioServer    string          // Linux: PulseAudio server to record ("" = default)
 	VsockAudioCh   <-chan net.Conn // macOS VM: vsock audio connections from guest
 
+	// Idle pipeline: paused but kept allocated for Linger after the last
+	// session leaves, or for good with Prewarm (which also starts it at
+	// launch).
+	Linger  time.Duration
+	Prewarm bool
+
 	OfferTimeout   time.Duration
 	AllowedOrigins []string
 	AuthFailLimit  int
@@ -59,24 +73,44 @@ type Config struct {
 	NewEncoder   EncoderFactory
 	InputFactory session.InputHandlerFactory
 	ClipFactory  session.ClipboardHandlerFactory
+
+	// NewHostCapturer opens a capturer with frames in host memory. It is
+	// used when NewCapturer's device frames find no encoder (see
+	// types.ErrNoDeviceEncoder); nil where capture never uses the GPU.
+	NewHostCapturer CapturerFactory
+
+	// NewCursorSource is set when the cursor is sent over the "cursor"
+	// data channel instead of being composited into frames.
+	NewCursorSource CursorSourceFactory
 }
 
 type Server struct {
 	cfg         Config
 	guestConfig []byte
+	prefix      string // URL path the desktop is served under ("" = root)
+	logPrefix   string
 
 	mu sync.Mutex
 
-	// Shared tracks (owned by server, broadcast to all PCs)
-	videoTrack *webrtc.TrackLocalStaticSample
+	// Shared tracks (owned by server, broadcast to all PCs). Video has one
+	// track per rendition; renditions[0] is full resolution.
+	renditions []*rendition
 	audioTrack *webrtc.TrackLocalStaticSample
 
 	// Pipeline resources
 	capturer types.MediaCapturer
-	encoder  types.VideoEncoder
 	audio    types.AudioCapturer
 	pipeStop chan struct{}  // closed to stop pipeline goroutine
 	pipeWg   sync.WaitGroup // waited before starting a new pipeline
+	pipeGate *pauseGate     // pauses capture while no session is connected
+
+	lingerTimer  *time.Timer // stops an idle pipeline after cfg.Linger
+	thumbStreams int         // open /debug/thumbnail streams, which keep the pipeline warm
+
+	cursors *cursorHub
+	snap    *snapshotTap
+	metrics *serverMetrics
+	inputAt atomic.Int64 // unix ns of the controller's last input flush
 
 	// Sessions
 	ctrl    *session.Session            // at most one controller
@@ -114,60 +148,135 @@ func New(cfg Config) *Server {
 	if err != nil {
 		log.Fatalf("failed to read guest config %s: %v", configFile, err)
 	}
+	if cfg.CaptureTimes {
+		// Tell the client to read capture times from the encoded frames.
+		var gc map[string]any
+		if err := json.Unmarshal(guestConfig, &gc); err != nil {
+			log.Fatalf("failed to parse guest config %s: %v", configFile, err)
+		}
+		gc["captureTimestamps"] = true
+		guestConfig, _ = json.Marshal(gc)
+	}
 
-	return &Server{
+	s := &Server{
 		cfg:         cfg,
 		guestConfig: guestConfig,
 		viewers:     make(map[string]*session.Session),
 		authFails:   make(map[string]authWindow),
+		cursors:     newCursorHub(),
+		snap:        newSnapshotTap(),
 	}
+	if cfg.Name != "" {
+		s.logPrefix = "desktop " + cfg.Name + ": "
+	}
+	s.metrics = s.newMetrics()
+	return s
 }
 
+// ListenAndServe serves s at the root of cfg.Addr.
 func (s *Server) ListenAndServe() error {
-	mux := http.NewServeMux()
-	mux.HandleFunc("GET /", s.handleIndex)
-	mux.HandleFunc("GET /config", s.handleConfig)
-
-	// Controller endpoints
-	mux.HandleFunc("POST /whep", s.handleWHEPOffer)
-	mux.HandleFunc("PATCH /whep/{id}", s.handleWHEPPatch)
-	mux.HandleFunc("DELETE /whep/{id}", s.handleWHEPDelete)
-	mux.HandleFunc("OPTIONS /whep", s.handleWHEPOptions)
-	mux.HandleFunc("OPTIONS /whep/{id}", s.handleWHEPOptions)
-
-	// Viewer endpoints
-	mux.HandleFunc("POST /whep/view", s.handleViewerOffer)
-	mux.HandleFunc("PATCH /whep/view/{id}", s.handleViewerPatch)
-	mux.HandleFunc("DELETE /whep/view/{id}", s.handleViewerDelete)
-	mux.HandleFunc("OPTIONS /whep/view", s.handleWHEPOptions)
-	mux.HandleFunc("OPTIONS /whep/view/{id}", s.handleWHEPOptions)
+	return ServeDesktops([]*Server{s}, nil)
+}
 
-	mux.HandleFunc("GET /debug/frame", s.handleDebugFrame)
+// ServeDesktops serves several desktops from one HTTP server. Each one's
+// web client and endpoints live under /d/{name}/, and / redirects to the
+// first. A single unnamed desktop is served at the root instead. With a
+// Spawner, desktops it starts are served under /d/{name}/ as well and
+// desktops may be empty. The listen address and TLS settings are taken
+// from the first desktop's Config, or the Spawner's.
+func ServeDesktops(desktops []*Server, sp *Spawner) error {
+	mux := http.NewServeMux()
+	var cfg Config
+	var what string
+	if len(desktops) == 1 && desktops[0].cfg.Name == "" && sp == nil {
+		cfg = desktops[0].cfg
+		desktops[0].routes(mux, "")
+		what = "display " + cfg.Display
+	} else {
+		var names []string
+		for _, s := range desktops {
+			s.routes(mux, "/d/"+s.cfg.Name)
+			names = append(names, s.cfg.Name+"="+s.cfg.Display)
+		}
+		if len(desktops) > 0 {
+			cfg = desktops[0].cfg
+			home := "/d/" + cfg.Name + "/"
+			mux.HandleFunc("GET /{$}", func(w http.ResponseWriter, r *http.Request) {
+				// Keep client options such as ?lowlatency.
+				target := home
+				if r.URL.RawQuery != "" {
+					target += "?" + r.URL.RawQuery
+				}
+				http.Redirect(w, r, target, http.StatusFound)
+			})
+			what = "desktops " + strings.Join(names, ", ")
+		}
+		if sp != nil {
+			sp.routes(mux, desktops)
+			if len(desktops) == 0 {
+				cfg = sp.auth.cfg
+				what = "desktops on demand"
+			} else {
+				what += " and more on demand"
+			}
+		}
+	}
 
 	srv := &http.Server{
-		Addr:    s.cfg.Addr,
+		Addr:    cfg.Addr,
 		Handler: mux,
 	}
 
+	for _, s := range desktops {
+		if s.cfg.Prewarm {
+			s.Prewarm()
+		}
+	}
+
 	switch {
-	case s.cfg.TLSCert != "" && s.cfg.TLSKey != "":
-		log.Printf("starting bunghole on %s (HTTPS, user-provided cert, display %s, %d fps, %d kbps, codec %s)",
-			s.cfg.Addr, s.cfg.Display, s.cfg.FPS, s.cfg.Bitrate, s.cfg.Codec)
-		return srv.ListenAndServeTLS(s.cfg.TLSCert, s.cfg.TLSKey)
-
-	case s.cfg.TLS != nil:
-		srv.TLSConfig = s.cfg.TLS
-		log.Printf("starting bunghole on %s (HTTPS, self-signed cert, display %s, %d fps, %d kbps, codec %s)",
-			s.cfg.Addr, s.cfg.Display, s.cfg.FPS, s.cfg.Bitrate, s.cfg.Codec)
+	case cfg.TLSCert != "" && cfg.TLSKey != "":
+		log.Printf("starting bunghole on %s (HTTPS, user-provided cert, %s, %d fps, %d kbps, codec %s)",
+			cfg.Addr, what, cfg.FPS, cfg.Bitrate, cfg.Codec)
+		return srv.ListenAndServeTLS(cfg.TLSCert, cfg.TLSKey)
+
+	case cfg.TLS != nil:
+		srv.TLSConfig = cfg.TLS
+		log.Printf("starting bunghole on %s (HTTPS, self-signed cert, %s, %d fps, %d kbps, codec %s)",
+			cfg.Addr, what, cfg.FPS, cfg.Bitrate, cfg.Codec)
 		return srv.ListenAndServeTLS("", "")
 
 	default:
-		log.Printf("starting bunghole on %s (HTTP, display %s, %d fps, %d kbps, codec %s)",
-			s.cfg.Addr, s.cfg.Display, s.cfg.FPS, s.cfg.Bitrate, s.cfg.Codec)
+		log.Printf("starting bunghole on %s (HTTP, %s, %d fps, %d kbps, codec %s)",
+			cfg.Addr, what, cfg.FPS, cfg.Bitrate, cfg.Codec)
 		return srv.ListenAndServe()
 	}
 }
 
+// routes registers s's endpoints on mux under prefix.
+func (s *Server) routes(mux *http.ServeMux, prefix string) {
+	s.prefix = prefix
+	mux.Handle("GET "+prefix+"/", http.StripPrefix(prefix, http.HandlerFunc(s.handleIndex)))
+	mux.HandleFunc("GET "+prefix+"/config", s.handleConfig)
+
+	// Controller endpoints
+	mux.HandleFunc("POST "+prefix+"/whep", s.handleWHEPOffer)
+	mux.HandleFunc("PATCH "+prefix+"/whep/{id}", s.handleWHEPPatch)
+	mux.HandleFunc("DELETE "+prefix+"/whep/{id}", s.handleWHEPDelete)
+	mux.HandleFunc("OPTIONS "+prefix+"/whep", s.handleWHEPOptions)
+	mux.HandleFunc("OPTIONS "+prefix+"/whep/{id}", s.handleWHEPOptions)
+
+	// Viewer endpoints
+	mux.HandleFunc("POST "+prefix+"/whep/view", s.handleViewerOffer)
+	mux.HandleFunc("PATCH "+prefix+"/whep/view/{id}", s.handleViewerPatch)
+	mux.HandleFunc("DELETE "+prefix+"/whep/view/{id}", s.handleViewerDelete)
+	mux.HandleFunc("OPTIONS "+prefix+"/whep/view", s.handleWHEPOptions)
+	mux.HandleFunc("OPTIONS "+prefix+"/whep/view/{id}", s.handleWHEPOptions)
+
+	mux.HandleFunc("GET "+prefix+"/debug/frame", s.handleDebugFrame)
+	mux.HandleFunc("GET "+prefix+"/debug/thumbnail", s.handleThumbnail)
+	mux.HandleFunc("GET "+prefix+"/metrics", s.handleMetrics)
+}
+
 // Teardown shuts down all sessions and releases resources.
 func (s *Server) Teardown() {
 	s.mu.Lock()
@@ -245,14 +354,19 @@ func (s *Server) handleWHEPOffer(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
-	videoTrack := s.videoTrack
+	rends := s.renditions
 	audioTrack := s.audioTrack
 	s.mu.Unlock()
 
+	var cursorSub session.CursorSubscribeFunc
+	if s.cfg.NewCursorSource != nil {
+		cursorSub = s.cursors.subscribe
+	}
+
 	sessionID := uuid.New().String()
 	sess, err := session.NewSession(sessionID, s.cfg.Display, s.cfg.Codec,
-		videoTrack, audioTrack,
-		s.cfg.InputFactory, s.cfg.ClipFactory)
+		rends[0].track, audioTrack, s.feedback(rends),
+		s.cfg.InputFactory, s.cfg.ClipFactory, cursorSub)
 	if err != nil {
 		log.Printf("session create error: %v", err)
 		http.Error(w, "internal error", 500)
@@ -301,7 +415,7 @@ func (s *Server) handleWHEPOffer(w http.ResponseWriter, r *http.Request) {
 	go s.watchSession(sess, true)
 
 	w.Header().Set("Content-Type", "application/sdp")
-	w.Header().Set("Location", fmt.Sprintf("/whep/%s", sessionID))
+	w.Header().Set("Location", fmt.Sprintf("%s/whep/%s", s.prefix, sessionID))
 	w.WriteHeader(201)
 	w.Write([]byte(sess.PC.LocalDescription().SDP))
 }
@@ -386,12 +500,14 @@ func (s *Server) handleViewerOffer(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
-	videoTrack := s.videoTrack
+	rends := s.renditions
 	audioTrack := s.audioTrack
 	s.mu.Unlock()
 
+	// Viewers start on full resolution; the ladder stage moves them once
+	// their bandwidth estimate settles.
 	sessionID := uuid.New().String()
-	sess, err := session.NewViewerSession(sessionID, s.cfg.Codec, videoTrack, audioTrack)
+	sess, err := session.NewViewerSession(sessionID, s.cfg.Codec, rends[0].track, audioTrack, s.feedback(rends))
 	if err != nil {
 		log.Printf("viewer session create error: %v", err)
 		http.Error(w, "internal error", 500)
@@ -439,7 +555,7 @@ func (s *Server) handleViewerOffer(w http.ResponseWriter, r *http.Request) {
 	go s.watchSession(sess, false)
 
 	w.Header().Set("Content-Type", "application/sdp")
-	w.Header().Set("Location", fmt.Sprintf("/whep/view/%s", sessionID))
+	w.Header().Set("Location", fmt.Sprintf("%s/whep/view/%s", s.prefix, sessionID))
 	w.WriteHeader(201)
 	w.Write([]byte(sess.PC.LocalDescription().SDP))
 }
@@ -642,7 +758,8 @@ func (s *Server) watchSession(sess *session.Session, isController bool) {
 // Must be called with s.mu held.
 func (s *Server) ensurePipelineLocked() error {
 	if s.pipeStop != nil {
-		return nil // already running
+		s.wakePipelineLocked() // already running, maybe idle
+		return nil
 	}
 
 	// Wait for any previous pipeline goroutine to finish cleanup
@@ -652,6 +769,7 @@ func (s *Server) ensurePipelineLocked() error {
 
 	// Re-check after re-acquiring lock
 	if s.pipeStop != nil {
+		s.wakePipelineLocked()
 		return nil
 	}
 
@@ -666,76 +784,67 @@ func (s *Server) ensurePipelineLocked() error {
 		cuMemcpy2D = cp.CuMemcpy2D()
 	}
 
-	enc, err := s.cfg.NewEncoder(cap.Width(), cap.Height(), s.cfg.FPS, s.cfg.Bitrate,
-		s.cfg.GPU, s.cfg.Codec, s.cfg.GOP, cudaCtx, cuMemcpy2D)
-	if err != nil {
+	// Encoders and shared video tracks, one per rendition
+	rends, err := s.newLadder(cap, cudaCtx, cuMemcpy2D)
+	if errors.Is(err, types.ErrNoDeviceEncoder) && s.cfg.NewHostCapturer != nil {
+		log.Printf("%s%v; capturing into host memory instead", s.logPrefix, err)
 		cap.Close()
-		return fmt.Errorf("encoder init: %w", err)
-	}
-
-	// Create shared tracks
-	var videoMimeType, videoFmtp string
-	if s.cfg.Codec == "h265" {
-		videoMimeType = webrtc.MimeTypeH265
-		videoFmtp = "profile-id=1"
-	} else {
-		videoMimeType = webrtc.MimeTypeH264
-		videoFmtp = "level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42001f"
+		if cap, err = s.cfg.NewHostCapturer(s.cfg.Display, s.cfg.FPS, s.cfg.GPU); err != nil {
+			return fmt.Errorf("capturer init: %w", err)
+		}
+		rends, err = s.newLadder(cap, nil, nil)
 	}
-
-	videoTrack, err := webrtc.NewTrackLocalStaticSample(
-		webrtc.RTPCodecCapability{
-			MimeType:    videoMimeType,
-			ClockRate:   90000,
-			SDPFmtpLine: videoFmtp,
-		},
-		"video", "bunghole",
-	)
 	if err != nil {
-		enc.Close()
 		cap.Close()
-		return fmt.Errorf("create video track: %w", err)
+		return err
 	}
 
 	audioTrack, err := webrtc.NewTrackLocalStaticSample(
 		webrtc.RTPCodecCapability{
-			MimeType:  webrtc.MimeTypeOpus,
-			ClockRate: 48000,
-			Channels:  2,
+			MimeType:    webrtc.MimeTypeOpus,
+			ClockRate:   48000,
+			Channels:    2,
+			SDPFmtpLine: session.OpusFmtp,
 		},
 		"audio", "bunghole",
 	)
 	if err != nil {
-		enc.Close()
+		for _, r := range rends {
+			r.enc.Close()
+		}
 		cap.Close()
 		return fmt.Errorf("create audio track: %w", err)
 	}
 
 	s.capturer = cap
-	s.encoder = enc
-	s.videoTrack = videoTrack
+	s.renditions = rends
 	s.audioTrack = audioTrack
 	s.pipeStop = make(chan struct{})
+	s.pipeGate = &pauseGate{}
 
 	s.pipeWg.Add(1)
-	go s.runPipeline(cap, enc, videoTrack, audioTrack, s.pipeStop)
+	go s.runPipeline(cap, rends, audioTrack, s.pipeGate, s.pipeStop)
 
-	log.Printf("pipeline started (%dx%d, %s)", cap.Width(), cap.Height(), s.cfg.Codec)
+	log.Printf("%spipeline started (%dx%d, %s, %d rendition(s))", s.logPrefix, cap.Width(), cap.Height(), s.cfg.Codec, len(rends))
 	return nil
 }
 
-// maybeStopPipelineLocked stops the pipeline if no sessions remain.
+// maybeStopPipelineLocked idles the pipeline if no sessions remain.
 // Must be called with s.mu held.
 func (s *Server) maybeStopPipelineLocked() {
 	if s.ctrl != nil || len(s.viewers) > 0 {
 		return
 	}
-	s.stopPipelineLocked()
+	s.idlePipelineLocked()
 }
 
 // stopPipelineLocked signals the pipeline to stop.
 // Must be called with s.mu held.
 func (s *Server) stopPipelineLocked() {
+	if s.lingerTimer != nil {
+		s.lingerTimer.Stop()
+		s.lingerTimer = nil
+	}
 	if s.pipeStop == nil {
 		return
 	}
@@ -744,179 +853,6 @@ func (s *Server) stopPipelineLocked() {
 	// Cleanup happens in runPipeline's defer
 }
 
-// runPipeline is the capture/encode loop. It writes to shared tracks and
-// stops when pipeStop is closed. Cleanup of cap/enc/audio is done in defer.
-func (s *Server) runPipeline(cap types.MediaCapturer, enc types.VideoEncoder, videoTrack, audioTrack *webrtc.TrackLocalStaticSample, stop chan struct{}) {
-	defer s.pipeWg.Done()
-	defer func() {
-		s.mu.Lock()
-		// Only nil out if these are still our resources
-		if s.capturer == cap {
-			s.capturer = nil
-		}
-		if s.encoder == enc {
-			s.encoder = nil
-		}
-		if s.audio != nil {
-			s.audio.Close()
-			s.audio = nil
-		}
-		if s.videoTrack == videoTrack {
-			s.videoTrack = nil
-		}
-		if s.audioTrack == audioTrack {
-			s.audioTrack = nil
-		}
-		s.mu.Unlock()
-
-		// Close encoder before capturer (encoder uses CUDA context owned by capturer)
-		enc.Close()
-		cap.Close()
-		log.Printf("pipeline stopped")
-	}()
-
-	// Start audio capture (non-fatal if it fails)
-	var (
-		ac  types.AudioCapturer
-		err error
-	)
-	if s.cfg.AudioUDPListen != "" {
-		ac, err = audio.NewUDPAudioCapture(s.cfg.AudioUDPListen)
-		if err == nil {
-			log.Printf("audio: source=guest-udp listen=%s", s.cfg.AudioUDPListen)
-		}
-	} else if s.cfg.VsockAudioCh != nil {
-		// Vsock first when available (VM mode) — the guest HAL driver
-		// sends Opus directly over vsock, no host-side SCK needed.
-		ac = audio.NewVsockAudioCapture(s.cfg.VsockAudioCh)
-		log.Printf("audio: source=guest-vsock")
-		err = nil
-	} else {
-		// Host desktop mode — capture via ScreenCaptureKit.
-		ac, err = audio.NewAudioCapture()
-	}
-	if err != nil {
-		log.Printf("audio capture init failed (continuing without audio): %v", err)
-	} else {
-		s.mu.Lock()
-		s.audio = ac
-		s.mu.Unlock()
-
-		audioPkts := make(chan *types.OpusPacket, 10)
-		go ac.Run(audioPkts, stop)
-		go func() {
-			for {
-				select {
-				case <-stop:
-					return
-				case pkt := <-audioPkts:
-					audioTrack.WriteSample(media.Sample{
-						Data:     pkt.Data,
-						Duration: pkt.Duration,
-					})
-				}
-			}
-		}()
-	}
-
-	frameDur := time.Duration(float64(time.Second) / float64(s.cfg.FPS))
-	ticker := time.NewTicker(frameDur)
-	defer ticker.Stop()
-
-	var loopCount, grabFails, encodeFails, encodeNils int
-	lastStats := time.Now()
-
-	for {
-		select {
-		case <-stop:
-			return
-		case <-ticker.C:
-			loopCount++
-			t0 := time.Now()
-
-			frame, err := cap.Grab()
-			if err != nil {
-				grabFails++
-				continue
-			}
-			tGrab := time.Since(t0)
-
-			t1 := time.Now()
-			encoded, err := enc.Encode(frame)
-			if err != nil {
-				encodeFails++
-				if encodeFails <= 5 {
-					log.Printf("encode error: %v", err)
-				}
-				continue
-			}
-			tEncode := time.Since(t1)
-
-			if encoded == nil {
-				encodeNils++
-				continue
-			}
-
-			t2 := time.Now()
-			// WriteSample broadcasts to all bound PeerConnections.
-			// Ignore errors — they occur when no PCs are bound yet.
-			videoTrack.WriteSample(media.Sample{
-				Data:     encoded.Data,
-				Duration: frameDur,
-			})
-			tSend := time.Since(t2)
-
-			if s.cfg.Stats && time.Since(lastStats) >= 5*time.Second {
-				log.Printf("pipeline: loops=%d grabFail=%d encFail=%d encNil=%d | last: grab=%v enc=%v send=%v",
-					loopCount, grabFails, encodeFails, encodeNils,
-					tGrab.Round(time.Microsecond), tEncode.Round(time.Microsecond), tSend.Round(time.Microsecond))
-				loopCount = 0
-				grabFails = 0
-				encodeFails = 0
-				encodeNils = 0
-				lastStats = time.Now()
-			}
-		}
-	}
-}
-
-func (s *Server) handleDebugFrame(w http.ResponseWriter, r *http.Request) {
-	if !s.checkAuth(w, r) {
-		return
-	}
-
-	s.mu.Lock()
-	cap := s.capturer
-	s.mu.Unlock()
-
-	var tempCap types.MediaCapturer
-	if cap == nil {
-		var err error
-		tempCap, err = s.cfg.NewCapturer(s.cfg.Display, 1, s.cfg.GPU)
-		if err != nil {
-			http.Error(w, fmt.Sprintf("capturer init: %v", err), 500)
-			return
-		}
-		defer tempCap.Close()
-		cap = tempCap
-	}
-
-	grabber, ok := cap.(types.DebugGrabber)
-	if !ok {
-		http.Error(w, "capturer does not support debug grab", 500)
-		return
-	}
-
-	img, err := grabber.GrabImage()
-	if err != nil {
-		http.Error(w, fmt.Sprintf("grab failed: %v", err), 500)
-		return
-	}
-
-	w.Header().Set("Content-Type", "image/png")
-	png.Encode(w, img)
-}
-
 func (s *Server) teardownLocked() {
 	if s.ctrl != nil {
 		s.ctrl.Close()
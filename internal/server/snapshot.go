@@ -0,0 +1,458 @@
+package server
+
+import (
+	"bytes"
+	"context"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"image"
+	"image/jpeg"
+	"image/png"
+	"log"
+	"net/http"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+	"unsafe"
+
+	"bunghole/internal/types"
+)
+
+const (
+	// snapshotReuse lets requests that arrive within this long of a
+	// capture share it, so dashboards polling /debug/frame and thumbnail
+	// streams cost one frame copy per interval between them.
+	snapshotReuse = 200 * time.Millisecond
+	// snapshotTimeout bounds the wait for the pipeline to serve a snapshot.
+	snapshotTimeout = 2 * time.Second
+
+	maxThumbnailFPS = 5
+)
+
+var errNoSnapshot = errors.New("timed out waiting for a frame")
+
+// snapshotFrame is a host copy of one captured frame, BGRA or NV12 (with
+// the chroma plane after the luma plane, at the same stride). It is not
+// modified once published.
+type snapshotFrame struct {
+	data          []byte
+	width, height int
+	stride        int
+	pixFmt        int
+	at            time.Time
+}
+
+// copySnapshot copies f to host memory. It runs on the goroutine that
+// grabbed f, before f is released; cap downloads frames in device memory.
+func copySnapshot(cap types.MediaCapturer, f *types.Frame) (*snapshotFrame, error) {
+	sf := &snapshotFrame{width: f.Width, height: f.Height, stride: f.Stride, pixFmt: f.PixFmt, at: time.Now()}
+	size := f.Stride * f.Height
+	if f.PixFmt == types.PixFmtNV12 {
+		size += size / 2
+	}
+	switch {
+	case f.IsCUDA || f.IsPixelBuffer:
+		dl, ok := cap.(types.FrameDownloader)
+		if !ok {
+			return nil, errors.New("capturer can't download device frames")
+		}
+		data, err := dl.DownloadFrame(f)
+		if err != nil {
+			return nil, err
+		}
+		sf.data = data
+	case f.Data != nil:
+		sf.data = bytes.Clone(f.Data)
+	default:
+		sf.data = make([]byte, size)
+		copy(sf.data, unsafe.Slice((*byte)(f.Ptr), size))
+	}
+	return sf, nil
+}
+
+// snapshotWait is one round of snapshot requests, served by a single copy.
+type snapshotWait struct {
+	done  chan struct{}
+	frame *snapshotFrame
+	err   error
+}
+
+// snapshotTap hands copies of pipeline frames to /debug/frame and the
+// thumbnail streams, so they don't open a capturer of their own while a
+// pipeline exists. The capture stage copies its next grab when want is
+// set; while paused it is poked through wake and grabs one just for the
+// tap. It outlives individual pipelines.
+type snapshotTap struct {
+	want atomic.Bool
+	wake chan struct{}
+
+	mu      sync.Mutex
+	last    *snapshotFrame
+	pending *snapshotWait
+}
+
+func newSnapshotTap() *snapshotTap {
+	return &snapshotTap{wake: make(chan struct{}, 1)}
+}
+
+// get returns the last copy if it is recent enough, or waits for the
+// capture stage to make one.
+func (t *snapshotTap) get(ctx context.Context) (*snapshotFrame, error) {
+	t.mu.Lock()
+	if t.last != nil && time.Since(t.last.at) < snapshotReuse {
+		f := t.last
+		t.mu.Unlock()
+		return f, nil
+	}
+	if t.pending == nil {
+		t.pending = &snapshotWait{done: make(chan struct{})}
+	}
+	w := t.pending
+	t.want.Store(true)
+	select {
+	case t.wake <- struct{}{}:
+	default:
+	}
+	t.mu.Unlock()
+
+	timer := time.NewTimer(snapshotTimeout)
+	defer timer.Stop()
+	select {
+	case <-w.done:
+		return w.frame, w.err
+	case <-timer.C:
+		return nil, errNoSnapshot
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	}
+}
+
+// fill serves the pending requests with f, or fails them with err.
+// Called by the capture stage, so its arguments can come straight from
+// copySnapshot.
+func (t *snapshotTap) fill(f *snapshotFrame, err error) {
+	t.mu.Lock()
+	w := t.pending
+	t.pending = nil
+	t.want.Store(false)
+	if err == nil {
+		t.last = f
+	}
+	select {
+	case <-t.wake:
+	default:
+	}
+	t.mu.Unlock()
+
+	if err != nil {
+		log.Printf("snapshot: %v", err)
+	}
+	if w != nil {
+		w.frame, w.err = f, err
+		close(w.done)
+	}
+}
+
+// snapshot returns a recent frame: from the pipeline if there is one,
+// running or warm, otherwise from a capturer opened just for it.
+func (s *Server) snapshot(ctx context.Context) (*snapshotFrame, error) {
+	s.mu.Lock()
+	running := s.pipeStop != nil
+	s.mu.Unlock()
+	if running {
+		return s.snap.get(ctx)
+	}
+
+	cap, err := s.cfg.NewCapturer(s.cfg.Display, 1, s.cfg.GPU)
+	if err != nil {
+		return nil, fmt.Errorf("capturer init: %w", err)
+	}
+	defer cap.Close()
+
+	// A capturer that has just started may not have a frame yet.
+	deadline := time.Now().Add(snapshotTimeout)
+	for {
+		frame, err := cap.Grab()
+		if err == nil {
+			if r, ok := cap.(types.FrameReleaser); ok {
+				defer r.ReleaseFrame(frame)
+			}
+			return copySnapshot(cap, frame)
+		}
+		if time.Now().After(deadline) {
+			return nil, fmt.Errorf("grab failed: %w", err)
+		}
+		select {
+		case <-ctx.Done():
+			return nil, ctx.Err()
+		case <-time.After(50 * time.Millisecond):
+		}
+	}
+}
+
+// image converts f to opaque RGBA, shrunk by scale (0 < scale <= 1) with
+// a box filter.
+func (f *snapshotFrame) image(scale float64) *image.RGBA {
+	w := max(int(float64(f.width)*scale+0.5), 1)
+	h := max(int(float64(f.height)*scale+0.5), 1)
+	full := w >= f.width && h >= f.height
+
+	if f.pixFmt == types.PixFmtNV12 {
+		img := nv12ToRGBA(f.data, f.width, f.height, f.stride)
+		if full {
+			return img
+		}
+		return boxShrink(img.Pix, img.Stride, f.width, f.height, w, h, 0, 2)
+	}
+	if full {
+		return bgraToRGBA(f.data, f.width, f.height, f.stride)
+	}
+	return boxShrink(f.data, f.stride, f.width, f.height, w, h, 2, 0)
+}
+
+// bgraToRGBA swaps the red and blue bytes of every pixel, two pixels per
+// 64-bit word, and forces alpha opaque.
+func bgraToRGBA(src []byte, w, h, stride int) *image.RGBA {
+	img := image.NewRGBA(image.Rect(0, 0, w, h))
+	for y := 0; y < h; y++ {
+		s := src[y*stride : y*stride+w*4]
+		d := img.Pix[y*img.Stride : y*img.Stride+w*4]
+		i := 0
+		for ; i+8 <= len(s); i += 8 {
+			v := binary.LittleEndian.Uint64(s[i:])
+			v = v&0x0000ff000000ff00 | v>>16&0x000000ff000000ff | v&0x000000ff000000ff<<16 | 0xff000000ff000000
+			binary.LittleEndian.PutUint64(d[i:], v)
+		}
+		if i < len(s) {
+			v := binary.LittleEndian.Uint32(s[i:])
+			v = v&0x0000ff00 | v>>16&0x000000ff | v&0x000000ff<<16 | 0xff000000
+			binary.LittleEndian.PutUint32(d[i:], v)
+		}
+	}
+	return img
+}
+
+// nv12ToRGBA converts NV12 to opaque RGBA. NV12 frames are BT.601 video
+// range (ScreenCaptureKit's 420v, NvFBC): Y spans 16-235 and chroma
+// 16-240, so both are expanded to full range (16.16 fixed point).
+func nv12ToRGBA(src []byte, w, h, stride int) *image.RGBA {
+	img := image.NewRGBA(image.Rect(0, 0, w, h))
+	chroma := src[stride*h:]
+	for y := 0; y < h; y++ {
+		luma := src[y*stride : y*stride+w]
+		uv := chroma[(y/2)*stride:]
+		d := img.Pix[y*img.Stride : y*img.Stride+w*4]
+		for x, l := range luma {
+			yv := (int32(l)-16)*76309 + 32768 // 255/219
+			u := int32(uv[x&^1]) - 128
+			v := int32(uv[x&^1+1]) - 128
+			d[4*x] = clamp8((yv + 104597*v) >> 16)
+			d[4*x+1] = clamp8((yv - 25675*u - 53279*v) >> 16)
+			d[4*x+2] = clamp8((yv + 132201*u) >> 16)
+			d[4*x+3] = 255
+		}
+	}
+	return img
+}
+
+func clamp8(v int32) uint8 {
+	if v < 0 {
+		return 0
+	}
+	if v > 255 {
+		return 255
+	}
+	return uint8(v)
+}
+
+// boxShrink scales 4-byte pixels down from sw x sh to dw x dh (no larger)
+// into opaque RGBA, averaging each output pixel's source block. rOff and
+// bOff are the red and blue byte offsets in src; green is at 1.
+func boxShrink(src []byte, stride, sw, sh, dw, dh, rOff, bOff int) *image.RGBA {
+	img := image.NewRGBA(image.Rect(0, 0, dw, dh))
+	xs := make([]int, dw+1) // source column span of each output column
+	for x := range xs {
+		xs[x] = x * sw / dw
+	}
+	sum := make([]uint32, dw*3)
+	for y := 0; y < dh; y++ {
+		y0, y1 := y*sh/dh, (y+1)*sh/dh
+		clear(sum)
+		for sy := y0; sy < y1; sy++ {
+			row := src[sy*stride : sy*stride+sw*4]
+			for x := 0; x < dw; x++ {
+				var r, g, b uint32
+				for sx := xs[x]; sx < xs[x+1]; sx++ {
+					p := row[sx*4 : sx*4+4]
+					r += uint32(p[rOff])
+					g += uint32(p[1])
+					b += uint32(p[bOff])
+				}
+				sum[3*x] += r
+				sum[3*x+1] += g
+				sum[3*x+2] += b
+			}
+		}
+		d := img.Pix[y*img.Stride : y*img.Stride+dw*4]
+		for x := 0; x < dw; x++ {
+			n := uint32((xs[x+1] - xs[x]) * (y1 - y0))
+			d[4*x] = uint8(sum[3*x] / n)
+			d[4*x+1] = uint8(sum[3*x+1] / n)
+			d[4*x+2] = uint8(sum[3*x+2] / n)
+			d[4*x+3] = 255
+		}
+	}
+	return img
+}
+
+// snapshotOptions are the query parameters shared by /debug/frame and
+// /debug/thumbnail.
+type snapshotOptions struct {
+	jpeg    bool
+	scale   float64 // 0 < scale <= 1
+	quality int     // JPEG quality
+}
+
+func parseSnapshotOptions(r *http.Request, def snapshotOptions) (snapshotOptions, error) {
+	o := def
+	q := r.URL.Query()
+	switch q.Get("format") {
+	case "":
+	case "png":
+		o.jpeg = false
+	case "jpeg", "jpg":
+		o.jpeg = true
+	default:
+		return o, fmt.Errorf("format must be png or jpeg")
+	}
+	if v := q.Get("scale"); v != "" {
+		f, err := strconv.ParseFloat(v, 64)
+		if err != nil || !(f > 0 && f <= 1) {
+			return o, fmt.Errorf("scale must be in (0, 1]")
+		}
+		o.scale = f
+	}
+	if v := q.Get("quality"); v != "" {
+		n, err := strconv.Atoi(v)
+		if err != nil || n < 1 || n > 100 {
+			return o, fmt.Errorf("quality must be 1-100")
+		}
+		o.quality = n
+	}
+	return o, nil
+}
+
+// encode writes f to w as o asks; PNG favours speed over size.
+func (o snapshotOptions) encode(w *bytes.Buffer, f *snapshotFrame) error {
+	img := f.image(o.scale)
+	if o.jpeg {
+		return jpeg.Encode(w, img, &jpeg.Options{Quality: o.quality})
+	}
+	enc := png.Encoder{CompressionLevel: png.BestSpeed}
+	return enc.Encode(w, img)
+}
+
+func (o snapshotOptions) contentType() string {
+	if o.jpeg {
+		return "image/jpeg"
+	}
+	return "image/png"
+}
+
+func (s *Server) handleDebugFrame(w http.ResponseWriter, r *http.Request) {
+	if !s.checkAuth(w, r) {
+		return
+	}
+	opts, err := parseSnapshotOptions(r, snapshotOptions{scale: 1, quality: 85})
+	if err != nil {
+		http.Error(w, err.Error(), 400)
+		return
+	}
+
+	f, err := s.snapshot(r.Context())
+	if err != nil {
+		http.Error(w, fmt.Sprintf("snapshot: %v", err), 500)
+		return
+	}
+	var buf bytes.Buffer
+	if err := opts.encode(&buf, f); err != nil {
+		http.Error(w, fmt.Sprintf("encode: %v", err), 500)
+		return
+	}
+	w.Header().Set("Content-Type", opts.contentType())
+	w.Header().Set("Content-Length", strconv.Itoa(buf.Len()))
+	w.Write(buf.Bytes())
+}
+
+// handleThumbnail streams low-rate JPEG thumbnails as MJPEG
+// (multipart/x-mixed-replace) for monitoring walls. The stream keeps the
+// pipeline warm, paused while no session is connected, and takes its
+// frames from it like /debug/frame does.
+func (s *Server) handleThumbnail(w http.ResponseWriter, r *http.Request) {
+	if !s.checkAuth(w, r) {
+		return
+	}
+	opts, err := parseSnapshotOptions(r, snapshotOptions{jpeg: true, scale: 0.25, quality: 70})
+	if err != nil {
+		http.Error(w, err.Error(), 400)
+		return
+	}
+	if !opts.jpeg {
+		http.Error(w, "thumbnails are JPEG only", 400)
+		return
+	}
+	fps := 1.0
+	if v := r.URL.Query().Get("fps"); v != "" {
+		fps, err = strconv.ParseFloat(v, 64)
+		if err != nil || !(fps > 0 && fps <= maxThumbnailFPS) {
+			http.Error(w, fmt.Sprintf("fps must be in (0, %d]", maxThumbnailFPS), 400)
+			return
+		}
+	}
+
+	release, err := s.holdPipeline()
+	if err != nil {
+		http.Error(w, fmt.Sprintf("pipeline: %v", err), 500)
+		return
+	}
+	defer release()
+
+	const boundary = "bunghole-thumbnail"
+	w.Header().Set("Content-Type", "multipart/x-mixed-replace; boundary="+boundary)
+	w.Header().Set("Cache-Control", "no-store")
+	rc := http.NewResponseController(w)
+
+	ticker := time.NewTicker(time.Duration(float64(time.Second) / fps))
+	defer ticker.Stop()
+	var buf bytes.Buffer
+	for {
+		f, err := s.snap.get(r.Context())
+		if err != nil {
+			if r.Context().Err() == nil {
+				log.Printf("thumbnail: %v", err)
+			}
+			return
+		}
+		buf.Reset()
+		if err := opts.encode(&buf, f); err != nil {
+			log.Printf("thumbnail: encode: %v", err)
+			return
+		}
+		fmt.Fprintf(w, "--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n", boundary, buf.Len())
+		buf.WriteString("\r\n")
+		if _, err := w.Write(buf.Bytes()); err != nil {
+			return
+		}
+		if err := rc.Flush(); err != nil {
+			return
+		}
+
+		select {
+		case <-r.Context().Done():
+			return
+		case <-ticker.C:
+		}
+	}
+}
@@ -0,0 +1,182 @@
+package server
+
+import (
+	"encoding/json"
+	"fmt"
+	"log"
+	"net/http"
+	"sort"
+	"strings"
+	"sync"
+
+	"github.com/google/uuid"
+)
+
+// SpawnFunc starts a desktop named name and returns a server for it and a
+// function that stops the desktop once the server is torn down.
+type SpawnFunc func(name string) (*Server, func(), error)
+
+// Spawner creates desktops at runtime (--desktop-pool). POST /desktops
+// starts one and serves it under /d/{name}/ like the --desktops ones;
+// DELETE /desktops/{name} tears it down again.
+type Spawner struct {
+	auth  *Server // checks tokens and rate limits /desktops
+	spawn SpawnFunc
+	limit int // most desktops running or starting at once
+
+	mu       sync.Mutex
+	reserved map[string]bool            // names of --desktops desktops
+	desktops map[string]*spawnedDesktop // nil while starting
+}
+
+type spawnedDesktop struct {
+	srv  *Server
+	mux  *http.ServeMux
+	stop func()
+}
+
+// NewSpawner returns a Spawner that takes its token and auth settings
+// from cfg and starts up to limit desktops at a time with spawn.
+func NewSpawner(cfg Config, limit int, spawn SpawnFunc) *Spawner {
+	return &Spawner{
+		auth:     New(cfg),
+		spawn:    spawn,
+		limit:    max(limit, 1),
+		reserved: make(map[string]bool),
+		desktops: make(map[string]*spawnedDesktop),
+	}
+}
+
+// routes registers the /desktops endpoints and the handler for spawned
+// desktops' paths on mux. static are the desktops served from the start,
+// whose names can't be taken.
+func (sp *Spawner) routes(mux *http.ServeMux, static []*Server) {
+	for _, s := range static {
+		sp.reserved[s.cfg.Name] = true
+	}
+	mux.HandleFunc("GET /desktops", sp.handleList)
+	mux.HandleFunc("POST /desktops", sp.handleCreate)
+	mux.HandleFunc("DELETE /desktops/{name}", sp.handleDelete)
+	mux.HandleFunc("/d/{name}/", sp.serveDesktop)
+}
+
+func (sp *Spawner) serveDesktop(w http.ResponseWriter, r *http.Request) {
+	sp.mu.Lock()
+	d := sp.desktops[r.PathValue("name")]
+	sp.mu.Unlock()
+	if d == nil {
+		http.NotFound(w, r)
+		return
+	}
+	d.mux.ServeHTTP(w, r)
+}
+
+func (sp *Spawner) handleList(w http.ResponseWriter, r *http.Request) {
+	if !sp.auth.checkAuth(w, r) {
+		return
+	}
+	sp.mu.Lock()
+	names := make([]string, 0, len(sp.desktops))
+	for name, d := range sp.desktops {
+		if d != nil { // leave out desktops still starting
+			names = append(names, name)
+		}
+	}
+	sp.mu.Unlock()
+	sort.Strings(names)
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(map[string][]string{"desktops": names})
+}
+
+// handleCreate starts a desktop named by the optional name query
+// parameter, or a random name, and answers 201 with its URL in Location,
+// or 429 once the limit of desktops is running.
+func (sp *Spawner) handleCreate(w http.ResponseWriter, r *http.Request) {
+	if !sp.auth.checkAuth(w, r) {
+		return
+	}
+	name := r.URL.Query().Get("name")
+	if name == "" {
+		name = uuid.NewString()[:8]
+	} else if strings.ContainsAny(name, "/?#%") {
+		http.Error(w, "bad desktop name", 400)
+		return
+	}
+
+	// Claim the name before starting the desktop, which can take a while.
+	sp.mu.Lock()
+	if _, taken := sp.desktops[name]; taken || sp.reserved[name] {
+		sp.mu.Unlock()
+		http.Error(w, fmt.Sprintf("desktop %q exists", name), 409)
+		return
+	}
+	if len(sp.desktops) >= sp.limit {
+		sp.mu.Unlock()
+		log.Printf("desktop %s: refused, %d desktops running", name, sp.limit)
+		http.Error(w, "too many desktops", 429)
+		return
+	}
+	sp.desktops[name] = nil
+	sp.mu.Unlock()
+
+	srv, stop, err := sp.spawn(name)
+	if err != nil {
+		sp.mu.Lock()
+		delete(sp.desktops, name)
+		sp.mu.Unlock()
+		log.Printf("desktop %s: %v", name, err)
+		http.Error(w, "failed to start desktop", 503)
+		return
+	}
+	d := &spawnedDesktop{srv: srv, mux: http.NewServeMux(), stop: stop}
+	srv.routes(d.mux, "/d/"+name)
+	if srv.cfg.Prewarm {
+		srv.Prewarm()
+	}
+
+	sp.mu.Lock()
+	sp.desktops[name] = d
+	sp.mu.Unlock()
+
+	w.Header().Set("Location", "/d/"+name+"/")
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(201)
+	json.NewEncoder(w).Encode(map[string]string{"name": name, "display": srv.cfg.Display})
+}
+
+func (sp *Spawner) handleDelete(w http.ResponseWriter, r *http.Request) {
+	if !sp.auth.checkAuth(w, r) {
+		return
+	}
+	name := r.PathValue("name")
+	sp.mu.Lock()
+	d := sp.desktops[name]
+	if d != nil {
+		delete(sp.desktops, name)
+	}
+	sp.mu.Unlock()
+	if d == nil {
+		http.NotFound(w, r)
+		return
+	}
+	d.srv.Teardown()
+	d.stop()
+	w.WriteHeader(204)
+}
+
+// Teardown tears down every spawned desktop and stops it.
+func (sp *Spawner) Teardown() {
+	sp.mu.Lock()
+	var desktops []*spawnedDesktop
+	for name, d := range sp.desktops {
+		if d != nil {
+			desktops = append(desktops, d)
+			delete(sp.desktops, name)
+		}
+	}
+	sp.mu.Unlock()
+	for _, d := range desktops {
+		d.srv.Teardown()
+		d.stop()
+	}
+}
@@ -0,0 +1,326 @@
+package session
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"log"
+	"math"
+	"sync"
+	"time"
+
+	"bunghole/internal/types"
+)
+
+// Binary input protocol, version 1. Each data channel message holds one
+// event, little-endian:
+//
+//	[0]    version (inputVersion)
+//	[1]    event type (input* below)
+//	[2:4]  pointer sequence (pointer events only, see below)
+//
+//	inputMove      x u16, y u16        absolute, in frame pixels
+//	inputMoveRel   dx i16, dy i16
+//	inputDown/Up   button u8, x u16, y u16
+//	inputWheel     dx f32, dy f32, x u16, y u16
+//	inputKeyDown/Up  code len u8, code, key len u8, key (UTF-8)
+//
+// Motion goes on the unordered, unreliable "motion" channel; everything
+// else on the reliable "input" channel. The client bumps the sequence on
+// every motion event and stamps buttons and wheel with the current one,
+// so motion that arrives late (after a newer motion or a click) is
+// dropped instead of moving the pointer backwards.
+//
+// Text messages on "input" are decoded as JSON types.InputEvent, for
+// clients that predate the binary protocol.
+const inputVersion = 1
+
+const (
+	inputMove = iota + 1
+	inputMoveRel
+	inputDown
+	inputUp
+	inputWheel
+	inputKeyDown
+	inputKeyUp
+)
+
+var errShortInput = errors.New("short input message")
+
+// decodeInput decodes one binary input message. seq is valid for pointer
+// events (pointer is true).
+func decodeInput(b []byte) (ev types.InputEvent, seq uint16, pointer bool, err error) {
+	if len(b) < 2 {
+		return ev, 0, false, errShortInput
+	}
+	if b[0] != inputVersion {
+		return ev, 0, false, fmt.Errorf("unsupported input protocol version %d", b[0])
+	}
+	typ, p := b[1], b[2:]
+
+	switch typ {
+	case inputMove, inputMoveRel, inputDown, inputUp, inputWheel:
+		if len(p) < 2 {
+			return ev, 0, false, errShortInput
+		}
+		seq, p, pointer = binary.LittleEndian.Uint16(p), p[2:], true
+	}
+
+	switch typ {
+	case inputMove:
+		if len(p) < 4 {
+			return ev, 0, false, errShortInput
+		}
+		ev.Type = "mousemove"
+		ev.X, ev.Y = u16(p[0:]), u16(p[2:])
+	case inputMoveRel:
+		if len(p) < 4 {
+			return ev, 0, false, errShortInput
+		}
+		ev.Type = "mousemove"
+		ev.Relative = true
+		ev.DX = float64(int16(binary.LittleEndian.Uint16(p[0:])))
+		ev.DY = float64(int16(binary.LittleEndian.Uint16(p[2:])))
+	case inputDown, inputUp:
+		if len(p) < 5 {
+			return ev, 0, false, errShortInput
+		}
+		ev.Type = "mousedown"
+		if typ == inputUp {
+			ev.Type = "mouseup"
+		}
+		ev.Button = int(p[0])
+		ev.X, ev.Y = u16(p[1:]), u16(p[3:])
+	case inputWheel:
+		if len(p) < 12 {
+			return ev, 0, false, errShortInput
+		}
+		ev.Type = "wheel"
+		ev.DX = float64(math.Float32frombits(binary.LittleEndian.Uint32(p[0:])))
+		ev.DY = float64(math.Float32frombits(binary.LittleEndian.Uint32(p[4:])))
+		ev.X, ev.Y = u16(p[8:]), u16(p[10:])
+	case inputKeyDown, inputKeyUp:
+		ev.Type = "keydown"
+		if typ == inputKeyUp {
+			ev.Type = "keyup"
+		}
+		var ok bool
+		if ev.Code, p, ok = lenString(p); !ok {
+			return ev, 0, false, errShortInput
+		}
+		if ev.Key, _, ok = lenString(p); !ok {
+			return ev, 0, false, errShortInput
+		}
+	default:
+		return ev, 0, false, fmt.Errorf("unknown input event type %d", typ)
+	}
+	return ev, seq, pointer, nil
+}
+
+func u16(b []byte) float64 { return float64(binary.LittleEndian.Uint16(b)) }
+
+// lenString reads a u8-length-prefixed string and returns the rest of b.
+func lenString(b []byte) (string, []byte, bool) {
+	if len(b) < 1 || len(b) < 1+int(b[0]) {
+		return "", nil, false
+	}
+	n := int(b[0])
+	return string(b[1 : 1+n]), b[1+n:], true
+}
+
+// inputFlushInterval is the shortest gap between two injector flushes
+// while only motion is pending, about a 240 Hz vblank. A 1000 Hz mouse
+// then costs a quarter of the X round trips, and the pointer still moves
+// faster than any capture rate can show. Buttons, wheel and keys skip the
+// wait.
+const inputFlushInterval = 4 * time.Millisecond
+
+// inputSink queues events from the session's input channels (pion runs
+// each channel's handler on its own goroutine) for a single injection
+// goroutine. It drops stale motion from the unordered channel and
+// coalesces consecutive moves while they wait, so the injector sees at
+// most one move between two other events.
+type inputSink struct {
+	mu        sync.Mutex
+	inj       types.EventInjector // nil until started and once closed
+	pending   []types.InputEvent
+	since     time.Time // when the oldest pending event arrived
+	urgent    bool      // a non-motion event is pending
+	coalesced int       // moves merged since the last take
+	seq       uint16    // newest pointer sequence seen
+	haveSeq   bool
+	badInput  int // logged decode errors
+
+	wake     chan struct{}
+	done     chan struct{}
+	finished chan struct{}
+}
+
+// start runs the injection goroutine for inj. onBatch, if set, is called
+// after each flush with the time the oldest event in it waited and how
+// many moves were merged into others.
+func (s *inputSink) start(inj types.EventInjector, onBatch func(lag time.Duration, coalesced int)) {
+	s.inj = inj
+	s.wake = make(chan struct{}, 1)
+	s.done = make(chan struct{})
+	s.finished = make(chan struct{})
+	go s.run(inj, onBatch)
+}
+
+// handleJSON queues a legacy JSON event.
+func (s *inputSink) handleJSON(b []byte) {
+	var ev types.InputEvent
+	if err := json.Unmarshal(b, &ev); err != nil {
+		return
+	}
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	s.enqueue(ev)
+}
+
+// handleBinary queues a binary event.
+func (s *inputSink) handleBinary(b []byte) {
+	ev, seq, pointer, err := decodeInput(b)
+
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if err != nil {
+		if s.badInput++; s.badInput <= 5 {
+			log.Printf("input: %v", err)
+		}
+		return
+	}
+
+	if pointer {
+		newer := !s.haveSeq || int16(seq-s.seq) > 0
+		if ev.Type == "mousemove" {
+			if !newer && !ev.Relative {
+				return // superseded by a later move or click
+			}
+		} else if ev.Type != "wheel" {
+			// The motion this click follows may have been lost; put
+			// the pointer where the client clicked first.
+			s.enqueue(types.InputEvent{Type: "mousemove", X: ev.X, Y: ev.Y})
+		}
+		if newer {
+			s.seq, s.haveSeq = seq, true
+		}
+	}
+	s.enqueue(ev)
+}
+
+// enqueue adds ev to the pending batch, merging it into a pending move of
+// the same kind. s.mu must be held.
+func (s *inputSink) enqueue(ev types.InputEvent) {
+	if s.inj == nil {
+		return
+	}
+	if n := len(s.pending); n > 0 && ev.Type == "mousemove" {
+		if last := &s.pending[n-1]; last.Type == "mousemove" && last.Relative == ev.Relative {
+			if ev.Relative {
+				last.DX += ev.DX
+				last.DY += ev.DY
+			} else {
+				*last = ev
+			}
+			s.coalesced++
+			return
+		}
+	}
+	if len(s.pending) == 0 {
+		s.since = time.Now()
+	}
+	s.pending = append(s.pending, ev)
+	if ev.Type != "mousemove" {
+		s.urgent = true
+	}
+	select {
+	case s.wake <- struct{}{}:
+	default:
+	}
+}
+
+// take swaps the pending batch for spare, which the caller is done with.
+func (s *inputSink) take(spare []types.InputEvent) (batch []types.InputEvent, since time.Time, coalesced int) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	batch, s.pending = s.pending, spare[:0]
+	since, coalesced = s.since, s.coalesced
+	s.urgent, s.coalesced = false, 0
+	return batch, since, coalesced
+}
+
+func (s *inputSink) isUrgent() bool {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	return s.urgent
+}
+
+// run injects pending events until close. Motion-only batches are held
+// until inputFlushInterval after the previous flush; the timer is only
+// armed for those, so an idle pointer's first move goes out immediately.
+func (s *inputSink) run(inj types.EventInjector, onBatch func(time.Duration, int)) {
+	defer close(s.finished)
+
+	batcher, _ := inj.(types.BatchInjector)
+	timer := time.NewTimer(0)
+	<-timer.C
+	var spare []types.InputEvent
+	var last time.Time
+	for {
+		select {
+		case <-s.wake:
+		case <-s.done:
+			return
+		}
+
+		if wait := inputFlushInterval - time.Since(last); wait > 0 && !s.isUrgent() {
+			timer.Reset(wait)
+		hold:
+			for !s.isUrgent() {
+				select {
+				case <-timer.C:
+					break hold
+				case <-s.wake:
+				case <-s.done:
+					timer.Stop()
+					return
+				}
+			}
+			timer.Stop()
+		}
+
+		batch, since, coalesced := s.take(spare)
+		if len(batch) == 0 {
+			continue
+		}
+		if batcher != nil {
+			batcher.InjectBatch(batch)
+		} else {
+			for _, ev := range batch {
+				inj.Inject(ev)
+			}
+		}
+		last = time.Now()
+		if onBatch != nil {
+			onBatch(last.Sub(since), coalesced)
+		}
+		spare = batch
+	}
+}
+
+// close stops injection and closes the injector; pending and later
+// events are dropped.
+func (s *inputSink) close() {
+	s.mu.Lock()
+	inj := s.inj
+	s.inj = nil
+	s.mu.Unlock()
+	if inj == nil {
+		return
+	}
+	close(s.done)
+	<-s.finished
+	inj.Close()
+}
@@ -0,0 +1,54 @@
+package session
+
+import (
+	"encoding/json"
+	"time"
+
+	"github.com/pion/webrtc/v4"
+)
+
+// LatencyReport is the glass-to-glass latency a client measured over its
+// last report interval: from the capture time each frame carries
+// (--capture-timestamps) to the frame's display, in milliseconds.
+type LatencyReport struct {
+	Frames int     `json:"frames"`
+	P50    float64 `json:"p50"`
+	P90    float64 `json:"p90"`
+	P99    float64 `json:"p99"`
+}
+
+// latencyMsg is a message on the "latency" data channel. The client sends
+// "ping" with its own clock in T and gets "pong" back with T echoed and
+// the server's wall clock, to translate capture times to its clock; and
+// "report" with its measurements.
+type latencyMsg struct {
+	Type string  `json:"type"`
+	T    float64 `json:"t,omitempty"`
+	LatencyReport
+}
+
+type latencyPong struct {
+	Type   string  `json:"type"` // "pong"
+	T      float64 `json:"t"`
+	Server float64 `json:"server"` // Unix time in ms
+}
+
+func handleLatency(dc *webrtc.DataChannel, data []byte, onReport func(LatencyReport)) {
+	var msg latencyMsg
+	if err := json.Unmarshal(data, &msg); err != nil {
+		return
+	}
+	switch msg.Type {
+	case "ping":
+		pong, _ := json.Marshal(latencyPong{
+			Type:   "pong",
+			T:      msg.T,
+			Server: float64(time.Now().UnixMicro()) / 1000,
+		})
+		dc.SendText(string(pong))
+	case "report":
+		if onReport != nil && msg.Frames > 0 {
+			onReport(msg.LatencyReport)
+		}
+	}
+}
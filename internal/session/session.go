@@ -1,13 +1,18 @@
 package session
 
 import (
-	"encoding/json"
 	"fmt"
 	"log"
 	"sync"
+	"sync/atomic"
+	"time"
 
 	"bunghole/internal/types"
 
+	"github.com/pion/interceptor"
+	"github.com/pion/interceptor/pkg/cc"
+	"github.com/pion/interceptor/pkg/gcc"
+	"github.com/pion/rtcp"
 	"github.com/pion/webrtc/v4"
 )
 
@@ -18,19 +23,62 @@ type InputHandlerFactory func(displayName string) (types.EventInjector, error)
 // with a callback for sending clipboard changes to the client.
 type ClipboardHandlerFactory func(displayName string, sendFn func(string)) (types.ClipboardSync, error)
 
+// CursorSubscribeFunc registers sendFn to receive cursor messages and
+// returns a function that unregisters it.
+type CursorSubscribeFunc func(sendFn func([]byte)) (unsubscribe func())
+
+// Feedback configures how a session reacts to its receiver.
+type Feedback struct {
+	Bandwidth *BandwidthConfig // nil: no bandwidth estimation
+	// OnKeyframeRequest is called on PLI/FIR from the receiver, once the
+	// PeerConnection connects and after SetVideoTrack, since the receiver
+	// can't decode until the next IDR of the track it is on.
+	OnKeyframeRequest func(*Session)
+	// OnInputBatch is called after each flush of the controller's input
+	// injector with how long the oldest event in it waited and how many
+	// moves were merged into others.
+	OnInputBatch func(lag time.Duration, coalesced int)
+	// OnLatencyReport is called with each glass-to-glass latency report
+	// the controller's client sends on the "latency" data channel.
+	OnLatencyReport func(LatencyReport)
+}
+
+// BandwidthConfig enables send-side bandwidth estimation for a session:
+// Google Congestion Control fed by TWCC feedback and receiver reports.
+// Rates are in bits per second.
+type BandwidthConfig struct {
+	InitialBps int
+	MinBps     int
+	MaxBps     int
+}
+
 type Session struct {
 	ID               string
 	PC               *webrtc.PeerConnection
-	InputHandler     types.EventInjector
 	ClipboardHandler types.ClipboardSync
+	cursorUnsub      func()
 	Stop             chan struct{}
 	closed           bool
 	mu               sync.Mutex
+
+	input inputSink
+
+	bwe        cc.BandwidthEstimator // nil when estimation is off
+	remb       atomic.Int64          // last REMB from the receiver, bps
+	onKeyframe func(*Session)
+
+	videoSender *webrtc.RTPSender
+	videoTrack  atomic.Pointer[webrtc.TrackLocalStaticSample]
 }
 
-// newPeerConnection creates a PeerConnection with the given codec registered
-// and the shared tracks added.
-func newPeerConnection(codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample) (*webrtc.PeerConnection, error) {
+// OpusFmtp is the audio fmtp line, shared with the audio track so they
+// match. It mirrors what browsers offer and advertises in-band FEC.
+const OpusFmtp = "minptime=10;useinbandfec=1"
+
+// newSession creates a PeerConnection with the given codec registered and
+// the shared tracks added, and starts reading RTCP from both senders. RTCP
+// must be read for the interceptors (NACK, reports, TWCC) to see it.
+func newSession(id, codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample, fb Feedback) (*Session, error) {
 	me := &webrtc.MediaEngine{}
 
 	var videoMimeType string
@@ -52,6 +100,13 @@ func newPeerConnection(codec string, videoTrack, audioTrack *webrtc.TrackLocalSt
 			MimeType:    videoMimeType,
 			ClockRate:   90000,
 			SDPFmtpLine: videoFmtp,
+			RTCPFeedback: []webrtc.RTCPFeedback{
+				{Type: webrtc.TypeRTCPFBGoogREMB},
+				{Type: webrtc.TypeRTCPFBTransportCC},
+				{Type: webrtc.TypeRTCPFBNACK},
+				{Type: webrtc.TypeRTCPFBNACK, Parameter: "pli"},
+				{Type: webrtc.TypeRTCPFBCCM, Parameter: "fir"},
+			},
 		},
 		PayloadType: videoPayloadType,
 	}, webrtc.RTPCodecTypeVideo); err != nil {
@@ -60,47 +115,191 @@ func newPeerConnection(codec string, videoTrack, audioTrack *webrtc.TrackLocalSt
 
 	if err := me.RegisterCodec(webrtc.RTPCodecParameters{
 		RTPCodecCapability: webrtc.RTPCodecCapability{
-			MimeType:  webrtc.MimeTypeOpus,
-			ClockRate: 48000,
-			Channels:  2,
+			MimeType:    webrtc.MimeTypeOpus,
+			ClockRate:   48000,
+			Channels:    2,
+			SDPFmtpLine: OpusFmtp,
 		},
 		PayloadType: 111,
 	}, webrtc.RTPCodecTypeAudio); err != nil {
 		return nil, fmt.Errorf("register Opus: %w", err)
 	}
 
-	api := webrtc.NewAPI(webrtc.WithMediaEngine(me))
+	ir := &interceptor.Registry{}
+	estimatorCh := make(chan cc.BandwidthEstimator, 1)
+	if bw := fb.Bandwidth; bw != nil {
+		// No pacer: frames go out as soon as they are encoded, and the
+		// encoder bitrate is what keeps us under the estimate.
+		ccf, err := cc.NewInterceptor(func() (cc.BandwidthEstimator, error) {
+			return gcc.NewSendSideBWE(
+				gcc.SendSideBWEInitialBitrate(bw.InitialBps),
+				gcc.SendSideBWEMinBitrate(bw.MinBps),
+				gcc.SendSideBWEMaxBitrate(bw.MaxBps),
+				gcc.SendSideBWEPacer(gcc.NewNoOpPacer()),
+			)
+		})
+		if err != nil {
+			return nil, fmt.Errorf("create congestion controller: %w", err)
+		}
+		ccf.OnNewPeerConnection(func(_ string, estimator cc.BandwidthEstimator) {
+			estimatorCh <- estimator
+		})
+		ir.Add(ccf)
+		if err := webrtc.ConfigureTWCCHeaderExtensionSender(me, ir); err != nil {
+			return nil, fmt.Errorf("configure TWCC: %w", err)
+		}
+	}
+	if err := webrtc.RegisterDefaultInterceptors(me, ir); err != nil {
+		return nil, fmt.Errorf("register interceptors: %w", err)
+	}
+
+	api := webrtc.NewAPI(webrtc.WithMediaEngine(me), webrtc.WithInterceptorRegistry(ir))
 	pc, err := api.NewPeerConnection(webrtc.Configuration{})
 	if err != nil {
 		return nil, fmt.Errorf("create peer connection: %w", err)
 	}
 
-	if _, err = pc.AddTrack(videoTrack); err != nil {
+	sess := &Session{
+		ID:         id,
+		PC:         pc,
+		Stop:       make(chan struct{}),
+		onKeyframe: fb.OnKeyframeRequest,
+	}
+	select {
+	case sess.bwe = <-estimatorCh:
+	default:
+	}
+
+	videoSender, err := pc.AddTrack(videoTrack)
+	if err != nil {
 		pc.Close()
 		return nil, fmt.Errorf("add video track: %w", err)
 	}
 
-	if _, err = pc.AddTrack(audioTrack); err != nil {
+	audioSender, err := pc.AddTrack(audioTrack)
+	if err != nil {
 		pc.Close()
 		return nil, fmt.Errorf("add audio track: %w", err)
 	}
 
-	return pc, nil
+	sess.videoSender = videoSender
+	sess.videoTrack.Store(videoTrack)
+
+	go sess.readRTCP(videoSender)
+	go sess.readRTCP(audioSender)
+
+	return sess, nil
 }
 
-// NewSession creates a controller session with data channels for input/clipboard.
-// The shared video and audio tracks are added to the PeerConnection.
-func NewSession(id, displayName, codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample, inputFactory InputHandlerFactory, clipboardFactory ClipboardHandlerFactory) (*Session, error) {
-	pc, err := newPeerConnection(codec, videoTrack, audioTrack)
-	if err != nil {
-		return nil, err
+// VideoTrack returns the shared video track this session is bound to.
+func (s *Session) VideoTrack() *webrtc.TrackLocalStaticSample {
+	return s.videoTrack.Load()
+}
+
+// SetVideoTrack rebinds the session to another shared video track (a
+// different rendition of the same codec) and asks that track for an IDR.
+func (s *Session) SetVideoTrack(track *webrtc.TrackLocalStaticSample) error {
+	if s.videoTrack.Load() == track {
+		return nil
+	}
+	if err := s.videoSender.ReplaceTrack(track); err != nil {
+		return fmt.Errorf("replace video track: %w", err)
+	}
+	s.videoTrack.Store(track)
+	s.requestKeyframe()
+	return nil
+}
+
+// readRTCP drains RTCP from sender until the PeerConnection closes.
+func (s *Session) readRTCP(sender *webrtc.RTPSender) {
+	for {
+		pkts, _, err := sender.ReadRTCP()
+		if err != nil {
+			return
+		}
+		for _, pkt := range pkts {
+			switch p := pkt.(type) {
+			case *rtcp.ReceiverEstimatedMaximumBitrate:
+				s.remb.Store(int64(p.Bitrate))
+			case *rtcp.PictureLossIndication, *rtcp.FullIntraRequest:
+				s.requestKeyframe()
+			}
+		}
 	}
+}
 
-	sess := &Session{
-		ID:   id,
-		PC:   pc,
-		Stop: make(chan struct{}),
+func (s *Session) requestKeyframe() {
+	if s.onKeyframe != nil {
+		s.onKeyframe(s)
 	}
+}
+
+// EstimatedBitrate returns the send bitrate this session's link can take in
+// bits per second: the GCC estimate, capped by the receiver's REMB if it
+// sent one. 0 means no estimate.
+func (s *Session) EstimatedBitrate() int {
+	est := 0
+	if s.bwe != nil {
+		est = s.bwe.GetTargetBitrate()
+	}
+	if remb := int(s.remb.Load()); remb > 0 && (est == 0 || remb < est) {
+		est = remb
+	}
+	return est
+}
+
+// LinkStats is what the receiver reports about this session's video
+// stream in RTCP receiver reports, plus the send-side estimate.
+type LinkStats struct {
+	Valid            bool // false until the first receiver report
+	RTT              time.Duration
+	Jitter           time.Duration
+	FractionLost     float64
+	PacketsLost      int64
+	EstimatedBitrate int // bps, see EstimatedBitrate
+}
+
+// LinkStats reads the video stream's remote-inbound stats from the
+// PeerConnection.
+func (s *Session) LinkStats() LinkStats {
+	ls := LinkStats{EstimatedBitrate: s.EstimatedBitrate()}
+	if r, ok := s.remoteInbound("video"); ok {
+		ls.Valid = true
+		ls.RTT = time.Duration(r.RoundTripTime * float64(time.Second))
+		ls.Jitter = time.Duration(r.Jitter * float64(time.Second))
+		ls.FractionLost = r.FractionLost
+		ls.PacketsLost = int64(r.PacketsLost)
+	}
+	return ls
+}
+
+// AudioLoss returns the fraction of audio packets lost in the receiver's
+// last report interval; ok is false until the first report.
+func (s *Session) AudioLoss() (fraction float64, ok bool) {
+	r, ok := s.remoteInbound("audio")
+	return r.FractionLost, ok
+}
+
+// remoteInbound returns the receiver-reported stats for the sender of the
+// given kind ("video" or "audio").
+func (s *Session) remoteInbound(kind string) (webrtc.RemoteInboundRTPStreamStats, bool) {
+	for _, st := range s.PC.GetStats() {
+		if r, ok := st.(webrtc.RemoteInboundRTPStreamStats); ok && r.Kind == kind {
+			return r, true
+		}
+	}
+	return webrtc.RemoteInboundRTPStreamStats{}, false
+}
+
+// NewSession creates a controller session with data channels for
+// input/clipboard/cursor. The shared video and audio tracks are added to the
+// PeerConnection. cursorSub is nil when the cursor is composited into frames.
+func NewSession(id, displayName, codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample, fb Feedback, inputFactory InputHandlerFactory, clipboardFactory ClipboardHandlerFactory, cursorSub CursorSubscribeFunc) (*Session, error) {
+	sess, err := newSession(id, codec, videoTrack, audioTrack, fb)
+	if err != nil {
+		return nil, err
+	}
+	pc := sess.PC
 
 	// Set up input handler via factory
 	if inputFactory != nil {
@@ -108,21 +307,21 @@ func NewSession(id, displayName, codec string, videoTrack, audioTrack *webrtc.Tr
 		if err != nil {
 			log.Printf("warning: input handler init failed: %v", err)
 		} else {
-			sess.InputHandler = ih
+			sess.input.start(ih, fb.OnInputBatch)
 		}
 	}
 
 	// Data channels are created by the client; we handle them via OnDataChannel
 	pc.OnDataChannel(func(dc *webrtc.DataChannel) {
 		switch dc.Label() {
-		case "input":
+		case "input", "motion":
+			// "motion" is the client's unordered pointer channel; both
+			// carry the binary protocol, "input" also legacy JSON.
 			dc.OnMessage(func(msg webrtc.DataChannelMessage) {
-				if sess.InputHandler != nil {
-					var event types.InputEvent
-					if err := json.Unmarshal(msg.Data, &event); err != nil {
-						return
-					}
-					sess.InputHandler.Inject(event)
+				if msg.IsString {
+					sess.input.handleJSON(msg.Data)
+				} else {
+					sess.input.handleBinary(msg.Data)
 				}
 			})
 		case "clipboard":
@@ -156,11 +355,37 @@ func NewSession(id, displayName, codec string, videoTrack, audioTrack *webrtc.Tr
 					ch.SetFromClient(string(msg.Data))
 				}
 			})
+		case "latency":
+			dc.OnMessage(func(msg webrtc.DataChannelMessage) {
+				handleLatency(dc, msg.Data, fb.OnLatencyReport)
+			})
+		case "cursor":
+			if cursorSub == nil {
+				break
+			}
+			dc.OnOpen(func() {
+				unsub := cursorSub(func(msg []byte) {
+					if dc.ReadyState() == webrtc.DataChannelStateOpen {
+						dc.SendText(string(msg))
+					}
+				})
+				sess.mu.Lock()
+				if sess.closed {
+					sess.mu.Unlock()
+					unsub()
+					return
+				}
+				sess.cursorUnsub = unsub
+				sess.mu.Unlock()
+			})
 		}
 	})
 
 	pc.OnConnectionStateChange(func(state webrtc.PeerConnectionState) {
 		log.Printf("controller %s connection state: %s", id, state.String())
+		if state == webrtc.PeerConnectionStateConnected {
+			sess.requestKeyframe()
+		}
 		if state == webrtc.PeerConnectionStateFailed ||
 			state == webrtc.PeerConnectionStateDisconnected ||
 			state == webrtc.PeerConnectionStateClosed {
@@ -173,20 +398,17 @@ func NewSession(id, displayName, codec string, videoTrack, audioTrack *webrtc.Tr
 
 // NewViewerSession creates a view-only session (no data channels, no input).
 // The shared video and audio tracks are added to the PeerConnection.
-func NewViewerSession(id, codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample) (*Session, error) {
-	pc, err := newPeerConnection(codec, videoTrack, audioTrack)
+func NewViewerSession(id, codec string, videoTrack, audioTrack *webrtc.TrackLocalStaticSample, fb Feedback) (*Session, error) {
+	sess, err := newSession(id, codec, videoTrack, audioTrack, fb)
 	if err != nil {
 		return nil, err
 	}
 
-	sess := &Session{
-		ID:   id,
-		PC:   pc,
-		Stop: make(chan struct{}),
-	}
-
-	pc.OnConnectionStateChange(func(state webrtc.PeerConnectionState) {
+	sess.PC.OnConnectionStateChange(func(state webrtc.PeerConnectionState) {
 		log.Printf("viewer %s connection state: %s", id, state.String())
+		if state == webrtc.PeerConnectionStateConnected {
+			sess.requestKeyframe()
+		}
 		if state == webrtc.PeerConnectionStateFailed ||
 			state == webrtc.PeerConnectionStateDisconnected ||
 			state == webrtc.PeerConnectionStateClosed {
@@ -206,12 +428,13 @@ func (s *Session) Close() {
 	s.closed = true
 	close(s.Stop)
 
-	if s.InputHandler != nil {
-		s.InputHandler.Close()
-	}
+	s.input.close()
 	if s.ClipboardHandler != nil {
 		s.ClipboardHandler.Close()
 	}
+	if s.cursorUnsub != nil {
+		s.cursorUnsub()
+	}
 	s.PC.Close()
 	log.Printf("session %s closed", s.ID)
 }
@@ -0,0 +1,61 @@
+package types
+
+import "sync"
+
+// PacketPool recycles the buffers behind EncodedFrames and OpusPackets so
+// steady-state streaming doesn't allocate a buffer per packet. Producers
+// keep one pool per stream; packet sizes within a stream are similar, so a
+// recycled buffer rarely has to grow. The zero value is ready to use.
+type PacketPool struct {
+	frames sync.Pool // *EncodedFrame
+	opus   sync.Pool // *OpusPacket
+}
+
+// Frame returns an EncodedFrame whose Data has length n. The contents of
+// Data are unspecified.
+func (p *PacketPool) Frame(n int) *EncodedFrame {
+	f, _ := p.frames.Get().(*EncodedFrame)
+	if f == nil {
+		f = &EncodedFrame{pool: p}
+	}
+	f.Data = grow(f.Data, n)
+	f.IsKey = false
+	return f
+}
+
+// Opus returns an OpusPacket whose Data has length n.
+func (p *PacketPool) Opus(n int) *OpusPacket {
+	o, _ := p.opus.Get().(*OpusPacket)
+	if o == nil {
+		o = &OpusPacket{pool: p}
+	}
+	o.Data = grow(o.Data, n)
+	o.Duration = 0
+	o.Lost = 0
+	return o
+}
+
+// grow returns b resized to n, reallocating with some headroom when its
+// capacity is too small (keyframes and bursts are larger than the average).
+func grow(b []byte, n int) []byte {
+	if cap(b) < n {
+		return make([]byte, n, n+n/4)
+	}
+	return b[:n]
+}
+
+// Release hands f back to the pool it came from. The caller must be done
+// with f.Data, including any copy the consumer kept a reference to.
+// Release is a no-op for frames that don't come from a pool.
+func (f *EncodedFrame) Release() {
+	if f.pool != nil {
+		f.pool.frames.Put(f)
+	}
+}
+
+// Release hands o back to the pool it came from; see EncodedFrame.Release.
+func (o *OpusPacket) Release() {
+	if o.pool != nil {
+		o.pool.opus.Put(o)
+	}
+}
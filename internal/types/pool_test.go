@@ -0,0 +1,31 @@
+//go:build !race
+
+// The race detector makes sync.Pool drop items at random.
+
+package types
+
+import (
+	"testing"
+	"time"
+)
+
+func TestPacketPoolAllocs(t *testing.T) {
+	var pool PacketPool
+	sizes := []int{1200, 40000, 900, 1500}
+
+	if n := testing.AllocsPerRun(1000, func() {
+		for _, size := range sizes {
+			pool.Frame(size).Release()
+		}
+	}); n != 0 {
+		t.Errorf("Frame/Release: %v allocs per run, want 0", n)
+	}
+
+	if n := testing.AllocsPerRun(1000, func() {
+		o := pool.Opus(160)
+		o.Duration = 20 * time.Millisecond
+		o.Release()
+	}); n != 0 {
+		t.Errorf("Opus/Release: %v allocs per run, want 0", n)
+	}
+}
@@ -1,6 +1,7 @@
 package types
 
 import (
+	"errors"
 	"image"
 	"time"
 	"unsafe"
@@ -15,6 +16,18 @@ type Frame struct {
 	Stride int
 	IsCUDA bool // true = Ptr is a CUDA device pointer (NV12 format)
 	PixFmt int  // 0 = BGRA (default), 1 = NV12
+	// IsPixelBuffer is set when Ptr is a CVPixelBufferRef (IOSurface-backed
+	// NV12) that encoders may submit to VideoToolbox as-is. The pixel data
+	// is not mapped; use the capturer's FrameDownloader to read it.
+	IsPixelBuffer bool
+
+	// Unchanged is set by damage-tracking capturers when nothing on screen
+	// changed since the previous Grab. Ptr still holds the previous content,
+	// so the pipeline may skip encoding the frame.
+	Unchanged bool
+	// Damage lists the rectangles that changed since the previous Grab.
+	// nil means the whole frame should be treated as changed.
+	Damage []image.Rectangle
 }
 
 const (
@@ -22,9 +35,13 @@ const (
 	PixFmtNV12 = 1
 )
 
+// EncodedFrame is one encoded access unit. Frames from a PacketPool must be
+// released once the consumer is done with Data.
 type EncodedFrame struct {
 	Data  []byte
 	IsKey bool
+
+	pool *PacketPool
 }
 
 type InputEvent struct {
@@ -39,9 +56,15 @@ type InputEvent struct {
 	Relative bool    `json:"relative,omitempty"`
 }
 
+// OpusPacket is one encoded audio frame; pooled like EncodedFrame.
 type OpusPacket struct {
 	Data     []byte
 	Duration time.Duration
+	// Lost is how many packets went missing in transport just before this
+	// one. The track's timestamp skips over them, like over DTX frames.
+	Lost int
+
+	pool *PacketPool
 }
 
 type MediaCapturer interface {
@@ -59,22 +82,127 @@ type CUDAProvider interface {
 	CuMemcpy2D() unsafe.Pointer
 }
 
-// DebugGrabber is optionally implemented by a MediaCapturer to provide
-// a debug image for the /debug/frame endpoint.
-type DebugGrabber interface {
-	GrabImage() (image.Image, error)
+// ErrNoDeviceEncoder is returned by an EncoderFactory given a CUDA
+// context when no hardware encoder can take the capturer's device frames.
+// The caller can capture into host memory instead.
+var ErrNoDeviceEncoder = errors.New("no hardware encoder for device frames")
+
+// FrameDownloader is optionally implemented by a MediaCapturer whose frames
+// live in device memory (IsCUDA) or in pixel buffers (IsPixelBuffer).
+// DownloadFrame copies f to host memory in
+// f's pixel format and stride. It must be called from the goroutine that
+// calls Grab, before f is released.
+type FrameDownloader interface {
+	DownloadFrame(f *Frame) ([]byte, error)
+}
+
+// FrameReleaser is optionally implemented by a MediaCapturer that hands out
+// frames from a pool of buffers. A frame returned by Grab stays valid across
+// later Grabs until it is passed to ReleaseFrame; at most FrameBuffers()
+// frames may be outstanding. The capturer may recycle the Frame itself, so
+// it must not be touched after ReleaseFrame. Capturers without it reuse a
+// single buffer, which the next Grab overwrites.
+type FrameReleaser interface {
+	FrameBuffers() int
+	ReleaseFrame(f *Frame)
+}
+
+// SourcePacer is optionally implemented by a MediaCapturer that can be
+// clocked by its source instead of polled on a ticker. Once
+// SetSourcePacing succeeds, Grab waits until the source has produced a
+// frame since the previous Grab, or until timeout passes, in which case it
+// returns the current picture with Unchanged set. SetSourcePacing is called
+// before the first Grab.
+type SourcePacer interface {
+	SetSourcePacing(timeout time.Duration) error
+}
+
+// Cursor is the pointer state reported by a CursorSource.
+type Cursor struct {
+	X, Y   int    // hotspot position in frame coordinates
+	Serial uint64 // identifies the current shape
+	// Shape is set only when the shape changed since the previous call.
+	Shape *CursorShape
+}
+
+// CursorShape is a cursor image in straight (non-premultiplied) RGBA.
+type CursorShape struct {
+	Width, Height int
+	HotX, HotY    int
+	RGBA          []byte
 }
 
+// CursorSource reports the cursor separately from the captured frames,
+// for capturers that leave it out of the image.
+type CursorSource interface {
+	Cursor() (*Cursor, error)
+	Close()
+}
+
+// VideoEncoder encodes captured frames. Encode may return a pooled frame,
+// which stays valid until the caller releases it; the caller must release
+// every frame it gets back.
 type VideoEncoder interface {
 	Encode(frame *Frame) (*EncodedFrame, error)
 	Close()
 }
 
+// RateController is optionally implemented by a VideoEncoder that can change
+// its target rate without reopening the codec. Changes apply from the next
+// Encode call; SetFrameRate only adjusts rate control, the caller is
+// responsible for actually feeding frames at the new rate.
+type RateController interface {
+	SetBitrate(kbps int) error
+	SetFrameRate(fps int) error
+}
+
+// KeyframeRequester is optionally implemented by a VideoEncoder that can
+// force the next encoded frame to be an IDR.
+type KeyframeRequester interface {
+	RequestKeyframe()
+}
+
+// Refresher is optionally implemented by a VideoEncoder that can give one
+// frame more bits than rate control would, to sharpen a picture that has
+// stopped changing. RequestRefresh applies to the next Encode call.
+type Refresher interface {
+	RequestRefresh()
+}
+
+// Resizer is optionally implemented by a VideoEncoder that can reopen its
+// codec at a new output size, keeping its rate, GOP and keyframe settings.
+// The first frame after a resize is an IDR. Resize must be called from the
+// goroutine that calls Encode.
+type Resizer interface {
+	Resize(width, height int) error
+}
+
+// ConvertTimer is optionally implemented by a VideoEncoder that converts
+// pixels on the CPU before encoding. It reports how much of the last Encode
+// call was spent converting.
+type ConvertTimer interface {
+	ConvertTime() time.Duration
+}
+
+// EncoderNamer is optionally implemented by a VideoEncoder to report the
+// codec implementation it opened, e.g. "h264_nvenc" or "libx264".
+type EncoderNamer interface {
+	EncoderName() string
+}
+
 type EventInjector interface {
 	Inject(event InputEvent)
 	Close()
 }
 
+// BatchInjector is optionally implemented by an EventInjector that can
+// apply several events for the cost of one: InjectBatch injects events in
+// order and flushes once at the end. Sessions call it from a single
+// goroutine.
+type BatchInjector interface {
+	InjectBatch(events []InputEvent)
+}
+
 type ClipboardSync interface {
 	SetFromClient(text string)
 	Run(stop <-chan struct{})
@@ -85,3 +213,29 @@ type AudioCapturer interface {
 	Run(packets chan<- *OpusPacket, stop <-chan struct{})
 	Close()
 }
+
+// GuestAudioStats are the buffer counters a guest audio driver reports.
+// Ring sizes are in frames; the counters are totals since the driver
+// started.
+type GuestAudioStats struct {
+	FrameDuration time.Duration // duration of the Opus packets it sends
+	RingFill      int           // output ring fill at the last report
+	RingPeak      int           // highest output ring fill since the report before
+	Overruns      uint64        // output frames dropped because the ring was full
+	Underruns     uint64        // input frames played as silence because the ring was empty
+	Packets       uint64        // Opus packets sent
+}
+
+// GuestAudioReporter is optionally implemented by an AudioCapturer fed by
+// a guest driver that reports its own buffer state. ok is false until the
+// first report arrives. Safe to call from any goroutine.
+type GuestAudioReporter interface {
+	GuestAudioStats() (stats GuestAudioStats, ok bool)
+}
+
+// LossTuner is optionally implemented by an AudioCapturer that runs its own
+// Opus encoder. SetPacketLoss passes the receivers' packet loss (percent)
+// on, so in-band FEC can be sized to it. Safe to call from any goroutine.
+type LossTuner interface {
+	SetPacketLoss(percent int)
+}
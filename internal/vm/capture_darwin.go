@@ -8,6 +8,10 @@ import (
 )
 
 // NewVMCapturer creates a capturer for the VM window using ScreenCaptureKit.
+// Frames are IOSurface-backed NV12 pixel buffers that never pass through
+// host memory. The stream is w x h: when that differs from the guest
+// display, ScreenCaptureKit scales the window on the GPU as it composites
+// it, so the encoder still gets encode-size buffers it can submit as-is.
 func NewVMCapturer(windowID uint32, fps, w, h int) (types.MediaCapturer, error) {
 	return capture.NewWindowCapturer(windowID, fps, w, h)
 }
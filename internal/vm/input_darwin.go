@@ -7,10 +7,23 @@ package vm
 
 #include <stdlib.h>
 
-void vm_input_key(void *view, int keycode, int press, const char *chars);
-void vm_input_mouse_move(void *view, double x, double y);
-void vm_input_mouse_button(void *view, int button, int press, double x, double y);
-void vm_input_scroll(void *view, double dx, double dy, double x, double y);
+enum {
+	VM_INPUT_KEY = 1,
+	VM_INPUT_MOVE,
+	VM_INPUT_BUTTON,
+	VM_INPUT_SCROLL,
+};
+
+typedef struct {
+	int type;
+	int code;
+	int press;
+	double x, y;
+	double dx, dy;
+	char chars[32];
+} VMInputEvent;
+
+void vm_input_batch(void *view, const VMInputEvent *events, int n);
 */
 import "C"
 import (
@@ -23,46 +36,75 @@ import (
 
 type VMInputHandler struct {
 	view         unsafe.Pointer
+	sx, sy       float64 // stream to view coordinates
 	lastX, lastY float64
+	events       []C.VMInputEvent // reused across batches
 }
 
-func NewVMInputHandler(view unsafe.Pointer) types.EventInjector {
-	return &VMInputHandler{view: view}
+// NewVMInputHandler injects into view. Pointer positions arrive in the
+// coordinates of a streamW x streamH stream of a guestW x guestH view.
+func NewVMInputHandler(view unsafe.Pointer, streamW, streamH, guestW, guestH int) types.EventInjector {
+	return &VMInputHandler{
+		view: view,
+		sx:   float64(guestW) / float64(streamW),
+		sy:   float64(guestH) / float64(streamH),
+	}
 }
 
 func (h *VMInputHandler) Inject(event types.InputEvent) {
-	switch event.Type {
-	case "mousemove":
-		h.lastX = event.X
-		h.lastY = event.Y
-		C.vm_input_mouse_move(h.view, C.double(event.X), C.double(event.Y))
-	case "mousedown":
-		h.lastX = event.X
-		h.lastY = event.Y
-		C.vm_input_mouse_button(h.view, C.int(event.Button), C.int(1),
-			C.double(event.X), C.double(event.Y))
-	case "mouseup":
-		h.lastX = event.X
-		h.lastY = event.Y
-		C.vm_input_mouse_button(h.view, C.int(event.Button), C.int(0),
-			C.double(event.X), C.double(event.Y))
-	case "wheel":
-		C.vm_input_scroll(h.view, C.double(event.DX), C.double(event.DY),
-			C.double(h.lastX), C.double(h.lastY))
-	case "keydown":
-		if kc, ok := input.CodeMap[event.Code]; ok {
-			cChars := C.CString(event.Key)
-			C.vm_input_key(h.view, C.int(kc), C.int(1), cChars)
-			C.free(unsafe.Pointer(cChars))
-		} else {
-			log.Printf("vm input: unmapped key code=%s key=%s", event.Code, event.Key)
-		}
-	case "keyup":
-		if kc, ok := input.CodeMap[event.Code]; ok {
-			cChars := C.CString(event.Key)
-			C.vm_input_key(h.view, C.int(kc), C.int(0), cChars)
-			C.free(unsafe.Pointer(cChars))
+	h.InjectBatch([]types.InputEvent{event})
+}
+
+// InjectBatch hands the whole batch to the main queue in one dispatch,
+// instead of one block per event.
+func (h *VMInputHandler) InjectBatch(events []types.InputEvent) {
+	h.events = h.events[:0]
+	for _, event := range events {
+		var ev C.VMInputEvent
+		switch event.Type {
+		case "mousemove":
+			h.lastX = event.X * h.sx
+			h.lastY = event.Y * h.sy
+			ev._type = C.VM_INPUT_MOVE
+			ev.x, ev.y = C.double(h.lastX), C.double(h.lastY)
+		case "mousedown", "mouseup":
+			h.lastX = event.X * h.sx
+			h.lastY = event.Y * h.sy
+			ev._type = C.VM_INPUT_BUTTON
+			ev.code = C.int(event.Button)
+			if event.Type == "mousedown" {
+				ev.press = 1
+			}
+			ev.x, ev.y = C.double(h.lastX), C.double(h.lastY)
+		case "wheel":
+			ev._type = C.VM_INPUT_SCROLL
+			ev.dx, ev.dy = C.double(event.DX), C.double(event.DY)
+			ev.x, ev.y = C.double(h.lastX), C.double(h.lastY)
+		case "keydown", "keyup":
+			kc, ok := input.CodeMap[event.Code]
+			if !ok {
+				if event.Type == "keydown" {
+					log.Printf("vm input: unmapped key code=%s key=%s", event.Code, event.Key)
+				}
+				continue
+			}
+			ev._type = C.VM_INPUT_KEY
+			ev.code = C.int(kc)
+			if event.Type == "keydown" {
+				ev.press = 1
+			}
+			// Key names longer than the buffer are truncated; chars
+			// stays NUL-terminated since ev is zeroed.
+			for i := 0; i < len(event.Key) && i < len(ev.chars)-1; i++ {
+				ev.chars[i] = C.char(event.Key[i])
+			}
+		default:
+			continue
 		}
+		h.events = append(h.events, ev)
+	}
+	if len(h.events) > 0 {
+		C.vm_input_batch(h.view, &h.events[0], C.int(len(h.events)))
 	}
 }
 
@@ -0,0 +1,127 @@
+//go:build linux
+
+package xserver
+
+import (
+	"fmt"
+	"log"
+	"os"
+	"os/exec"
+	"sync"
+	"time"
+)
+
+// poolRetry is how long a pool slot waits after a desktop failed to start.
+const poolRetry = 5 * time.Second
+
+// Pool keeps desktops (Xorg plus desktop session) started ahead of time,
+// so handing one out takes no longer than taking it off a channel. Each
+// of its slots starts a desktop, waits for Get to take it, and starts the
+// next one. Every desktop's cookie goes into one Xauthority file, which
+// XAUTHORITY points at, so this process can open any of their displays.
+type Pool struct {
+	resolution string
+	user       string
+	gpu        int
+	xauth      string
+
+	ready chan *XServer
+	stop  chan struct{}
+	wg    sync.WaitGroup
+
+	authMu sync.Mutex // serializes xauth merges into xauth
+}
+
+// NewPool starts size desktops in the background and keeps that many
+// ready. existing is merged into the pool's Xauthority file.
+func NewPool(resolution, runAsUser string, gpu, size int, existing string) (*Pool, error) {
+	prepareHeadless()
+
+	xauth, err := MergeXauthority(existing, nil)
+	if err != nil {
+		return nil, err
+	}
+	p := &Pool{
+		resolution: resolution,
+		user:       runAsUser,
+		gpu:        gpu,
+		xauth:      xauth,
+		ready:      make(chan *XServer),
+		stop:       make(chan struct{}),
+	}
+	for i := 0; i < size; i++ {
+		p.wg.Add(1)
+		go p.fill()
+	}
+	return p, nil
+}
+
+// Xauthority returns the path of the file holding every pooled desktop's
+// cookie.
+func (p *Pool) Xauthority() string { return p.xauth }
+
+// fill runs one pool slot.
+func (p *Pool) fill() {
+	defer p.wg.Done()
+	for {
+		xs, err := p.start()
+		if err != nil {
+			log.Printf("desktop pool: %v", err)
+			select {
+			case <-time.After(poolRetry):
+				continue
+			case <-p.stop:
+				return
+			}
+		}
+		select {
+		case p.ready <- xs:
+		case <-p.stop:
+			xs.Stop()
+			return
+		}
+	}
+}
+
+func (p *Pool) start() (*XServer, error) {
+	begin := time.Now()
+	xs, err := startXServer(p.resolution, p.gpu)
+	if err != nil {
+		return nil, fmt.Errorf("start X server: %w", err)
+	}
+	if err := xs.StartDesktopSession(p.resolution, p.user); err != nil {
+		xs.Stop()
+		return nil, fmt.Errorf("start desktop session on %s: %w", xs.Display, err)
+	}
+
+	p.authMu.Lock()
+	out, err := exec.Command("xauth", "-f", p.xauth, "merge", xs.Xauthority).CombinedOutput()
+	p.authMu.Unlock()
+	if err != nil {
+		xs.Stop()
+		return nil, fmt.Errorf("xauth merge: %w: %s", err, out)
+	}
+	log.Printf("desktop pool: %s ready in %v", xs.Display, time.Since(begin).Round(time.Millisecond))
+	return xs, nil
+}
+
+// Get takes a ready desktop out of the pool, waiting up to timeout for
+// one if all of them are still starting. The caller stops it when done.
+func (p *Pool) Get(timeout time.Duration) (*XServer, error) {
+	select {
+	case xs := <-p.ready:
+		return xs, nil
+	case <-time.After(timeout):
+		return nil, fmt.Errorf("no desktop ready after %v", timeout)
+	case <-p.stop:
+		return nil, fmt.Errorf("desktop pool closed")
+	}
+}
+
+// Close stops the desktops still waiting in the pool. Desktops handed out
+// by Get are left to their callers.
+func (p *Pool) Close() {
+	close(p.stop)
+	p.wg.Wait()
+	os.Remove(p.xauth)
+}
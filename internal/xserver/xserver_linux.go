@@ -3,7 +3,10 @@
 package xserver
 
 import (
+	"bufio"
+	"context"
 	"fmt"
+	"io"
 	"log"
 	"os"
 	"os/exec"
@@ -11,6 +14,7 @@ import (
 	"path/filepath"
 	"strconv"
 	"strings"
+	"sync"
 	"syscall"
 	"time"
 )
@@ -22,18 +26,112 @@ type XServer struct {
 	xorgCmd     *exec.Cmd
 	sessionCmd  *exec.Cmd
 	tmpDir      string
+	displayNum  int
+	vt          int
+}
+
+// Display numbers and VTs handed to Xorg servers this process started.
+// Xorg only takes its lock file once it is up, so servers started in
+// parallel would otherwise pick the same ones.
+var (
+	reserveMu        sync.Mutex
+	reservedDisplays = map[int]bool{}
+	reservedVTs      = map[int]bool{}
+)
+
+// prepareOnce runs the prereq check and stale Xorg cleanup before the
+// first server this process starts. Running the cleanup again later
+// would take this process's own servers for stale ones and kill them.
+var prepareOnce sync.Once
+
+func prepareHeadless() {
+	prepareOnce.Do(func() {
+		checkHeadlessPrereqs()
+		cleanStaleXorgProcesses()
+	})
 }
 
 func StartXServer(resolution string, gpu int) (*XServer, error) {
-	checkHeadlessPrereqs()
-	cleanStaleXorgProcesses()
+	prepareHeadless()
+	return startXServer(resolution, gpu)
+}
+
+// StartXServers starts one Xorg per entry of gpus, in parallel. If any of
+// them fails, the ones that started are stopped again.
+func StartXServers(resolution string, gpus []int) ([]*XServer, error) {
+	prepareHeadless()
+
+	servers := make([]*XServer, len(gpus))
+	errs := make([]error, len(gpus))
+	var wg sync.WaitGroup
+	for i, gpu := range gpus {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			servers[i], errs[i] = startXServer(resolution, gpu)
+		}()
+	}
+	wg.Wait()
+
+	for i, err := range errs {
+		if err == nil {
+			continue
+		}
+		for _, xs := range servers {
+			if xs != nil {
+				xs.Stop()
+			}
+		}
+		return nil, fmt.Errorf("gpu %d: %w", gpus[i], err)
+	}
+	return servers, nil
+}
 
-	// Find an available display number
+// MergeXauthority writes one Xauthority file holding the cookies of all
+// servers, plus those in existing if it is set, and returns its path. A
+// process that talks to several displays needs it: Xlib only reads the
+// file $XAUTHORITY names.
+func MergeXauthority(existing string, servers []*XServer) (string, error) {
+	f, err := os.CreateTemp("", "bunghole-xauth-*")
+	if err != nil {
+		return "", fmt.Errorf("create Xauthority: %w", err)
+	}
+	f.Close()
+
+	args := []string{"-f", f.Name(), "merge"}
+	if existing != "" {
+		args = append(args, existing)
+	}
+	for _, xs := range servers {
+		args = append(args, xs.Xauthority)
+	}
+	if len(args) == 3 {
+		return f.Name(), nil // nothing to merge yet
+	}
+	if out, err := exec.Command("xauth", args...).CombinedOutput(); err != nil {
+		os.Remove(f.Name())
+		return "", fmt.Errorf("xauth merge: %w: %s", err, out)
+	}
+	return f.Name(), nil
+}
+
+func startXServer(resolution string, gpu int) (*XServer, error) {
+	// Find an available display number and VT
+	reserveMu.Lock()
 	displayNum := findAvailableDisplay()
+	vtNum, err := findAvailableVT()
+	if err != nil {
+		reserveMu.Unlock()
+		return nil, err
+	}
+	reservedDisplays[displayNum] = true
+	reservedVTs[vtNum] = true
+	reserveMu.Unlock()
 	display := fmt.Sprintf(":%d", displayNum)
 
 	tmpDir, err := os.MkdirTemp("", "bunghole-x-*")
 	if err != nil {
+		releaseDisplay(displayNum, vtNum)
 		return nil, fmt.Errorf("create temp dir: %w", err)
 	}
 
@@ -43,6 +141,7 @@ func StartXServer(resolution string, gpu int) (*XServer, error) {
 	confPath := filepath.Join(tmpDir, "xorg.conf")
 	if err := writeXorgConf(confPath, resolution, gpu); err != nil {
 		os.RemoveAll(tmpDir)
+		releaseDisplay(displayNum, vtNum)
 		return nil, fmt.Errorf("write xorg.conf: %w", err)
 	}
 
@@ -51,11 +150,21 @@ func StartXServer(resolution string, gpu int) (*XServer, error) {
 	xauthCmd := exec.Command("xauth", "-f", xauth, "add", display, "MIT-MAGIC-COOKIE-1", cookie)
 	if out, err := xauthCmd.CombinedOutput(); err != nil {
 		os.RemoveAll(tmpDir)
+		releaseDisplay(displayNum, vtNum)
 		return nil, fmt.Errorf("xauth add: %w: %s", err, out)
 	}
 
+	// Xorg writes the display number to -displayfd once it accepts
+	// connections (fd 3 is the first of ExtraFiles).
+	readyR, readyW, err := os.Pipe()
+	if err != nil {
+		os.RemoveAll(tmpDir)
+		releaseDisplay(displayNum, vtNum)
+		return nil, fmt.Errorf("create ready pipe: %w", err)
+	}
+	defer readyR.Close()
+
 	// Start Xorg
-	vtNum := findAvailableVT()
 	xorgArgs := []string{
 		display,
 		fmt.Sprintf("vt%d", vtNum),
@@ -64,6 +173,7 @@ func StartXServer(resolution string, gpu int) (*XServer, error) {
 		"-noreset",
 		"-keeptty",
 		"-novtswitch",
+		"-displayfd", "3",
 		"-verbose", "3",
 	}
 
@@ -79,19 +189,25 @@ func StartXServer(resolution string, gpu int) (*XServer, error) {
 
 	xorgLog, err := os.Create(filepath.Join(tmpDir, "xorg.log"))
 	if err != nil {
+		readyW.Close()
 		os.RemoveAll(tmpDir)
+		releaseDisplay(displayNum, vtNum)
 		return nil, fmt.Errorf("create xorg log: %w", err)
 	}
 	xorgCmd.Stdout = xorgLog
 	xorgCmd.Stderr = xorgLog
+	xorgCmd.ExtraFiles = []*os.File{readyW}
 	xorgCmd.SysProcAttr = &syscall.SysProcAttr{
 		Setsid:    true,
 		Pdeathsig: syscall.SIGTERM,
 	}
 
-	if err := xorgCmd.Start(); err != nil {
+	err = xorgCmd.Start()
+	readyW.Close()
+	if err != nil {
 		xorgLog.Close()
 		os.RemoveAll(tmpDir)
+		releaseDisplay(displayNum, vtNum)
 		return nil, fmt.Errorf("start Xorg: %w", err)
 	}
 
@@ -100,10 +216,12 @@ func StartXServer(resolution string, gpu int) (*XServer, error) {
 		Xauthority: xauth,
 		xorgCmd:    xorgCmd,
 		tmpDir:     tmpDir,
+		displayNum: displayNum,
+		vt:         vtNum,
 	}
 
 	// Wait for X server to be ready
-	if err := xs.waitReady(10 * time.Second); err != nil {
+	if err := xs.waitReady(readyR, 10*time.Second); err != nil {
 		xs.Stop()
 		return nil, fmt.Errorf("Xorg not ready: %w", err)
 	}
@@ -278,13 +396,14 @@ gsettings set org.gnome.desktop.screensaver idle-activation-enabled false 2>/dev
 gsettings set org.gnome.desktop.session idle-delay 0 2>/dev/null
 gsettings set org.gnome.desktop.lockdown disable-lock-screen true 2>/dev/null
 
-# Start PipeWire + WirePlumber + PipeWire-Pulse
+# Start PipeWire, then WirePlumber + PipeWire-Pulse once its socket is up
 pipewire &
-sleep 0.3
+for i in $(seq 100); do
+	[ -S "$XDG_RUNTIME_DIR/pipewire-0" ] && break
+	sleep 0.02
+done
 wireplumber &
-sleep 0.3
 pipewire-pulse &
-sleep 1
 
 # Start gnome-shell
 exec gnome-shell --x11
@@ -314,28 +433,49 @@ exec gnome-shell --x11
 	}
 	xs.sessionCmd = cmd
 
-	// Wait for gnome-shell to be ready by checking for _NET_SUPPORTING_WM_CHECK
-	deadline := time.Now().Add(15 * time.Second)
-	for time.Now().Before(deadline) {
-		checkCmd := exec.Command("xprop", "-root", "_NET_SUPPORTING_WM_CHECK")
-		checkCmd.Env = append(os.Environ(),
-			"DISPLAY="+xs.Display,
-			"XAUTHORITY="+xs.Xauthority,
-		)
-		if out, err := checkCmd.Output(); err == nil && strings.Contains(string(out), "window id") {
-			log.Printf("GNOME Shell is ready on %s", xs.Display)
-			if err := xs.configureDisplay(resolution); err != nil {
-				log.Printf("warning: display config failed: %v", err)
-			}
-			return nil
+	if xs.waitWindowManager(15 * time.Second) {
+		log.Printf("GNOME Shell is ready on %s", xs.Display)
+		if err := xs.configureDisplay(resolution); err != nil {
+			log.Printf("warning: display config failed: %v", err)
 		}
-		time.Sleep(500 * time.Millisecond)
+		return nil
 	}
 
 	log.Printf("desktop session started on %s (gnome-shell may still be initializing)", xs.Display)
 	return nil
 }
 
+// waitWindowManager reports whether a window manager (gnome-shell) set
+// _NET_SUPPORTING_WM_CHECK on the root window within timeout. xprop -spy
+// prints the property once and again each time it changes, so this
+// wakes up as soon as it is set.
+func (xs *XServer) waitWindowManager(timeout time.Duration) bool {
+	ctx, cancel := context.WithTimeout(context.Background(), timeout)
+	defer cancel()
+	cmd := exec.CommandContext(ctx, "xprop", "-root", "-spy", "_NET_SUPPORTING_WM_CHECK")
+	cmd.Env = append(os.Environ(),
+		"DISPLAY="+xs.Display,
+		"XAUTHORITY="+xs.Xauthority,
+	)
+	out, err := cmd.StdoutPipe()
+	if err != nil {
+		return false
+	}
+	if err := cmd.Start(); err != nil {
+		return false
+	}
+	defer cmd.Wait()
+	defer cancel() // kill xprop before Wait
+
+	sc := bufio.NewScanner(out)
+	for sc.Scan() {
+		if strings.Contains(sc.Text(), "window id") {
+			return true
+		}
+	}
+	return false
+}
+
 func (xs *XServer) Stop() {
 	if xs.sessionCmd != nil && xs.sessionCmd.Process != nil {
 		log.Printf("stopping desktop session")
@@ -369,34 +509,47 @@ func (xs *XServer) Stop() {
 	if xs.tmpDir != "" {
 		os.RemoveAll(xs.tmpDir)
 	}
+	releaseDisplay(xs.displayNum, xs.vt)
 }
 
-func (xs *XServer) waitReady(timeout time.Duration) error {
-	deadline := time.Now().Add(timeout)
-	for time.Now().Before(deadline) {
-		// Check if Xorg exited early
-		if xs.xorgCmd.ProcessState != nil {
-			break
+func releaseDisplay(displayNum, vt int) {
+	reserveMu.Lock()
+	delete(reservedDisplays, displayNum)
+	delete(reservedVTs, vt)
+	reserveMu.Unlock()
+}
+
+// waitReady waits for Xorg to report its display number on ready, the
+// -displayfd pipe. The pipe reaches EOF instead if Xorg exits first.
+func (xs *XServer) waitReady(ready *os.File, timeout time.Duration) error {
+	done := make(chan error, 1)
+	go func() {
+		line, err := bufio.NewReader(ready).ReadString('\n')
+		if err == nil && strings.TrimSpace(line) != strings.TrimPrefix(xs.Display, ":") {
+			err = fmt.Errorf("Xorg reports display :%s", strings.TrimSpace(line))
 		}
-		socketPath := fmt.Sprintf("/tmp/.X11-unix/X%s", strings.TrimPrefix(xs.Display, ":"))
-		if _, err := os.Stat(socketPath); err == nil {
-			cmd := exec.Command("xdpyinfo")
-			cmd.Env = append(os.Environ(),
-				"DISPLAY="+xs.Display,
-				"XAUTHORITY="+xs.Xauthority,
-			)
-			if err := cmd.Run(); err == nil {
-				return nil
-			}
+		done <- err
+	}()
+
+	var err error
+	select {
+	case err = <-done:
+		if err == nil {
+			return nil
+		}
+		if err == io.EOF {
+			err = fmt.Errorf("Xorg on %s exited during startup", xs.Display)
 		}
-		time.Sleep(200 * time.Millisecond)
+	case <-time.After(timeout):
+		ready.Close() // ends the reader
+		err = fmt.Errorf("timeout waiting for X server on %s", xs.Display)
 	}
 	// Dump Xorg log so the failure reason is visible
 	logPath := filepath.Join(xs.tmpDir, "xorg.log")
 	if data, err := os.ReadFile(logPath); err == nil && len(data) > 0 {
 		log.Printf("--- Xorg log ---\n%s--- end Xorg log ---", data)
 	}
-	return fmt.Errorf("timeout waiting for X server on %s", xs.Display)
+	return err
 }
 
 func findAvailableDisplay() int {
@@ -405,7 +558,7 @@ func findAvailableDisplay() int {
 		lock := fmt.Sprintf("/tmp/.X%d-lock", i)
 		_, sockErr := os.Stat(socket)
 		_, lockErr := os.Stat(lock)
-		if os.IsNotExist(sockErr) && os.IsNotExist(lockErr) {
+		if os.IsNotExist(sockErr) && os.IsNotExist(lockErr) && !reservedDisplays[i] {
 			return i
 		}
 	}
@@ -449,15 +602,17 @@ func patchGnomeShellJS(tmpDir string) string {
 	return fmt.Sprintf("/org/gnome/shell=%s", filepath.Join(tmpDir, "gnome-overlay"))
 }
 
-func findAvailableVT() int {
+// findAvailableVT returns a VT from 7 to 12 that isn't the current one
+// and isn't taken by another server of this process.
+func findAvailableVT() (int, error) {
+	out, _ := exec.Command("fgconsole").Output()
+	currentVT, _ := strconv.Atoi(strings.TrimSpace(string(out)))
 	for vt := 7; vt <= 12; vt++ {
-		out, _ := exec.Command("fgconsole").Output()
-		currentVT, _ := strconv.Atoi(strings.TrimSpace(string(out)))
-		if vt != currentVT {
-			return vt
+		if vt != currentVT && !reservedVTs[vt] {
+			return vt, nil
 		}
 	}
-	return 8
+	return 0, fmt.Errorf("no free VT between 7 and 12")
 }
 
 func generateXauthCookie() string {
@@ -174,5 +174,6 @@ fi
 echo
 echo "Optional install-time overrides in guest:"
 echo "  BUNGHOLE_VM_AUDIO_UDP=<host:port>   (force UDP transport)"
+echo "  BUNGHOLE_VM_AUDIO_UDP_SEQ=0         (send bare Opus datagrams, for older hosts)"
 echo "  BUNGHOLE_VM_AUDIO_STATS_INTERVAL=<duration>"
 echo "  BUNGHOLE_VM_AUDIO_SKIP_PROBE=1"
@@ -11,6 +11,7 @@ BIN_DST="$APP_DIR/bunghole-vm-audio"
 TEMPLATE="$SCRIPT_DIR/$LABEL.plist.template"
 
 UDP_DEST="${BUNGHOLE_VM_AUDIO_UDP:-}"
+UDP_SEQ="${BUNGHOLE_VM_AUDIO_UDP_SEQ:-1}"
 STATS_INTERVAL="${BUNGHOLE_VM_AUDIO_STATS_INTERVAL:-5s}"
 SKIP_PROBE="${BUNGHOLE_VM_AUDIO_SKIP_PROBE:-0}"
 LOG_OUT="$HOME/Library/Logs/bunghole-vm-audio.log"
@@ -51,6 +52,10 @@ TRANSPORT_ARGS=""
 if [[ -n "$UDP_DEST" ]]; then
     TRANSPORT_ARGS="        <string>--transport=udp</string>
         <string>--udp=$UDP_DEST</string>"
+    if [[ "$UDP_SEQ" == "1" ]]; then
+        TRANSPORT_ARGS="$TRANSPORT_ARGS
+        <string>--udp-seq</string>"
+    fi
 else
     TRANSPORT_ARGS="        <string>--transport=auto</string>"
 fi